@@ -0,0 +1,194 @@
+/**
+* @brief PhantomLimb operator console, run as its own process
+* @file main.cpp
+* @author Benjamin Blundell <oni@section9.co.uk>
+* @date 19/10/2026
+*
+*/
+
+#include "console_channel.hpp"
+#include "frame_pacer.hpp"
+#include "timing.hpp"
+
+#ifdef _SEBURO_LINUX
+#include "ux_window.hpp"
+#endif
+
+#include <thread>
+#include <atomic>
+#include <sstream>
+
+
+using namespace std;
+using namespace s9;
+
+
+/*
+ * Attach to the render process's segment, waiting for it to come up if need be
+ */
+
+static ConsoleChannel Connect(const std::string &name) {
+  bool told = false;
+  for (;;) {
+    ConsoleChannel channel(name);
+    if (channel.connected())
+      return channel;
+    if (!told) {
+      cout << "PhantomConsole: waiting for PhantomLimb on " << name << endl;
+      told = true;
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(500));
+  }
+}
+
+/*
+ * Headless stand-in for the window. Reads commands from stdin, one per line, and prints a
+ * telemetry summary every second. Enough to drive the render process from a script
+ */
+
+static bool ParseCommand(const std::string &line, GameSettings &settings, Command &command) {
+  std::istringstream in(line);
+  std::string word;
+  in >> word;
+
+  command.arm = BOTH_ARMS;
+  command.settings = settings;
+
+  if (word == "fire")          command.type = COMMAND_FIRE_BALL;
+  else if (word == "reset")    command.type = COMMAND_RESET_PHYSICS;
+  else if (word == "game")     command.type = COMMAND_TOGGLE_GAME;
+  else if (word == "tracking") command.type = COMMAND_RESTART_TRACKING;
+  else if (word == "view")     command.type = COMMAND_RESET_VIEW;
+  else if (word == "quit")     command.type = COMMAND_QUIT;
+  else if (word == "handed") {
+    int arm;
+    if (!(in >> arm) || arm < BOTH_ARMS || arm > RIGHT_ARM_COPY)
+      return false;
+    command.type = COMMAND_SET_HANDED;
+    command.arm = static_cast<ArmState>(arm);
+  } else if (word == "speed" || word == "width" || word == "emphasis") {
+    float_t value;
+    if (!(in >> value))
+      return false;
+    if (word == "speed")      settings.speed_min = value;
+    else if (word == "width") settings.width = value;
+    else                      settings.emphasis = value != 0;
+    command.type = COMMAND_SETTINGS;
+    command.settings = settings;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+static int RunHeadless(ConsoleChannel channel) {
+
+  std::atomic<bool> running(true);
+  GameSettings settings = channel.settings();
+
+  if (!channel.AttachReader())
+    cerr << "PhantomConsole: another console is reading telemetry. Commands only from here" << endl;
+
+  std::thread input([&]() {
+    std::string line;
+    while (running && std::getline(cin, line)) {
+      if (line.empty())
+        continue;
+      Command command;
+      if (!ParseCommand(line, settings, command)) {
+        cerr << "PhantomConsole: fire, reset, game, tracking, view, quit, handed <0-6>, speed <x>, width <x> or emphasis <0|1>" << endl;
+        continue;
+      }
+      if (!channel.Post(command))
+        cerr << "PhantomConsole: command queue full, dropping " << line << endl;
+      if (command.type == COMMAND_QUIT)
+        break;
+    }
+    running = false;
+  });
+
+  Histogram frame_times(0.0, 50.0, 25);
+  Histogram input_to_swap(0.0, 50.0, 25);
+  TelemetrySample latest = TelemetrySample();
+  size_t frames = 0, missed = 0, reprojected = 0;
+  uint64_t last_heartbeat = channel.heartbeat();
+  double_t last_beat_time = NowSeconds();
+
+  while (running) {
+    std::this_thread::sleep_for(std::chrono::seconds(1));
+
+    TelemetrySample sample;
+    while (channel.Receive(sample)) {
+      frame_times.Add(sample.frame_time * 1000.0);
+      input_to_swap.Add(sample.input_to_swap * 1000.0);
+      missed += sample.missed;
+      reprojected += sample.reprojected;
+      frames++;
+      latest = sample;
+    }
+
+    double_t now = NowSeconds();
+    uint64_t heartbeat = channel.heartbeat();
+    if (heartbeat != last_heartbeat) {
+      last_heartbeat = heartbeat;
+      last_beat_time = now;
+    } else if (now - last_beat_time > 2.0) {
+      cout << "PhantomConsole: PhantomLimb not responding" << endl;
+      continue;
+    }
+
+    if (frames == 0)
+      continue;
+
+    cout << "PhantomConsole: frames " << frames << " missed " << missed << " reprojected " << reprojected
+      << " frame p50 " << frame_times.Percentile(0.5) << "ms p99 " << frame_times.Percentile(0.99) << "ms"
+      << " input to swap p99 " << input_to_swap.Percentile(0.99) << "ms"
+      << " balls " << latest.balls << " tracked 0x" << std::hex << latest.tracked << std::dec
+      << (latest.half_rate ? " half rate" : "") << (latest.playing ? " playing" : "")
+      << " dropped " << channel.dropped() << endl;
+
+    frame_times.Clear();
+    input_to_swap.Clear();
+    frames = missed = reprojected = 0;
+  }
+
+  // The input thread may still be blocked on stdin if we stopped for another reason
+  input.detach();
+  return EXIT_SUCCESS;
+}
+
+
+/*
+ * Main function. Pass --headless for the stdin console, and a segment name to use
+ * something other than the default
+ */
+
+int main (int argc, char * argv[]) {
+
+  bool headless = false;
+  std::string segment = "/phantomlimb_console";
+
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    if (arg == "--headless")
+      headless = true;
+    else if (arg == "--segment" && i + 1 < argc)
+      segment = argv[++i];
+  }
+
+  ConsoleChannel channel = Connect(segment);
+  cout << "PhantomConsole: connected to " << segment << endl;
+
+  if (headless)
+    return RunHeadless(channel);
+
+#ifdef _SEBURO_LINUX
+  // GTK gets no arguments of ours
+  int gtk_argc = 1;
+  Glib::RefPtr<Gtk::Application> app = Gtk::Application::create(gtk_argc, argv, "uk.co.section9.phantomconsole");
+  UXWindow window(channel, [&app]() { app->quit(); });
+  return app->run(window);
+#else
+  return RunHeadless(channel);
+#endif
+}
@@ -3,16 +3,29 @@ precision highp float;
 
 out vec4 fragColor;
 
-uniform sampler2DRect baseTex0;
-uniform sampler2DRect newTex1;
+uniform sampler2DRect uSample;
+uniform sampler2DRect uHistory;
+
+// Weight of the new sample, how far a pixel may move before it is taken outright,
+// and whether zero means no reading
+uniform float uWeight;
+uniform float uReject;
+uniform int uHoles;
+
 in vec2 texCoord;
 
 void main(void){
-	
-    float col = texture2DRect(baseTex0, texCoord).r;
-    float col2 = texture2DRect(newTex1, texCoord).r;
-    
-    float d = min(col,col2);
-    
-	fragColor = vec4(d,d,d,1.0);
+
+	vec4 history = texture(uHistory, texCoord);
+	vec4 current = texture(uSample, texCoord);
+
+	float weight = uWeight;
+
+	if ((uHoles != 0 && history.r == 0.0) || (uReject > 0.0 && abs(current.r - history.r) > uReject))
+		weight = 1.0;
+
+	if (uHoles != 0 && current.r == 0.0)
+		weight = 0.0;
+
+	fragColor = mix(history, current, weight);
 }
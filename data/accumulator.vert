@@ -1,10 +1,13 @@
 #version 330
 precision highp float;
 
-in vec4 a_vertex;
+// One triangle that covers the whole target, made from the vertex id so no buffers are needed
+uniform vec2 uSize;
+
 out vec2 texCoord;
 
 void main(void) {
-	gl_Position = a_vertex;
-	texCoord = gl_MultiTexCoord0.st;
+	vec2 pos = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2);
+	texCoord = pos * uSize;
+	gl_Position = vec4(pos * 2.0 - 1.0, 0.0, 1.0);
 }
@@ -0,0 +1,29 @@
+#version 330
+precision highp float;
+
+// Every ball in one draw. Transforms and colour come from PhantomBalls, the eye from PhantomPass
+
+layout (location = 0) in vec3 aVertPosition;
+layout (location = 1) in vec3 aVertNormal;
+
+layout(std140) uniform PhantomEyes {
+  mat4 uEyeView[2];
+  mat4 uEyeProjection[2];
+};
+
+layout(std140) uniform PhantomPass {
+  ivec4 uPass;
+};
+
+layout(std140) uniform PhantomBalls {
+  vec4 uBallColour;
+  mat4 uBallModel[64];
+};
+
+out vec4 vColour;
+
+void main() {
+  int eye = uPass.x;
+  gl_Position = uEyeProjection[eye] * uEyeView[eye] * uBallModel[gl_InstanceID] * vec4(aVertPosition, 1.0);
+  vColour = uBallColour;
+}
@@ -10,10 +10,13 @@ invariant in vec2 sScreenCenter;
 // Oculus specific uniforms
 uniform vec2 uScale = vec2(0.25,0.5);
 uniform vec2 uScaleIn = vec2(4.0,2.0);
-uniform vec4 uHmdWarpParam  = vec4(1.0,0.22,0.24,0.0);
-uniform vec4 uChromAbParam;
-
-uniform float uDistortionScale = 0.8;
+// uTimewarp is the rotation from the pose at scanout back to the pose the eyes were rendered with
+layout(std140) uniform PhantomWarp {
+  vec4 uHmdWarpParam;
+  vec4 uChromAbParam;
+  vec4 uLens;         // Lens centre offset, 1 / distortion scale, tan half fov
+  mat4 uTimewarp;
+};
 
 in vec2 sTexCoord;
 
@@ -21,6 +24,14 @@ in vec2 sTexCoord;
 
 out vec4 sOutColour; // GLSL 1.50 or higher
 
+// Lens centred projected coordinates seen from the newest pose, moved to where that view
+// direction landed in the eye buffer that was actually rendered
+
+vec2 timewarp(vec2 p) {
+  vec3 dir = mat3(uTimewarp) * vec3(p * uLens.zw, -1.0);
+  return (dir.xy / -dir.z) / uLens.zw;
+}
+
 // Performs Barrel distortion and Chromatic Abberation correction
 
 void main(void)
@@ -37,7 +48,7 @@ void main(void)
     );
 
   vec2 theta_blue = rvector * (uChromAbParam.z + uChromAbParam.w * rSq);
-  vec2 tc_blue = sLensCenter + uScale * uDistortionScale * theta_blue;
+  vec2 tc_blue = sLensCenter + uScale * timewarp(uLens.y * theta_blue);
   if (!all(equal(clamp(tc_blue, sScreenCenter-vec2(0.25,0.5), sScreenCenter+vec2(0.25,0.5)), tc_blue))) {
     sOutColour = vec4(0);
     return;
@@ -46,11 +57,11 @@ void main(void)
 
   float blue = texture(uTexSampler0, tc_blue * tex_size).b;
 
-  vec2  tc_green = sLensCenter + uScale * uDistortionScale * rvector;
+  vec2  tc_green = sLensCenter + uScale * timewarp(uLens.y * rvector);
   vec4  center = texture(uTexSampler0, tc_green * tex_size);
 
   vec2  theta_red = rvector * (uChromAbParam.x + uChromAbParam.y * rSq);
-  vec2  tc_red = sLensCenter + uScale * uDistortionScale * theta_red;
+  vec2  tc_red = sLensCenter + uScale * timewarp(uLens.y * theta_red);
   float red = texture(uTexSampler0, tc_red * tex_size).r;
 
 
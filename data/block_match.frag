@@ -2,23 +2,15 @@
 precision highp float;
 out vec4 fragColor;
 
-<<<<<<< HEAD
 uniform sampler2D camTexA;
 uniform sampler2D camTexB;
 
-=======
-uniform sampler2DRect camTex0;
-uniform sampler2DRect camTex1;
->>>>>>> 66c096aae473ec318a88ac57c1088ec3fff0067f
 uniform int rangeX;
 uniform int rangeY;
 uniform int stepSize;
 uniform float offsetL;
-<<<<<<< HEAD
 float lod;
 uniform float topLod;
-=======
->>>>>>> 66c096aae473ec318a88ac57c1088ec3fff0067f
 
 uniform int width;
 uniform int height;
@@ -172,42 +164,7 @@ vec4 refineBlock() {
 void main(void){
 	lod = topLod;
 	
-<<<<<<< HEAD
 	createPoisson();
   
 	fragColor = refineBlock();
-=======
-  //  vec4 col = texture2DRect(camTex0, texCoord);
-    vec4 col2 = texture2DRect(camTex1, texCoord);
-    
-    int i;
-    int j;
-    float running  = 255.0;
-    vec4 current = vec4(0,0,0,1.0);
-    
-	for (i= -rangeY; i<= rangeY; i = i+stepSize) {
-		
-		for (j= -rangeX; j<= rangeX; j = j+stepSize) {
-		
-			vec2 tc = vec2(j,i);
-			vec2 offset =  texCoord + tc;
-			if (offset.x >-1 && offset.x < width){
-				if (offset.y >-1 && offset.y < height){
-			
-					vec4 col = texture2DRect(camTex0, texCoord + tc);
-			
-					float diff = distance(col2,col);
-					if (diff < running){
-				
-						running  = diff;
-						current = vec4(tc.x * offsetL ,tc.y * offsetL,0.0,1.0);
-					}
-			
-				}
-			}
-		}
-	}
- 
-	fragColor = current;
->>>>>>> 66c096aae473ec318a88ac57c1088ec3fff0067f
 }
@@ -1,10 +1,15 @@
 #version 330
 precision highp float;
 
-in vec4 a_vertex;
+// Default layout from Seburo
+layout (location = 0) in vec3 aVertPosition;
+layout (location = 1) in vec3 aVertNormal;
+layout (location = 2) in vec4 aVertColour;
+layout (location = 3) in vec2 aVertTexCoord;
+
 out vec2 texCoord;
 
 void main(void) {
-	gl_Position = a_vertex;
-	texCoord = gl_MultiTexCoord0.st;
+	gl_Position = vec4(aVertPosition, 1.0);
+	texCoord = aVertTexCoord;
 }
@@ -0,0 +1,22 @@
+#version 330
+precision highp float;
+
+in vec4 vVertexPosition;
+in vec4 vColour;
+in vec2 vTexCoord;
+
+out vec4 fragColor;
+
+// Raw 16 bit depth from the sensor. Near and far are in the same normalised units
+uniform sampler2DRect uBaseTex;
+uniform float uNear;
+uniform float uFar;
+
+void main() {
+  vec2 texsize = textureSize(uBaseTex);
+  float depth = texture(uBaseTex,vTexCoord * texsize).r;
+
+  // Zero is no reading. Closer is brighter, and anything outside the player band fades out
+  float grey = depth > 0.0 ? 1.0 - clamp((depth - uNear) / (uFar - uNear), 0.0, 1.0) : 0.0;
+  fragColor = vec4(grey, grey, grey, 1.0);
+}
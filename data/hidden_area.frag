@@ -0,0 +1,10 @@
+#version 330
+precision highp float;
+
+// Only depth is written. Colour writes are masked off while this runs
+
+out vec4 fragColor;
+
+void main() {
+  fragColor = vec4(0.0);
+}
@@ -0,0 +1,10 @@
+#version 330
+precision highp float;
+
+// Hidden area ring, already in eye clip space. Sits on the near plane
+
+layout (location = 0) in vec2 aPosition;
+
+void main() {
+  gl_Position = vec4(aPosition, -1.0, 1.0);
+}
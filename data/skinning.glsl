@@ -18,10 +18,18 @@ layout (location = 4) in uvec4 aVertBoneIndex;
 layout (location = 5) in vec4 aVertWeight;
 
 
-// Defaults set by Seburo
+// Set by Seburo per node
 uniform mat4 uModelMatrix;
-uniform mat4 uViewMatrix;
-uniform mat4 uProjectionMatrix;
+
+// Both eye cameras for the frame, and which one this pass uses
+layout(std140) uniform PhantomEyes {
+  mat4 uEyeView[2];
+  mat4 uEyeProjection[2];
+};
+
+layout(std140) uniform PhantomPass {
+  ivec4 uPass;
+};
 
 // Skinning defaults from Seburo
 uniform mat4 uBonePalette[128]; // Quite a lot! :O
@@ -53,7 +61,7 @@ void main() {
   bp = vec4(aVertPosition,1.0) * uBonePalette[aVertBoneIndex.w] * bias;
   skinnedPosition += bp.xyz;
 
-  sVertexPosition = uProjectionMatrix * uViewMatrix * uModelMatrix * vec4(skinnedPosition,1.0);
+  sVertexPosition = uEyeProjection[uPass.x] * uEyeView[uPass.x] * uModelMatrix * vec4(skinnedPosition,1.0);
   gl_Position = sVertexPosition;
   sTexCoord = aVertTexCoord;
 } 
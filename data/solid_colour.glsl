@@ -14,14 +14,22 @@ layout (location = 2) in vec3 aVertColour;
 layout (location = 3) in vec2 aVertTexCoord;
 layout (location = 4) in vec3 aVertTangent;
 
-// Defaults set by Seburo
+// Set by Seburo per node
 uniform mat4 uModelMatrix;
-uniform mat4 uViewMatrix;
-uniform mat4 uProjectionMatrix;
+
+// Both eye cameras for the frame, and which one this pass uses
+layout(std140) uniform PhantomEyes {
+  mat4 uEyeView[2];
+  mat4 uEyeProjection[2];
+};
+
+layout(std140) uniform PhantomPass {
+  ivec4 uPass;
+};
 
 void main() {            
 
-  vVertexPosition = uProjectionMatrix * uViewMatrix * uModelMatrix * vec4(aVertPosition,1.0);
+  vVertexPosition = uEyeProjection[uPass.x] * uEyeView[uPass.x] * uModelMatrix * vec4(aVertPosition,1.0);
   gl_Position = vVertexPosition;
   vTexCoord = aVertTexCoord;
 } 
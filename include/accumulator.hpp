@@ -0,0 +1,137 @@
+/*
+* @brief PhantomLimb temporal accumulation buffer
+* @file accumulator.hpp
+* @author Benjamin Blundell <oni@section9.co.uk>
+* @date 19/10/2026
+*
+*/
+
+#ifndef PHANTOM_ACCUMULATOR_HPP
+#define PHANTOM_ACCUMULATOR_HPP
+
+#include "s9/common.hpp"
+#include "s9/gl/common.hpp"
+#include "s9/file.hpp"
+
+#include "timing.hpp"
+
+#include <atomic>
+
+namespace s9 {
+
+  // How new samples are folded into the history
+  typedef enum {
+    ACCUMULATE_EMA,     // Exponential moving average with a fixed weight
+    ACCUMULATE_BOX      // Plain mean of the first N samples since the last reset, then hold
+  }AccumulateMode;
+
+  struct AccumulatorSettings {
+    AccumulatorSettings() : mode(ACCUMULATE_EMA), alpha(0.3f), samples(8), reject(0), holes(true),
+      motion_threshold(0) {}
+
+    AccumulateMode  mode;
+    float_t         alpha;            // EMA weight of the newest sample
+    size_t          samples;          // Box size
+    float_t         reject;           // Pixels that move further than this take the new sample outright. 0 is off
+    bool            holes;            // Zero means no reading, so keep the history there
+    float_t         motion_threshold; // Motion above this resets everything, in whatever units Motion is fed. 0 is off
+  };
+
+  /**
+   * Temporal accumulation for denoising the depth feed or building supersampled frames.
+   * On the GPU it ping-pongs between two float FBOs. The CPU version works on SSE float
+   * buffers, so it can run on the sensor thread where there is no GL context.
+   * Pick one or the other when constructing. The GPU one must be made and used on the GL thread.
+   * Reset and Motion may come from any thread - they take effect at the next sample.
+   */
+
+  class Accumulator {
+
+  public:
+
+    Accumulator() {}
+
+    /// CPU accumulator
+    Accumulator(size_t width, size_t height, const AccumulatorSettings &settings);
+
+    /// GPU accumulator for rectangle textures of this size. program is the linked accumulator
+    /// program, still owned by whoever built it
+    Accumulator(size_t width, size_t height, GLenum format, GLuint program, const AccumulatorSettings &settings);
+
+    /// GPU. Folds the texture on unit 0 into the history. Leaves the framebuffer as it found it
+    void Accumulate(GLuint texture);
+
+    /// CPU. In and out may be the same buffer
+    void Accumulate(const float_t *in, float_t *out);
+    void Accumulate(const uint16_t *in, uint16_t *out);
+
+    /// Start again from the next sample
+    void Reset() { CXSHARED obj_->reset_pending.store(true); }
+
+    /// The reset on motion hook. Pass however far the view or sensor moved since the last sample
+    void Motion(float_t amount);
+
+    /// GPU. The accumulated result
+    void Bind(GLuint unit = 0);
+    void Unbind();
+
+    bool gpu() { CXSHARED return obj_->gpu; }
+    size_t width() { CXSHARED return obj_->width; }
+    size_t height() { CXSHARED return obj_->height; }
+
+    /// Box mode has all its samples
+    bool complete() { CXSHARED return obj_->settings.mode == ACCUMULATE_BOX && obj_->count >= obj_->settings.samples; }
+
+    size_t count() { CXSHARED return obj_->count.load(); }
+    size_t resets() { CXSHARED return obj_->resets.load(); }
+
+    /// Seconds for the last sample. The GPU figure comes from a timer query and lags a frame or two
+    double_t last_cost() { CXSHARED return obj_->last_cost.load(); }
+
+  private:
+
+    struct SharedObject {
+      SharedObject(size_t width, size_t height, bool gpu, GLenum format, GLuint program, const AccumulatorSettings &settings);
+      ~SharedObject();
+
+      float_t Weight();
+
+      AccumulatorSettings   settings;
+      size_t                width;
+      size_t                height;
+      bool                  gpu;
+
+      // Only the thread accumulating writes count and last_cost. Anyone may read them
+      std::atomic<size_t>   count;
+      std::atomic<size_t>   resets;
+      std::atomic<double_t> last_cost;
+      std::atomic<bool>     reset_pending;
+
+      // GPU - history is read from textures[current] and written to the other
+      GLuint                framebuffers[2];
+      GLuint                textures[2];
+      GLuint                vao;
+      GLuint                query;
+      bool                  query_pending;
+      size_t                current;
+      GLuint                bound_unit;
+      GLuint                program;
+
+      // CPU
+      std::vector<float_t>  history;
+      std::vector<float_t>  scratch;
+    };
+
+    std::shared_ptr<SharedObject> obj_;
+
+  public:
+    bool operator == (const Accumulator &ref) const { return this->obj_ == ref.obj_; }
+    typedef std::shared_ptr<SharedObject> Accumulator::*unspecified_bool_type;
+    operator unspecified_bool_type() const { return ( obj_.get() == 0 ) ? 0 : &Accumulator::obj_; }
+    void reset() { obj_.reset(); }
+
+  };
+
+}
+
+#endif
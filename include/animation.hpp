@@ -0,0 +1,182 @@
+/*
+* @brief PhantomLimb compressed MD5 animation clips
+* @file animation.hpp
+* @author Benjamin Blundell <oni@section9.co.uk>
+* @date 19/10/2026
+*
+*/
+
+#ifndef PHANTOM_ANIMATION_HPP
+#define PHANTOM_ANIMATION_HPP
+
+#include "s9/common.hpp"
+
+#include "timing.hpp"
+
+namespace s9 {
+
+  struct AnimationSettings {
+    AnimationSettings() : tolerance(0.25f) {}
+
+    float_t tolerance;    // Degrees a dropped key may sit off the interpolated track
+  };
+
+  /// Joint rotations for a set of bones, one array per component. Padded to a multiple of
+  /// four with identity so the SIMD paths never need a tail
+  struct AnimationPose {
+    AnimationPose() : bones(0) {}
+
+    void Resize(size_t count);
+    glm::quat rotation(size_t i) const { return glm::quat(w[i], x[i], y[i], z[i]); }
+
+    size_t                bones;
+    std::vector<float_t>  x, y, z, w;
+  };
+
+  /**
+   * An md5anim clip, kept as joint rotations relative to the clip's own base frame - the
+   * same sense as Bone::set_rotation_relative. Translations are dropped, as nothing we pose
+   * moves a joint.
+   *
+   * Each joint's track is quantised to three 16 bit components, with w rebuilt on sampling,
+   * and reduced to the keys linear interpolation cannot recover within the tolerance. Tracks
+   * are stored structure of arrays, and a joint the clip never animates ends up as one key.
+   */
+
+  class AnimationClip {
+
+  public:
+
+    AnimationClip() {}
+    AnimationClip(const std::string &path, const AnimationSettings &settings = AnimationSettings());
+
+    bool loaded() { CXSHARED return obj_->frames > 0; }
+    const std::string& path() { CXSHARED return obj_->path; }
+
+    size_t num_bones() { CXSHARED return obj_->names.size(); }
+    const std::string& bone_name(size_t i) { CXSHARED return obj_->names[i]; }
+
+    /// Index of the named joint, or -1
+    int32_t bone(const std::string &name);
+
+    size_t frames() { CXSHARED return obj_->frames; }
+    double_t frame_rate() { CXSHARED return obj_->rate; }
+    double_t duration() { CXSHARED return obj_->frames > 1 ? (obj_->frames - 1) / obj_->rate : 0; }
+
+    /// Keys kept, against one per joint per frame
+    size_t keys() { CXSHARED return obj_->frame.size(); }
+    size_t raw_keys() { CXSHARED return obj_->frames * obj_->names.size(); }
+    size_t bytes();
+
+    /// Worst error in degrees between the stored tracks and the source, over every frame
+    float_t max_error() { CXSHARED return obj_->max_error; }
+
+  private:
+
+    friend class AnimationPlayer;
+
+    struct SharedObject {
+      SharedObject(const std::string &path, const AnimationSettings &settings);
+
+      std::string               path;
+      std::vector<std::string>  names;
+      size_t                    frames;
+      double_t                  rate;
+      float_t                   max_error;
+
+      // Joint i's keys run from first[i] to first[i + 1]
+      std::vector<uint32_t>     first;
+      std::vector<uint16_t>     frame;
+      std::vector<int16_t>      x, y, z;
+    };
+
+    std::shared_ptr<SharedObject> obj_;
+
+  public:
+    bool operator == (const AnimationClip &ref) const { return this->obj_ == ref.obj_; }
+    typedef std::shared_ptr<SharedObject> AnimationClip::*unspecified_bool_type;
+    operator unspecified_bool_type() const { return ( obj_.get() == 0 ) ? 0 : &AnimationClip::obj_; }
+    void reset() { obj_.reset(); }
+
+  };
+
+  /**
+   * Plays a set of clips onto one skeleton, looping, with a crossfade when switching clip.
+   * Its bones are every joint any of the clips name, and a clip that lacks one leaves it at
+   * identity. One player per user - it keeps a cursor into every track, so sampling a
+   * forward moving clip never searches.
+   *
+   * Sampling finds the bracketing keys per joint, then decodes, interpolates and blends four
+   * joints at a time with SSE.
+   */
+
+  class AnimationPlayer {
+
+  public:
+
+    AnimationPlayer() {}
+    AnimationPlayer(const std::vector<AnimationClip> &clips);
+
+    /// Switch clip, fading over this many seconds. Starts the clip from the beginning
+    void Play(size_t clip, double_t fade);
+
+    /// Move time on and sample the pose
+    void Update(double_t dt);
+
+    size_t num_bones() { CXSHARED return obj_->names.size(); }
+    const std::string& bone_name(size_t i) { CXSHARED return obj_->names[i]; }
+    const AnimationPose& pose() { CXSHARED return obj_->pose; }
+    size_t playing() { CXSHARED return obj_->current; }
+
+    /// Time sampling and blending every clip with and without SIMD, per bone per frame, and
+    /// print that with how well each compressed
+    void Benchmark();
+
+  private:
+
+    struct Binding {
+      AnimationClip           clip;
+      std::vector<int32_t>    tracks;     // Clip joint for each of our bones, or -1
+      std::vector<uint32_t>   cursors;    // Last key used on each track
+      double_t                time;
+    };
+
+    // The two keys either side of the sample time for each bone, still quantised
+    struct Keys {
+      void Resize(size_t count);
+
+      std::vector<int16_t>    ax, ay, az;
+      std::vector<int16_t>    bx, by, bz;
+      std::vector<float_t>    alpha;
+    };
+
+    struct SharedObject {
+      std::vector<std::string>  names;
+      std::vector<Binding>      bindings;
+      size_t                    current;
+      size_t                    previous;
+      double_t                  fade;
+      double_t                  fade_time;
+      bool                      simd;
+
+      Keys                      keys;
+      AnimationPose             pose;
+      AnimationPose             from;
+    };
+
+    static void Sample(Binding &binding, Keys &keys, AnimationPose &pose, bool simd);
+    static void Blend(const AnimationPose &a, const AnimationPose &b, float_t t, AnimationPose &out, bool simd);
+
+    std::shared_ptr<SharedObject> obj_;
+
+  public:
+    bool operator == (const AnimationPlayer &ref) const { return this->obj_ == ref.obj_; }
+    typedef std::shared_ptr<SharedObject> AnimationPlayer::*unspecified_bool_type;
+    operator unspecified_bool_type() const { return ( obj_.get() == 0 ) ? 0 : &AnimationPlayer::obj_; }
+    void reset() { obj_.reset(); }
+
+  };
+
+}
+
+#endif
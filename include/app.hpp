@@ -28,83 +28,31 @@
 #include "s9/obj_mesh.hpp"
 
 #include "physics.hpp"
+#include "sensor.hpp"
+#include "stereo.hpp"
+#include "session.hpp"
+#include "batch_render.hpp"
+#include "headset.hpp"
+#include "latency.hpp"
+#include "uniform_buffer.hpp"
+#include "ball_batch.hpp"
+#include "render_queue.hpp"
+#include "hidden_area.hpp"
+#include "task_system.hpp"
+#include "frame_pacer.hpp"
+#include "operator.hpp"
+#include "console_channel.hpp"
+#include "ux_window.hpp"
+#include "animation.hpp"
+#include "mesh_parse.hpp"
+#include "program_cache.hpp"
 
 #include <gtkmm.h>
+#include <map>
  
 namespace s9 {
 
 
-#ifdef _SEBURO_LINUX
-
-	// Type for selecting which arms to use
-	typedef enum {
-		BOTH_ARMS,
-		LEFT_ARM_RIGHT_FROZEN,
-		RIGHT_ARM_LEFT_FROZEN,
-		LEFT_ARM_RIGHT_MIRROR,
-		RIGHT_ARM_LEFT_MIRROR,
-		LEFT_ARM_COPY,
-		RIGHT_ARM_COPY
-	}ArmState;
-
-	class PhantomLimb;
-
-	/*
- 	 * UX Window for the Application. Runs on the main screen
- 	 */
-
-	class UXWindow : public Gtk::Window {
-
-	public:
-	  UXWindow(gl::WithUXApp &gtk_app, PhantomLimb &app, XMLSettings &settings);
-	  virtual ~UXWindow();
-
-	protected:
-	  //Signal handlers:
-	  void on_button_fire_clicked();
-	  void on_button_reset_clicked();
-	  void on_button_auto_game_clicked();
-	  void on_button_quit_clicked();
-	  void on_button_tracking_clicked();
-	  void on_button_oculus_clicked();
-	  bool on_window_closed(GdkEventAny* event);
-	  void on_combo_arms_changed();
-	  void on_button_emphasis_toggled();
-	  void on_scale_speed_changed();
-	  void on_scale_width_changed();
-
-	  // Layout
-
-	  Gtk::Grid		grid_;
-
-	  // Buttons
-	  Gtk::Button* button_fire_;
-	  Gtk::Button* button_auto_game_;
-	  Gtk::Button* button_reset_;
-	  Gtk::Button* button_oculus_;
-	  Gtk::Button* button_tracking_;
-	  Gtk::Button* button_quit_;
-
-	  Gtk::ComboBoxText combo_arms_;
-
-	  Gtk::CheckButton* button_emphasis_;
-
-	  Gtk::HScale* scale_speed_;
-	  Gtk::Label scale_speed_label_;
-
-	  Gtk::HScale* scale_width_;
-	  Gtk::Label scale_width_label_;
-
-
-	  PhantomLimb& app_;
-	  gl::WithUXApp& gtk_app_;
-
-	  XMLSettings &file_settings_;
-
-	};
-
-#endif
-
 	/*
  	 * Phantom Limb main Oculus 3D Application
  	 */
@@ -112,11 +60,12 @@ namespace s9 {
 	class PhantomLimb : public WindowApp<GLFWwindow*> {
 	public:
 		
-		PhantomLimb (XMLSettings &settings ) : file_settings_(settings) {};
+		PhantomLimb (XMLSettings &settings, ConsoleChannel console ) : console_(console), file_settings_(settings) {};
 		~PhantomLimb();
 
 		
 		void Init();
+		void Shutdown();
 		void Display(GLFWwindow* window, double_t dt);
 		void Update(double_t dt);
 
@@ -124,22 +73,33 @@ namespace s9 {
 		void ProcessEvent(KeyboardEvent e, GLFWwindow* window);
 		void ProcessEvent(ResizeEvent e, GLFWwindow* window);
 
-		// UX Interface functions
+		/// Write the operator's settings back, once the frame loop has stopped reading them
+		void StoreSettings() { game_->Write(file_settings_); }
+
+		void UpdateMainThread(double_t dt);
+		void UpdateUser(size_t idx, double_t dt);
+		void DrainSensor();
+		void UpdateGame(double_t dt);
+
+
+	protected:
+
+		// Operator actions, only ever applied by the frame loop while the simulation is idle
+
+		void ApplyCommands(GLFWwindow* window);
+		void PublishTelemetry(double_t dt, double_t cost, bool reprojected);
 		void FireBall();
 		void ResetPhysics() { physics_.Reset(); }
 		void PlayGame(bool b) { playing_game_ = b; last_shot_ = 0; }
-		void RestartTracking() { openni_skeleton_tracker_.RestartTracking(); }
-		void ResetOculus() { oculus_.ResetView(); }
+		void RestartTracking() { sensor_.RestartTracking(); }
+		void ResetOculus() { headset_.ResetView(); }
 		void SetHanded(ArmState a) { arm_state_ = a; }
 
-		bool playing_game() {return playing_game_; }
-
-		void UpdateMainThread(double_t dt);
-
-		void set_arm_emphasis(bool b) { arm_emphasis_ = b; }
-
+		ConsoleChannel console_;
+		std::shared_ptr<const GameSettings> game_;
 
-	protected:
+		// What the console is told about the simulation, copied while no task is running
+		TelemetrySample telemetry_;
 
 		// Geometry
 		Quad quad_;
@@ -152,30 +112,66 @@ namespace s9 {
 		Camera camera_ortho_;
 		Camera 				camera_left_;
 		Camera 				camera_right_;
+		Camera 				camera_overlay_left_;
+		Camera 				camera_overlay_right_;
 		
 		// Global Nodes
 
-		Node node_model_;
 		Node node_depth_;
     Node node_colour_;
     Node node_hands_;
     Node node_left_hand_;
     Node node_right_hand_;
 
-    Node 					node_left_;
-		Node 					node_right_;
 		
+		// Per user state, indexed by OpenNI user id - 1. Kept in flat arrays so cost is linear in users
+		struct TrackedUser {
+			SkeletonSample sample;
+			glm::mat4 offset;
+			glm::vec3 hand_left;
+			glm::vec3 hand_right;
+			double_t update_cost;
+			bool in_scene;
+
+			// Idle and fallback clips, layered under the tracked arms
+			AnimationPlayer animation;
+			std::vector<Bone*> animation_bones;
+			glm::quat arm_pose[4];
+			float_t fallback;
+			bool was_tracked;
+		};
+
+		std::vector<TrackedUser> users_;
+		std::vector<MD5Model> user_models_;
+		std::vector<Node> user_nodes_;
+		std::vector<int32_t> animation_arms_;
+		double_t animation_fade_;
+		double_t stats_time_;
+
 		// Model Classes
-		MD5Model md5_;
 		SkeletonShape skeleton_shape_;
 
 		ObjMesh room_;
 
-		// Oculus Rift
-		oculus::OculusBase oculus_;
+		// Oculus Rift, or the simulated stand in
+		Headset headset_;
+		glm::quat render_orientation_;
+		bool timewarp_;
+		LatencyProbe latency_;
+		HiddenAreaMask hidden_area_;
 		glm::quat oculus_rotation_dt_;
 		glm::quat oculus_rotation_prev_;
 
+		// Eye views are the fixed base view turned by the absolute head pose each frame
+		bool absolute_pose_;
+		glm::mat4 base_view_;
+		glm::mat4 base_eye_views_[2];
+		UniformBuffer<EyeBlock> eyes_;
+		UniformBuffer<PassBlock> passes_;
+		UniformBuffer<WarpBlock> warp_;
+
+		void SetEyes(const glm::mat4 &left_view, const glm::mat4 &right_view);
+
 		gl::FBO				fbo_;
 		GLuint				null_VAO_;
 
@@ -185,11 +181,23 @@ namespace s9 {
 		glm::vec4 hand_pos_left_;
 		glm::vec4 hand_pos_right_;
 
-		glm::vec3 hand_pos_left_final_;
-		glm::vec3 hand_pos_right_final_;
-
 		// Balls for Physics
-		Node 	node_ball_;
+		BallBatch ball_batch_;
+
+		// Draws for both eyes, sorted by state each frame
+		typedef enum {
+			PROGRAM_BALLS,
+			PROGRAM_SKINNING,
+			PROGRAM_ROOM
+		}ProgramId;
+
+		RenderQueue render_queue_;
+		std::vector<uint32_t> user_items_[2];
+		uint32_t room_items_[2];
+		uint32_t ball_items_[2];
+		glm::vec3 view_position_;
+
+		void BindEyePass(uint8_t eye);
 		glm::vec4 ball_colour_;
 		float_t ball_radius_;
 
@@ -197,32 +205,92 @@ namespace s9 {
 		s9::oni::OpenNIBase openni_;
     s9::oni::OpenNISkeleton openni_skeleton_tracker_;
 
+		// Sensor thread
+		SensorIngest sensor_;
+
+		// Stereo depth, when there is no sensor
+		StereoMatcher stereo_;
+
+		// Depth stream colliders
+		DepthColliders depth_colliders_;
+		std::vector<glm::vec3> depth_centres_;
+
 		// Shaders
 
 		gl::Shader shader_skinning_;
 		gl::Shader shader_quad_;
 		gl::Shader shader_colour_;
-		gl::Shader shader_warp_;
 		gl::Shader shader_room_;
+		gl::Shader shader_depth_;
+
+		// Programs we bind ourselves rather than through the scene graph
+		ProgramCache programs_;
+		size_t program_warp_, program_balls_, program_hidden_area_, program_accumulator_;
+		bool warp_blocks_resolved_, programs_reported_;
+		double_t init_start_;
 
 		// Colours
 
 		glm::vec4 hand_left_colour_, hand_right_colour_;
 
-		// Temp bytes for data off the cameras
+		// Live images off the sensor, streamed into textures
+
+		CameraFeed depth_feed_;
+		CameraFeed colour_feed_;
+		Accumulator depth_accumulator_;
+		bool depth_overlay_;
+		float_t depth_near_;
+		float_t depth_far_;
+
+		void DrawOverlay(Camera &camera);
+		void DrawScene();
+		void WarpToScreen(bool timewarp);
+
+		// Holds each frame back to start as late as the predicted vsync allows
+		FramePacer pacer_;
+		double_t skipped_dt_;
 
-		byte_t *camera_buffer_;
+		// Session recording, and replaying one offline into a video
+
+		SessionRecorder recorder_;
+		SessionPlayer player_;
+		BatchRenderer batch_;
+		bool offline_;
+		double_t offline_time_;
+		std::vector<SessionEvent> session_events_;
+
+		void DisplayOffline(GLFWwindow* window);
 
 		float rotation_;
 
+		// CPU cost of each headset frame, reported with the other stats
+		double_t frame_cost_;
+		double_t frame_cost_max_;
+		size_t frame_count_;
+
 		// Physics
 
 		PhantomPhysics physics_;
 
+		// Simulation for the next frame runs on the task system while this one is warped and
+		// swapped. Only the GL work stays on this thread
+
+		TaskSystem tasks_;
+		TaskGraph sim_graph_;
+		bool pipelined_;
+		bool sim_pending_;
+		double_t sim_dt_;
+		double_t sim_wait_;
+		double_t sim_wall_;
+		size_t sim_frames_;
+		std::map<std::string, double_t> stage_times_;
+
+		void StartSimulation(double_t dt);
+		void FinishSimulation();
+
 		// Game
 
 		bool playing_game_;
-		bool arm_emphasis_;
 		double_t last_shot_;
 
 		ArmState arm_state_;
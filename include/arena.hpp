@@ -0,0 +1,102 @@
+/*
+* @brief PhantomLimb arena allocator for Bullet
+* @file arena.hpp
+* @author Benjamin Blundell <oni@section9.co.uk>
+* @date 19/10/2026
+*
+*/
+
+#ifndef PHANTOM_ARENA_HPP
+#define PHANTOM_ARENA_HPP
+
+#include "s9/common.hpp"
+
+#include <algorithm>
+#include <atomic>
+
+namespace s9 {
+
+  /**
+   * A simple bump allocator. Memory is handed out from large blocks, one after the other,
+   * and only given back all at once when the arena is released or destroyed.
+   *
+   * Pooled allocations are rounded up to a power of two. Freeing one puts it on a list for
+   * its size, and the next pooled allocation of that size takes it from there, so anything
+   * that keeps growing and freeing arrays - as Bullet does - settles instead of creeping.
+   * Not thread safe - an arena belongs to whichever thread has it in scope.
+   */
+
+  class Arena {
+  public:
+    static const size_t kBlockSize = 1024 * 1024;
+    static const size_t kSizeClasses = 48;
+
+    Arena() : head_(nullptr), used_(0), reserved_(0), allocations_(0), pooled_(0), reused_(0) {
+      std::fill(free_, free_ + kSizeClasses, nullptr);
+    }
+    ~Arena() { Release(); }
+
+    void* Allocate(size_t size, size_t alignment);
+
+    /// size_class is set to what must be handed back to FreePooled
+    void* AllocatePooled(size_t size, size_t alignment, uint32_t &size_class);
+    void FreePooled(void* ptr, uint32_t size_class);
+
+    /// Frees every block. Anything allocated from here is gone
+    void Release();
+
+    size_t used() const { return used_; }
+    size_t reserved() const { return reserved_; }
+    size_t allocations() const { return allocations_; }
+
+    /// Bytes waiting on the free lists, and how many allocations came off them
+    size_t pooled() const { return pooled_; }
+    size_t reused() const { return reused_; }
+
+  private:
+    Arena(const Arena&);
+    Arena& operator=(const Arena&);
+
+    struct Block {
+      Block*  next;
+      size_t  size;
+      size_t  offset;
+    };
+
+    // Each free entry holds the next one in its first bytes
+    struct FreeEntry {
+      FreeEntry* next;
+    };
+
+    Block*      head_;
+    size_t      used_;
+    size_t      reserved_;
+    size_t      allocations_;
+    size_t      pooled_;
+    size_t      reused_;
+    FreeEntry*  free_[kSizeClasses];
+  };
+
+  /// Makes an arena the target of all Bullet allocations on this thread until it goes out of scope
+  class ArenaScope {
+  public:
+    ArenaScope(Arena &arena);
+    ~ArenaScope();
+  private:
+    Arena* previous_;
+  };
+
+  /// Running totals for Bullet allocations made with no arena in scope
+  struct BulletAllocStats {
+    size_t heap_allocations;
+    size_t heap_bytes;
+  };
+
+  /// Route btAlignedAlloc / btAlignedFree through the arenas. Call once, before any Bullet object exists
+  void InstallBulletArenaHooks();
+
+  BulletAllocStats GetBulletAllocStats();
+
+}
+
+#endif
@@ -0,0 +1,76 @@
+/*
+* @brief PhantomLimb instanced ball drawing
+* @file ball_batch.hpp
+* @author Benjamin Blundell <oni@section9.co.uk>
+* @date 19/10/2026
+*
+*/
+
+#ifndef PHANTOM_BALL_BATCH_HPP
+#define PHANTOM_BALL_BATCH_HPP
+
+#include "s9/common.hpp"
+#include "s9/file.hpp"
+#include "s9/gl/common.hpp"
+
+#include "uniform_buffer.hpp"
+
+namespace s9 {
+
+  /**
+   * Draws every physics ball in a single instanced call per eye. The sphere lives in its own
+   * vertex array, and the per ball transforms and the ball material go into the PhantomBalls
+   * block with one write per frame, rather than a node draw and a set of uniforms per ball.
+   * Past one block's worth of balls the buffer holds further copies of the block, and each
+   * copy is range bound and drawn in turn.
+   */
+
+  class BallBatch {
+
+  public:
+
+    BallBatch() {}
+
+    /// program is the linked ball_instanced program, which stays owned by whoever built it.
+    /// Balls past max_balls are not drawn
+    BallBatch(float_t radius, size_t segments, const glm::vec4 &colour, GLuint program,
+      size_t max_balls = kMaxBallInstances);
+
+    /// Once per frame, before either eye
+    void Update(const std::vector<glm::mat4> &balls);
+
+    /// Draws with whichever eye PhantomPass has bound
+    void Draw();
+
+    size_t count() { CXSHARED return obj_->count; }
+
+  private:
+
+    struct SharedObject {
+      SharedObject(float_t radius, size_t segments, const glm::vec4 &colour, GLuint program, size_t max_balls);
+      ~SharedObject();
+
+      GLuint                    vao;
+      GLuint                    vbo;
+      GLuint                    ibo;
+      GLsizei                   index_count;
+
+      GLuint                    program;
+      UniformBuffer<BallBlock>  block;
+      size_t                    copies;
+      size_t                    count;
+    };
+
+    std::shared_ptr<SharedObject> obj_;
+
+  public:
+    bool operator == (const BallBatch &ref) const { return this->obj_ == ref.obj_; }
+    typedef std::shared_ptr<SharedObject> BallBatch::*unspecified_bool_type;
+    operator unspecified_bool_type() const { return ( obj_.get() == 0 ) ? 0 : &BallBatch::obj_; }
+    void reset() { obj_.reset(); }
+
+  };
+
+}
+
+#endif
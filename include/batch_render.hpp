@@ -0,0 +1,95 @@
+/*
+* @brief PhantomLimb offscreen frame capture for session videos
+* @file batch_render.hpp
+* @author Benjamin Blundell <oni@section9.co.uk>
+* @date 19/10/2026
+*
+*/
+
+#ifndef PHANTOM_BATCH_RENDER_HPP
+#define PHANTOM_BATCH_RENDER_HPP
+
+#include "s9/common.hpp"
+#include "s9/gl/common.hpp"
+
+#include "timing.hpp"
+
+#include <cstdio>
+#include <algorithm>
+
+namespace s9 {
+
+  /**
+   * Reads rendered frames back through a ring of pixel buffers and writes them out, either
+   * piped into an encoder or as a numbered PPM sequence. Each Capture starts an asynchronous
+   * read of the bound framebuffer, and frames are written once their fence has passed.
+   * Capture only waits when every buffer in the ring is still in flight - that wait is the
+   * readback stall. Only uses GL 3.2 features, so it runs on software Mesa.
+   */
+
+  class BatchRenderer {
+
+  public:
+
+    static const size_t kSlots = 4;
+
+    BatchRenderer() {}
+
+    /// Output is a video file for the encoder, or a printf pattern ending in .ppm for a sequence
+    BatchRenderer(size_t width, size_t height, double_t fps, const std::string &output, const std::string &encoder);
+
+    /// GL thread. Reads colour attachment 0 of the bound framebuffer
+    void Capture();
+
+    /// Write out everything still in flight and close the output
+    void Finish();
+
+    size_t frames() { CXSHARED return obj_->written; }
+    double_t stall() { CXSHARED return obj_->stall; }
+    double_t write_time() { CXSHARED return obj_->write_time; }
+    double_t fps() { CXSHARED return obj_->written > 0 ? obj_->written / std::max(obj_->last_write - obj_->first_capture, 1e-6) : 0; }
+
+  private:
+
+    struct SharedObject {
+      SharedObject(size_t width, size_t height, double_t fps, const std::string &output, const std::string &encoder);
+      ~SharedObject();
+
+      void Retire(bool wait);
+      void Write(const byte_t *pixels);
+      void Close();
+
+      size_t                width;
+      size_t                height;
+      size_t                frame_bytes;
+
+      GLuint                pbos[kSlots];
+      GLsync                fences[kSlots];
+      size_t                oldest;
+      size_t                in_flight;
+
+      FILE*                 pipe;
+      bool                  sequence;
+      std::string           pattern;
+
+      size_t                captured;
+      size_t                written;
+      double_t              first_capture;
+      double_t              last_write;
+      double_t              stall;
+      double_t              write_time;
+    };
+
+    std::shared_ptr<SharedObject> obj_;
+
+  public:
+    bool operator == (const BatchRenderer &ref) const { return this->obj_ == ref.obj_; }
+    typedef std::shared_ptr<SharedObject> BatchRenderer::*unspecified_bool_type;
+    operator unspecified_bool_type() const { return ( obj_.get() == 0 ) ? 0 : &BatchRenderer::obj_; }
+    void reset() { obj_.reset(); }
+
+  };
+
+}
+
+#endif
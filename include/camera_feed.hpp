@@ -0,0 +1,120 @@
+/*
+* @brief PhantomLimb sensor image to texture streaming
+* @file camera_feed.hpp
+* @author Benjamin Blundell <oni@section9.co.uk>
+* @date 19/10/2026
+*
+*/
+
+#ifndef PHANTOM_CAMERA_FEED_HPP
+#define PHANTOM_CAMERA_FEED_HPP
+
+#include "s9/common.hpp"
+#include "s9/gl/common.hpp"
+
+#include "timing.hpp"
+
+#include <atomic>
+
+namespace s9 {
+
+  // Pixel layouts we can stream
+  typedef enum {
+    FEED_DEPTH16,
+    FEED_RGB8
+  }FeedFormat;
+
+  /**
+   * Streams sensor images into a rectangle texture without either side waiting on the other.
+   * The sensor thread copies each frame straight into a free slot of a persistently mapped
+   * pixel buffer. Once per frame the render thread uploads the newest complete slot with
+   * glTexSubImage2D and fences it. A slot only goes back to the sensor once its fence has
+   * passed, and if there is no free slot the frame is dropped rather than waited for.
+   * Create, Upload and Bind are render thread only. Submit is for the sensor thread.
+   */
+
+  class CameraFeed {
+
+  public:
+
+    static const size_t kSlots = 3;
+
+    CameraFeed() {}
+
+    CameraFeed(size_t width, size_t height, FeedFormat format);
+
+    /// Sensor thread. Returns false if the frame was dropped
+    bool Submit(const void *data, size_t width, size_t height);
+
+    /// Render thread. Never blocks. Returns true if the texture changed
+    bool Upload();
+
+    void Bind(GLuint unit = 0);
+    void Unbind();
+
+    GLuint texture() { CXSHARED return obj_->texture; }
+
+    size_t width() { CXSHARED return obj_->width; }
+    size_t height() { CXSHARED return obj_->height; }
+    bool persistent() { CXSHARED return obj_->persistent; }
+
+    size_t submitted() { CXSHARED return obj_->submitted.load(); }
+    size_t dropped() { CXSHARED return obj_->dropped.load(); }
+    size_t uploaded() { CXSHARED return obj_->uploaded; }
+    double_t upload_cost() { CXSHARED return obj_->upload_cost; }
+
+  private:
+
+    // A slot moves FREE -> WRITING (sensor) -> READY -> UPLOADING (render) -> FREE
+    typedef enum {
+      SLOT_FREE,
+      SLOT_WRITING,
+      SLOT_READY,
+      SLOT_UPLOADING
+    }SlotState;
+
+    struct Slot {
+      std::atomic<int>      state;
+      std::atomic<size_t>   sequence;
+      GLsync                fence;
+      byte_t*               data;
+    };
+
+    struct SharedObject {
+      SharedObject(size_t width, size_t height, FeedFormat format);
+      ~SharedObject();
+
+      size_t                width;
+      size_t                height;
+      FeedFormat            format;
+      size_t                slot_bytes;
+
+      GLuint                texture;
+      GLuint                pbo;
+      GLuint                bound_unit;
+      bool                  persistent;   // False when the driver lacks ARB_buffer_storage
+      byte_t*               mapped;
+      std::vector<byte_t>   staging;      // Backs the slots when there is no persistent map
+
+      Slot                  slots[kSlots];
+
+      std::atomic<size_t>   sequence;
+      std::atomic<size_t>   submitted;
+      std::atomic<size_t>   dropped;
+      size_t                uploaded;
+      double_t              upload_cost;
+    };
+
+    std::shared_ptr<SharedObject> obj_;
+
+  public:
+    bool operator == (const CameraFeed &ref) const { return this->obj_ == ref.obj_; }
+    typedef std::shared_ptr<SharedObject> CameraFeed::*unspecified_bool_type;
+    operator unspecified_bool_type() const { return ( obj_.get() == 0 ) ? 0 : &CameraFeed::obj_; }
+    void reset() { obj_.reset(); }
+
+  };
+
+}
+
+#endif
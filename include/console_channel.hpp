@@ -0,0 +1,117 @@
+/*
+* @brief PhantomLimb shared memory channel to the operator console
+* @file console_channel.hpp
+* @author Benjamin Blundell <oni@section9.co.uk>
+* @date 19/10/2026
+*
+*/
+
+#ifndef PHANTOM_CONSOLE_CHANNEL_HPP
+#define PHANTOM_CONSOLE_CHANNEL_HPP
+
+#include "s9/common.hpp"
+
+#include "operator.hpp"
+#include "ring_buffer.hpp"
+
+#include <atomic>
+
+namespace s9 {
+
+  /**
+   * A POSIX shared memory segment between the render process and the operator console.
+   * It holds two rings. Telemetry runs from the render process to the console, one sample
+   * a frame. Commands run the other way, and any number of consoles may post at once. Both
+   * rings are the lock-free ones used in process, and plain data only goes across.
+   *
+   * The render process creates the segment and is its only consumer of commands. It also
+   * bumps a heartbeat every frame and republishes the live game settings whenever they
+   * change, so a console started late can pick up where things are. A console that stops
+   * reading just lets the telemetry ring fill, and the render process drops samples.
+   *
+   * The telemetry ring has a single consumer, so only one console may read it at a time.
+   * AttachReader claims it with the console's process ID. A claim left by a console that
+   * died is taken over.
+   */
+
+  class ConsoleChannel {
+
+  public:
+
+    ConsoleChannel() {}
+
+    /// Render side. Replaces any segment of the same name left behind by a crash
+    ConsoleChannel(const std::string &name, const GameSettings &settings);
+
+    /// Console side. Check connected() - the render process may not be up yet
+    ConsoleChannel(const std::string &name);
+
+    bool connected() { CXSHARED return obj_->segment != nullptr; }
+
+    // Render process
+
+    void Publish(const TelemetrySample &sample);
+    bool Poll(Command &command) { CXSHARED return obj_->segment->commands.Pop(command); }
+    void PublishSettings(const GameSettings &settings);
+
+    // Console
+
+    bool Post(const Command &command) { CXSHARED return obj_->segment->commands.Push(command); }
+
+    /// Become the one telemetry reader. False if another console already is
+    bool AttachReader();
+
+    /// Always false unless this channel is the attached reader
+    bool Receive(TelemetrySample &sample) { CXSHARED return obj_->reader && obj_->segment->telemetry.Pop(sample); }
+    GameSettings settings();
+
+    /// Bumped once per render frame. If it stops moving the render process has gone
+    uint64_t heartbeat() { CXSHARED return obj_->segment->heartbeat.load(std::memory_order_acquire); }
+
+    /// Telemetry samples the console was too slow to take
+    uint64_t dropped() { CXSHARED return obj_->segment->dropped.load(std::memory_order_relaxed); }
+
+  private:
+
+    static const uint32_t kMagic = 0x504c434f; // PLCO
+    static const uint32_t kVersion = 2;
+
+    struct Segment {
+      std::atomic<uint32_t>   magic;
+      uint32_t                version;
+      std::atomic<uint64_t>   heartbeat;
+      std::atomic<uint64_t>   dropped;
+      std::atomic<int32_t>    reader;       // Process ID of the telemetry reader, 0 for none
+
+      // Even when settings is stable, odd while it is being written
+      std::atomic<uint32_t>   settings_sequence;
+      GameSettings            settings;
+
+      SPSCRingBuffer<TelemetrySample, 1024> telemetry;
+      MPSCRingBuffer<Command, 64>           commands;
+    };
+
+    struct SharedObject {
+      SharedObject(const std::string &name, bool create);
+      ~SharedObject();
+
+      std::string name;
+      int         fd;
+      Segment*    segment;
+      bool        owner;
+      bool        reader;
+    };
+
+    std::shared_ptr<SharedObject> obj_;
+
+  public:
+    bool operator == (const ConsoleChannel &ref) const { return this->obj_ == ref.obj_; }
+    typedef std::shared_ptr<SharedObject> ConsoleChannel::*unspecified_bool_type;
+    operator unspecified_bool_type() const { return ( obj_.get() == 0 ) ? 0 : &ConsoleChannel::obj_; }
+    void reset() { obj_.reset(); }
+
+  };
+
+}
+
+#endif
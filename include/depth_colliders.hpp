@@ -0,0 +1,127 @@
+/*
+* @brief PhantomLimb depth stream to physics collider stage
+* @file depth_colliders.hpp
+* @author Benjamin Blundell <oni@section9.co.uk>
+* @date 19/10/2026
+*
+*/
+
+#ifndef PHANTOM_DEPTH_COLLIDERS_HPP
+#define PHANTOM_DEPTH_COLLIDERS_HPP
+
+#include "s9/common.hpp"
+
+#include "timing.hpp"
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+namespace s9 {
+
+  /// A raw depth image in millimetres, as read off the sensor
+  struct DepthFrame {
+    DepthFrame() : width(0), height(0), timestamp(0) {}
+    size_t                  width;
+    size_t                  height;
+    double_t                timestamp;
+    std::vector<uint16_t>   depth;
+  };
+
+  /// Settings for the voxeliser. Distances are in metres
+  struct DepthColliderSettings {
+    size_t    downsample;       // Take every Nth pixel in x and y
+    float_t   near_clip;        // The user mask - only depths inside this band are the player
+    float_t   far_clip;
+    float_t   voxel_size;
+    size_t    min_points;       // Voxels with fewer points than this are noise
+    size_t    max_spheres;      // Size of the kinematic sphere pool in the physics world
+    double_t  budget;           // Seconds allowed per frame on the worker
+    glm::vec3 sensor_position;  // Sensor in world space, facing back down +z at the player
+    glm::vec3 volume_min;       // World space volume we voxelise
+    glm::vec3 volume_max;
+    float_t   fov_h;            // Field of view of the depth camera in degrees
+    float_t   fov_v;
+  };
+
+  /**
+   * Turns the depth stream into a small set of sphere centres for the physics world.
+   * The sensor thread submits frames, a worker thread downsamples, masks and voxelises
+   * them within a fixed time budget, and the render thread picks up the latest result.
+   * All buffers are allocated once, up front.
+   */
+
+  class DepthColliders {
+
+  public:
+
+    DepthColliders() {}
+
+    DepthColliders(const DepthColliderSettings &settings);
+
+    void Start();
+
+    void Stop();
+
+    /// Sensor thread. Swaps the frame in, so the caller gets an old buffer back to reuse
+    void Submit(DepthFrame &frame);
+
+    /// Render thread. Never blocks - returns false if there is nothing new
+    bool Latest(std::vector<glm::vec3> &centres);
+
+    const DepthColliderSettings& settings() { CXSHARED return obj_->settings; }
+
+    size_t frames() { CXSHARED return obj_->frames.load(); }
+    size_t overruns() { CXSHARED return obj_->overruns.load(); }
+    double_t last_cost() { CXSHARED return obj_->last_cost.load(); }
+
+  private:
+
+    struct SharedObject {
+      SharedObject(const DepthColliderSettings &settings);
+      ~SharedObject();
+
+      void Run();
+      void Process();
+
+      DepthColliderSettings     settings;
+
+      // Voxel grid, sized once from the volume and voxel size
+      size_t                    grid_x, grid_y, grid_z;
+      std::vector<uint16_t>     counts;
+      std::vector<glm::vec3>    sums;
+      std::vector<uint32_t>     occupied;
+
+      DepthFrame                pending;
+      DepthFrame                working;
+      bool                      has_pending;
+
+      std::vector<glm::vec3>    result;
+      std::vector<glm::vec3>    published;
+      bool                      has_published;
+
+      std::mutex                frame_mutex;
+      std::mutex                result_mutex;
+      std::condition_variable   frame_ready;
+
+      std::thread               thread;
+      std::atomic<bool>         running;
+      std::atomic<size_t>       frames;
+      std::atomic<size_t>       overruns;
+      std::atomic<double_t>     last_cost;
+    };
+
+    std::shared_ptr<SharedObject> obj_;
+
+  public:
+    bool operator == (const DepthColliders &ref) const { return this->obj_ == ref.obj_; }
+    typedef std::shared_ptr<SharedObject> DepthColliders::*unspecified_bool_type;
+    operator unspecified_bool_type() const { return ( obj_.get() == 0 ) ? 0 : &DepthColliders::obj_; }
+    void reset() { obj_.reset(); }
+
+  };
+
+}
+
+#endif
@@ -0,0 +1,148 @@
+/*
+* @brief PhantomLimb frame pacing
+* @file frame_pacer.hpp
+* @author Benjamin Blundell <oni@section9.co.uk>
+* @date 19/10/2026
+*
+*/
+
+#ifndef PHANTOM_FRAME_PACER_HPP
+#define PHANTOM_FRAME_PACER_HPP
+
+#include "s9/common.hpp"
+
+#include "timing.hpp"
+
+#include <sstream>
+#include <thread>
+
+namespace s9 {
+
+  typedef enum {
+    FRAME_RENDER,     // Draw the scene and warp it
+    FRAME_REPROJECT   // Warp the last eye buffers again with a fresh head pose
+  }FrameType;
+
+  /**
+   * Fixed width bins over [low, high). Anything outside lands in the end bins
+   */
+
+  class Histogram {
+
+  public:
+
+    Histogram() : low_(0), high_(1), total_(0) {}
+    Histogram(double_t low, double_t high, size_t bins) : bins_(bins, 0), low_(low), high_(high), total_(0) {}
+
+    void Add(double_t value);
+    void Clear();
+
+    size_t total() const { return total_; }
+    double_t Percentile(double_t p) const;
+
+    /// One text row per bin, as wide as the bar is long
+    std::string Render(const std::string &units, size_t width) const;
+
+  private:
+    std::vector<size_t> bins_;
+    double_t low_, high_;
+    size_t total_;
+
+  };
+
+  struct FramePacerSettings {
+    double_t refresh;         // Hz
+    double_t margin;          // Seconds kept spare before the predicted vsync
+    double_t spin;            // The last stretch of a wait spins rather than sleeps
+    bool     half_rate;       // Allow dropping to half rate with reprojected frames in between
+    double_t recover;         // Seconds of headroom before going back to full rate
+  };
+
+  /**
+   * Works out when each vsync will land from when the swaps return, and holds the frame
+   * back until it only just has time to make the next one - so input is sampled and the
+   * scene drawn as late as it can be rather than a whole refresh early.
+   *
+   * When the frame no longer fits it drops to half rate. The scene is drawn every other
+   * refresh and the ones between only re-warp the last eye buffers to the latest head pose.
+   * Once there is room again for long enough it goes back to full rate.
+   *
+   * Frame times, missed refreshes and input to swap times are kept as histograms for the
+   * operator window.
+   */
+
+  class FramePacer {
+
+  public:
+
+    FramePacer() {}
+    FramePacer(const FramePacerSettings &settings);
+
+    /// Call on entering the frame - straight after the last swap returned. Sleeps until this
+    /// frame should start, then says what kind of frame it is
+    FrameType Wait();
+
+    /// The head pose the warp uses has just been read
+    void InputSampled();
+
+    /// All the work for this frame is issued and the swap is next
+    void Submitted();
+
+    bool half_rate() { CXSHARED return obj_->half_rate; }
+    double_t period() { CXSHARED return obj_->period; }
+    double_t slept() { CXSHARED return obj_->slept; }
+
+    /// The frame that just finished, for per frame telemetry
+    double_t last_interval() { CXSHARED return obj_->last_interval; }
+    size_t last_missed() { CXSHARED return obj_->last_missed; }
+    double_t last_input_to_swap() { CXSHARED return obj_->last_input_to_swap; }
+
+    /// Everything the operator window shows, since the last Clear
+    std::string Report();
+    void Clear();
+
+  private:
+
+    struct SharedObject {
+      FramePacerSettings settings;
+
+      double_t  period;
+      double_t  vsync;            // Phase locked estimate of the last vsync
+      double_t  last_swap;
+      double_t  start;            // When this frame's work began
+      double_t  input;
+      double_t  cost;             // Decaying peak of the work per scene frame
+      double_t  reproject_cost;   // and per reprojected one
+      double_t  slept;
+      double_t  headroom;         // How long the frame has fitted comfortably, at half rate
+      double_t  miss_window;
+      size_t    recent_misses;
+      size_t    frame;
+      bool      half_rate;
+      FrameType type;
+
+      double_t  last_interval;
+      size_t    last_missed;
+      double_t  last_input_to_swap;
+
+      Histogram   frame_times;
+      Histogram   missed;
+      Histogram   input_to_swap;
+      size_t      frames;
+      size_t      misses;
+      size_t      reprojected;
+    };
+
+    std::shared_ptr<SharedObject> obj_;
+
+  public:
+    bool operator == (const FramePacer &ref) const { return this->obj_ == ref.obj_; }
+    typedef std::shared_ptr<SharedObject> FramePacer::*unspecified_bool_type;
+    operator unspecified_bool_type() const { return ( obj_.get() == 0 ) ? 0 : &FramePacer::obj_; }
+    void reset() { obj_.reset(); }
+
+  };
+
+}
+
+#endif
@@ -0,0 +1,115 @@
+/*
+* @brief PhantomLimb head mounted display, real or simulated
+* @file headset.hpp
+* @author Benjamin Blundell <oni@section9.co.uk>
+* @date 19/10/2026
+*
+*/
+
+#ifndef PHANTOM_HEADSET_HPP
+#define PHANTOM_HEADSET_HPP
+
+#include "s9/common.hpp"
+#include "s9/oculus/oculus.hpp"
+
+namespace s9 {
+
+  /// Panel, lens and scripted head motion for the simulated headset. Defaults are a DK1
+  struct SimulatedHMDSettings {
+    bool      enabled;
+    glm::vec2 resolution;
+    glm::vec2 screen_size;          // Metres
+    float_t   eye_to_screen;        // Metres
+    float_t   lens_separation;      // Metres
+    float_t   ipd;                  // Metres
+    glm::vec4 distortion;           // Barrel warp k0 - k3
+    glm::vec4 chromatic;            // Red and blue scale coefficients
+
+    // The head turns in a Lissajous pattern so every frame sees a new orientation
+    float_t   yaw;                  // Degrees either side
+    float_t   pitch;                // Degrees either side
+    float_t   roll;                 // Degrees either side
+    double_t  period;               // Seconds for a full yaw sweep
+
+    SimulatedHMDSettings() : enabled(false), resolution(1280.0f, 800.0f), screen_size(0.14976f, 0.0936f),
+      eye_to_screen(0.041f), lens_separation(0.0635f), ipd(0.064f), distortion(1.0f, 0.22f, 0.24f, 0.0f),
+      chromatic(0.996f, -0.004f, 1.014f, 0.0f), yaw(30.0f), pitch(10.0f), roll(0.0f), period(8.0) {}
+  };
+
+  /**
+   * The display the app renders for. Forwards to the Rift when one is connected, and
+   * otherwise, if simulation is enabled, stands in for one with the same accessors. The
+   * simulated device derives its projections and warp parameters from the panel and lens
+   * geometry exactly as the SDK does, so the full stereo, FBO and warp path runs unchanged
+   * on any machine - including software Mesa - and its timings are comparable.
+   */
+
+  class Headset {
+
+  public:
+
+    Headset() {}
+
+    Headset(float_t near, float_t far, const SimulatedHMDSettings &settings);
+
+    void Update(double_t dt);
+    void ResetView();
+
+    /// True for a Rift, or for the simulator if it is standing in
+    bool Connected() { CXSHARED return obj_->simulated || obj_->oculus.Connected(); }
+    bool simulated() { CXSHARED return obj_->simulated; }
+
+    glm::vec2 fbo_size() { CXSHARED return obj_->simulated ? obj_->fbo_size : obj_->oculus.fbo_size(); }
+    glm::vec2 screen_resolution() { CXSHARED return obj_->simulated ? obj_->settings.resolution : obj_->oculus.screen_resolution(); }
+
+    glm::mat4 left_projection() { CXSHARED return obj_->simulated ? obj_->left_projection : obj_->oculus.left_projection(); }
+    glm::mat4 right_projection() { CXSHARED return obj_->simulated ? obj_->right_projection : obj_->oculus.right_projection(); }
+    glm::mat4 left_inter() { CXSHARED return obj_->simulated ? obj_->left_inter : obj_->oculus.left_inter(); }
+    glm::mat4 right_inter() { CXSHARED return obj_->simulated ? obj_->right_inter : obj_->oculus.right_inter(); }
+
+    /// The newest pose there is. Cheap enough to call again just before the warp pass
+    glm::quat orientation();
+
+    /// tan of half the field of view across and up each eye, for reprojection
+    glm::vec2 tan_half_fov();
+
+    float_t distortion_xcenter_offset() { CXSHARED return obj_->simulated ? obj_->xcenter_offset : obj_->oculus.distortion_xcenter_offset(); }
+    float_t distortion_scale() { CXSHARED return obj_->simulated ? obj_->distortion_scale : obj_->oculus.distortion_scale(); }
+    glm::vec4 distortion_parameters() { CXSHARED return obj_->simulated ? obj_->settings.distortion : obj_->oculus.distortion_parameters(); }
+    glm::vec4 chromatic_abberation() { CXSHARED return obj_->simulated ? obj_->settings.chromatic : obj_->oculus.chromatic_abberation(); }
+
+  private:
+
+    struct SharedObject {
+      SharedObject(float_t near, float_t far, const SimulatedHMDSettings &settings);
+
+      void Simulate(float_t near, float_t far);
+
+      oculus::OculusBase    oculus;
+      bool                  simulated;
+      SimulatedHMDSettings  settings;
+
+      glm::vec2             fbo_size;
+      glm::mat4             left_projection;
+      glm::mat4             right_projection;
+      glm::mat4             left_inter;
+      glm::mat4             right_inter;
+      float_t               xcenter_offset;
+      float_t               distortion_scale;
+
+      double_t              start;
+    };
+
+    std::shared_ptr<SharedObject> obj_;
+
+  public:
+    bool operator == (const Headset &ref) const { return this->obj_ == ref.obj_; }
+    typedef std::shared_ptr<SharedObject> Headset::*unspecified_bool_type;
+    operator unspecified_bool_type() const { return ( obj_.get() == 0 ) ? 0 : &Headset::obj_; }
+    void reset() { obj_.reset(); }
+
+  };
+
+}
+
+#endif
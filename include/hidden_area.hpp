@@ -0,0 +1,113 @@
+/*
+* @brief PhantomLimb hidden area mask for the eye buffers
+* @file hidden_area.hpp
+* @author Benjamin Blundell <oni@section9.co.uk>
+* @date 19/10/2026
+*
+*/
+
+#ifndef PHANTOM_HIDDEN_AREA_HPP
+#define PHANTOM_HIDDEN_AREA_HPP
+
+#include "s9/common.hpp"
+#include "s9/file.hpp"
+#include "s9/gl/common.hpp"
+
+namespace s9 {
+
+  /**
+   * The barrel warp only ever samples the part of each eye buffer inside the distorted lens
+   * outline - the corners are never seen. This builds that outline per eye from the same
+   * distortion and chromatic parameters barrel.frag uses, and writes a ring covering
+   * everything outside it into the depth buffer at the near plane, straight after the clear.
+   * The eye passes then fail the depth test there before any shading.
+   *
+   * To report what it saves, every probe_interval frames is drawn without the mask. Masked
+   * and unmasked frames are timed and their passing samples counted on the GPU separately.
+   * Samples are counted after the mask is written, so they are only the eye passes' own.
+   */
+
+  class HiddenAreaMask {
+
+  public:
+
+    static const size_t kQueries = 4;
+
+    HiddenAreaMask() {}
+
+    /// Margin widens the visible outline, leaving room for timewarp to look a little further out.
+    /// program is the linked hidden_area program, still owned by whoever built it
+    HiddenAreaMask(const glm::vec4 &distortion, const glm::vec4 &chromatic, float_t xcenter_offset,
+      float_t distortion_scale, float_t margin, size_t probe_interval, GLuint program);
+
+    /// Starts measuring the eye passes. Returns false on a probe frame, where the mask is skipped
+    bool Begin();
+
+    /// Write the mask into both halves of the bound framebuffer. Depth must already be clear
+    void Write(size_t width, size_t height);
+
+    void End();
+
+    /// Fraction of each eye buffer the mask covers
+    float_t coverage() { CXSHARED return obj_->coverage; }
+
+    /// Averages per frame since the last Clear. Times in seconds
+    double_t masked_time() { CXSHARED return obj_->totals[1].frames > 0 ? obj_->totals[1].time / obj_->totals[1].frames : 0; }
+    double_t unmasked_time() { CXSHARED return obj_->totals[0].frames > 0 ? obj_->totals[0].time / obj_->totals[0].frames : 0; }
+    double_t masked_samples() { CXSHARED return obj_->totals[1].frames > 0 ? obj_->totals[1].samples / obj_->totals[1].frames : 0; }
+    double_t unmasked_samples() { CXSHARED return obj_->totals[0].frames > 0 ? obj_->totals[0].samples / obj_->totals[0].frames : 0; }
+
+    void Clear();
+
+  private:
+
+    struct Query {
+      GLuint  time;
+      GLuint  samples;
+      bool    masked;
+      bool    pending;
+    };
+
+    struct Totals {
+      double_t  time;
+      double_t  samples;
+      size_t    frames;
+    };
+
+    struct SharedObject {
+      SharedObject(const glm::vec4 &distortion, const glm::vec4 &chromatic, float_t xcenter_offset,
+        float_t distortion_scale, float_t margin, size_t probe_interval, GLuint program);
+      ~SharedObject();
+
+      void Collect();
+      void CountSamples();
+
+      GLuint      program;
+      GLuint      vao;
+      GLuint      vbo;
+      GLsizei     ring_vertices;    // Per eye
+
+      float_t     coverage;
+      size_t      probe_interval;
+      size_t      frame;
+
+      Query       queries[kQueries];
+      size_t      current;
+      bool        active;
+      bool        counting;         // The samples query is open
+      Totals      totals[2];        // Unmasked, masked
+    };
+
+    std::shared_ptr<SharedObject> obj_;
+
+  public:
+    bool operator == (const HiddenAreaMask &ref) const { return this->obj_ == ref.obj_; }
+    typedef std::shared_ptr<SharedObject> HiddenAreaMask::*unspecified_bool_type;
+    operator unspecified_bool_type() const { return ( obj_.get() == 0 ) ? 0 : &HiddenAreaMask::obj_; }
+    void reset() { obj_.reset(); }
+
+  };
+
+}
+
+#endif
@@ -0,0 +1,89 @@
+/*
+* @brief PhantomLimb motion to photon latency measurement
+* @file latency.hpp
+* @author Benjamin Blundell <oni@section9.co.uk>
+* @date 19/10/2026
+*
+*/
+
+#ifndef PHANTOM_LATENCY_HPP
+#define PHANTOM_LATENCY_HPP
+
+#include "s9/common.hpp"
+#include "s9/gl/common.hpp"
+
+namespace s9 {
+
+  /**
+   * Measures, on the GPU clock, how old each head pose is by the time the warp pass that
+   * shows it has finished. Each frame records the GPU time at two moments: when the pose the
+   * eyes were rendered with was sampled, and when it was sampled again just before the warp.
+   * A timestamp query after the warp closes the frame. Results come back a few frames later
+   * and never stall. The vsync wait after the warp is not included, so both figures are a
+   * lower bound on motion to photon - what matters is the gap between them.
+   */
+
+  class LatencyProbe {
+
+  public:
+
+    static const size_t kSlots = 4;
+
+    LatencyProbe() {}
+
+    LatencyProbe(bool create);
+
+    /// The pose for the eye passes has just been read
+    void RenderSampled();
+
+    /// The pose has just been read again for the warp
+    void WarpSampled();
+
+    /// The warp has been submitted
+    void End();
+
+    /// Averages since the last Clear, in seconds
+    double_t render_latency() { CXSHARED return obj_->frames > 0 ? obj_->render_total / obj_->frames : 0; }
+    double_t warp_latency() { CXSHARED return obj_->frames > 0 ? obj_->warp_total / obj_->frames : 0; }
+    size_t frames() { CXSHARED return obj_->frames; }
+
+    void Clear() { CXSHARED obj_->render_total = obj_->warp_total = 0; obj_->frames = 0; }
+
+  private:
+
+    struct Slot {
+      GLuint    query;
+      GLint64   render_time;
+      GLint64   warp_time;
+      bool      pending;
+    };
+
+    struct SharedObject {
+      SharedObject();
+      ~SharedObject();
+
+      void Collect();
+
+      Slot      slots[kSlots];
+      size_t    current;
+      GLint64   render_time;  // This frame, until End hands it to a slot
+      GLint64   warp_time;
+
+      double_t  render_total;
+      double_t  warp_total;
+      size_t    frames;
+    };
+
+    std::shared_ptr<SharedObject> obj_;
+
+  public:
+    bool operator == (const LatencyProbe &ref) const { return this->obj_ == ref.obj_; }
+    typedef std::shared_ptr<SharedObject> LatencyProbe::*unspecified_bool_type;
+    operator unspecified_bool_type() const { return ( obj_.get() == 0 ) ? 0 : &LatencyProbe::obj_; }
+    void reset() { obj_.reset(); }
+
+  };
+
+}
+
+#endif
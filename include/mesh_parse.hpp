@@ -0,0 +1,144 @@
+/*
+* @brief PhantomLimb parallel OBJ and MD5 mesh parsing
+* @file mesh_parse.hpp
+* @author Benjamin Blundell <oni@section9.co.uk>
+* @date 19/10/2026
+*
+*/
+
+#ifndef PHANTOM_MESH_PARSE_HPP
+#define PHANTOM_MESH_PARSE_HPP
+
+#include "s9/common.hpp"
+
+#include "task_system.hpp"
+#include "timing.hpp"
+
+namespace s9 {
+
+  /**
+   * A whole file mapped read only. Empty if it could not be opened
+   */
+
+  class MappedFile {
+
+  public:
+
+    MappedFile() {}
+    MappedFile(const std::string &path);
+
+    const char* data() { CXSHARED return obj_->data; }
+    size_t size() { CXSHARED return obj_->size; }
+
+  private:
+
+    struct SharedObject {
+      SharedObject(const std::string &path);
+      ~SharedObject();
+
+      const char* data;
+      size_t      size;
+    };
+
+    std::shared_ptr<SharedObject> obj_;
+
+  public:
+    bool operator == (const MappedFile &ref) const { return this->obj_ == ref.obj_; }
+    typedef std::shared_ptr<SharedObject> MappedFile::*unspecified_bool_type;
+    operator unspecified_bool_type() const { return ( obj_.get() == 0 ) ? 0 : &MappedFile::obj_; }
+    void reset() { obj_.reset(); }
+
+  };
+
+  /// Parse a number at p, skipping blanks first. Ignores the locale and never allocates.
+  /// Returns where the number ended, or p if there was not one
+  const char* ParseFloat(const char *p, const char *end, float_t &value);
+  const char* ParseInt(const char *p, const char *end, int32_t &value);
+
+  /// An OBJ as one vertex per distinct position, texcoord and normal corner, and triangles.
+  /// Faces with more than three corners are fanned
+  struct ObjData {
+    std::vector<float_t>      vertices;     // Position xyz, texcoord uv, normal xyz
+    std::vector<uint32_t>     indices;
+    std::vector<std::string>  materials;    // usemtl names, and the first index each covers
+    std::vector<size_t>       material_starts;
+    size_t                    positions;    // Counts in the file
+    size_t                    texcoords;
+    size_t                    normals;
+  };
+
+  struct MD5MeshData {
+    struct Joint {
+      std::string name;
+      int32_t     parent;
+      float_t     position[3];
+      float_t     orientation[3];   // x, y, z. w is rebuilt
+    };
+
+    struct Mesh {
+      std::string           shader;
+      std::vector<float_t>  texcoords;      // uv per vertex
+      std::vector<uint32_t> weight_start;   // per vertex
+      std::vector<uint32_t> weight_count;
+      std::vector<uint32_t> indices;        // Triangles
+      std::vector<float_t>  weights;        // joint, bias, x, y, z per weight
+    };
+
+    std::vector<Joint>  joints;
+    std::vector<Mesh>   meshes;
+  };
+
+  /**
+   * Mesh loading off a mapped file. The file is cut into chunks at line ends, the chunks are
+   * parsed on the task system, and their results merged. A reference parser that reads the
+   * same files a line at a time through streams, as the Seburo loaders do, is kept for the
+   * benchmark and to check against.
+   *
+   * OBJ corners are deduplicated within a chunk, so a corner used on both sides of a chunk
+   * boundary ends up as two vertices.
+   */
+
+  class MeshParser {
+
+  public:
+
+    MeshParser() {}
+    MeshParser(TaskSystem &tasks, size_t chunk_size = 64 * 1024);
+
+    bool ParseObj(const std::string &path, ObjData &data);
+    bool ParseMD5Mesh(const std::string &path, MD5MeshData &data);
+
+    static bool ParseObjStream(const std::string &path, ObjData &data);
+    static bool ParseMD5MeshStream(const std::string &path, MD5MeshData &data);
+
+    /// Every OBJ and md5mesh under the directory, through both parsers, in MB/s. Each OBJ is
+    /// also checked against the reference with 1KB chunks, so indices cross many boundaries
+    void Benchmark(const std::string &directory);
+
+    /// Parse with both and compare the attributes at every triangle corner. Vertices are
+    /// compared through the indices, as the mapped parser splits those shared across chunks
+    bool CheckObj(const std::string &path);
+
+    /// Every OBJ and md5mesh under the directory
+    static std::vector<std::string> FindMeshes(const std::string &directory);
+
+  private:
+
+    struct SharedObject {
+      TaskSystem  tasks;
+      size_t      chunk_size;
+    };
+
+    std::shared_ptr<SharedObject> obj_;
+
+  public:
+    bool operator == (const MeshParser &ref) const { return this->obj_ == ref.obj_; }
+    typedef std::shared_ptr<SharedObject> MeshParser::*unspecified_bool_type;
+    operator unspecified_bool_type() const { return ( obj_.get() == 0 ) ? 0 : &MeshParser::obj_; }
+    void reset() { obj_.reset(); }
+
+  };
+
+}
+
+#endif
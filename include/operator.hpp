@@ -0,0 +1,78 @@
+/*
+* @brief PhantomLimb operator commands and telemetry
+* @file operator.hpp
+* @author Benjamin Blundell <oni@section9.co.uk>
+* @date 19/10/2026
+*
+*/
+
+#ifndef PHANTOM_OPERATOR_HPP
+#define PHANTOM_OPERATOR_HPP
+
+#include "s9/common.hpp"
+#include "s9/xml_parse.hpp"
+
+namespace s9 {
+
+  // Type for selecting which arms to use
+  typedef enum {
+    BOTH_ARMS,
+    LEFT_ARM_RIGHT_FROZEN,
+    RIGHT_ARM_LEFT_FROZEN,
+    LEFT_ARM_RIGHT_MIRROR,
+    RIGHT_ARM_LEFT_MIRROR,
+    LEFT_ARM_COPY,
+    RIGHT_ARM_COPY
+  }ArmState;
+
+  // Operator actions. The console queues them and the frame loop applies them
+  typedef enum {
+    COMMAND_FIRE_BALL,
+    COMMAND_RESET_PHYSICS,
+    COMMAND_TOGGLE_GAME,
+    COMMAND_RESTART_TRACKING,
+    COMMAND_RESET_VIEW,
+    COMMAND_SET_HANDED,
+    COMMAND_SETTINGS,
+    COMMAND_QUIT
+  }CommandType;
+
+  /// The game settings the operator can change while running. Published whole as a new
+  /// snapshot on every change, and never modified once published
+  struct GameSettings {
+    float_t fire_interval;
+    float_t width;
+    float_t speed_min;
+    float_t speed_factor;
+    float_t height_min;
+    float_t height_factor;
+    bool emphasis;
+
+    void Read(XMLSettings &settings);
+    void Write(XMLSettings &settings) const;
+  };
+
+  /// Everything here crosses between processes, so it is plain data only
+  struct Command {
+    CommandType   type;
+    ArmState      arm;          // COMMAND_SET_HANDED
+    GameSettings  settings;     // COMMAND_SETTINGS
+  };
+
+  /// One per headset frame, from the render process to the console
+  struct TelemetrySample {
+    double_t  time;
+    float_t   frame_time;       // Seconds between swaps
+    float_t   frame_cost;       // CPU seconds to issue the frame
+    float_t   input_to_swap;    // Seconds from the warp's head pose to the swap
+    uint32_t  missed;           // Refreshes missed before this frame
+    uint32_t  balls;
+    uint32_t  tracked;          // Bit per user slot
+    uint8_t   reprojected;
+    uint8_t   half_rate;
+    uint8_t   playing;
+  };
+
+}
+
+#endif
@@ -11,15 +11,86 @@
 
 #include "s9/common.hpp"
 
+#include "arena.hpp"
+#include "sphere_solver.hpp"
+#include "task_system.hpp"
+
 #include <LinearMath/btAlignedObjectArray.h>
 #include <btBulletDynamicsCommon.h>
 
+#ifdef BT_THREADSAFE
+#include <BulletDynamics/Dynamics/btDiscreteDynamicsWorldMt.h>
+#include <BulletDynamics/ConstraintSolver/btSequentialImpulseConstraintSolverMt.h>
+#include <BulletCollision/CollisionDispatch/btCollisionDispatcherMt.h>
+#else
+class btConstraintSolverPoolMt;
+#endif
+
+#include <atomic>
+#include <condition_variable>
+#include <memory>
 #include <mutex>
+#include <thread>
 
 namespace s9 {
 
+  // What simulates the balls
+  typedef enum {
+    PHYSICS_BULLET,
+    PHYSICS_SPHERES
+  }PhysicsBackend;
+
+  // Which broadphase the world uses
+  typedef enum {
+    BROADPHASE_DBVT,
+    BROADPHASE_AXIS_SWEEP
+  }BroadphaseType;
+
+  // What happened to each ball fired
+  typedef enum {
+    BALL_IN_FLIGHT,
+    BALL_HIT,
+    BALL_MISSED
+  }BallResult;
+
+  /**
+   * Tuning for the Bullet world. Defaults match the original hard coded setup.
+   * Normally filled in from the physics section of settings.xml
+   */
+
+  struct PhysicsProfile {
+    PhysicsProfile() : name("default"), backend(PHYSICS_BULLET), broadphase(BROADPHASE_DBVT),
+      world_min(-50.0f, -100.0f, -50.0f), world_max(50.0f, 50.0f, 50.0f),
+      solver_iterations(10), max_substeps(10), fixed_timestep(1.0 / 60.0),
+      linear_sleep(0.8f), angular_sleep(1.0f), deactivation_time(2.0f),
+      multithreaded(false), threads(0), ground_size(50.0f), log_interval(0),
+      ccd(true), hand_interpolation(true), max_balls(20), sphere_iterations(2) {}
+
+    std::string     name;
+    PhysicsBackend  backend;
+    BroadphaseType  broadphase;
+    glm::vec3       world_min;          // Bounds for the axis sweep broadphase
+    glm::vec3       world_max;
+    int             solver_iterations;
+    int             max_substeps;
+    double_t        fixed_timestep;
+    float_t         linear_sleep;       // Sleeping thresholds for the balls
+    float_t         angular_sleep;
+    float_t         deactivation_time;
+    bool            multithreaded;      // Needs Bullet built with BT_THREADSAFE
+    size_t          threads;            // 0 means let Bullet decide
+    float_t         ground_size;        // Half extent of the ground box
+    double_t        log_interval;       // Seconds between timing reports. 0 is off
+    bool            ccd;                // Swept sphere CCD on each ball
+    bool            hand_interpolation; // Sweep kinematic hands between sensor samples
+    size_t          max_balls;          // Firing past this many resets the world
+    size_t          sphere_iterations;  // Contact passes per substep for the sphere solver
+  };
+
   /**
-   * A class that deals with BulletPhysics to create a set of balls that the user can hit
+   * A class that deals with BulletPhysics to create a set of balls that the user can hit.
+   * With the spheres backend the same interface drives a SphereSolver instead, which only
+   * knows balls, kinematic spheres and the ground, but keeps up with thousands of balls
    */
 
   class PhantomPhysics  {
@@ -28,50 +99,165 @@ namespace s9 {
 
     PhantomPhysics() {}
 
-    PhantomPhysics(float_t gravity, float_t hand_radius);
+    /// tasks spreads the sphere solver's contact passes. Bullet has its own scheduler
+    PhantomPhysics(float_t gravity, float_t hand_radius, size_t num_users = 1, size_t proxy_count = 0, float_t proxy_radius = 0.0f,
+      const PhysicsProfile &profile = PhysicsProfile(), TaskSystem tasks = TaskSystem());
 
+    /// Ask for a fresh world. Returns at once - the new world is built on another thread
+    /// and swapped in at the start of the next Update
     void Reset();
 
     void Update(double dt);
 
     void AddBall (float_t radius, glm::vec3 pos, glm::vec3 velocity);
 
-    void MoveLeftHand(glm::vec3 pos);
+    void MoveLeftHand(glm::vec3 pos, size_t user = 0);
+
+    void MoveRightHand(glm::vec3 pos, size_t user = 0);
 
-    void MoveRightHand(glm::vec3 pos);
+    void ParkHands(size_t user);
+
+    void SetDepthProxies(const std::vector<glm::vec3> &centres);
 
     std::vector<glm::mat4>& ball_orients () { CXSHARED return obj_->ball_orients; }
 
+    /// Rain 20, 1000 and 10000 balls onto the ground through each backend and print the mean
+    /// step time and ball steps per second
+    static void Benchmark(float_t gravity, float_t hand_radius, const PhysicsProfile &profile, TaskSystem tasks);
+
+    /// Run one Bullet world for ten minutes of game time and report how far its arena grew,
+    /// then fill it with balls and reset it, over and over, printing resident memory as it
+    /// goes. Both should stay flat once warmed up
+    static void Soak(float_t gravity, float_t hand_radius, const PhysicsProfile &profile, size_t resets);
+
 
   private:
 
+    struct SharedObject;
+
+    /**
+     * One complete Bullet world. Everything it allocates is owned here and released in
+     * the destructor, so a World can be built and thrown away on any thread.
+     * All Bullet memory for the world comes from its own arena, which goes in one release.
+     */
+
+    struct World {
+      World(const SharedObject &config);
+      ~World();
+
+      btRigidBody* CreateBody(btCollisionShape *shape, btScalar mass, const btTransform &start, const btVector3 &inertia);
+
+      void MoveHand(size_t idx, glm::vec3 pos, bool snap = false);
+      void ScoreBalls(SharedObject &owner);
+
+      static void PreTick(btDynamicsWorld *world, btScalar time_step);
+
+      // Where an interpolated hand is heading and how far along it is
+      struct HandTrack {
+        btVector3 from;
+        btVector3 to;
+        double_t  elapsed;
+        double_t  duration;
+        double_t  last_change;
+      };
+
+      // First, so it outlives everything allocated from it
+      Arena arena;
+
+      const PhysicsProfile &profile;
+
+      // Declared in construction order, so they are destroyed in reverse - bodies go first,
+      // the configuration last
+      std::unique_ptr<btDefaultCollisionConfiguration>  collision_configuration;
+      std::unique_ptr<btCollisionDispatcher>            dispatcher;
+      std::unique_ptr<btBroadphaseInterface>            broadphase;
+      std::unique_ptr<btConstraintSolver>               solver;
+      std::unique_ptr<btConstraintSolver>               solver_pool;
+      std::unique_ptr<btDiscreteDynamicsWorld>          dynamics_world;
+
+      std::vector< std::unique_ptr<btCollisionShape> >  collision_shapes;
+      std::vector< std::unique_ptr<btMotionState> >     motion_states;
+      std::vector< std::unique_ptr<btRigidBody> >       bodies;
+
+      // Views onto bodies, by role
+      std::vector<btRigidBody*>   balls;
+      std::vector<BallResult>     ball_results;
+
+      // Kinematic hand spheres, two per user - left then right
+      std::vector<btRigidBody*>   hands;
+      std::vector<HandTrack>      hand_tracks;
+
+      // Kinematic spheres driven by the depth stream. Created once per world and parked when unused
+      std::vector<btRigidBody*>   depth_proxies;
+
+      // Every ball of the same size shares one sphere
+      btCollisionShape*           ball_shape;
+      float_t                     ball_radius;
+
+      btRigidBody*                ground;
+      double_t                    sim_time;
+    };
+
     struct SharedObject {
-      SharedObject(float_t gravity, float_t hand_radius);
+      SharedObject(float_t gravity, float_t hand_radius, size_t num_users, size_t proxy_count, float_t proxy_radius,
+        const PhysicsProfile &profile, TaskSystem tasks);
       ~SharedObject();
 
-      void InitPhysics();
-      void ExitPhysics();
+      void RunBuilder();
+      void SwapPendingWorld();
+      void LogTiming(double_t step_time, size_t frame_allocs, size_t frame_bytes);
+      void ScoreSpheres();
 
+      // Fixed for the life of the object, so the builder thread may read them freely
+      PhysicsProfile profile;
       btVector3 gravity_vector;
-       //keep the collision shapes, for deletion/cleanup
-      btAlignedObjectArray<btCollisionShape*>   collision_shapes;
-      btAlignedObjectArray<btRigidBody*>        balls;
-      btBroadphaseInterface*                    broadphase;
-      btCollisionDispatcher*                    dispatcher;
-      btConstraintSolver*                       solver;
-      btDefaultCollisionConfiguration*          collision_configuration;
-      btDiscreteDynamicsWorld*                  dynamics_world;
+      float_t   hand_radius;
+      size_t    num_users;
+      size_t    proxy_count;
+      float_t   proxy_radius;
 
-      btRigidBody *left_hand, *right_hand, *ground;
+      // The live world. Only touched by the thread calling Update, under update_mutex.
+      // Empty with the spheres backend
+      std::unique_ptr<World> world;
 
-      float_t  hand_radius;
+      // The spheres backend. A reset is cheap, so it happens at the next Update
+      SphereSolver              spheres;
+      std::vector<BallResult>   sphere_results;
+      std::atomic<bool>         spheres_reset;
 
       std::vector<glm::mat4> ball_orients;
 
-      bool running_ = false;
+      // Reset builds the replacement world here and Update swaps it in between steps.
+      // The world it replaces goes back to the builder to be destroyed
+      std::thread               builder;
+      std::mutex                builder_mutex;
+      std::condition_variable   builder_wake;
+      bool                      builder_running;
+      bool                      build_requested;
+      std::atomic<World*>       pending_world;
+      std::atomic<World*>       retired_world;
+      std::atomic<bool>         reset_in_flight;
 
       std::mutex update_mutex;
 
+      // Step timing, reset every log_interval
+      double_t  timing_start;
+      double_t  timing_total;
+      double_t  timing_max;
+      size_t    timing_steps;
+
+      // Bullet allocations made during Update. Should sit at zero once a world has warmed up
+      size_t    alloc_total;
+      size_t    alloc_max;
+      size_t    alloc_bytes;
+      size_t    arena_reserved;   // At the last log, 0 for a world not yet logged
+
+      // Hit and miss tally for the session. Survives a Reset
+      size_t    stats_fired;
+      size_t    stats_hits;
+      size_t    stats_misses;
+      size_t    stats_resets;
+
     };
    
     std::shared_ptr<SharedObject> obj_;
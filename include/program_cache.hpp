@@ -0,0 +1,108 @@
+/*
+* @brief PhantomLimb program binary cache and parallel program builds
+* @file program_cache.hpp
+* @author Benjamin Blundell <oni@section9.co.uk>
+* @date 19/10/2026
+*
+*/
+
+#ifndef PHANTOM_PROGRAM_CACHE_HPP
+#define PHANTOM_PROGRAM_CACHE_HPP
+
+#include "s9/common.hpp"
+#include "s9/gl/common.hpp"
+
+#include "timing.hpp"
+
+namespace s9 {
+
+  /**
+   * Builds a set of GL programs together. Every program is queued first, then Build issues
+   * all the compiles and links at once without asking after any of them, so a driver with
+   * KHR_parallel_shader_compile works on them across its own threads while we carry on
+   * loading. A program is only waited on when first asked for.
+   *
+   * Linked programs are saved with glGetProgramBinary, keyed on a hash of their sources and
+   * the GL vendor, renderer and version, and loaded from there on the next launch. A binary
+   * the driver refuses is thrown away and the program compiled from source as normal.
+   *
+   * The cache owns the programs. Must be made and used on the GL thread.
+   */
+
+  class ProgramCache {
+
+  public:
+
+    ProgramCache() {}
+
+    /// directory holds the binaries. Empty turns the binary cache off
+    ProgramCache(const std::string &directory);
+
+    /// Queue a program. Geometry is optional. Nothing happens until Build
+    size_t Add(const std::string &name, const std::string &vertex, const std::string &fragment,
+      const std::string &geometry = "");
+
+    /// Start every queued program, from a binary where one matches. Does not wait
+    void Build();
+
+    /// The linked program, waiting for it if need be. 0 if it failed
+    GLuint program(size_t i);
+
+    /// Whether the program came out of the binary cache
+    bool cached(size_t i) { CXSHARED return obj_->programs[i].cached; }
+
+    /// Wait for everything, then print how long each took and whether the start was cold or warm.
+    /// Call it once the first frame is out, or it forces every wait itself
+    void Report();
+
+  private:
+
+    typedef enum {
+      PROGRAM_QUEUED,
+      PROGRAM_BUILDING,
+      PROGRAM_READY,
+      PROGRAM_FAILED
+    }ProgramState;
+
+    struct Program {
+      std::string   name;
+      std::string   paths[3];       // Vertex, fragment, geometry
+      std::string   sources[3];
+      uint64_t      key;
+      GLuint        program;
+      GLuint        shaders[3];
+      ProgramState  state;
+      bool          cached;
+      double_t      ready;          // Seconds from Build
+    };
+
+    struct SharedObject {
+      ~SharedObject();
+
+      std::string           directory;
+      std::string           driver;
+      bool                  binaries;
+      bool                  parallel;
+      double_t              build_start;
+      double_t              issue_time;
+      std::vector<Program>  programs;
+    };
+
+    bool LoadBinary(Program &p);
+    void SaveBinary(Program &p);
+    void Compile(Program &p);
+    void Finish(Program &p);
+
+    std::shared_ptr<SharedObject> obj_;
+
+  public:
+    bool operator == (const ProgramCache &ref) const { return this->obj_ == ref.obj_; }
+    typedef std::shared_ptr<SharedObject> ProgramCache::*unspecified_bool_type;
+    operator unspecified_bool_type() const { return ( obj_.get() == 0 ) ? 0 : &ProgramCache::obj_; }
+    void reset() { obj_.reset(); }
+
+  };
+
+}
+
+#endif
@@ -0,0 +1,110 @@
+/*
+* @brief PhantomLimb state sorted render queue
+* @file render_queue.hpp
+* @author Benjamin Blundell <oni@section9.co.uk>
+* @date 19/10/2026
+*
+*/
+
+#ifndef PHANTOM_RENDER_QUEUE_HPP
+#define PHANTOM_RENDER_QUEUE_HPP
+
+#include "s9/common.hpp"
+
+#include <functional>
+
+namespace s9 {
+
+  /// Bits 63-62 pass, 61-54 program, 53-42 material, 41-30 mesh, 29-0 depth front to back.
+  /// Pass sorts first, so each eye is bound once and its draws are grouped by program within it
+  inline uint64_t RenderKey(uint8_t program, uint16_t material, uint16_t mesh, uint8_t pass, float_t depth) {
+    float_t d = depth < 0.0f ? 0.0f : (depth > 1.0f ? 1.0f : depth);
+    return (static_cast<uint64_t>(pass & 0x3) << 62)
+      | (static_cast<uint64_t>(program) << 54)
+      | (static_cast<uint64_t>(material & 0xfff) << 42)
+      | (static_cast<uint64_t>(mesh & 0xfff) << 30)
+      | static_cast<uint64_t>(d * 0x3fffffff);
+  }
+
+  /**
+   * Flattens what the app draws into small packets each frame, sorts them by a 64 bit state
+   * key and submits them in that order. A pass is only bound when it changes, and within a
+   * pass the same program and material are drawn back to back. Each item still binds its own
+   * program, so only pass binds are actually saved.
+   * Items are registered once - a draw function plus the state it needs - and each frame only
+   * submits packets that refer to them. The sort is an LSD radix sort over the key bytes that
+   * actually differ. Render thread only.
+   */
+
+  class RenderQueue {
+
+  public:
+
+    typedef std::function<void()> DrawFunc;
+    typedef std::function<void(uint8_t)> PassFunc;
+
+    RenderQueue() {}
+
+    /// Switching pass - an eye, say - goes through this
+    RenderQueue(PassFunc bind_pass);
+
+    /// Program and material are small ids the caller assigns. Packets with the same ids are
+    /// assumed to share that state
+    uint32_t Register(uint8_t program, uint16_t material, uint16_t mesh, DrawFunc draw);
+
+    /// Depth is 0 to 1, nearest first
+    void Submit(uint32_t item, uint8_t pass, float_t depth = 0.0f);
+
+    /// Sort and draw everything submitted since the last Flush
+    void Flush();
+
+    /// Last frame
+    size_t draws() { CXSHARED return obj_->draws; }
+    size_t pass_binds() { CXSHARED return obj_->pass_binds; }
+
+    /// Last frame, had the packets been drawn in the order they were submitted
+    size_t unsorted_pass_binds() { CXSHARED return obj_->unsorted_pass_binds; }
+
+  private:
+
+    struct Packet {
+      uint64_t  key;
+      uint32_t  item;
+    };
+
+    struct Item {
+      uint8_t   program;
+      uint16_t  material;
+      uint16_t  mesh;
+      DrawFunc  draw;
+    };
+
+    struct SharedObject {
+      SharedObject(PassFunc bind_pass) : bind_pass(bind_pass), draws(0), pass_binds(0),
+        unsorted_pass_binds(0) {}
+
+      void Sort();
+
+      PassFunc              bind_pass;
+      std::vector<Item>     items;
+      std::vector<Packet>   packets;
+      std::vector<Packet>   scratch;
+
+      size_t                draws;
+      size_t                pass_binds;
+      size_t                unsorted_pass_binds;
+    };
+
+    std::shared_ptr<SharedObject> obj_;
+
+  public:
+    bool operator == (const RenderQueue &ref) const { return this->obj_ == ref.obj_; }
+    typedef std::shared_ptr<SharedObject> RenderQueue::*unspecified_bool_type;
+    operator unspecified_bool_type() const { return ( obj_.get() == 0 ) ? 0 : &RenderQueue::obj_; }
+    void reset() { obj_.reset(); }
+
+  };
+
+}
+
+#endif
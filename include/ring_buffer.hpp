@@ -0,0 +1,171 @@
+/*
+* @brief Bounded lock-free ring buffers
+* @file ring_buffer.hpp
+* @author Benjamin Blundell <oni@section9.co.uk>
+* @date 19/10/2026
+*
+*/
+
+#ifndef PHANTOM_RING_BUFFER_HPP
+#define PHANTOM_RING_BUFFER_HPP
+
+#include "s9/common.hpp"
+
+#include <atomic>
+#include <cstddef>
+
+namespace s9 {
+
+  /**
+   * A fixed size single-producer / single-consumer queue. Neither side ever blocks
+   * or locks. Push fails when full, Pop fails when empty. N must be a power of two.
+   *
+   * For data where only the latest matters, PushOverwrite makes room by discarding the
+   * oldest entry instead. The producer then moves the tail too, so Pop copies a slot out
+   * before claiming it, and says which slot it is copying so the producer never writes
+   * over it mid copy.
+   */
+
+  template<typename T, size_t N>
+  class SPSCRingBuffer {
+    static_assert( N > 0 && (N & (N - 1)) == 0, "SPSCRingBuffer size must be a power of two");
+
+  public:
+    SPSCRingBuffer() : head_(0), tail_(0), reading_(0) {}
+
+    /// Called only from the producer thread
+    bool Push(const T &value) {
+      size_t head = head_.load(std::memory_order_relaxed);
+      if (head - tail_.load(std::memory_order_acquire) == N)
+        return false;
+      buffer_[head & (N - 1)] = value;
+      head_.store(head + 1, std::memory_order_release);
+      return true;
+    }
+
+    /// Called only from the producer thread. Never fails for want of room. Returns false if
+    /// anything was lost - normally the oldest entry, or the new one in the rare case the
+    /// consumer is copying out of the very slot it would go in
+    bool PushOverwrite(const T &value) {
+      size_t head = head_.load(std::memory_order_relaxed);
+      size_t tail = tail_.load();
+      bool kept = true;
+
+      // Either we discard the oldest or the consumer has just taken it. Both leave room
+      if (head - tail == N && tail_.compare_exchange_strong(tail, tail + 1))
+        kept = false;
+
+      size_t reading = reading_.load();
+      if (reading != 0 && reading == head - N + 1)
+        return false;
+
+      buffer_[head & (N - 1)] = value;
+      head_.store(head + 1, std::memory_order_release);
+      return kept;
+    }
+
+    /// Called only from the consumer thread
+    bool Pop(T &value) {
+      size_t tail = tail_.load();
+      for (;;) {
+        if (tail == head_.load(std::memory_order_acquire))
+          return false;
+
+        // Once reading_ is up, either the producer sees it or we see the tail it moved
+        reading_.store(tail + 1);
+        if (tail_.load() == tail) {
+          value = buffer_[tail & (N - 1)];
+          if (tail_.compare_exchange_strong(tail, tail + 1))
+            break;
+        } else {
+          tail = tail_.load();
+        }
+      }
+      reading_.store(0, std::memory_order_release);
+      return true;
+    }
+
+    /// Approximate when called while the other side is running
+    size_t size() const { return head_.load(std::memory_order_acquire) - tail_.load(std::memory_order_acquire); }
+    bool empty() const { return size() == 0; }
+    size_t capacity() const { return N; }
+
+  private:
+    // Keep the two indices on separate cache lines so producer and consumer dont fight
+    alignas(64) std::atomic<size_t> head_;
+    alignas(64) std::atomic<size_t> tail_;
+    std::atomic<size_t> reading_;         // One past the index Pop is copying, 0 when idle
+    alignas(64) T buffer_[N];
+
+  };
+
+  /**
+   * A fixed size multi-producer / single-consumer queue. Each slot carries a sequence
+   * number, so producers claim a slot with one compare and swap on the head and publish it
+   * by bumping its sequence - no locks on either side. Push fails when full, Pop fails when
+   * empty or when the oldest slot is claimed but not yet written. N must be a power of two.
+   */
+
+  template<typename T, size_t N>
+  class MPSCRingBuffer {
+    static_assert( N > 0 && (N & (N - 1)) == 0, "MPSCRingBuffer size must be a power of two");
+
+  public:
+    MPSCRingBuffer() : head_(0), tail_(0) {
+      for (size_t i = 0; i < N; ++i)
+        slots_[i].sequence.store(i, std::memory_order_relaxed);
+    }
+
+    /// Safe from any number of threads at once
+    bool Push(const T &value) {
+      size_t head = head_.load(std::memory_order_relaxed);
+      for (;;) {
+        Slot &slot = slots_[head & (N - 1)];
+        size_t sequence = slot.sequence.load(std::memory_order_acquire);
+        std::ptrdiff_t diff = static_cast<std::ptrdiff_t>(sequence) - static_cast<std::ptrdiff_t>(head);
+
+        if (diff == 0) {
+          if (head_.compare_exchange_weak(head, head + 1, std::memory_order_relaxed)) {
+            slot.value = value;
+            slot.sequence.store(head + 1, std::memory_order_release);
+            return true;
+          }
+        } else if (diff < 0) {
+          return false;
+        } else {
+          head = head_.load(std::memory_order_relaxed);
+        }
+      }
+    }
+
+    /// Called only from the consumer thread. The slot gives up its copy, so nothing it holds
+    /// lingers in the queue
+    bool Pop(T &value) {
+      size_t tail = tail_.load(std::memory_order_relaxed);
+      Slot &slot = slots_[tail & (N - 1)];
+      if (slot.sequence.load(std::memory_order_acquire) != tail + 1)
+        return false;
+      value = slot.value;
+      slot.value = T();
+      slot.sequence.store(tail + N, std::memory_order_release);
+      tail_.store(tail + 1, std::memory_order_relaxed);
+      return true;
+    }
+
+    size_t capacity() const { return N; }
+
+  private:
+    struct Slot {
+      std::atomic<size_t> sequence;
+      T value;
+    };
+
+    alignas(64) std::atomic<size_t> head_;
+    alignas(64) std::atomic<size_t> tail_;
+    alignas(64) Slot slots_[N];
+
+  };
+
+}
+
+#endif
@@ -0,0 +1,134 @@
+/*
+* @brief PhantomLimb Sensor Ingestion Header
+* @file sensor.hpp
+* @author Benjamin Blundell <oni@section9.co.uk>
+* @date 19/10/2026
+*
+*/
+
+#ifndef PHANTOM_SENSOR_HPP
+#define PHANTOM_SENSOR_HPP
+
+#include "s9/common.hpp"
+#include "s9/openni/openni.hpp"
+
+#include "ring_buffer.hpp"
+#include "depth_colliders.hpp"
+#include "camera_feed.hpp"
+#include "accumulator.hpp"
+#include "timing.hpp"
+
+#include <atomic>
+#include <thread>
+
+namespace s9 {
+
+  // The tracked joints we actually retarget onto the model
+  typedef enum {
+    LEFT_SHOULDER,
+    LEFT_ELBOW,
+    RIGHT_SHOULDER,
+    RIGHT_ELBOW,
+    JOINT_COUNT
+  }TrackedJoint;
+
+  /// A single timestamped pose for one user, copied out of OpenNI on the sensor thread
+  struct SkeletonSample {
+    double_t  timestamp;
+    uint32_t  slot;         // Which of our users this is
+    uint32_t  user_id;      // NiTE's ID for them, 0 while the slot is free
+    bool      tracked;
+    glm::quat joints[JOINT_COUNT];
+  };
+
+  /**
+   * Polls OpenNI and the skeleton tracker on its own thread so a stalled sensor never
+   * stalls a headset frame. Samples are handed to the render thread through a lock-free
+   * queue, one sample per user slot per poll. NiTE gives a user a new ID each time it finds
+   * them again, so IDs are mapped onto slots as users come and go. Poses only matter while
+   * they are fresh, so if the render thread falls behind the oldest samples give way to the
+   * newest. Start and Stop may be called from the main thread only.
+   */
+
+  class SensorIngest {
+
+  public:
+
+    static const size_t kQueueSize = 64;
+
+    SensorIngest() {}
+
+    SensorIngest(oni::OpenNIBase &openni, oni::OpenNISkeleton &tracker, double_t poll_rate, size_t max_users = 1);
+
+    void Start();
+
+    void Stop();
+
+    /// Hand every depth frame on to the collider stage. Call before Start
+    void set_depth_colliders(DepthColliders &colliders) { CXSHARED obj_->depth_colliders = colliders; }
+
+    /// Stream the raw depth and colour images out for display. Call before Start
+    void set_depth_feed(CameraFeed &feed) { CXSHARED obj_->depth_feed = feed; }
+    void set_colour_feed(CameraFeed &feed) { CXSHARED obj_->colour_feed = feed; }
+
+    /// Smooth the depth on this thread before anyone sees it, if it is a CPU accumulator.
+    /// Either kind is fed the largest joint turn between polls, in degrees, as its motion
+    void set_depth_accumulator(Accumulator &accumulator) { CXSHARED obj_->depth_accumulator = accumulator; }
+
+    /// The tracker belongs to the sensor thread, so this only asks. It restarts between polls
+    void RestartTracking() { CXSHARED obj_->restart_requested.store(true); }
+
+    /// Drain one sample. Render thread only
+    bool Pop(SkeletonSample &sample) { CXSHARED return obj_->queue.Pop(sample); }
+
+    bool running() { CXSHARED return obj_->running.load(); }
+    size_t dropped() { CXSHARED return obj_->dropped.load(); }
+    size_t polled() { CXSHARED return obj_->polled.load(); }
+
+  private:
+
+    struct SharedObject {
+      SharedObject(oni::OpenNIBase &openni, oni::OpenNISkeleton &tracker, double_t poll_rate, size_t max_users);
+      ~SharedObject();
+
+      void Run();
+      void AssignSlots();
+      void CaptureImages();
+      void CaptureDepth(openni::VideoFrameRef &frame);
+
+      oni::OpenNIBase         openni;
+      oni::OpenNISkeleton     tracker;
+      double_t                poll_interval;
+      size_t                  max_users;
+      std::vector<uint32_t>   slot_users;       // NiTE ID in each slot, 0 if free
+      std::vector<SkeletonSample> previous;     // Last poll, per slot, for the motion hook
+
+      std::thread             thread;
+      std::atomic<bool>       running;
+      std::atomic<bool>       restart_requested;
+      std::atomic<size_t>     dropped;
+      std::atomic<size_t>     polled;
+
+      SPSCRingBuffer<SkeletonSample, kQueueSize> queue;
+
+      DepthColliders          depth_colliders;
+      DepthFrame              depth_frame;
+
+      CameraFeed              depth_feed;
+      CameraFeed              colour_feed;
+      Accumulator             depth_accumulator;
+    };
+
+    std::shared_ptr<SharedObject> obj_;
+
+  public:
+    bool operator == (const SensorIngest &ref) const { return this->obj_ == ref.obj_; }
+    typedef std::shared_ptr<SharedObject> SensorIngest::*unspecified_bool_type;
+    operator unspecified_bool_type() const { return ( obj_.get() == 0 ) ? 0 : &SensorIngest::obj_; }
+    void reset() { obj_.reset(); }
+
+  };
+
+}
+
+#endif
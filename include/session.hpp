@@ -0,0 +1,125 @@
+/*
+* @brief PhantomLimb session recording and replay
+* @file session.hpp
+* @author Benjamin Blundell <oni@section9.co.uk>
+* @date 19/10/2026
+*
+*/
+
+#ifndef PHANTOM_SESSION_HPP
+#define PHANTOM_SESSION_HPP
+
+#include "s9/common.hpp"
+
+#include "sensor.hpp"
+#include "operator.hpp"
+
+#include <fstream>
+
+namespace s9 {
+
+  // What each record in a session file holds
+  typedef enum {
+    SESSION_SAMPLE = 1,
+    SESSION_BALL = 2,
+    SESSION_COMMAND = 3
+  }SessionEventType;
+
+  /// A ball as it was fired
+  struct BallEvent {
+    float_t   radius;
+    glm::vec3 position;
+    glm::vec3 velocity;
+  };
+
+  struct SessionEvent {
+    SessionEventType  type;
+    double_t          time;     // Seconds since the recording started
+    SkeletonSample    sample;
+    BallEvent         ball;
+    Command           command;  // Only the type and arm are kept
+  };
+
+  /**
+   * Writes every skeleton sample, every ball fired and the operator commands that change the
+   * simulation to a file, so the session can be replayed later without the sensor. Main
+   * thread only.
+   */
+
+  class SessionRecorder {
+
+  public:
+
+    SessionRecorder() {}
+
+    SessionRecorder(const std::string &path);
+
+    void Record(const SkeletonSample &sample);
+    void Record(const BallEvent &ball);
+    void Record(const Command &command);
+
+    size_t events() { CXSHARED return obj_->events; }
+
+  private:
+
+    struct SharedObject {
+      SharedObject(const std::string &path);
+
+      void WriteHeader(SessionEventType type, double_t time);
+
+      std::ofstream   file;
+      double_t        start;
+      size_t          events;
+    };
+
+    std::shared_ptr<SharedObject> obj_;
+
+  public:
+    bool operator == (const SessionRecorder &ref) const { return this->obj_ == ref.obj_; }
+    typedef std::shared_ptr<SharedObject> SessionRecorder::*unspecified_bool_type;
+    operator unspecified_bool_type() const { return ( obj_.get() == 0 ) ? 0 : &SessionRecorder::obj_; }
+    void reset() { obj_.reset(); }
+
+  };
+
+  /**
+   * Loads a recorded session and hands its events back in order as replay time moves on
+   */
+
+  class SessionPlayer {
+
+  public:
+
+    SessionPlayer() {}
+
+    SessionPlayer(const std::string &path);
+
+    /// Every event up to and including this time that has not been handed out yet
+    void Advance(double_t time, std::vector<SessionEvent> &events);
+
+    bool loaded() { CXSHARED return !obj_->events.empty(); }
+    bool finished() { CXSHARED return obj_->next >= obj_->events.size(); }
+    double_t duration() { CXSHARED return obj_->events.empty() ? 0 : obj_->events.back().time; }
+
+  private:
+
+    struct SharedObject {
+      SharedObject(const std::string &path);
+
+      std::vector<SessionEvent> events;
+      size_t                    next;
+    };
+
+    std::shared_ptr<SharedObject> obj_;
+
+  public:
+    bool operator == (const SessionPlayer &ref) const { return this->obj_ == ref.obj_; }
+    typedef std::shared_ptr<SharedObject> SessionPlayer::*unspecified_bool_type;
+    operator unspecified_bool_type() const { return ( obj_.get() == 0 ) ? 0 : &SessionPlayer::obj_; }
+    void reset() { obj_.reset(); }
+
+  };
+
+}
+
+#endif
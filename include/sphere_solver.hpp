@@ -0,0 +1,139 @@
+/*
+* @brief PhantomLimb structure of arrays sphere solver
+* @file sphere_solver.hpp
+* @author Benjamin Blundell <oni@section9.co.uk>
+* @date 19/10/2026
+*
+*/
+
+#ifndef PHANTOM_SPHERE_SOLVER_HPP
+#define PHANTOM_SPHERE_SOLVER_HPP
+
+#include "s9/common.hpp"
+
+#include "task_system.hpp"
+
+namespace s9 {
+
+  struct SphereSolverSettings {
+    SphereSolverSettings() : gravity(0.0f, -9.8f, 0.0f), fixed_timestep(1.0 / 60.0), max_substeps(10),
+      iterations(2), restitution(0.2f), friction(0.5f), ground_size(50.0f), hand_interpolation(true) {}
+
+    glm::vec3   gravity;
+    double_t    fixed_timestep;
+    int         max_substeps;
+    size_t      iterations;         // Contact passes per substep
+    float_t     restitution;
+    float_t     friction;           // Fraction of sliding speed lost per second on the ground
+    float_t     ground_size;        // Half extent of the ground box, whose top sits at y = 0
+    bool        hand_interpolation;
+  };
+
+  /**
+   * Just enough physics for the game - dynamic spheres against a ground box and a handful
+   * of kinematic spheres for the hands and depth proxies - without a general rigid body
+   * world. Balls are kept structure of arrays and integrated four at a time with SSE.
+   *
+   * Each substep bins every sphere into a hashed uniform grid, then resolves contacts as a
+   * few Jacobi passes. Every ball only ever writes its own correction, so the passes split
+   * across the task system in ranges with no locking. Balls do not spin, so their
+   * transforms are translations.
+   */
+
+  class SphereSolver {
+
+  public:
+
+    SphereSolver() {}
+
+    /// Kinematic spheres are numbered hands first, then proxies
+    SphereSolver(float_t hand_radius, size_t hands, float_t proxy_radius, size_t proxies,
+      const SphereSolverSettings &settings = SphereSolverSettings(), TaskSystem tasks = TaskSystem());
+
+    size_t Add(float_t radius, const glm::vec3 &position, const glm::vec3 &velocity);
+
+    /// Drop every ball. Kinematics stay where they are
+    void Clear();
+
+    /// Move a kinematic sphere. Sweeps over the time since its last move, unless this move or
+    /// the one before it was a snap
+    void MoveKinematic(size_t idx, const glm::vec3 &position, bool snap = false);
+
+    /// Fixed substeps, carrying over what is left like Bullet does
+    void Step(double_t dt);
+
+    size_t size() { CXSHARED return obj_->count; }
+    glm::vec3 position(size_t i) { CXSHARED return glm::vec3(obj_->px[i], obj_->py[i], obj_->pz[i]); }
+
+    /// Whether a kinematic has touched the ball since the last Clear
+    bool touched(size_t i) { CXSHARED return obj_->touched[i] != 0; }
+
+    /// Translation matrices for every ball, resized to fit
+    void Transforms(std::vector<glm::mat4> &out);
+
+  private:
+
+    struct Kinematic {
+      glm::vec3 from;
+      glm::vec3 to;
+      glm::vec3 position;
+      glm::vec3 velocity;
+      float_t   radius;
+      bool      snapped;      // The next move jumps as well
+      double_t  elapsed;
+      double_t  duration;
+      double_t  last_change;
+    };
+
+    struct SharedObject {
+      void Substep(float_t h);
+      void Integrate(float_t h);
+      void MoveKinematics(float_t h);
+      void BuildGrid();
+      void Contacts(size_t begin, size_t end);
+      void Apply(size_t begin, size_t end);
+      void Resize(size_t capacity);
+
+      SphereSolverSettings    settings;
+      TaskSystem              tasks;
+      TaskGraph               graph;
+      size_t                  ranges;
+
+      size_t                  count;
+      float_t                 max_radius;
+      double_t                accumulator;
+      double_t                sim_time;
+
+      // Balls
+      std::vector<float_t>    px, py, pz;
+      std::vector<float_t>    vx, vy, vz;
+      std::vector<float_t>    radius;
+      std::vector<float_t>    dpx, dpy, dpz;    // Corrections from the current pass
+      std::vector<float_t>    dvx, dvy, dvz;
+      std::vector<uint8_t>    touched;
+
+      std::vector<Kinematic>  kinematics;
+
+      // Grid. Balls then kinematics, sorted by bucket. cells holds each entry's own cell so
+      // a bucket shared by two cells is never counted twice
+      float_t                 cell_size;
+      size_t                  buckets;
+      std::vector<uint32_t>   bucket_start;
+      std::vector<uint32_t>   entries;
+      std::vector<int32_t>    cells;            // x, y, z per entry in the order of the source
+      std::vector<uint32_t>   entry_bucket;
+    };
+
+    std::shared_ptr<SharedObject> obj_;
+
+  public:
+    bool operator == (const SphereSolver &ref) const { return this->obj_ == ref.obj_; }
+    typedef std::shared_ptr<SharedObject> SphereSolver::*unspecified_bool_type;
+    operator unspecified_bool_type() const { return ( obj_.get() == 0 ) ? 0 : &SphereSolver::obj_; }
+    void reset() { obj_.reset(); }
+
+  };
+
+}
+
+#endif
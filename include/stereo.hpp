@@ -0,0 +1,187 @@
+/*
+* @brief PhantomLimb CPU stereo block matcher
+* @file stereo.hpp
+* @author Benjamin Blundell <oni@section9.co.uk>
+* @date 19/10/2026
+*
+*/
+
+#ifndef PHANTOM_STEREO_HPP
+#define PHANTOM_STEREO_HPP
+
+#include "s9/common.hpp"
+
+#include "depth_colliders.hpp"
+#include "camera_feed.hpp"
+#include "timing.hpp"
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+namespace s9 {
+
+  // How two blocks are compared
+  typedef enum {
+    STEREO_SAD,
+    STEREO_CENSUS
+  }StereoCost;
+
+  struct StereoSettings {
+    StereoSettings() : max_disparity(64), block_radius(3), levels(3), threads(0), cost(STEREO_SAD),
+      uniqueness(0.9f), focal_length(570.0f), baseline(0.06f) {}
+
+    size_t      max_disparity;  // Search range at full resolution, in pixels
+    size_t      block_radius;   // Blocks are 8 pixels wide and 2 * radius + 1 high
+    size_t      levels;         // Pyramid levels. 1 is a plain full resolution search
+    size_t      threads;        // Row workers. 0 means one per core
+    StereoCost  cost;
+    float_t     uniqueness;     // Best cost must beat the runner up by this ratio
+    float_t     focal_length;   // Rectified focal length in pixels at full resolution
+    float_t     baseline;       // Distance between the cameras in metres
+  };
+
+  /// A rectified pair of 8 bit grey images, left camera as the reference
+  struct StereoPair {
+    StereoPair() : width(0), height(0) {}
+    size_t                  width;
+    size_t                  height;
+    std::vector<uint8_t>    left;
+    std::vector<uint8_t>    right;
+  };
+
+  /**
+   * Disparity from a rectified stereo pair, on the CPU. Blocks are compared with SIMD SAD or
+   * with census Hamming distance. The full disparity range is only searched on the coarsest
+   * level of a pyramid. Each finer level refines the level above within a couple of pixels, and
+   * the rows of every level are split across a pool of threads.
+   * Match may be called directly, or Start a worker that turns each submitted pair into a
+   * depth frame for the collider stage and the depth feed, for when there is no OpenNI device.
+   */
+
+  class StereoMatcher {
+
+  public:
+
+    StereoMatcher() {}
+
+    StereoMatcher(const StereoSettings &settings);
+
+    /// Fills disparity() for this pair. Blocks until every row is done. Not while the worker is running
+    void Match(const StereoPair &pair);
+
+    /// Disparity to depth in millimetres, in the same layout OpenNI gives us
+    void ToDepth(DepthFrame &frame);
+
+    /// Time Match on this pair over a spread of disparity ranges and print the throughput
+    void Benchmark(const StereoPair &pair);
+
+    void Start();
+    void Stop();
+
+    /// Any thread. Swaps the pair in, so the caller gets an old buffer back to reuse
+    void Submit(StereoPair &pair);
+
+    void set_depth_colliders(DepthColliders &colliders) { CXSHARED obj_->depth_colliders = colliders; }
+    void set_depth_feed(CameraFeed &feed) { CXSHARED obj_->depth_feed = feed; }
+
+    /// Full resolution disparity in pixels. Zero where there was no confident match
+    const std::vector<float_t>& disparity() { CXSHARED return obj_->disparity; }
+
+    const StereoSettings& settings() { CXSHARED return obj_->settings; }
+
+    size_t frames() { CXSHARED return obj_->frames.load(); }
+    double_t last_cost() { CXSHARED return obj_->last_cost.load(); }
+    double_t megapixels_per_second() { CXSHARED return obj_->mpps.load(); }
+
+    /// Load a binary PGM pair. A stand in source for when there are no cameras attached
+    static bool LoadPair(const std::string &left, const std::string &right, StereoPair &pair);
+
+  private:
+
+    /// Splits a range of rows into chunks and runs them across the workers and the caller
+    class RowPool {
+    public:
+      RowPool(size_t threads);
+      ~RowPool();
+
+      void Run(size_t rows, const std::function<void(size_t, size_t)> &fn);
+
+    private:
+      void Work();
+      void Drain();
+
+      std::vector<std::thread>  workers_;
+      std::mutex                mutex_;
+      std::condition_variable   wake_;
+      std::condition_variable   done_;
+      const std::function<void(size_t, size_t)> *job_;
+      size_t                    rows_;
+      size_t                    chunk_;
+      std::atomic<size_t>       next_;
+      size_t                    active_;
+      size_t                    generation_;
+      bool                      running_;
+    };
+
+    // One pyramid level. Census codes are only filled in for census matching
+    struct Level {
+      size_t                  width;
+      size_t                  height;
+      std::vector<uint8_t>    left;
+      std::vector<uint8_t>    right;
+      std::vector<uint32_t>   census_left;
+      std::vector<uint32_t>   census_right;
+      std::vector<uint8_t>    disparity;
+    };
+
+    struct SharedObject {
+      SharedObject(const StereoSettings &settings);
+      ~SharedObject();
+
+      void Resize(size_t width, size_t height);
+      void BuildPyramid(const StereoPair &pair);
+      void MatchRows(size_t level, size_t y0, size_t y1);
+      void Match(const StereoPair &pair);
+      void ToDepth(DepthFrame &frame);
+      void Run();
+
+      StereoSettings            settings;
+      RowPool                   pool;
+
+      std::vector<Level>        levels;
+      std::vector<float_t>      disparity;
+
+      // Async depth source
+      StereoPair                pending;
+      StereoPair                working;
+      bool                      has_pending;
+      DepthFrame                depth_frame;
+      DepthColliders            depth_colliders;
+      CameraFeed                depth_feed;
+
+      std::mutex                pair_mutex;
+      std::condition_variable   pair_ready;
+      std::thread               thread;
+      std::atomic<bool>         running;
+
+      std::atomic<size_t>       frames;
+      std::atomic<double_t>     last_cost;
+      std::atomic<double_t>     mpps;
+    };
+
+    std::shared_ptr<SharedObject> obj_;
+
+  public:
+    bool operator == (const StereoMatcher &ref) const { return this->obj_ == ref.obj_; }
+    typedef std::shared_ptr<SharedObject> StereoMatcher::*unspecified_bool_type;
+    operator unspecified_bool_type() const { return ( obj_.get() == 0 ) ? 0 : &StereoMatcher::obj_; }
+    void reset() { obj_.reset(); }
+
+  };
+
+}
+
+#endif
@@ -0,0 +1,154 @@
+/*
+* @brief PhantomLimb work stealing task system
+* @file task_system.hpp
+* @author Benjamin Blundell <oni@section9.co.uk>
+* @date 19/10/2026
+*
+*/
+
+#ifndef PHANTOM_TASK_SYSTEM_HPP
+#define PHANTOM_TASK_SYSTEM_HPP
+
+#include "s9/common.hpp"
+
+#include "timing.hpp"
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+namespace s9 {
+
+  class TaskSystem;
+
+  /**
+   * A fixed set of named tasks and the order they must run in. Built once, then run again
+   * every frame - each run resets the dependency counts. The duration of each task on its
+   * last run is kept, for per stage timings.
+   */
+
+  class TaskGraph {
+
+  public:
+
+    TaskGraph() {}
+
+    TaskGraph(bool create);
+
+    size_t Add(const std::string &name, std::function<void()> fn);
+
+    /// task will not start until after has finished
+    void Depend(size_t task, size_t after);
+
+    size_t size() { CXSHARED return obj_->tasks.size(); }
+    const std::string& name(size_t task) { CXSHARED return obj_->tasks[task]->name; }
+    double_t time(size_t task) { CXSHARED return obj_->tasks[task]->time; }
+
+    bool done() { CXSHARED return obj_->remaining.load() == 0; }
+
+  protected:
+
+    friend class TaskSystem;
+
+    struct SharedObject;
+
+    struct Task {
+      std::string           name;
+      std::function<void()> fn;
+      std::vector<Task*>    dependents;
+      int                   dependencies;
+      std::atomic<int>      pending;
+      double_t              time;
+      SharedObject*         graph;
+    };
+
+    struct SharedObject {
+      std::vector< std::unique_ptr<Task> >  tasks;
+      std::atomic<size_t>                   remaining;
+    };
+
+    std::shared_ptr<SharedObject> obj_;
+
+  public:
+    bool operator == (const TaskGraph &ref) const { return this->obj_ == ref.obj_; }
+    typedef std::shared_ptr<SharedObject> TaskGraph::*unspecified_bool_type;
+    operator unspecified_bool_type() const { return ( obj_.get() == 0 ) ? 0 : &TaskGraph::obj_; }
+    void reset() { obj_.reset(); }
+
+  };
+
+  /**
+   * Worker threads that each keep their own queue of ready tasks. A worker takes the newest
+   * task from its own queue and, when that is empty, steals the oldest from another. Tasks made
+   * ready by a finishing task go onto the queue of the worker that finished it. The thread
+   * that waits on a graph runs tasks too, so nothing sits idle while it waits.
+   */
+
+  class TaskSystem {
+
+  public:
+
+    TaskSystem() {}
+
+    /// Zero threads picks one fewer than the hardware has, leaving a core for the GL thread
+    TaskSystem(size_t threads);
+
+    /// Start a graph. Returns straight away. A graph must be finished before it is run again
+    void Run(TaskGraph &graph);
+
+    /// Help out until the graph has finished
+    void Wait(TaskGraph &graph);
+
+    void Stop();
+
+    size_t threads() { CXSHARED return obj_->queues.size(); }
+
+    /// Seconds spent running tasks, over every thread, since the last Clear
+    double_t busy() { CXSHARED return obj_->busy_ns.load() / 1.0e9; }
+    void Clear() { CXSHARED obj_->busy_ns.store(0); }
+
+  private:
+
+    typedef TaskGraph::Task Task;
+
+    struct Queue {
+      std::mutex        mutex;
+      std::deque<Task*> tasks;
+    };
+
+    struct SharedObject {
+      SharedObject(size_t threads);
+      ~SharedObject();
+
+      void Push(Task *task);
+      Task* Take(size_t queue);
+      void Execute(Task *task);
+      void Work(size_t index);
+      void Stop();
+
+      std::vector< std::unique_ptr<Queue> > queues;
+      std::vector<std::thread>              workers;
+      std::mutex                            sleep_mutex;
+      std::condition_variable               wake;
+      std::atomic<size_t>                   ready;
+      std::atomic<size_t>                   next_queue;
+      std::atomic<bool>                     running;
+      std::atomic<uint64_t>                 busy_ns;
+    };
+
+    std::shared_ptr<SharedObject> obj_;
+
+  public:
+    bool operator == (const TaskSystem &ref) const { return this->obj_ == ref.obj_; }
+    typedef std::shared_ptr<SharedObject> TaskSystem::*unspecified_bool_type;
+    operator unspecified_bool_type() const { return ( obj_.get() == 0 ) ? 0 : &TaskSystem::obj_; }
+    void reset() { obj_.reset(); }
+
+  };
+
+}
+
+#endif
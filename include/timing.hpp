@@ -0,0 +1,26 @@
+/*
+* @brief PhantomLimb timing helpers
+* @file timing.hpp
+* @author Benjamin Blundell <oni@section9.co.uk>
+* @date 19/10/2026
+*
+*/
+
+#ifndef PHANTOM_TIMING_HPP
+#define PHANTOM_TIMING_HPP
+
+#include "s9/common.hpp"
+
+#include <chrono>
+
+namespace s9 {
+
+  /// Monotonic time in seconds. All sensor and frame timestamps use this clock
+  inline double_t NowSeconds() {
+    return std::chrono::duration_cast< std::chrono::duration<double_t> >(
+      std::chrono::steady_clock::now().time_since_epoch()).count();
+  }
+
+}
+
+#endif
@@ -0,0 +1,141 @@
+/*
+* @brief PhantomLimb uniform buffer blocks
+* @file uniform_buffer.hpp
+* @author Benjamin Blundell <oni@section9.co.uk>
+* @date 19/10/2026
+*
+*/
+
+#ifndef PHANTOM_UNIFORM_BUFFER_HPP
+#define PHANTOM_UNIFORM_BUFFER_HPP
+
+#include "s9/common.hpp"
+#include "s9/gl/common.hpp"
+#include "s9/gl/shader.hpp"
+
+#include <cstring>
+
+namespace s9 {
+
+  // Binding points shared with the block declarations in the shaders
+  typedef enum {
+    UNIFORM_BINDING_EYES = 0,
+    UNIFORM_BINDING_PASS = 1,
+    UNIFORM_BINDING_WARP = 2,
+    UNIFORM_BINDING_BALLS = 3
+  }UniformBinding;
+
+  /// PhantomEyes. Index 0 is the left eye
+  struct EyeBlock {
+    glm::mat4 view[2];
+    glm::mat4 projection[2];
+  };
+
+  /// PhantomPass. Which eye of PhantomEyes the current pass draws with, in x
+  struct PassBlock {
+    glm::ivec4 eye;
+  };
+
+  /// PhantomWarp. Everything the distortion pass needs
+  struct WarpBlock {
+    glm::vec4 warp;           // Barrel k0 - k3
+    glm::vec4 chromatic;
+    glm::vec4 lens;           // Lens centre offset, 1 / distortion scale, tan half fov x and y
+    glm::mat4 timewarp;
+  };
+
+  static const size_t kMaxBallInstances = 64;
+
+  /// PhantomBalls. One material and a transform per ball
+  struct BallBlock {
+    glm::vec4 colour;
+    glm::mat4 model[kMaxBallInstances];
+  };
+
+  /// Point every block the shader declares at its binding. Call once after loading
+  void ResolveUniformBlocks(gl::Shader &shader);
+  void ResolveUniformBlocks(GLuint program);
+
+  /**
+   * A std140 uniform block kept on the CPU as a plain struct, and sent to its buffer in one
+   * mapped write. Block must only hold members whose std140 layout matches the C++ one -
+   * mat4, vec4, ivec4 and arrays of them - so it can be copied straight across.
+   * A buffer can hold several copies of the block, each at an offset the driver allows, so a
+   * pass can switch copies with a range bind instead of rewriting the buffer. Render thread only.
+   */
+
+  template<typename Block>
+  class UniformBuffer {
+
+  public:
+
+    UniformBuffer() {}
+
+    UniformBuffer(UniformBinding binding, size_t copies = 1)
+      : obj_ (std::shared_ptr<SharedObject>(new SharedObject(binding, copies))) {}
+
+    Block& data(size_t copy = 0) { CXSHARED return obj_->data[copy]; }
+
+    /// Send every copy, or only the first bytes of a single copy. The old contents are
+    /// invalidated so the driver never waits on a draw still reading them
+    void Upload(size_t bytes = 0) {
+      CXSHARED
+      size_t size = bytes > 0 && obj_->data.size() == 1 ? bytes : obj_->stride * obj_->data.size();
+      glBindBuffer(GL_UNIFORM_BUFFER, obj_->buffer);
+      byte_t *mapped = static_cast<byte_t*>(glMapBufferRange(GL_UNIFORM_BUFFER, 0, size,
+        GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT));
+      if (mapped != nullptr) {
+        if (obj_->data.size() == 1) {
+          memcpy(mapped, &obj_->data[0], std::min(size, sizeof(Block)));
+        } else {
+          for (size_t i = 0; i < obj_->data.size(); ++i)
+            memcpy(mapped + i * obj_->stride, &obj_->data[i], sizeof(Block));
+        }
+        glUnmapBuffer(GL_UNIFORM_BUFFER);
+      }
+      glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    }
+
+    /// Attach one copy to the binding point every shader using this block reads from
+    void Bind(size_t copy = 0) {
+      CXSHARED
+      glBindBufferRange(GL_UNIFORM_BUFFER, obj_->binding, obj_->buffer, copy * obj_->stride, sizeof(Block));
+    }
+
+    GLuint binding() { CXSHARED return obj_->binding; }
+
+  private:
+
+    struct SharedObject {
+      SharedObject(UniformBinding binding, size_t copies) : binding(binding), data(std::max<size_t>(copies, 1)) {
+        GLint alignment = 256;
+        glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+        stride = (sizeof(Block) + alignment - 1) / alignment * alignment;
+
+        glGenBuffers(1, &buffer);
+        glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+        glBufferData(GL_UNIFORM_BUFFER, stride * data.size(), nullptr, GL_DYNAMIC_DRAW);
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+      }
+
+      ~SharedObject() { glDeleteBuffers(1, &buffer); }
+
+      GLuint              buffer;
+      GLuint              binding;
+      size_t              stride;
+      std::vector<Block>  data;
+    };
+
+    std::shared_ptr<SharedObject> obj_;
+
+  public:
+    bool operator == (const UniformBuffer &ref) const { return this->obj_ == ref.obj_; }
+    typedef std::shared_ptr<SharedObject> UniformBuffer::*unspecified_bool_type;
+    operator unspecified_bool_type() const { return ( obj_.get() == 0 ) ? 0 : &UniformBuffer::obj_; }
+    void reset() { obj_.reset(); }
+
+  };
+
+}
+
+#endif
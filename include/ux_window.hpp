@@ -0,0 +1,100 @@
+/*
+* @brief PhantomLimb operator console window
+* @file ux_window.hpp
+* @author Benjamin Blundell <oni@section9.co.uk>
+* @date 19/10/2026
+*
+*/
+
+#ifndef PHANTOM_UX_WINDOW_HPP
+#define PHANTOM_UX_WINDOW_HPP
+
+#include "s9/common.hpp"
+
+#include "operator.hpp"
+#include "console_channel.hpp"
+#include "frame_pacer.hpp"
+#include "timing.hpp"
+
+#include <gtkmm.h>
+#include <functional>
+#include <sstream>
+
+namespace s9 {
+
+#ifdef _SEBURO_LINUX
+
+  /*
+   * UX Window for the Application. Runs on the main screen, normally in its own process.
+   * Everything it does goes through the console channel, so it never touches the render
+   * loop directly
+   */
+
+  class UXWindow : public Gtk::Window {
+
+  public:
+    /// quit closes whatever is hosting this window
+    UXWindow(ConsoleChannel channel, std::function<void()> quit);
+    virtual ~UXWindow();
+
+  protected:
+    //Signal handlers:
+    void on_button_fire_clicked();
+    void on_button_reset_clicked();
+    void on_button_auto_game_clicked();
+    void on_button_quit_clicked();
+    void on_button_tracking_clicked();
+    void on_button_oculus_clicked();
+    bool on_window_closed(GdkEventAny* event);
+    void on_combo_arms_changed();
+    void on_button_emphasis_toggled();
+    void on_scale_speed_changed();
+    void on_scale_width_changed();
+    bool on_telemetry_timeout();
+
+    // Layout
+
+    Gtk::Grid   grid_;
+
+    // Buttons
+    Gtk::Button* button_fire_;
+    Gtk::Button* button_auto_game_;
+    Gtk::Button* button_reset_;
+    Gtk::Button* button_oculus_;
+    Gtk::Button* button_tracking_;
+    Gtk::Button* button_quit_;
+
+    Gtk::ComboBoxText combo_arms_;
+
+    Gtk::CheckButton* button_emphasis_;
+
+    Gtk::HScale* scale_speed_;
+    Gtk::Label scale_speed_label_;
+
+    Gtk::HScale* scale_width_;
+    Gtk::Label scale_width_label_;
+
+    Gtk::Label telemetry_label_;
+
+    void Post(CommandType type, ArmState arm = BOTH_ARMS);
+    void PublishSettings();
+
+    ConsoleChannel channel_;
+    std::function<void()> quit_;
+    GameSettings game_settings_;
+
+    // Telemetry
+    TelemetrySample latest_;
+    Histogram frame_times_;
+    Histogram missed_;
+    Histogram input_to_swap_;
+    uint64_t last_heartbeat_;
+    double_t last_beat_time_;
+
+  };
+
+#endif
+
+}
+
+#endif
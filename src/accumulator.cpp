@@ -0,0 +1,310 @@
+/**
+* @brief Temporal accumulation on the GPU or the CPU
+* @file accumulator.cpp
+* @author Benjamin Blundell <oni@section9.co.uk>
+* @date 19/10/2026
+*
+*/
+
+#include "accumulator.hpp"
+
+#include <algorithm>
+#include <limits>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+
+using namespace std;
+using namespace s9;
+
+
+// Fold one run of samples into the history, the same rules as accumulator.frag
+
+static void AccumulateSpan(float_t *history, const float_t *in, float_t *out, size_t count,
+  float_t weight, float_t reject, bool holes) {
+
+  size_t i = 0;
+
+#ifdef __SSE2__
+  const __m128 w = _mm_set1_ps(weight);
+  const __m128 one = _mm_set1_ps(1.0f);
+  const __m128 zero = _mm_setzero_ps();
+  const __m128 limit = _mm_set1_ps(reject > 0 ? reject : std::numeric_limits<float_t>::max());
+  const __m128 sign = _mm_set1_ps(-0.0f);
+
+  for (; i + 4 <= count; i += 4) {
+    __m128 h = _mm_loadu_ps(history + i);
+    __m128 c = _mm_loadu_ps(in + i);
+    __m128 diff = _mm_sub_ps(c, h);
+
+    __m128 take = _mm_cmpgt_ps(_mm_andnot_ps(sign, diff), limit);
+    if (holes)
+      take = _mm_or_ps(take, _mm_cmpeq_ps(h, zero));
+    __m128 weights = _mm_or_ps(_mm_and_ps(take, one), _mm_andnot_ps(take, w));
+
+    if (holes)
+      weights = _mm_andnot_ps(_mm_cmpeq_ps(c, zero), weights);
+
+    __m128 result = _mm_add_ps(h, _mm_mul_ps(weights, diff));
+    _mm_storeu_ps(history + i, result);
+    _mm_storeu_ps(out + i, result);
+  }
+#endif
+
+  for (; i < count; ++i) {
+    float_t h = history[i];
+    float_t c = in[i];
+    float_t wi = weight;
+
+    if ((holes && h == 0) || (reject > 0 && std::fabs(c - h) > reject))
+      wi = 1.0f;
+    if (holes && c == 0)
+      wi = 0;
+
+    history[i] = out[i] = h + wi * (c - h);
+  }
+}
+
+
+Accumulator::Accumulator(size_t width, size_t height, const AccumulatorSettings &settings)
+  : obj_ (std::shared_ptr<SharedObject>(new SharedObject(width, height, false, 0, 0, settings))) {
+
+}
+
+Accumulator::Accumulator(size_t width, size_t height, GLenum format, GLuint program, const AccumulatorSettings &settings)
+  : obj_ (std::shared_ptr<SharedObject>(new SharedObject(width, height, true, format, program, settings))) {
+
+}
+
+void Accumulator::Motion(float_t amount) {
+  CXSHARED
+  if (obj_->settings.motion_threshold > 0 && amount > obj_->settings.motion_threshold && obj_->count.load() > 0 &&
+    !obj_->reset_pending.exchange(true))
+    obj_->resets++;
+}
+
+// Render the blend into whichever buffer is not the history, then swap. The timer
+// query is only read back once the GPU says it is ready, so this never stalls
+
+void Accumulator::Accumulate(GLuint texture) {
+  CXSHARED
+
+  if (obj_->query_pending) {
+    GLint available = 0;
+    glGetQueryObjectiv(obj_->query, GL_QUERY_RESULT_AVAILABLE, &available);
+    if (available) {
+      GLuint64 elapsed = 0;
+      glGetQueryObjectui64v(obj_->query, GL_QUERY_RESULT, &elapsed);
+      obj_->last_cost.store(elapsed * 1.0e-9);
+      obj_->query_pending = false;
+    }
+  }
+
+  float_t weight = obj_->Weight();
+  if (weight == 0)
+    return;
+
+  GLint previous_framebuffer = 0;
+  GLint viewport[4];
+  glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &previous_framebuffer);
+  glGetIntegerv(GL_VIEWPORT, viewport);
+  GLboolean depth_test = glIsEnabled(GL_DEPTH_TEST);
+
+  bool timed = !obj_->query_pending;
+  if (timed)
+    glBeginQuery(GL_TIME_ELAPSED, obj_->query);
+
+  size_t next = 1 - obj_->current;
+
+  glBindFramebuffer(GL_DRAW_FRAMEBUFFER, obj_->framebuffers[next]);
+  glViewport(0, 0, obj_->width, obj_->height);
+  glDisable(GL_DEPTH_TEST);
+
+  GLuint program = obj_->program;
+  glUseProgram(program);
+  glUniform1i(glGetUniformLocation(program, "uSample"), 0);
+  glUniform1i(glGetUniformLocation(program, "uHistory"), 1);
+  glUniform1f(glGetUniformLocation(program, "uWeight"), weight);
+  glUniform1f(glGetUniformLocation(program, "uReject"), obj_->settings.reject);
+  glUniform1i(glGetUniformLocation(program, "uHoles"), obj_->settings.holes ? 1 : 0);
+  glUniform2f(glGetUniformLocation(program, "uSize"), static_cast<float_t>(obj_->width), static_cast<float_t>(obj_->height));
+
+  glActiveTexture(GL_TEXTURE0);
+  glBindTexture(GL_TEXTURE_RECTANGLE, texture);
+  glActiveTexture(GL_TEXTURE1);
+  glBindTexture(GL_TEXTURE_RECTANGLE, obj_->textures[obj_->current]);
+
+  glBindVertexArray(obj_->vao);
+  glDrawArrays(GL_TRIANGLES, 0, 3);
+  glBindVertexArray(0);
+
+  glBindTexture(GL_TEXTURE_RECTANGLE, 0);
+  glActiveTexture(GL_TEXTURE0);
+  glBindTexture(GL_TEXTURE_RECTANGLE, 0);
+  glUseProgram(0);
+
+  if (timed) {
+    glEndQuery(GL_TIME_ELAPSED);
+    obj_->query_pending = true;
+  }
+
+  glBindFramebuffer(GL_DRAW_FRAMEBUFFER, previous_framebuffer);
+  glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+  if (depth_test)
+    glEnable(GL_DEPTH_TEST);
+
+  obj_->current = next;
+}
+
+void Accumulator::Accumulate(const float_t *in, float_t *out) {
+  CXSHARED
+
+  double_t start = NowSeconds();
+  size_t count = obj_->width * obj_->height;
+  float_t weight = obj_->Weight();
+
+  if (weight == 0)
+    std::copy(obj_->history.begin(), obj_->history.end(), out);
+  else
+    AccumulateSpan(&obj_->history[0], in, out, count, weight, obj_->settings.reject, obj_->settings.holes);
+
+  obj_->last_cost.store(NowSeconds() - start);
+}
+
+// Depth in millimetres. Converted to float and back in blocks of eight
+
+void Accumulator::Accumulate(const uint16_t *in, uint16_t *out) {
+  CXSHARED
+
+  double_t start = NowSeconds();
+  size_t count = obj_->width * obj_->height;
+  float_t *scratch = &obj_->scratch[0];
+  size_t i = 0;
+
+#ifdef __SSE2__
+  const __m128i zero = _mm_setzero_si128();
+  for (; i + 8 <= count; i += 8) {
+    __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i));
+    _mm_storeu_ps(scratch + i, _mm_cvtepi32_ps(_mm_unpacklo_epi16(v, zero)));
+    _mm_storeu_ps(scratch + i + 4, _mm_cvtepi32_ps(_mm_unpackhi_epi16(v, zero)));
+  }
+#endif
+  for (; i < count; ++i)
+    scratch[i] = in[i];
+
+  float_t weight = obj_->Weight();
+  if (weight == 0)
+    std::copy(obj_->history.begin(), obj_->history.end(), scratch);
+  else
+    AccumulateSpan(&obj_->history[0], scratch, scratch, count, weight, obj_->settings.reject, obj_->settings.holes);
+
+  i = 0;
+
+#ifdef __SSE2__
+  // There is no unsigned saturating pack in SSE2, so shift into signed range and back
+  const __m128i bias32 = _mm_set1_epi32(32768);
+  const __m128i bias16 = _mm_set1_epi16(static_cast<int16_t>(0x8000));
+  for (; i + 8 <= count; i += 8) {
+    __m128i lo = _mm_sub_epi32(_mm_cvtps_epi32(_mm_loadu_ps(scratch + i)), bias32);
+    __m128i hi = _mm_sub_epi32(_mm_cvtps_epi32(_mm_loadu_ps(scratch + i + 4)), bias32);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), _mm_xor_si128(_mm_packs_epi32(lo, hi), bias16));
+  }
+#endif
+  for (; i < count; ++i)
+    out[i] = static_cast<uint16_t>(std::min(std::max(scratch[i] + 0.5f, 0.0f), 65535.0f));
+
+  obj_->last_cost.store(NowSeconds() - start);
+}
+
+void Accumulator::Bind(GLuint unit) {
+  CXSHARED
+  obj_->bound_unit = unit;
+  glActiveTexture(GL_TEXTURE0 + unit);
+  glBindTexture(GL_TEXTURE_RECTANGLE, obj_->textures[obj_->current]);
+}
+
+void Accumulator::Unbind() {
+  CXSHARED
+  glActiveTexture(GL_TEXTURE0 + obj_->bound_unit);
+  glBindTexture(GL_TEXTURE_RECTANGLE, 0);
+  glActiveTexture(GL_TEXTURE0);
+}
+
+
+Accumulator::SharedObject::SharedObject(size_t width, size_t height, bool gpu, GLenum format, GLuint program,
+  const AccumulatorSettings &settings) : settings(settings), width(width), height(height), gpu(gpu),
+  count(0), resets(0), last_cost(0), reset_pending(false), vao(0), query(0), query_pending(false), current(0), bound_unit(0),
+  program(program) {
+
+  framebuffers[0] = framebuffers[1] = 0;
+  textures[0] = textures[1] = 0;
+
+  if (!gpu) {
+    history.assign(width * height, 0.0f);
+    scratch.assign(width * height, 0.0f);
+    return;
+  }
+
+  glGenTextures(2, textures);
+  glGenFramebuffers(2, framebuffers);
+
+  for (size_t i = 0; i < 2; ++i) {
+    glBindTexture(GL_TEXTURE_RECTANGLE, textures[i]);
+    glTexParameteri(GL_TEXTURE_RECTANGLE, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_RECTANGLE, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_RECTANGLE, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_RECTANGLE, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexImage2D(GL_TEXTURE_RECTANGLE, 0, format, width, height, 0, GL_RGBA, GL_FLOAT, nullptr);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffers[i]);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_RECTANGLE, textures[i], 0);
+
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+      cerr << "Accumulator: float framebuffer " << i << " is not complete" << endl;
+
+    GLfloat clear[] = {0.0f, 0.0f, 0.0f, 0.0f};
+    glClearBufferfv(GL_COLOR, 0, clear);
+  }
+
+  glBindFramebuffer(GL_FRAMEBUFFER, 0);
+  glBindTexture(GL_TEXTURE_RECTANGLE, 0);
+
+  glGenVertexArrays(1, &vao);
+  glGenQueries(1, &query);
+}
+
+Accumulator::SharedObject::~SharedObject() {
+  if (!gpu)
+    return;
+
+  glDeleteQueries(1, &query);
+  glDeleteVertexArrays(1, &vao);
+  glDeleteFramebuffers(2, framebuffers);
+  glDeleteTextures(2, textures);
+}
+
+// The weight of the newest sample. The first sample after a reset replaces the history,
+// box mode takes the running mean and then holds once it has all its samples
+
+float_t Accumulator::SharedObject::Weight() {
+
+  if (reset_pending.exchange(false))
+    count.store(0);
+
+  size_t count = this->count.load();
+  float_t weight = 0;
+
+  if (count == 0)
+    weight = 1.0f;
+  else if (settings.mode == ACCUMULATE_EMA)
+    weight = settings.alpha;
+  else if (count < settings.samples)
+    weight = 1.0f / static_cast<float_t>(count + 1);
+
+  if (settings.mode == ACCUMULATE_EMA || count < settings.samples)
+    this->count.store(count + 1);
+
+  return weight;
+}
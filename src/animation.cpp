@@ -0,0 +1,533 @@
+/**
+* @brief Compressed MD5 animation clips
+* @file animation.cpp
+* @author Benjamin Blundell <oni@section9.co.uk>
+* @date 19/10/2026
+*
+*/
+
+#include "animation.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <limits>
+#include <sstream>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+
+using namespace std;
+using namespace s9;
+
+
+static const float_t kQuantise = 32767.0f;
+static const float_t kDegrees = 57.2957795f;
+
+// Plain quaternion maths for loading. Sampling works on the SoA arrays directly
+
+struct Quat {
+  float_t x, y, z, w;
+};
+
+static Quat Multiply(const Quat &a, const Quat &b) {
+  Quat r;
+  r.w = a.w * b.w - a.x * b.x - a.y * b.y - a.z * b.z;
+  r.x = a.w * b.x + a.x * b.w + a.y * b.z - a.z * b.y;
+  r.y = a.w * b.y - a.x * b.z + a.y * b.w + a.z * b.x;
+  r.z = a.w * b.z + a.x * b.y - a.y * b.x + a.z * b.w;
+  return r;
+}
+
+static Quat Conjugate(const Quat &q) {
+  Quat r = { -q.x, -q.y, -q.z, q.w };
+  return r;
+}
+
+/// md5 only stores x, y and z. w is rebuilt as negative, the way Doom did it
+static Quat FromMD5(float_t x, float_t y, float_t z) {
+  float_t t = 1.0f - x * x - y * y - z * z;
+  Quat q = { x, y, z, t > 0 ? -std::sqrt(t) : 0.0f };
+  return q;
+}
+
+static Quat Dequantise(int16_t x, int16_t y, int16_t z) {
+  Quat q = { x / kQuantise, y / kQuantise, z / kQuantise, 0 };
+  float_t t = 1.0f - q.x * q.x - q.y * q.y - q.z * q.z;
+  q.w = t > 0 ? std::sqrt(t) : 0.0f;
+  return q;
+}
+
+static Quat Nlerp(const Quat &a, Quat b, float_t t) {
+  if (a.x * b.x + a.y * b.y + a.z * b.z + a.w * b.w < 0)
+    b = { -b.x, -b.y, -b.z, -b.w };
+  Quat r = { a.x + (b.x - a.x) * t, a.y + (b.y - a.y) * t, a.z + (b.z - a.z) * t, a.w + (b.w - a.w) * t };
+  float_t length = std::sqrt(r.x * r.x + r.y * r.y + r.z * r.z + r.w * r.w);
+  r.x /= length; r.y /= length; r.z /= length; r.w /= length;
+  return r;
+}
+
+/// Angle between two rotations, in degrees
+static float_t Difference(const Quat &a, const Quat &b) {
+  float_t d = std::min(1.0f, std::fabs(a.x * b.x + a.y * b.y + a.z * b.z + a.w * b.w));
+  return 2.0f * std::acos(d) * kDegrees;
+}
+
+
+void AnimationPose::Resize(size_t count) {
+  bones = count;
+  size_t padded = (count + 3) & ~static_cast<size_t>(3);
+  x.assign(padded, 0.0f);
+  y.assign(padded, 0.0f);
+  z.assign(padded, 0.0f);
+  w.assign(padded, 1.0f);
+}
+
+
+AnimationClip::AnimationClip(const std::string &path, const AnimationSettings &settings)
+  : obj_ (std::shared_ptr<SharedObject>(new SharedObject(path, settings))) {
+
+}
+
+int32_t AnimationClip::bone(const std::string &name) {
+  CXSHARED
+  for (size_t i = 0; i < obj_->names.size(); ++i) {
+    if (obj_->names[i] == name)
+      return static_cast<int32_t>(i);
+  }
+  return -1;
+}
+
+size_t AnimationClip::bytes() {
+  CXSHARED
+  return obj_->first.size() * sizeof(uint32_t) + obj_->frame.size() * (sizeof(uint16_t) + 3 * sizeof(int16_t));
+}
+
+AnimationClip::SharedObject::SharedObject(const std::string &path, const AnimationSettings &settings) :
+  path(path), frames(0), rate(24.0), max_error(0) {
+
+  std::ifstream file(path.c_str());
+  if (!file) {
+    cerr << "PhantomLimb: could not open animation " << path << endl;
+    return;
+  }
+
+  // The md5anim layout - a hierarchy saying which components each joint animates, a base
+  // frame, then every frame as a flat run of just those components
+
+  struct Joint {
+    size_t  flags;
+    size_t  start;
+    Quat    base;
+  };
+
+  std::vector<Joint> joints;
+  std::vector< std::vector<Quat> > source;
+  size_t num_frames = 0, num_joints = 0, base = 0;
+
+  std::string line;
+  while (std::getline(file, line)) {
+    std::istringstream in(line);
+    std::string word;
+    if (!(in >> word))
+      continue;
+
+    if (word == "numFrames") {
+      in >> num_frames;
+    } else if (word == "numJoints") {
+      in >> num_joints;
+    } else if (word == "frameRate") {
+      in >> rate;
+    } else if (word == "hierarchy") {
+      while (std::getline(file, line) && line.find('}') == std::string::npos) {
+        size_t open = line.find('"'), close = line.find('"', open + 1);
+        if (open == std::string::npos || close == std::string::npos)
+          continue;
+        Joint joint;
+        int32_t parent;
+        std::istringstream fields(line.substr(close + 1));
+        fields >> parent >> joint.flags >> joint.start;
+        names.push_back(line.substr(open + 1, close - open - 1));
+        joints.push_back(joint);
+      }
+    } else if (word == "baseframe") {
+      while (std::getline(file, line) && line.find('}') == std::string::npos && base < joints.size()) {
+        float_t tx, ty, tz, qx, qy, qz;
+        if (sscanf(line.c_str(), " ( %f %f %f ) ( %f %f %f )", &tx, &ty, &tz, &qx, &qy, &qz) == 6)
+          joints[base++].base = FromMD5(qx, qy, qz);
+      }
+    } else if (word == "frame") {
+      std::vector<float_t> components;
+      float_t value;
+      while (file >> value)
+        components.push_back(value);
+      file.clear();
+      std::getline(file, line);
+
+      // Relative to the base frame, so a clip without a joint can be read as identity
+      std::vector<Quat> pose(joints.size());
+      for (size_t i = 0; i < joints.size(); ++i) {
+        float_t q[3] = { joints[i].base.x, joints[i].base.y, joints[i].base.z };
+        // Any translation components come first in the joint's run
+        size_t next = joints[i].start + ((joints[i].flags & 1) != 0) + ((joints[i].flags & 2) != 0)
+          + ((joints[i].flags & 4) != 0);
+        for (size_t c = 0; c < 3; ++c) {
+          if ((joints[i].flags & (8 << c)) != 0 && next < components.size())
+            q[c] = components[next++];
+        }
+        pose[i] = Multiply(Conjugate(joints[i].base), FromMD5(q[0], q[1], q[2]));
+      }
+      source.push_back(pose);
+    }
+  }
+
+  if (joints.empty() || base != joints.size() || source.empty() || source.size() != num_frames ||
+    joints.size() != num_joints || source.size() > std::numeric_limits<uint16_t>::max()) {
+    cerr << "PhantomLimb: could not read animation " << path << endl;
+    names.clear();
+    return;
+  }
+
+  frames = source.size();
+
+  // Quantise every frame of a track, with w kept positive so it can be rebuilt, then keep
+  // only the keys the track cannot do without. From each kept key, reach as far forward as
+  // interpolating straight to the candidate still passes through every frame in between
+
+  float_t tolerance = settings.tolerance;
+  first.push_back(0);
+
+  std::vector<int16_t> qx(frames), qy(frames), qz(frames);
+  std::vector<Quat> decoded(frames);
+  std::vector<size_t> kept;
+
+  for (size_t j = 0; j < joints.size(); ++j) {
+    for (size_t f = 0; f < frames; ++f) {
+      Quat q = source[f][j];
+      float_t sign = q.w < 0 ? -1.0f : 1.0f;
+      qx[f] = static_cast<int16_t>(std::floor(q.x * sign * kQuantise + 0.5f));
+      qy[f] = static_cast<int16_t>(std::floor(q.y * sign * kQuantise + 0.5f));
+      qz[f] = static_cast<int16_t>(std::floor(q.z * sign * kQuantise + 0.5f));
+      decoded[f] = Dequantise(qx[f], qy[f], qz[f]);
+    }
+
+    kept.assign(1, 0);
+    size_t from = 0;
+    for (size_t to = from + 2; to < frames; ++to) {
+      bool fits = true;
+      for (size_t f = from + 1; f < to && fits; ++f) {
+        float_t t = static_cast<float_t>(f - from) / (to - from);
+        fits = Difference(Nlerp(decoded[from], decoded[to], t), decoded[f]) <= tolerance;
+      }
+      if (!fits) {
+        from = to - 1;
+        kept.push_back(from);
+      }
+    }
+    if (frames > 1 && kept.back() != frames - 1)
+      kept.push_back(frames - 1);
+
+    // A joint that never moves
+    if (kept.size() == 2 && from == 0 && Difference(decoded[0], decoded[frames - 1]) <= tolerance)
+      kept.resize(1);
+
+    for (size_t k : kept) {
+      frame.push_back(static_cast<uint16_t>(k));
+      x.push_back(qx[k]);
+      y.push_back(qy[k]);
+      z.push_back(qz[k]);
+    }
+    first.push_back(static_cast<uint32_t>(frame.size()));
+
+    // What that cost against the source
+    size_t key = 0;
+    for (size_t f = 0; f < frames; ++f) {
+      while (key + 1 < kept.size() && kept[key + 1] <= f)
+        key++;
+      Quat q = decoded[kept[key]];
+      if (key + 1 < kept.size())
+        q = Nlerp(q, decoded[kept[key + 1]], static_cast<float_t>(f - kept[key]) / (kept[key + 1] - kept[key]));
+      max_error = std::max(max_error, Difference(q, source[f][j]));
+    }
+  }
+
+  cout << "PhantomLimb: animation " << path << " " << names.size() << " joints " << frames << " frames, "
+    << frame.size() << " of " << frames * names.size() << " keys kept, "
+    << first.size() * sizeof(uint32_t) + frame.size() * 4 * sizeof(int16_t) << " bytes, max error "
+    << max_error << " degrees" << endl;
+}
+
+
+AnimationPlayer::AnimationPlayer(const std::vector<AnimationClip> &clips)
+  : obj_ (std::shared_ptr<SharedObject>(new SharedObject())) {
+
+  // Our bones are every joint any clip names, in the order they first turn up
+  for (AnimationClip clip : clips) {
+    if (!clip || !clip.loaded())
+      continue;
+    for (const std::string &name : clip.obj_->names) {
+      if (std::find(obj_->names.begin(), obj_->names.end(), name) == obj_->names.end())
+        obj_->names.push_back(name);
+    }
+  }
+
+  for (AnimationClip clip : clips) {
+    Binding binding;
+    binding.clip = clip;
+    binding.time = 0;
+    for (const std::string &name : obj_->names)
+      binding.tracks.push_back(clip && clip.loaded() ? clip.bone(name) : -1);
+    binding.cursors.assign(obj_->names.size(), 0);
+    for (size_t i = 0; i < obj_->names.size(); ++i) {
+      if (binding.tracks[i] >= 0)
+        binding.cursors[i] = clip.obj_->first[binding.tracks[i]];
+    }
+    obj_->bindings.push_back(binding);
+  }
+
+  obj_->current = obj_->previous = 0;
+  obj_->fade = obj_->fade_time = 0;
+#ifdef __SSE2__
+  obj_->simd = true;
+#else
+  obj_->simd = false;
+#endif
+
+  obj_->keys.Resize(obj_->names.size());
+  obj_->pose.Resize(obj_->names.size());
+  obj_->from.Resize(obj_->names.size());
+}
+
+void AnimationPlayer::Play(size_t clip, double_t fade) {
+  CXSHARED
+  if (clip >= obj_->bindings.size() || clip == obj_->current)
+    return;
+
+  obj_->previous = obj_->current;
+  obj_->current = clip;
+  obj_->fade_time = fade;
+  obj_->fade = fade > 0 ? 0 : 1.0;
+  obj_->bindings[clip].time = 0;
+}
+
+void AnimationPlayer::Update(double_t dt) {
+  CXSHARED
+  SharedObject &o = *obj_;
+  if (o.bindings.empty())
+    return;
+
+  o.bindings[o.current].time += dt;
+  Sample(o.bindings[o.current], o.keys, o.pose, o.simd);
+
+  if (o.fade < 1.0) {
+    o.fade = std::min(1.0, o.fade + dt / o.fade_time);
+    o.bindings[o.previous].time += dt;
+    Sample(o.bindings[o.previous], o.keys, o.from, o.simd);
+    Blend(o.from, o.pose, static_cast<float_t>(o.fade), o.pose, o.simd);
+  }
+}
+
+void AnimationPlayer::Keys::Resize(size_t count) {
+  size_t padded = (count + 3) & ~static_cast<size_t>(3);
+  ax.assign(padded, 0); ay.assign(padded, 0); az.assign(padded, 0);
+  bx.assign(padded, 0); by.assign(padded, 0); bz.assign(padded, 0);
+  alpha.assign(padded, 0.0f);
+}
+
+/// The key search is scalar, but cheap - the cursors only ever step forward unless the clip
+/// loops. Decoding and interpolating then goes four bones at a time
+
+void AnimationPlayer::Sample(Binding &binding, Keys &keys, AnimationPose &pose, bool simd) {
+
+  if (!binding.clip || !binding.clip.loaded()) {
+    pose.Resize(pose.bones);
+    return;
+  }
+
+  const AnimationClip::SharedObject &clip = *binding.clip.obj_;
+  double_t position = 0;
+  if (clip.frames > 1) {
+    position = std::fmod(binding.time * clip.rate, static_cast<double_t>(clip.frames - 1));
+    binding.time = position / clip.rate;
+  }
+  float_t f = static_cast<float_t>(position);
+
+  for (size_t i = 0; i < pose.bones; ++i) {
+    int32_t track = binding.tracks[i];
+    if (track < 0) {
+      keys.ax[i] = keys.ay[i] = keys.az[i] = 0;
+      keys.bx[i] = keys.by[i] = keys.bz[i] = 0;
+      keys.alpha[i] = 0;
+      continue;
+    }
+
+    uint32_t begin = clip.first[track], end = clip.first[track + 1];
+    uint32_t &a = binding.cursors[i];
+    if (clip.frame[a] > f)
+      a = begin;
+    while (a + 1 < end && clip.frame[a + 1] <= f)
+      a++;
+    uint32_t b = a + 1 < end ? a + 1 : a;
+
+    keys.ax[i] = clip.x[a]; keys.ay[i] = clip.y[a]; keys.az[i] = clip.z[a];
+    keys.bx[i] = clip.x[b]; keys.by[i] = clip.y[b]; keys.bz[i] = clip.z[b];
+    keys.alpha[i] = b != a ? (f - clip.frame[a]) / (clip.frame[b] - clip.frame[a]) : 0;
+  }
+
+  size_t i = 0;
+  size_t count = pose.x.size();
+
+#ifdef __SSE2__
+  if (simd) {
+    const __m128 scale = _mm_set1_ps(1.0f / kQuantise);
+    const __m128 one = _mm_set1_ps(1.0f);
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 sign = _mm_set1_ps(-0.0f);
+
+    // Four int16 to four floats in -1 to 1
+    #define PHANTOM_DECODE(v) _mm_mul_ps(_mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16)), scale)
+
+    for (; i < count; i += 4) {
+      __m128i s;
+      s = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(&keys.ax[i])); __m128 ax = PHANTOM_DECODE(s);
+      s = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(&keys.ay[i])); __m128 ay = PHANTOM_DECODE(s);
+      s = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(&keys.az[i])); __m128 az = PHANTOM_DECODE(s);
+      s = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(&keys.bx[i])); __m128 bx = PHANTOM_DECODE(s);
+      s = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(&keys.by[i])); __m128 by = PHANTOM_DECODE(s);
+      s = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(&keys.bz[i])); __m128 bz = PHANTOM_DECODE(s);
+
+      __m128 aw = _mm_sqrt_ps(_mm_max_ps(zero, _mm_sub_ps(one,
+        _mm_add_ps(_mm_mul_ps(ax, ax), _mm_add_ps(_mm_mul_ps(ay, ay), _mm_mul_ps(az, az))))));
+      __m128 bw = _mm_sqrt_ps(_mm_max_ps(zero, _mm_sub_ps(one,
+        _mm_add_ps(_mm_mul_ps(bx, bx), _mm_add_ps(_mm_mul_ps(by, by), _mm_mul_ps(bz, bz))))));
+
+      // Take the short way round
+      __m128 dot = _mm_add_ps(_mm_add_ps(_mm_mul_ps(ax, bx), _mm_mul_ps(ay, by)),
+        _mm_add_ps(_mm_mul_ps(az, bz), _mm_mul_ps(aw, bw)));
+      __m128 flip = _mm_and_ps(dot, sign);
+      bx = _mm_xor_ps(bx, flip); by = _mm_xor_ps(by, flip);
+      bz = _mm_xor_ps(bz, flip); bw = _mm_xor_ps(bw, flip);
+
+      __m128 t = _mm_loadu_ps(&keys.alpha[i]);
+      __m128 rx = _mm_add_ps(ax, _mm_mul_ps(t, _mm_sub_ps(bx, ax)));
+      __m128 ry = _mm_add_ps(ay, _mm_mul_ps(t, _mm_sub_ps(by, ay)));
+      __m128 rz = _mm_add_ps(az, _mm_mul_ps(t, _mm_sub_ps(bz, az)));
+      __m128 rw = _mm_add_ps(aw, _mm_mul_ps(t, _mm_sub_ps(bw, aw)));
+
+      __m128 length = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(rx, rx), _mm_mul_ps(ry, ry)),
+        _mm_add_ps(_mm_mul_ps(rz, rz), _mm_mul_ps(rw, rw))));
+      _mm_storeu_ps(&pose.x[i], _mm_div_ps(rx, length));
+      _mm_storeu_ps(&pose.y[i], _mm_div_ps(ry, length));
+      _mm_storeu_ps(&pose.z[i], _mm_div_ps(rz, length));
+      _mm_storeu_ps(&pose.w[i], _mm_div_ps(rw, length));
+    }
+
+    #undef PHANTOM_DECODE
+  }
+#endif
+
+  for (; i < count; ++i) {
+    Quat q = Nlerp(Dequantise(keys.ax[i], keys.ay[i], keys.az[i]), Dequantise(keys.bx[i], keys.by[i], keys.bz[i]),
+      keys.alpha[i]);
+    pose.x[i] = q.x; pose.y[i] = q.y; pose.z[i] = q.z; pose.w[i] = q.w;
+  }
+}
+
+/// Normalised lerp from a to b. out may be either of them
+
+void AnimationPlayer::Blend(const AnimationPose &a, const AnimationPose &b, float_t t, AnimationPose &out, bool simd) {
+
+  size_t i = 0;
+  size_t count = out.x.size();
+
+#ifdef __SSE2__
+  if (simd) {
+    const __m128 weight = _mm_set1_ps(t);
+    const __m128 sign = _mm_set1_ps(-0.0f);
+
+    for (; i < count; i += 4) {
+      __m128 ax = _mm_loadu_ps(&a.x[i]), ay = _mm_loadu_ps(&a.y[i]), az = _mm_loadu_ps(&a.z[i]), aw = _mm_loadu_ps(&a.w[i]);
+      __m128 bx = _mm_loadu_ps(&b.x[i]), by = _mm_loadu_ps(&b.y[i]), bz = _mm_loadu_ps(&b.z[i]), bw = _mm_loadu_ps(&b.w[i]);
+
+      __m128 dot = _mm_add_ps(_mm_add_ps(_mm_mul_ps(ax, bx), _mm_mul_ps(ay, by)),
+        _mm_add_ps(_mm_mul_ps(az, bz), _mm_mul_ps(aw, bw)));
+      __m128 flip = _mm_and_ps(dot, sign);
+      bx = _mm_xor_ps(bx, flip); by = _mm_xor_ps(by, flip);
+      bz = _mm_xor_ps(bz, flip); bw = _mm_xor_ps(bw, flip);
+
+      __m128 rx = _mm_add_ps(ax, _mm_mul_ps(weight, _mm_sub_ps(bx, ax)));
+      __m128 ry = _mm_add_ps(ay, _mm_mul_ps(weight, _mm_sub_ps(by, ay)));
+      __m128 rz = _mm_add_ps(az, _mm_mul_ps(weight, _mm_sub_ps(bz, az)));
+      __m128 rw = _mm_add_ps(aw, _mm_mul_ps(weight, _mm_sub_ps(bw, aw)));
+
+      __m128 length = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(rx, rx), _mm_mul_ps(ry, ry)),
+        _mm_add_ps(_mm_mul_ps(rz, rz), _mm_mul_ps(rw, rw))));
+      _mm_storeu_ps(&out.x[i], _mm_div_ps(rx, length));
+      _mm_storeu_ps(&out.y[i], _mm_div_ps(ry, length));
+      _mm_storeu_ps(&out.z[i], _mm_div_ps(rz, length));
+      _mm_storeu_ps(&out.w[i], _mm_div_ps(rw, length));
+    }
+  }
+#endif
+
+  for (; i < count; ++i) {
+    Quat qa = { a.x[i], a.y[i], a.z[i], a.w[i] };
+    Quat qb = { b.x[i], b.y[i], b.z[i], b.w[i] };
+    Quat q = Nlerp(qa, qb, t);
+    out.x[i] = q.x; out.y[i] = q.y; out.z[i] = q.z; out.w[i] = q.w;
+  }
+}
+
+/// 2000 headset frames per clip, about 27s of playback at 75Hz, on a copy of the state so
+/// playback is untouched
+
+void AnimationPlayer::Benchmark() {
+  CXSHARED
+
+  const size_t kFrames = 2000;
+  const double_t kStep = 1.0 / 75.0;
+
+  Keys keys;
+  keys.Resize(obj_->names.size());
+  AnimationPose pose, other;
+  pose.Resize(obj_->names.size());
+  other.Resize(obj_->names.size());
+
+  for (Binding binding : obj_->bindings) {
+    if (!binding.clip || !binding.clip.loaded())
+      continue;
+
+    size_t tracked = std::count_if(binding.tracks.begin(), binding.tracks.end(), [](int32_t t) { return t >= 0; });
+    double_t cost[2], blend[2];
+
+    for (size_t simd = 0; simd < 2; ++simd) {
+      if (simd == 1 && !obj_->simd) {
+        cost[1] = cost[0];
+        blend[1] = blend[0];
+        continue;
+      }
+
+      binding.time = 0;
+      double_t start = NowSeconds();
+      for (size_t f = 0; f < kFrames; ++f) {
+        binding.time += kStep;
+        Sample(binding, keys, pose, simd == 1);
+      }
+      cost[simd] = (NowSeconds() - start) / kFrames / obj_->names.size();
+
+      start = NowSeconds();
+      for (size_t f = 0; f < kFrames; ++f)
+        Blend(other, pose, 0.5f, other, simd == 1);
+      blend[simd] = (NowSeconds() - start) / kFrames / obj_->names.size();
+    }
+
+    AnimationClip clip = binding.clip;
+    cout << "AnimationPlayer: " << clip.path() << " " << obj_->names.size() << " bones (" << tracked << " in clip)"
+      << " keys " << clip.keys() << "/" << clip.raw_keys()
+      << " " << clip.bytes() << " bytes against " << clip.raw_keys() * 4 * sizeof(float_t)
+      << " sample " << cost[0] * 1.0e9 << "ns scalar " << cost[1] * 1.0e9 << "ns simd"
+      << " blend " << blend[0] * 1.0e9 << "ns scalar " << blend[1] * 1.0e9 << "ns simd, per bone" << endl;
+  }
+}
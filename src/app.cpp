@@ -8,6 +8,7 @@
 
 #include "app.hpp"
 #include <signal.h>
+#include <sstream>
 
 
 using namespace std;
@@ -28,32 +29,189 @@ using namespace s9::oni;
 
   std::srand(std::time(0)); 
 
+  // Our own programs go in first, so the driver is compiling them while Seburo builds the
+  // scene graph shaders and everything else loads. They are only waited on when first used
+
+  init_start_ = NowSeconds();
+  programs_ = ProgramCache(file_settings_["shaders/cache"].Value());
+  program_warp_ = programs_.Add("barrel", "./data/barrel.vert", "./data/barrel.frag", "./data/barrel.geom");
+  program_balls_ = programs_.Add("ball_instanced", "./data/ball_instanced.vert", "./data/ball_instanced.frag");
+  program_hidden_area_ = programs_.Add("hidden_area", "./data/hidden_area.vert", "./data/hidden_area.frag");
+  program_accumulator_ = programs_.Add("accumulator", "./data/accumulator.vert", "./data/accumulator.frag");
+  programs_.Build();
+
   // File Load
 
   shader_skinning_ = Shader(s9::File("./data/skinning.glsl"));
   shader_quad_= Shader( s9::File("./data/quad_texture.vert"), s9::File("./data/quad_texture.frag"));
   shader_colour_ = Shader(s9::File("./data/solid_colour.glsl"));
 
-  shader_warp_ = Shader( s9::File("./data/barrel.vert"), 
-        s9::File("./data/barrel.frag"),
-        s9::File("./data/barrel.geom"));
-
   shader_room_ = Shader( s9::File("./data/basic_mesh.vert"),  s9::File("./data/textured_mesh.frag"));
+  shader_depth_ = Shader( s9::File("./data/quad_texture.vert"), s9::File("./data/depth_overlay.frag"));
+
+  // Per frame state lives in uniform blocks. Their bindings are fixed here, once
+
+  ResolveUniformBlocks(shader_skinning_);
+  ResolveUniformBlocks(shader_colour_);
+  ResolveUniformBlocks(shader_room_);
+  warp_blocks_resolved_ = programs_reported_ = false;
 
-  // Oculus Rift Setup
+  eyes_ = UniformBuffer<EyeBlock>(UNIFORM_BINDING_EYES);
+  warp_ = UniformBuffer<WarpBlock>(UNIFORM_BINDING_WARP);
 
-  oculus_ = oculus::OculusBase(0.01f, 100.0f);
+  passes_ = UniformBuffer<PassBlock>(UNIFORM_BINDING_PASS, 2);
+  passes_.data(0).eye = glm::ivec4(0);
+  passes_.data(1).eye = glm::ivec4(1);
+  passes_.Upload();
+
+  // Oculus Rift Setup. Without one the simulated headset drives the same render path
+
+  SimulatedHMDSettings hs;
+  hs.enabled = FromStringS9<bool>(*file_settings_["hmd/simulate"]);
+  hs.resolution = glm::vec2( FromStringS9<float_t>(*file_settings_["hmd/resolution/x"]),
+    FromStringS9<float_t>(*file_settings_["hmd/resolution/y"]));
+  hs.ipd = FromStringS9<float_t>(*file_settings_["hmd/ipd"]);
+  hs.yaw = FromStringS9<float_t>(*file_settings_["hmd/track/yaw"]);
+  hs.pitch = FromStringS9<float_t>(*file_settings_["hmd/track/pitch"]);
+  hs.roll = FromStringS9<float_t>(*file_settings_["hmd/track/roll"]);
+  hs.period = FromStringS9<double_t>(*file_settings_["hmd/track/period"]);
+
+  headset_ = Headset(0.01f, 100.0f, hs);
+  timewarp_ = FromStringS9<bool>(*file_settings_["hmd/timewarp"]);
+  frame_cost_ = 0;
+  frame_cost_max_ = 0;
+  frame_count_ = 0;
 
   // OpenNI
   openni_ = OpenNIBase(openni::ANY_DEVICE);
   openni_skeleton_tracker_ = OpenNISkeleton(openni_);
 
+  sensor_ = SensorIngest(openni_, openni_skeleton_tracker_, FromStringS9<double_t>(*file_settings_["sensor/poll_rate"]),
+    FromStringS9<size_t>(*file_settings_["users/max"]));
+
+  if (FromStringS9<bool>(*file_settings_["depth/enabled"])) {
+    DepthColliderSettings ds;
+    ds.downsample = FromStringS9<size_t>(*file_settings_["depth/downsample"]);
+    ds.near_clip = FromStringS9<float_t>(*file_settings_["depth/near"]);
+    ds.far_clip = FromStringS9<float_t>(*file_settings_["depth/far"]);
+    ds.voxel_size = FromStringS9<float_t>(*file_settings_["depth/voxel_size"]);
+    ds.min_points = FromStringS9<size_t>(*file_settings_["depth/min_points"]);
+    ds.max_spheres = FromStringS9<size_t>(*file_settings_["depth/max_spheres"]);
+    ds.budget = FromStringS9<double_t>(*file_settings_["depth/budget_ms"]) / 1000.0;
+    ds.sensor_position = glm::vec3( FromStringS9<float_t>(*file_settings_["depth/sensor/x"]),
+      FromStringS9<float_t>(*file_settings_["depth/sensor/y"]),
+      FromStringS9<float_t>(*file_settings_["depth/sensor/z"]));
+    ds.volume_min = glm::vec3(-1.5f, 0.0f, -1.5f);
+    ds.volume_max = glm::vec3(1.5f, 2.5f, 1.5f);
+    ds.fov_h = 58.0f; // Xtion / Kinect depth camera
+    ds.fov_v = 45.0f;
+
+    depth_colliders_ = DepthColliders(ds);
+    depth_centres_.reserve(ds.max_spheres);
+    depth_colliders_.Start();
+    sensor_.set_depth_colliders(depth_colliders_);
+  }
+
+  // Camera images for the overlay. The sensor writes them straight into mapped GPU memory
+
+  depth_overlay_ = false;
+  if (FromStringS9<bool>(*file_settings_["feed/enabled"])) {
+    size_t feed_width = FromStringS9<size_t>(*file_settings_["feed/width"]);
+    size_t feed_height = FromStringS9<size_t>(*file_settings_["feed/height"]);
+
+    depth_feed_ = CameraFeed(feed_width, feed_height, FEED_DEPTH16);
+    sensor_.set_depth_feed(depth_feed_);
+
+    if (FromStringS9<bool>(*file_settings_["feed/colour"])) {
+      colour_feed_ = CameraFeed(feed_width, feed_height, FEED_RGB8);
+      sensor_.set_colour_feed(colour_feed_);
+    }
+
+    depth_overlay_ = FromStringS9<bool>(*file_settings_["feed/overlay"]);
+
+    // Temporal smoothing of the depth feed. On the GPU it works on the uploaded texture,
+    // otherwise on the sensor thread so the colliders get the smoothed depth as well.
+    // Either way the sensor thread resets it when the tracked joints turn quickly
+
+    if (FromStringS9<bool>(*file_settings_["accumulate/enabled"])) {
+      AccumulatorSettings as;
+      as.mode = file_settings_["accumulate/mode"].Value() == "box" ? ACCUMULATE_BOX : ACCUMULATE_EMA;
+      as.alpha = FromStringS9<float_t>(*file_settings_["accumulate/alpha"]);
+      as.samples = FromStringS9<size_t>(*file_settings_["accumulate/samples"]);
+      as.reject = FromStringS9<float_t>(*file_settings_["accumulate/reject_mm"]);
+      as.motion_threshold = FromStringS9<float_t>(*file_settings_["accumulate/motion_threshold"]);
+      as.holes = true;
+
+      if (FromStringS9<bool>(*file_settings_["accumulate/gpu"])) {
+        as.reject /= 65535.0f;
+        depth_accumulator_ = Accumulator(feed_width, feed_height, GL_R32F, programs_.program(program_accumulator_), as);
+      } else {
+        depth_accumulator_ = Accumulator(feed_width, feed_height, as);
+      }
+      sensor_.set_depth_accumulator(depth_accumulator_);
+    }
+  }
+
+  // Depth texels are millimetres normalised over the full 16 bits
+  depth_near_ = FromStringS9<float_t>(*file_settings_["depth/near"]) * 1000.0f / 65535.0f;
+  depth_far_ = FromStringS9<float_t>(*file_settings_["depth/far"]) * 1000.0f / 65535.0f;
+
+  // Offline replay of a recorded session takes the place of the sensor entirely
+
+  offline_ = FromStringS9<bool>(*file_settings_["render/enabled"]);
+  offline_time_ = 0;
+  if (offline_) {
+    player_ = SessionPlayer(file_settings_["render/session"].Value());
+    if (!player_.loaded()) {
+      cerr << "PhantomLimb: nothing to replay. Running live" << endl;
+      offline_ = false;
+    }
+  }
+
+  if (!offline_) {
+    sensor_.Start();
+    if (FromStringS9<bool>(*file_settings_["session/record"]))
+      recorder_ = SessionRecorder(file_settings_["session/path"].Value());
+  }
+
+  // Depth from a rectified stereo pair stands in for the sensor when there is no OpenNI device
+
+  if (FromStringS9<bool>(*file_settings_["stereo/enabled"]) && !openni_.ready() && !offline_) {
+    StereoSettings ss;
+    ss.max_disparity = FromStringS9<size_t>(*file_settings_["stereo/max_disparity"]);
+    ss.block_radius = FromStringS9<size_t>(*file_settings_["stereo/block_radius"]);
+    ss.levels = FromStringS9<size_t>(*file_settings_["stereo/levels"]);
+    ss.threads = FromStringS9<size_t>(*file_settings_["stereo/threads"]);
+    ss.cost = file_settings_["stereo/cost"].Value() == "census" ? STEREO_CENSUS : STEREO_SAD;
+    ss.uniqueness = FromStringS9<float_t>(*file_settings_["stereo/uniqueness"]);
+    ss.focal_length = FromStringS9<float_t>(*file_settings_["stereo/focal_length"]);
+    ss.baseline = FromStringS9<float_t>(*file_settings_["stereo/baseline"]);
+
+    stereo_ = StereoMatcher(ss);
+    if (depth_colliders_)
+      stereo_.set_depth_colliders(depth_colliders_);
+    if (depth_feed_)
+      stereo_.set_depth_feed(depth_feed_);
+
+    StereoPair pair;
+    if (StereoMatcher::LoadPair(file_settings_["stereo/left"].Value(), file_settings_["stereo/right"].Value(), pair)) {
+      if (FromStringS9<bool>(*file_settings_["stereo/benchmark"]))
+        stereo_.Benchmark(pair);
+      stereo_.Start();
+      stereo_.Submit(pair);
+    }
+  }
+
   // Virtual Cameras
   // Calibrated for the Sintel Model
   camera_= Camera( glm::vec3(0.0f,1.59f,-0.04),  glm::vec3(0.0,1.59f,-4.0f));
   camera_.set_update_on_node_draw(false);
   camera_.set_near(0.01f);
   camera_.Resize(1280,800);
+  camera_.Update();
+  base_view_ = camera_.view_matrix();
+  view_position_ = glm::vec3(glm::inverse(base_view_)[3]);
+  absolute_pose_ = file_settings_["hmd/pose"].Value() != "incremental";
 
   camera_left_ = Camera(glm::vec3(0.0f,0.0f,0.0f));
   camera_right_ = Camera(glm::vec3(0.0f,0.0f,0.0f));
@@ -66,24 +224,97 @@ using namespace s9::oni;
   camera_ortho_.set_far(1.0f);
   camera_ortho_.set_orthographic(true);
 
-  // MD5 Model Load
-
-  md5_ = MD5Model( s9::File("./data/tracksuit/tracksuit.md5mesh") ); 
-  //md5_.set_geometry_cast(WIREFRAME);
+  // The overlay is drawn flat into each eye of the FBO, so it gets warped with the scene
+  camera_overlay_left_ = Camera(glm::vec3(0.0f,0.0f,0.1f));
+  camera_overlay_left_.set_near(0.01f);
+  camera_overlay_left_.set_far(1.0f);
+  camera_overlay_left_.set_orthographic(true);
 
-  // Nodes
+  camera_overlay_right_ = Camera(glm::vec3(0.0f,0.0f,0.1f));
+  camera_overlay_right_.set_near(0.01f);
+  camera_overlay_right_.set_far(1.0f);
+  camera_overlay_right_.set_orthographic(true);
 
-  node_model_.Add(md5_).Add(shader_skinning_);
+  // MD5 Model Load - one instance per user so each has its own skeleton.
+  // User 0 is the patient and stands at the camera; anyone else is spaced out along x
 
   model_base_mat_ = glm::rotate(glm::mat4(), 180.0f, glm::vec3(0.0f, 1.0f, 0.0f));
   model_base_mat_ = glm::rotate(model_base_mat_, -90.0f, glm::vec3(1.0f, 0.0f, 0.0f));
   //mat = glm::scale(mat, glm::vec3(0.1f,0.1f,0.1f));
-  
-  node_model_.set_matrix(model_base_mat_);
+
+  size_t max_users = std::max<size_t>(1, FromStringS9<size_t>(*file_settings_["users/max"]));
+  float_t user_spacing = FromStringS9<float_t>(*file_settings_["users/spacing"]);
+
+  users_.resize(max_users);
+  user_models_.resize(max_users);
+  user_nodes_.resize(max_users);
+
+  for (size_t i = 0; i < max_users; ++i) {
+    user_models_[i] = MD5Model( s9::File("./data/tracksuit/tracksuit.md5mesh") ); 
+    //user_models_[i].set_geometry_cast(WIREFRAME);
+
+    users_[i].sample.tracked = false;
+    users_[i].sample.slot = static_cast<uint32_t>(i);
+    users_[i].sample.user_id = 0;
+    users_[i].offset = glm::translate(glm::mat4(1.0f), glm::vec3(user_spacing * i, 0.0f, 0.0f));
+    users_[i].update_cost = 0;
+    users_[i].in_scene = false;
+
+    // Nodes
+    user_nodes_[i].Add(user_models_[i]).Add(shader_skinning_);
+    user_nodes_[i].set_matrix(users_[i].offset * model_base_mat_);
+  }
+
+  // Animation clips - an idle for when the user is tracked and a fallback for when they are
+  // not. Each user gets their own player over the same compressed clips
+
+  animation_fade_ = FromStringS9<double_t>(*file_settings_["animation/fade"]);
+
+  if (FromStringS9<bool>(*file_settings_["animation/enabled"])) {
+    AnimationSettings as;
+    as.tolerance = FromStringS9<float_t>(*file_settings_["animation/tolerance"]);
+
+    std::vector<AnimationClip> clips;
+    clips.push_back(AnimationClip(file_settings_["animation/idle"].Value(), as));
+    if (file_settings_["animation/fallback"].Value() == file_settings_["animation/idle"].Value())
+      clips.push_back(clips[0]);
+    else
+      clips.push_back(AnimationClip(file_settings_["animation/fallback"].Value(), as));
+
+    const char *arm_bones[] = {"upper_arm.L", "lower_arm.L", "upper_arm.R", "lower_arm.R"};
+
+    for (size_t i = 0; i < max_users; ++i) {
+      users_[i].animation = AnimationPlayer(clips);
+      users_[i].fallback = 0;
+      users_[i].was_tracked = true;
+
+      AnimationPlayer &player = users_[i].animation;
+      animation_arms_.assign(player.num_bones(), -1);
+      users_[i].animation_bones.resize(player.num_bones());
+      for (size_t b = 0; b < player.num_bones(); ++b) {
+        users_[i].animation_bones[b] = user_models_[i].skeleton().GetBone(player.bone_name(b));
+        for (size_t a = 0; a < 4; ++a) {
+          if (player.bone_name(b) == arm_bones[a])
+            animation_arms_[b] = static_cast<int32_t>(a);
+        }
+      }
+    }
+
+    // Sampling cost per bone, on these clips and any heavier ones we were pointed at
+    if (FromStringS9<bool>(*file_settings_["animation/benchmark"])) {
+      std::istringstream paths(file_settings_["animation/benchmark_clips"].Value());
+      std::string path;
+      while (paths >> path)
+        clips.push_back(AnimationClip(path, as));
+      AnimationPlayer(clips).Benchmark();
+    }
+  }
 
   quad_ = Quad(320,240);
-  node_depth_.Add(quad_).Add(shader_quad_).Add(camera_ortho_);
-  node_colour_.Add(quad_).Add(shader_quad_).Add(camera_ortho_);
+  node_depth_.Add(quad_).Add(shader_depth_)
+    .Add(gl::ShaderClause<float_t,1>("uNear", depth_near_))
+    .Add(gl::ShaderClause<float_t,1>("uFar", depth_far_));
+  node_colour_.Add(quad_).Add(shader_quad_);
 
   hand_left_colour_ = glm::vec4(1.0f,0.0f,0.0f,1.0f);
   hand_right_colour_ = glm::vec4(0.0f,1.0f,0.0f,1.0f);
@@ -103,13 +334,14 @@ using namespace s9::oni;
 
   // Physics Ball
   ball_radius_ = 0.25f;
-  Sphere ball(ball_radius_, 30);
   ball_colour_ = glm::vec4(1.0f,0.0f,1.0f,1.0f);
-  node_ball_.Add(shader_colour_).Add(ball).Add(gl::ShaderClause<glm::vec4,1>("uColour", ball_colour_));
+  // One over the limit, as the physics only resets once the limit is passed
+  ball_batch_ = BallBatch(ball_radius_, 30, ball_colour_, programs_.program(program_balls_),
+    FromStringS9<size_t>(*file_settings_["physics/max_balls"]) + 1);
 
   // Skeleton Shape
 
-  skeleton_shape_ = SkeletonShape(md5_.skeleton());
+  skeleton_shape_ = SkeletonShape(user_models_[0].skeleton());
   //skeleton_shape_.set_geometry_cast(WIREFRAME);
   //skeleton_shape_.Add(shader_colour_).Add(camera_);
   //node_model_.Add(skeleton_shape_);
@@ -122,20 +354,136 @@ using namespace s9::oni;
   //node_left_.Add(camera_left_).Add(node_model_).Add(node_hands_).Add(room_);
   //node_right_.Add(camera_right_).Add(node_model_).Add(node_hands_).Add(room_);
 
-  node_left_.Add(camera_left_).Add(node_model_).Add(room_);
-  node_right_.Add(camera_right_).Add(node_model_).Add(room_);
+  // Everything either eye can draw is registered with the render queue once, under that
+  // eye's camera. Each frame DrawScene submits what is in the scene and the queue orders it.
+  // The patient is always drawn. Other users are submitted while they are tracked
+
+  render_queue_ = RenderQueue([this](uint8_t eye) { BindEyePass(eye); });
+
+  Camera eye_cameras[2] = {camera_left_, camera_right_};
+  for (size_t eye = 0; eye < 2; ++eye) {
+    user_items_[eye].resize(max_users);
+    for (size_t i = 0; i < max_users; ++i) {
+      Node node;
+      node.Add(eye_cameras[eye]).Add(user_nodes_[i]);
+      user_items_[eye][i] = render_queue_.Register(PROGRAM_SKINNING, 0, static_cast<uint16_t>(i), [node]() mutable { node.Draw(); });
+    }
+
+    Node room;
+    room.Add(eye_cameras[eye]).Add(room_);
+    room_items_[eye] = render_queue_.Register(PROGRAM_ROOM, 0, 0, [room]() mutable { room.Draw(); });
+    ball_items_[eye] = render_queue_.Register(PROGRAM_BALLS, 0, 0, [this]() { ball_batch_.Draw(); });
+  }
+
+  users_[0].in_scene = true;
+  stats_time_ = 0;
   
   // Game stuff
 
   arm_state_ = BOTH_ARMS;
   playing_game_ = false;
-  arm_emphasis_ = FromStringS9<bool>(*file_settings_["game/emphasis"]);
+
+  // The operator changes these through snapshots. The settings file is only read from here on
+  GameSettings game;
+  game.Read(file_settings_);
+  game_ = std::make_shared<const GameSettings>(game);
+  if (console_ && console_.connected())
+    console_.PublishSettings(game);
   last_shot_ = 0;
 
   // Physics
 
+  size_t proxy_count = depth_colliders_ ? depth_colliders_.settings().max_spheres : 0;
+  float_t proxy_radius = depth_colliders_ ? depth_colliders_.settings().voxel_size * 0.5f : 0.0f;
+
+  PhysicsProfile profile;
+  profile.name = file_settings_["physics/name"].Value();
+  profile.broadphase = file_settings_["physics/broadphase"].Value() == "axis_sweep" ? BROADPHASE_AXIS_SWEEP : BROADPHASE_DBVT;
+  profile.world_min = glm::vec3( FromStringS9<float_t>(*file_settings_["physics/world/min/x"]),
+    FromStringS9<float_t>(*file_settings_["physics/world/min/y"]),
+    FromStringS9<float_t>(*file_settings_["physics/world/min/z"]));
+  profile.world_max = glm::vec3( FromStringS9<float_t>(*file_settings_["physics/world/max/x"]),
+    FromStringS9<float_t>(*file_settings_["physics/world/max/y"]),
+    FromStringS9<float_t>(*file_settings_["physics/world/max/z"]));
+  profile.solver_iterations = FromStringS9<int>(*file_settings_["physics/solver_iterations"]);
+  profile.max_substeps = FromStringS9<int>(*file_settings_["physics/max_substeps"]);
+  profile.fixed_timestep = 1.0 / FromStringS9<double_t>(*file_settings_["physics/step_rate"]);
+  profile.linear_sleep = FromStringS9<float_t>(*file_settings_["physics/sleep/linear"]);
+  profile.angular_sleep = FromStringS9<float_t>(*file_settings_["physics/sleep/angular"]);
+  profile.deactivation_time = FromStringS9<float_t>(*file_settings_["physics/sleep/time"]);
+  profile.multithreaded = FromStringS9<bool>(*file_settings_["physics/multithreaded"]);
+  profile.threads = FromStringS9<size_t>(*file_settings_["physics/threads"]);
+  profile.ground_size = FromStringS9<float_t>(*file_settings_["physics/ground_size"]);
+  profile.log_interval = FromStringS9<double_t>(*file_settings_["physics/log_interval"]);
+  profile.ccd = FromStringS9<bool>(*file_settings_["physics/ccd"]);
+  profile.hand_interpolation = FromStringS9<bool>(*file_settings_["physics/hand_interpolation"]);
+  profile.backend = file_settings_["physics/backend"].Value() == "spheres" ? PHYSICS_SPHERES : PHYSICS_BULLET;
+  profile.max_balls = FromStringS9<size_t>(*file_settings_["physics/max_balls"]);
+  profile.sphere_iterations = FromStringS9<size_t>(*file_settings_["physics/sphere_iterations"]);
+
+  // The sphere solver spreads its contact passes over the same workers as the simulation
+  tasks_ = TaskSystem(FromStringS9<size_t>(*file_settings_["tasks/threads"]));
+
+  if (FromStringS9<bool>(*file_settings_["physics/benchmark"]))
+    PhantomPhysics::Benchmark(FromStringS9<float_t>( *file_settings_["game/gravity"]),
+      FromStringS9<float_t>(*file_settings_["game/hand_radius"]), profile, tasks_);
+
+  size_t soak_resets = FromStringS9<size_t>(*file_settings_["physics/soak"]);
+  if (soak_resets > 0)
+    PhantomPhysics::Soak(FromStringS9<float_t>( *file_settings_["game/gravity"]),
+      FromStringS9<float_t>(*file_settings_["game/hand_radius"]), profile, soak_resets);
+
   physics_ = PhantomPhysics( FromStringS9<float_t>( *file_settings_["game/gravity"]), 
-    FromStringS9<float_t>(*file_settings_["game/hand_radius"]));
+    FromStringS9<float_t>(*file_settings_["game/hand_radius"]), users_.size(), proxy_count, proxy_radius, profile, tasks_);
+
+  // One frame of simulation as a task graph. Users retarget in parallel - each only moves its
+  // own hands - and the physics step follows once every hand target is in
+
+  pipelined_ = FromStringS9<bool>(*file_settings_["tasks/pipeline"]);
+  sim_pending_ = false;
+  telemetry_ = TelemetrySample();
+  sim_dt_ = sim_wait_ = sim_wall_ = skipped_dt_ = 0;
+  sim_frames_ = 0;
+
+  sim_graph_ = TaskGraph(true);
+  size_t sensor_task = sim_graph_.Add("sensor", [this]() { DrainSensor(); });
+  size_t game_task = sim_graph_.Add("game", [this]() { UpdateGame(sim_dt_); });
+  size_t physics_task = sim_graph_.Add("physics", [this]() { physics_.Update(sim_dt_); });
+
+  // The game records fired balls alongside the sensor samples, so it waits for the drain
+  sim_graph_.Depend(game_task, sensor_task);
+  sim_graph_.Depend(physics_task, game_task);
+
+  for (size_t i = 0; i < users_.size(); ++i) {
+    size_t retarget_task = sim_graph_.Add("retarget", [this, i]() {
+      double_t start = NowSeconds();
+      UpdateUser(i, sim_dt_);
+      users_[i].update_cost = NowSeconds() - start;
+    });
+    sim_graph_.Depend(retarget_task, sensor_task);
+    sim_graph_.Depend(physics_task, retarget_task);
+  }
+
+  cout << "PhantomLimb: task system " << tasks_.threads() << " workers, simulation "
+    << (pipelined_ ? "pipelined one frame ahead" : "in step with the frame") << endl;
+
+  // Mesh parse throughput - the mapped, chunked parser against the stream reference and the
+  // Seburo loaders we actually build meshes with
+
+  if (FromStringS9<bool>(*file_settings_["parse/benchmark"])) {
+    MeshParser parser(tasks_, FromStringS9<size_t>(*file_settings_["parse/chunk_kb"]) * 1024);
+    parser.Benchmark("./data");
+
+    for (const std::string &path : MeshParser::FindMeshes("./data")) {
+      double_t start = NowSeconds();
+      if (path.compare(path.size() - 4, 4, ".obj") == 0)
+        ObjMesh mesh = ObjMesh(s9::File(path));
+      else
+        MD5Model model = MD5Model(s9::File(path));
+      double_t taken = NowSeconds() - start;
+      cout << "PhantomLimb: Seburo loader " << path << " " << MappedFile(path).size() / (1024.0 * 1024.0) / taken << " MB/s" << endl;
+    }
+  }
 
   CXGLERROR
 
@@ -145,21 +493,187 @@ using namespace s9::oni;
   glEnable(GL_CULL_FACE);
   glCullFace(GL_BACK);
 
+  cout << "PhantomLimb: init took " << (NowSeconds() - init_start_) * 1000.0 << "ms" << endl;
+
 }
 
-// Moved onto the main thread as GCC gets upset on quitting the thread with OpenNI
+// OpenNI is polled on the sensor thread. Here we only drain the samples it has queued
+
+void PhantomLimb::DrainSensor() {
+
+  // Each user slot keeps only its newest sample - older ones are already stale
+
+  SkeletonSample sample;
+  while (sensor_.Pop(sample)) {
+    if (recorder_)
+      recorder_.Record(sample);
+    if (sample.slot < users_.size())
+      users_[sample.slot].sample = sample;
+  }
+
+  // Body collision from the depth stream, if the worker has something new
+
+  if (depth_colliders_ && depth_colliders_.Latest(depth_centres_))
+    physics_.SetDepthProxies(depth_centres_);
+}
+
+void PhantomLimb::UpdateGame(double_t dt) {
+  if (playing_game_){
+    last_shot_ += dt ;
+    if (last_shot_ > game_->fire_interval) {
+      last_shot_ = 0;
+      FireBall();
+    }
+  }
+}
+
+/// Launch the simulation graph. Nothing it touches may be read until FinishSimulation
+
+void PhantomLimb::StartSimulation(double_t dt) {
+  sim_dt_ = dt + skipped_dt_;
+  skipped_dt_ = 0;
+  tasks_.Run(sim_graph_);
+  sim_pending_ = true;
+}
+
+/// Wait for the simulation, helping out if it is not done, and keep its stage timings
+
+void PhantomLimb::FinishSimulation() {
+  double_t start = NowSeconds();
+  tasks_.Wait(sim_graph_);
+  sim_wait_ += NowSeconds() - start;
+  sim_pending_ = false;
+
+  for (size_t i = 0; i < sim_graph_.size(); ++i)
+    stage_times_[sim_graph_.name(i)] += sim_graph_.time(i);
+  sim_frames_++;
+
+  // The one point in a frame where nothing else is writing what the console reports. With the
+  // pipeline on, telemetry goes out while the next frame's graph is running
+  telemetry_.balls = physics_.ball_orients().size();
+  telemetry_.tracked = 0;
+  for (size_t i = 0; i < users_.size() && i < 32; ++i) {
+    if (users_[i].sample.tracked)
+      telemetry_.tracked |= 1u << i;
+  }
+  telemetry_.playing = playing_game_;
+}
+
+// Anything that must stay on the GL thread, which is now only the stats
 
 void PhantomLimb::UpdateMainThread(double_t dt) { 
 
+  // Report the per-user cost every few seconds
+
+  stats_time_ += dt;
+  sim_wall_ += dt;
+  if (stats_time_ > 5.0) {
+    stats_time_ = 0;
+    for (size_t i = 0; i < users_.size(); ++i) {
+      cout << "PhantomLimb: user " << i << " (NiTE " << users_[i].sample.user_id << ")"
+        << (users_[i].sample.tracked ? " tracked" : " idle")
+        << " update " << users_[i].update_cost * 1000.0 << "ms" << endl;
+    }
+
+    if (sim_frames_ > 0) {
+      cout << "PhantomLimb: simulation stages";
+      for (auto &stage : stage_times_) {
+        cout << " " << stage.first << " " << stage.second / sim_frames_ * 1000.0 << "ms";
+        stage.second = 0;
+      }
+      cout << ", frame waited " << sim_wait_ / sim_frames_ * 1000.0 << "ms"
+        << ", cores " << tasks_.busy() / (sim_wall_ * (tasks_.threads() + 1)) * 100.0 << "% busy"
+        << " (" << tasks_.threads() << " workers + main)" << endl;
+      tasks_.Clear();
+      sim_wait_ = sim_wall_ = 0;
+      sim_frames_ = 0;
+    }
+
+    if (frame_count_ > 0) {
+      cout << "PhantomLimb: " << (headset_.simulated() ? "simulated headset" : "rift") << " frames " << frame_count_
+        << " cpu " << frame_cost_ / frame_count_ * 1000.0 << "ms"
+        << " max " << frame_cost_max_ * 1000.0 << "ms" << endl;
+      frame_cost_ = 0;
+      frame_cost_max_ = 0;
+      frame_count_ = 0;
+    }
+
+    if (pacer_) {
+      cout << "PhantomLimb: pacing " << (pacer_.half_rate() ? "half rate" : "full rate")
+        << " at " << 1.0 / pacer_.period() << "Hz" << endl;
+      pacer_.Clear();
+    }
+
+    if (latency_ && latency_.frames() > 0) {
+      cout << "PhantomLimb: motion to warp " << latency_.render_latency() * 1000.0 << "ms from render pose, "
+        << latency_.warp_latency() * 1000.0 << "ms from latched pose"
+        << (timewarp_ ? " (timewarp on)" : " (timewarp off)") << endl;
+      latency_.Clear();
+    }
+
+    if (hidden_area_) {
+      cout << "PhantomLimb: hidden area " << hidden_area_.coverage() * 100.0f << "% masked,"
+        << " samples " << hidden_area_.masked_samples() << " vs " << hidden_area_.unmasked_samples() << " unmasked,"
+        << " eye passes " << hidden_area_.masked_time() * 1000.0 << "ms vs " << hidden_area_.unmasked_time() * 1000.0 << "ms unmasked" << endl;
+      hidden_area_.Clear();
+    }
+
+    if (render_queue_) {
+      cout << "PhantomLimb: render queue draws " << render_queue_.draws()
+        << " pass binds " << render_queue_.pass_binds() << " (" << render_queue_.unsorted_pass_binds() << " unsorted)" << endl;
+    }
+
+    if (stereo_) {
+      cout << "PhantomLimb: stereo frames " << stereo_.frames()
+        << " " << stereo_.megapixels_per_second() << " MP/s"
+        << " at " << stereo_.settings().max_disparity << " disparities"
+        << " (" << stereo_.last_cost() * 1000.0 << "ms)" << endl;
+    }
+
+    if (depth_feed_) {
+      cout << "PhantomLimb: depth feed " << (depth_feed_.persistent() ? "persistent" : "staged")
+        << " submitted " << depth_feed_.submitted()
+        << " dropped " << depth_feed_.dropped()
+        << " uploaded " << depth_feed_.uploaded()
+        << " upload " << depth_feed_.upload_cost() * 1000.0 << "ms" << endl;
+    }
+
+    if (depth_accumulator_) {
+      cout << "PhantomLimb: depth accumulator " << (depth_accumulator_.gpu() ? "gpu" : "cpu")
+        << " samples " << depth_accumulator_.count()
+        << " resets " << depth_accumulator_.resets()
+        << " cost " << depth_accumulator_.last_cost() * 1000.0 << "ms" << endl;
+    }
+  }
+
+}
+
+/// Retarget a single users skeleton onto their model and move their physics hands
+
+void PhantomLimb::UpdateUser(size_t idx, double_t dt) {
+
+  TrackedUser &user_state = users_[idx];
+  MD5Model &model = user_models_[idx];
+
   // update the skeleton positions
-  md5_.skeleton().Update();
+  model.skeleton().Update();
+
+  // Add or remove this user from the scene as tracking comes and goes. The patient always stays
+
+  if (idx > 0 && user_state.sample.tracked != user_state.in_scene) {
+    if (!user_state.sample.tracked)
+      physics_.ParkHands(idx);
+    user_state.in_scene = user_state.sample.tracked;
+  }
+
+  if (!user_state.in_scene)
+    return;
 
   // Now copy over the positions of the captured skeleton to the MD5
 
-  if (openni_.ready()) {
-    openni_skeleton_tracker_.Update();
-    OpenNISkeleton::User user = openni_skeleton_tracker_.GetUserByID(1);
-    if (user.IsTracked()){
+  {
+    const SkeletonSample &user = user_state.sample;
+    if (user.tracked){
 
       // Returned matrices are rotated 180 which is annoying but thats the OpenNI Way
       // In addition, the MD5 model may not have rest orientations that are anywhere near the same :S
@@ -206,7 +720,7 @@ void PhantomLimb::UpdateMainThread(double_t dt) {
  
       // LEFT Model Arm Upper
 
-      Bone * luparm = md5_.skeleton().GetBone("upper_arm.L");
+      Bone * luparm = model.skeleton().GetBone("upper_arm.L");
       if (luparm != nullptr) {
         
         glm::quat final_rotation;
@@ -216,7 +730,7 @@ void PhantomLimb::UpdateMainThread(double_t dt) {
           case BOTH_ARMS:
           case LEFT_ARM_RIGHT_MIRROR:
           case LEFT_ARM_COPY:
-            final_rotation = user.skeleton().GetBone("Left Shoulder")->rotation();
+            final_rotation = user.joints[LEFT_SHOULDER];
           break;  
 	       
           case LEFT_ARM_RIGHT_FROZEN:
@@ -225,7 +739,7 @@ void PhantomLimb::UpdateMainThread(double_t dt) {
 
           case RIGHT_ARM_LEFT_MIRROR:
           case RIGHT_ARM_LEFT_FROZEN: {
-            glm::quat tq = user.skeleton().GetBone("Right Shoulder")->rotation();
+            glm::quat tq = user.joints[RIGHT_SHOULDER];
             float_t angle = glm::angle(tq);
             glm::vec3 axis = glm::axis(tq);
             final_rotation = glm::angleAxis(-angle, -axis.x,axis.y,axis.z);
@@ -233,7 +747,7 @@ void PhantomLimb::UpdateMainThread(double_t dt) {
           }
 
           case RIGHT_ARM_COPY:
-            glm::quat tq = user.skeleton().GetBone("Right Shoulder")->rotation();
+            glm::quat tq = user.joints[RIGHT_SHOULDER];
             glm::quat tr = glm::angleAxis(-180.0f, 0.0f, 1.0f, 0.0f);
             float_t angle = glm::angle(tq);
             glm::vec3 axis = glm::axis(tq);
@@ -241,13 +755,14 @@ void PhantomLimb::UpdateMainThread(double_t dt) {
           break;
         }
 
-        luparm->set_rotation_relative( rys * rzs * final_rotation   * rzsi * rysi );
+        user_state.arm_pose[0] = rys * rzs * final_rotation   * rzsi * rysi;
+        luparm->set_rotation_relative( user_state.arm_pose[0] );
 
       }
 
       // LEFT Model Arm Lower
 
-      Bone * lloarm = md5_.skeleton().GetBone("lower_arm.L");
+      Bone * lloarm = model.skeleton().GetBone("lower_arm.L");
       if (lloarm != nullptr) {
         glm::quat final_rotation;
 
@@ -255,7 +770,7 @@ void PhantomLimb::UpdateMainThread(double_t dt) {
           case BOTH_ARMS:
           case LEFT_ARM_RIGHT_MIRROR:
           case LEFT_ARM_COPY:
-		        final_rotation = user.skeleton().GetBone("Left Elbow")->rotation();
+		        final_rotation = user.joints[LEFT_ELBOW];
           break;  
 	       
           case LEFT_ARM_RIGHT_FROZEN:
@@ -265,7 +780,7 @@ void PhantomLimb::UpdateMainThread(double_t dt) {
           case RIGHT_ARM_LEFT_MIRROR:
           case RIGHT_ARM_COPY:
           case RIGHT_ARM_LEFT_FROZEN:{
-            glm::quat tq =user.skeleton().GetBone("Right Elbow")->rotation();
+            glm::quat tq =user.joints[RIGHT_ELBOW];
             float_t angle = glm::angle(tq);
             glm::vec3 axis = glm::axis(tq);
             final_rotation = glm::angleAxis(-angle, -axis.x,axis.y,axis.z);
@@ -275,12 +790,13 @@ void PhantomLimb::UpdateMainThread(double_t dt) {
 
         }
 
-        lloarm->set_rotation_relative(  rys * rzs * final_rotation * rzsi * rysi);
+        user_state.arm_pose[1] = rys * rzs * final_rotation * rzsi * rysi;
+        lloarm->set_rotation_relative( user_state.arm_pose[1] );
       }
         
       // RIGHT Arm Upper
 
-      Bone * ruparm = md5_.skeleton().GetBone("upper_arm.R");
+      Bone * ruparm = model.skeleton().GetBone("upper_arm.R");
       if (ruparm != nullptr) {
         glm::quat final_rotation;
 
@@ -288,17 +804,17 @@ void PhantomLimb::UpdateMainThread(double_t dt) {
           case BOTH_ARMS:
           case RIGHT_ARM_LEFT_MIRROR:
           case RIGHT_ARM_COPY:
-            final_rotation = user.skeleton().GetBone("Right Shoulder")->rotation();
+            final_rotation = user.joints[RIGHT_SHOULDER];
           break;
 	       
           case RIGHT_ARM_LEFT_FROZEN: {
-            final_rotation = glm::angleAxis(90.0f,0.0f,0.0f,1.0f); // user.skeleton().GetBone("Right Shoulder")->rotation();
+            final_rotation = glm::angleAxis(90.0f,0.0f,0.0f,1.0f); // user.joints[RIGHT_SHOULDER];
             break;
           }
 
           case LEFT_ARM_RIGHT_MIRROR:
           case LEFT_ARM_RIGHT_FROZEN: {
-            glm::quat tq = user.skeleton().GetBone("Left Shoulder")->rotation();
+            glm::quat tq = user.joints[LEFT_SHOULDER];
             float_t angle = glm::angle(tq);
             glm::vec3 axis = glm::axis(tq);
             final_rotation = glm::angleAxis(-angle, -axis.x, axis.y, axis.z);
@@ -306,7 +822,7 @@ void PhantomLimb::UpdateMainThread(double_t dt) {
           }
 
           case LEFT_ARM_COPY:
-            glm::quat tq = user.skeleton().GetBone("Left Shoulder")->rotation();
+            glm::quat tq = user.joints[LEFT_SHOULDER];
             glm::quat tr = glm::angleAxis(-180.0f, 0.0f, 1.0f, 0.0f);
             float_t angle = glm::angle(tq);
             glm::vec3 axis = glm::axis(tq);
@@ -315,13 +831,14 @@ void PhantomLimb::UpdateMainThread(double_t dt) {
 
         }
 
-        ruparm->set_rotation_relative( nrys * nrzs *  final_rotation * nrzsi * nrysi  );
+        user_state.arm_pose[2] = nrys * nrzs *  final_rotation * nrzsi * nrysi;
+        ruparm->set_rotation_relative( user_state.arm_pose[2] );
 
       }
 
       // RIGHT Arm Lower
 
-      Bone * rloarm = md5_.skeleton().GetBone("lower_arm.R");
+      Bone * rloarm = model.skeleton().GetBone("lower_arm.R");
       if (rloarm != nullptr) {
         glm::quat final_rotation;
 
@@ -329,7 +846,7 @@ void PhantomLimb::UpdateMainThread(double_t dt) {
           case BOTH_ARMS:
           case RIGHT_ARM_LEFT_MIRROR:
           case RIGHT_ARM_COPY:
-            final_rotation = user.skeleton().GetBone("Right Elbow")->rotation();
+            final_rotation = user.joints[RIGHT_ELBOW];
           break;
           
           case RIGHT_ARM_LEFT_FROZEN:
@@ -339,7 +856,7 @@ void PhantomLimb::UpdateMainThread(double_t dt) {
           case LEFT_ARM_RIGHT_MIRROR:
           case LEFT_ARM_COPY:
           case LEFT_ARM_RIGHT_FROZEN:{
-            glm::quat tq = user.skeleton().GetBone("Left Elbow")->rotation();
+            glm::quat tq = user.joints[LEFT_ELBOW];
             float_t angle = glm::angle(tq);
             glm::vec3 axis = glm::axis(tq);
             final_rotation = glm::angleAxis(-angle, -axis.x, axis.y, axis.z);
@@ -349,83 +866,142 @@ void PhantomLimb::UpdateMainThread(double_t dt) {
         
         }
 
-        rloarm->set_rotation_relative(  nrys * nrzs  * final_rotation * nrzsi * nrysi );
+        user_state.arm_pose[3] = nrys * nrzs  * final_rotation * nrzsi * nrysi;
+        rloarm->set_rotation_relative( user_state.arm_pose[3] );
       }
 
     }
   }
 
+  // Clips pose everything tracking does not. If tracking drops, the arms fade over to the
+  // clip from where tracking last left them, and fade back when it returns
+
+  if (user_state.animation) {
+    bool tracked = user_state.sample.tracked;
+    if (tracked != user_state.was_tracked) {
+      user_state.animation.Play(tracked ? 0 : 1, animation_fade_);
+      user_state.was_tracked = tracked;
+    }
+
+    float_t step = animation_fade_ > 0 ? static_cast<float_t>(dt / animation_fade_) : 1.0f;
+    user_state.fallback = tracked ? std::max(0.0f, user_state.fallback - step) : std::min(1.0f, user_state.fallback + step);
+
+    user_state.animation.Update(dt);
+    const AnimationPose &pose = user_state.animation.pose();
+
+    for (size_t i = 0; i < user_state.animation_bones.size(); ++i) {
+      Bone *bone = user_state.animation_bones[i];
+      if (bone == nullptr)
+        continue;
+
+      int32_t arm = animation_arms_[i];
+      if (arm < 0)
+        bone->set_rotation_relative(pose.rotation(i));
+      else if (user_state.fallback > 0)
+        bone->set_rotation_relative(glm::slerp(user_state.arm_pose[arm], pose.rotation(i), user_state.fallback));
+    }
+  }
+
 
   // set the hit targets for physics as spheres where the hands are
   // This is done in model space so the actual positions, we need to move to world space
 
   // Dependent on Arm state
 
-  Bone * lloarm = md5_.skeleton().GetBone("lower_arm.L");
+  Bone * lloarm = model.skeleton().GetBone("lower_arm.L");
   if (lloarm != nullptr){
 
-    glm::vec4 lp = glm::inverse(model_base_mat_) * lloarm->skinned_matrix() * hand_pos_left_;
+    glm::vec4 lp = user_state.offset * glm::inverse(model_base_mat_) * lloarm->skinned_matrix() * hand_pos_left_;
 
-    hand_pos_left_final_ = glm::vec3(lp.x,lp.y,lp.z);
-    glm::mat4 trans = glm::translate(glm::mat4(1.0f), hand_pos_left_final_);
-    node_left_hand_.set_matrix(trans);
-
-    physics_.MoveLeftHand(hand_pos_left_final_);
+    user_state.hand_left = glm::vec3(lp.x,lp.y,lp.z);
+    physics_.MoveLeftHand(user_state.hand_left, idx);
   }
 
 
-  Bone * rloarm = md5_.skeleton().GetBone("lower_arm.R");
+  Bone * rloarm = model.skeleton().GetBone("lower_arm.R");
   if (rloarm != nullptr){
-    glm::vec4 lp =  glm::inverse(model_base_mat_) * rloarm->skinned_matrix() * hand_pos_right_;
-
-    hand_pos_right_final_ = glm::vec3(lp.x,lp.y,lp.z);
+    glm::vec4 lp = user_state.offset * glm::inverse(model_base_mat_) * rloarm->skinned_matrix() * hand_pos_right_;
 
-    glm::mat4 trans = glm::translate(glm::mat4(1.0f), hand_pos_right_final_);
-    node_right_hand_.set_matrix(trans);
-
-    physics_.MoveRightHand(hand_pos_right_final_);
+    user_state.hand_right = glm::vec3(lp.x,lp.y,lp.z);
+    physics_.MoveRightHand(user_state.hand_right, idx);
   }
 
+  // The debug hand markers follow the patient
 
- 
-
+  if (idx == 0) {
+    node_left_hand_.set_matrix(glm::translate(glm::mat4(1.0f), user_state.hand_left));
+    node_right_hand_.set_matrix(glm::translate(glm::mat4(1.0f), user_state.hand_right));
+  }
 
 }
 
 void PhantomLimb::Update(double_t dt) {
 
    // Update Oculus - take the difference
-  oculus_.Update(dt);
+  headset_.Update(dt);
 
 }
 
 
 /*
- * Called as fast as possible. Not set FPS wise but dt is passed in
+ * Called once per refresh. With pacing on, the frame pacer holds it back so the work starts
+ * as late as will still make the next vsync. dt is passed in
  */
 
  void PhantomLimb::Display(GLFWwindow* window, double_t dt){
 
-  GLfloat depth = 1.0f;
+  if (offline_) {
+    DisplayOffline(window);
+    return;
+  }
 
-  // Update Physics
-  physics_.Update(dt);
+  GLfloat depth = 1.0f;
 
-   // Update game state
-  if (playing_game_){
-    last_shot_ += dt ;
-    if (last_shot_ > FromStringS9<float_t>( *file_settings_["game/time"])) {
-      last_shot_ = 0;
-      FireBall();
+  if (!pacer_ && FromStringS9<bool>(*file_settings_["pacing/enabled"])) {
+    FramePacerSettings ps;
+    ps.refresh = FromStringS9<double_t>(*file_settings_["pacing/refresh"]);
+    if (ps.refresh <= 0) {
+      GLFWmonitor *monitor = glfwGetWindowMonitor(window);
+      const GLFWvidmode *mode = glfwGetVideoMode(monitor != nullptr ? monitor : glfwGetPrimaryMonitor());
+      ps.refresh = mode != nullptr && mode->refreshRate > 0 ? mode->refreshRate : 60.0;
     }
+    ps.margin = FromStringS9<double_t>(*file_settings_["pacing/margin_ms"]) / 1000.0;
+    ps.spin = FromStringS9<double_t>(*file_settings_["pacing/spin_ms"]) / 1000.0;
+    ps.half_rate = FromStringS9<bool>(*file_settings_["pacing/half_rate"]);
+    ps.recover = FromStringS9<double_t>(*file_settings_["pacing/recover"]);
+    pacer_ = FramePacer(ps);
   }
 
+  // Sleep until there is just enough time left to make the next vsync
+
+  FrameType frame = pacer_ ? pacer_.Wait() : FRAME_RENDER;
+  double_t frame_start = NowSeconds();
+
+  // At half rate every other refresh only re-warps the last eye buffers to where the head is
+  // now. The simulation catches the time up on the next scene frame
+
+  if (frame == FRAME_REPROJECT && fbo_) {
+    skipped_dt_ += dt;
+    WarpToScreen(true);
+    pacer_.Submitted();
+    PublishTelemetry(dt, NowSeconds() - frame_start, true);
+    return;
+  }
+
+  // Pipelined, this frame's simulation was launched at the end of the last one and has been
+  // running through its warp and swap. Otherwise it runs now, across the workers
+
+  if (!sim_pending_)
+    StartSimulation(dt);
+  FinishSimulation();
+
+  ApplyCommands(window);
   UpdateMainThread(dt);
 
   // Create the FBO and setup the cameras
-  if (!fbo_ && oculus_.Connected()){
+  if (!fbo_ && headset_.Connected()){
     
-      glm::vec2 s = oculus_.fbo_size();
+      glm::vec2 s = headset_.fbo_size();
       fbo_ = FBO(static_cast<size_t>(s.x), static_cast<size_t>(s.y)); 
 
       camera_left_.Resize(static_cast<size_t>(s.x / 2.0f), static_cast<size_t>(s.y ));
@@ -433,12 +1009,33 @@ void PhantomLimb::Update(double_t dt) {
 
       camera_.Resize(static_cast<size_t>(s.x ), static_cast<size_t>(s.y ));
 
-      camera_left_.set_projection_matrix(oculus_.left_projection());
-      camera_right_.set_projection_matrix(oculus_.right_projection());
+      camera_overlay_left_.Resize(static_cast<size_t>(s.x / 2.0f), static_cast<size_t>(s.y ));
+      camera_overlay_right_.Resize(static_cast<size_t>(s.x / 2.0f), static_cast<size_t>(s.y ),static_cast<size_t>(s.x / 2.0f) );
+
+      camera_left_.set_projection_matrix(headset_.left_projection());
+      camera_right_.set_projection_matrix(headset_.right_projection());
 
-      camera_ortho_.Resize(oculus_.screen_resolution().x, oculus_.screen_resolution().y);
+      // The interocular offsets never change, so fold them into the base view once
+      base_eye_views_[0] = base_view_ * headset_.left_inter();
+      base_eye_views_[1] = base_view_ * headset_.right_inter();
+
+      eyes_.data().projection[0] = headset_.left_projection();
+      eyes_.data().projection[1] = headset_.right_projection();
+
+      camera_ortho_.Resize(headset_.screen_resolution().x, headset_.screen_resolution().y);
 
       glGenVertexArrays(1, &(null_VAO_));
+
+      latency_ = LatencyProbe(true);
+
+      // Mask off what the lenses never show, from the same parameters the warp uses
+      if (FromStringS9<bool>(*file_settings_["hmd/hidden_area/enabled"])) {
+        hidden_area_ = HiddenAreaMask(headset_.distortion_parameters(), headset_.chromatic_abberation(),
+          headset_.distortion_xcenter_offset(), headset_.distortion_scale(),
+          FromStringS9<float_t>(*file_settings_["hmd/hidden_area/margin"]),
+          FromStringS9<size_t>(*file_settings_["hmd/hidden_area/probe_interval"]),
+          programs_.program(program_hidden_area_));
+      }
       
   }
 
@@ -448,361 +1045,500 @@ void PhantomLimb::Update(double_t dt) {
     glClearBufferfv(GL_COLOR, 0, &glm::vec4(0.9f, 0.9f, 0.9f, 1.0f)[0]);
     glClearBufferfv(GL_DEPTH, 0, &depth );
 
-    // Grab Textures
-    openni_.Update(); // While thread safe, its best to put this immediately before the update_textures
-    
-    //openni_.update_textures(); ///\todo this is causing errors
+    // Grab Textures - OpenNI itself is updated on the sensor thread and these never wait on it
+    if (depth_feed_ && depth_feed_.Upload() && depth_accumulator_ && depth_accumulator_.gpu())
+      depth_accumulator_.Accumulate(depth_feed_.texture());
+    if (colour_feed_)
+      colour_feed_.Upload();
 
     // Alter camera with the oculus
-    glm::quat q = glm::inverse(oculus_.orientation());
-    oculus_rotation_dt_ = glm::inverse(oculus_rotation_prev_) * q;
-    oculus_rotation_prev_ =  q;
-    camera_.Rotate(oculus_rotation_dt_);
-    camera_.Update();
+    render_orientation_ = headset_.orientation();
+    if (latency_)
+      latency_.RenderSampled();
+
+    if (absolute_pose_) {
+      // The head turn is applied fresh to the fixed eye views each frame, so nothing accumulates
+      glm::mat4 head = glm::mat4_cast(glm::inverse(render_orientation_));
+      SetEyes(head * base_eye_views_[0], head * base_eye_views_[1]);
+    } else {
+      glm::quat q = glm::inverse(render_orientation_);
+      oculus_rotation_dt_ = glm::inverse(oculus_rotation_prev_) * q;
+      oculus_rotation_prev_ =  q;
+      camera_.Rotate(oculus_rotation_dt_);
+      camera_.Update();
+
+      SetEyes(camera_.view_matrix() * headset_.left_inter(), camera_.view_matrix() * headset_.right_inter());
+    }
 
-    camera_left_.set_view_matrix( camera_.view_matrix() * oculus_.left_inter() );
-    camera_right_.set_view_matrix(  camera_.view_matrix() * oculus_.right_inter() );
+    // Depth is clear, so the mask goes in first and the eye passes early reject behind it
+    if (hidden_area_ && hidden_area_.Begin())
+      hidden_area_.Write(camera_.width(), camera_.height());
 
-    // Draw Balls left and right
+    DrawScene();
 
-    node_ball_.Add(camera_left_);
-    for (glm::mat4 mat : physics_.ball_orients()){
-      node_ball_.set_matrix(mat);
-      node_ball_.Draw();
-    }
-    node_ball_.Remove(camera_left_);
+    if (hidden_area_)
+      hidden_area_.End();
 
+    fbo_.Unbind();
 
-    node_ball_.Add(camera_right_);
-    for (glm::mat4 mat : physics_.ball_orients()){
-      node_ball_.set_matrix(mat);
-      node_ball_.Draw();
-    }
-    node_ball_.Remove(camera_right_);
+    // Every draw reading the simulation has been issued, so the next frame's can start. The
+    // head pose is still sampled at render and again at the warp, so this adds no head latency.
+    // If the pacer had time to sleep there is no need to run ahead - sampling late is better
+    if (pipelined_ && !(pacer_ && pacer_.slept() > 0))
+      StartSimulation(dt);
 
-    // Draw Model
-    node_left_.Draw();
-    node_right_.Draw();
+    //CXGLERROR
 
-    // Draw the hand collision units
+    WarpToScreen(timewarp_);
 
-    // Draw textures from the camera
-    /*
-    glm::mat4 mat = glm::translate(glm::mat4(1.0f), glm::vec3(160,120,0));
-    node_depth_.set_matrix(mat);
-    openni_.texture_depth().Bind();
-    node_depth_.Draw();
-    openni_.texture_depth().Unbind();
+    //CXGLERROR -  annoyingly there is an error
 
-    mat = glm::translate(glm::mat4(1.0f), glm::vec3(480,120,0));
-    node_colour_.set_matrix(mat);
-    openni_.texture_colour().Bind();
-    node_colour_.Draw();
-    openni_.texture_colour().Unbind();
+    double_t frame_cost = NowSeconds() - frame_start;
+    frame_cost_ += frame_cost;
+    frame_cost_max_ = std::max(frame_cost_max_, frame_cost);
+    frame_count_++;
+  }
 
-    */
+  // No headset yet, so nothing was drawn - keep the simulation going regardless
+  if (pipelined_ && !sim_pending_ && !(pacer_ && pacer_.slept() > 0))
+    StartSimulation(dt);
 
-    fbo_.Unbind();
-    //CXGLERROR
+  if (pacer_)
+    pacer_.Submitted();
 
-    // Draw to main screen - this cheats and uses a geometry shader
+  PublishTelemetry(dt, NowSeconds() - frame_start, false);
+}
 
-    // Be wary here that we are messing with the polygon mode up the chain
+/// The barrel warp of both eye buffers onto the screen. With timewarp the buffers are turned
+/// by however far the head has moved since they were rendered
 
-    glClearBufferfv(GL_COLOR, 0, &glm::vec4(0.9f, 0.9f, 0.9f, 1.0f)[0]);
-    glClearBufferfv(GL_DEPTH, 0, &depth );
+void PhantomLimb::WarpToScreen(bool timewarp_on) {
 
-    glBindVertexArray(null_VAO_);
+  GLfloat depth = 1.0f;
 
-    glViewport(0,0, camera_ortho_.width(), camera_ortho_.height());
+  // Draw to main screen - this cheats and uses a geometry shader
 
-    shader_warp_.Bind();
-    fbo_.colour().Bind();
+  // Be wary here that we are messing with the polygon mode up the chain
 
-    shader_warp_.s("uDistortionOffset", oculus_.distortion_xcenter_offset()); // Can change with future headsets apparently
-    shader_warp_.s("uDistortionScale", 1.0f/oculus_.distortion_scale());
-    shader_warp_.s("uChromAbParam", oculus_.chromatic_abberation());
-    shader_warp_.s("uHmdWarpParam",oculus_.distortion_parameters() );
+  glClearBufferfv(GL_COLOR, 0, &glm::vec4(0.9f, 0.9f, 0.9f, 1.0f)[0]);
+  glClearBufferfv(GL_DEPTH, 0, &depth );
 
-    glDrawArrays(GL_POINTS, 0, 1);
+  glBindVertexArray(null_VAO_);
 
-    fbo_.colour().Unbind();
-    shader_warp_.Unbind();
+  glViewport(0,0, camera_ortho_.width(), camera_ortho_.height());
 
-    glBindVertexArray(0);
+  // The warp program's blocks are bound here rather than in Init, so Init never waits
+  // on its link
 
-    //CXGLERROR -  annoyingly there is an error
+  GLuint warp_program = programs_.program(program_warp_);
+  if (!warp_blocks_resolved_) {
+    ResolveUniformBlocks(warp_program);
+    warp_blocks_resolved_ = true;
   }
-}
 
-/// Fire a ball into the scene
-void PhantomLimb::FireBall() {
+  glUseProgram(warp_program);
+  fbo_.colour().Bind();
 
-  float_t rval0 = static_cast<float_t>(std::rand()) /  RAND_MAX;
-  float_t rval1 = static_cast<float_t>(std::rand()) /  RAND_MAX;
+  // Late latch - sample the head again as close to scanout as we can, and rotate the eye
+  // buffers by however far it has turned since they were rendered
 
-  float_t game_width = FromStringS9<float_t>(*file_settings_["game/width"]);
-  float_t speed_min = FromStringS9<float_t>(*file_settings_["game/speed/min"]);
-  float_t speed_factor = FromStringS9<float_t>(*file_settings_["game/speed/factor"]);
+  glm::quat latched = headset_.orientation();
+  if (latency_)
+    latency_.WarpSampled();
+  if (pacer_)
+    pacer_.InputSampled();
 
-  float_t height_min = FromStringS9<float_t>(*file_settings_["game/height/min"]);
-  float_t height_factor = FromStringS9<float_t>(*file_settings_["game/height/factor"]);
+  glm::mat4 timewarp(1.0f);
+  if (timewarp_on)
+    timewarp = glm::mat4_cast(glm::inverse(render_orientation_) * latched);
 
-  float_t xpos = -game_width + (rval0 * 2.0f * game_width);
+  // Everything the warp reads goes across in one write
+  WarpBlock &warp_block = warp_.data();
+  glm::vec2 tan_half_fov = headset_.tan_half_fov();
+  warp_block.warp = headset_.distortion_parameters();
+  warp_block.chromatic = headset_.chromatic_abberation();
+  warp_block.lens = glm::vec4(headset_.distortion_xcenter_offset(), 1.0f / headset_.distortion_scale(), tan_half_fov.x, tan_half_fov.y);
+  warp_block.timewarp = timewarp;
+  warp_.Upload();
+  warp_.Bind();
 
-  if (arm_emphasis_){
-    switch (arm_state_) {
-      case BOTH_ARMS:
-      case LEFT_ARM_RIGHT_MIRROR:
-      case RIGHT_ARM_LEFT_MIRROR:
-      break;
-           
-      case LEFT_ARM_COPY:
-      case LEFT_ARM_RIGHT_FROZEN:
-        xpos = (-game_width * 0.1) + (rval0 * 1.1 * game_width);
-      break;
+  glDrawArrays(GL_POINTS, 0, 1);
 
-     
-      case RIGHT_ARM_LEFT_FROZEN: 
-      case RIGHT_ARM_COPY:
-        xpos = -game_width + (rval0 * 1.1f * game_width);
-      break;
-    }
+  if (latency_)
+    latency_.End();
 
-  }
+  fbo_.colour().Unbind();
+  glUseProgram(0);
+
+  glBindVertexArray(0);
 
+  // The report waits on every program, so it only runs once the first frame is out
 
-  physics_.AddBall(ball_radius_, glm::vec3( xpos , height_min + (rval1 * height_factor), -4.0f), 
-      glm::vec3(0.0f, (4.0f - speed_min + rval1 ) * 0.5f + rval0, speed_factor * rval1 + speed_min));
+  if (!programs_reported_) {
+    programs_.Report();
+    programs_reported_ = true;
+  }
 }
 
+/// Both eye cameras, and the block every shader reads them from, in one go
 
-PhantomLimb::~PhantomLimb() {   
+void PhantomLimb::SetEyes(const glm::mat4 &left_view, const glm::mat4 &right_view) {
+  camera_left_.set_view_matrix(left_view);
+  camera_right_.set_view_matrix(right_view);
 
+  eyes_.data().view[0] = left_view;
+  eyes_.data().view[1] = right_view;
+  eyes_.Upload();
+  eyes_.Bind();
 }
 
+/// Each eye pass only switches which copy of PhantomPass is bound, and the viewport
 
-/*
- * This is called by the wrapper function when an event is fired
- */
+void PhantomLimb::BindEyePass(uint8_t eye) {
+  passes_.Bind(eye);
+  if (eye == 0)
+    glViewport(0, 0, camera_left_.width(), camera_left_.height());
+  else
+    glViewport(camera_left_.width(), 0, camera_right_.width(), camera_right_.height());
+}
 
-void PhantomLimb::ProcessEvent(MouseEvent e, GLFWwindow* window){}
+/// Both eyes into whatever is bound. Shared by the headset and the offline renderer
 
-/*
- * Called when the window is Resized. You should set cameras here
- */
+void PhantomLimb::DrawScene() {
 
-void PhantomLimb::ProcessEvent(ResizeEvent e, GLFWwindow* window){
-  camera_ortho_.Resize(e.w,e.h);
-}
+  GLfloat depth = 1.0f;
 
-void PhantomLimb::ProcessEvent(KeyboardEvent e, GLFWwindow* window){}
+  // The balls go across once for both eyes
+
+  ball_batch_.Update(physics_.ball_orients());
+
+  // Both eyes into one queue, nearest users first. The room surrounds everything so goes last
+
+  for (uint8_t eye = 0; eye < 2; ++eye) {
+    if (ball_batch_.count() > 0)
+      render_queue_.Submit(ball_items_[eye], eye);
 
+    for (size_t i = 0; i < users_.size(); ++i) {
+      if (users_[i].in_scene) {
+        glm::vec3 position(users_[i].offset[3]);
+        render_queue_.Submit(user_items_[eye][i], eye, glm::length(position - view_position_) / 100.0f);
+      }
+    }
+
+    render_queue_.Submit(room_items_[eye], eye, 1.0f);
+  }
+
+  render_queue_.Flush();
 
+  // Draw the hand collision units
+
+  // Draw textures from the camera, over the top of everything else
+  if (depth_overlay_ && depth_feed_ && !offline_) {
+    glClearBufferfv(GL_DEPTH, 0, &depth );
+    DrawOverlay(camera_overlay_left_);
+    DrawOverlay(camera_overlay_right_);
+  }
+}
 
 /*
- * The UX window Class
+ * Replays a recorded session at a fixed timestep, as fast as the GPU will go, and writes
+ * each side by side stereo frame out through the batch renderer. No headset or sensor needed
  */
 
-#ifdef _SEBURO_LINUX
+void PhantomLimb::DisplayOffline(GLFWwindow* window) {
 
+  if (!player_)
+    return;
 
-///\todo passing in the gtk_app is a bit naughty I think
-UXWindow::UXWindow(gl::WithUXApp &gtk_app, PhantomLimb &app, XMLSettings &settings) : gtk_app_(gtk_app), app_(app), file_settings_(settings)  {  
+  ApplyCommands(window);
 
-  //Glib::RefPtr< Screen > screen =  Gdk::Screen::get_default();
-  //Glib::RefPtr<Display> display = screen->get_display();
+  GLfloat depth = 1.0f;
+  double_t fps = FromStringS9<double_t>(*file_settings_["render/fps"]);
+  double_t dt = 1.0 / fps;
 
-  maximize();
-  fullscreen();
+  if (!batch_) {
+    size_t width = FromStringS9<size_t>(*file_settings_["render/width"]);
+    size_t height = FromStringS9<size_t>(*file_settings_["render/height"]);
+    float_t fov = FromStringS9<float_t>(*file_settings_["render/fov"]);
 
-  // Sets the border width of the window.
-  set_border_width(10);
+    fbo_ = FBO(width, height);
 
-  // When the button receives the "clicked" signal, it will call the
-  // on_button_clicked() method defined below.
-  button_fire_ = new Gtk::Button("Fire Ball");
-  button_fire_->signal_clicked().connect(sigc::mem_fun(*this, &UXWindow::on_button_fire_clicked));
-  button_fire_->set_hexpand(true);
-  button_fire_->set_vexpand(true);
+    camera_left_.Resize(width / 2, height);
+    camera_right_.Resize(width / 2, height, width / 2);
+    camera_.Resize(width, height);
 
+    glm::mat4 projection = glm::perspective(fov, static_cast<float_t>(width / 2) / height, 0.01f, 100.0f);
+    camera_left_.set_projection_matrix(projection);
+    camera_right_.set_projection_matrix(projection);
 
-  button_reset_ = new Gtk::Button("Reset Game");
-  button_reset_->signal_clicked().connect(sigc::mem_fun(*this, &UXWindow::on_button_reset_clicked));
-  button_reset_->set_hexpand(true);
-  button_reset_->set_vexpand(true);
+    eyes_.data().projection[0] = projection;
+    eyes_.data().projection[1] = projection;
 
-  button_auto_game_ = new Gtk::Button("Auto Game Start / Stop");
-  button_auto_game_->signal_clicked().connect(sigc::mem_fun(*this, &UXWindow::on_button_auto_game_clicked));
-  button_auto_game_->set_hexpand(true);
-  button_auto_game_->set_vexpand(true);
+    // Never wait on the display while we are writing frames
+    glfwSwapInterval(0);
 
-  button_oculus_ = new Gtk::Button("Reset Oculus View");
-  button_oculus_->signal_clicked().connect(sigc::mem_fun(*this, &UXWindow::on_button_oculus_clicked));
-  button_oculus_->set_hexpand(true);
-  button_oculus_->set_vexpand(true);
+    batch_ = BatchRenderer(width, height, fps, file_settings_["render/output"].Value(),
+      file_settings_["render/encoder"].Value());
 
-  button_tracking_ = new Gtk::Button("Restart Tracking");
-  button_tracking_->signal_clicked().connect(sigc::mem_fun(*this, &UXWindow::on_button_tracking_clicked));
-  button_tracking_->set_hexpand(true);
-  button_tracking_->set_vexpand(true);
+    cout << "PhantomLimb: rendering " << player_.duration() << "s of session at " << fps << " fps" << endl;
+  }
 
+  // Everything recorded up to the end of this frame, then the same fixed step the live app would take
+
+  offline_time_ += dt;
+  player_.Advance(offline_time_, session_events_);
+
+  for (SessionEvent &event : session_events_) {
+    if (event.type == SESSION_SAMPLE) {
+      if (event.sample.slot < users_.size())
+        users_[event.sample.slot].sample = event.sample;
+    } else if (event.type == SESSION_BALL) {
+      physics_.AddBall(event.ball.radius, event.ball.position, event.ball.velocity);
+    } else if (event.type == SESSION_COMMAND) {
+      if (event.command.type == COMMAND_RESET_PHYSICS)
+        ResetPhysics();
+      else if (event.command.type == COMMAND_SET_HANDED)
+        SetHanded(event.command.arm);
+    }
+  }
 
-  button_quit_ = new Gtk::Button("Quit");
-  button_quit_->signal_clicked().connect(sigc::mem_fun(*this, &UXWindow::on_button_quit_clicked));
-  button_quit_->set_hexpand(true);
-  button_quit_->set_vexpand(true);
+  // Same order as the live sim graph - the hands move first, then physics steps against them
 
-  signal_delete_event().connect(sigc::mem_fun(*this, &UXWindow::on_window_closed));
+  for (size_t i = 0; i < users_.size(); ++i)
+    UpdateUser(i, dt);
 
-  button_emphasis_ = new Gtk::CheckButton("Arm-Game Emphasis");
-  button_emphasis_->signal_toggled().connect(sigc::mem_fun(*this, &UXWindow::on_button_emphasis_toggled));
-  button_emphasis_->set_hexpand(true);
-  button_emphasis_->set_vexpand(true);
-  button_emphasis_->set_active( FromStringS9<bool>(*file_settings_["game/emphasis"]) );
+  physics_.Update(dt);
 
+  float_t half_ipd = FromStringS9<float_t>(*file_settings_["render/ipd"]) * 0.5f;
+  SetEyes( base_view_ * glm::translate(glm::mat4(1.0f), glm::vec3(half_ipd, 0.0f, 0.0f)),
+    base_view_ * glm::translate(glm::mat4(1.0f), glm::vec3(-half_ipd, 0.0f, 0.0f)) );
+
+  fbo_.Bind();
+  glClearBufferfv(GL_COLOR, 0, &glm::vec4(0.9f, 0.9f, 0.9f, 1.0f)[0]);
+  glClearBufferfv(GL_DEPTH, 0, &depth );
+  DrawScene();
+  batch_.Capture();
+  fbo_.Unbind();
+
+  if (player_.finished()) {
+    batch_.Finish();
+    player_.reset();
+    glfwSetWindowShouldClose(window, GL_TRUE);
+  }
+}
 
-  scale_speed_ = new Gtk::HScale();
-  scale_speed_->set_range(0.1,4.0);
-  scale_speed_->signal_value_changed().connect(sigc::mem_fun(*this, &UXWindow::on_scale_speed_changed));
-  scale_speed_->set_value( FromStringS9<float_t>(*file_settings_["game/speed/min"]) );
+/// Depth view in the lower middle of one eye, with the colour view beside it if we have one
 
-  scale_speed_label_.set_text("Ball Speed");
+void PhantomLimb::DrawOverlay(Camera &camera) {
 
+  float_t scale = (camera.width() * 0.25f) / depth_feed_.width();
+  float_t x = camera.width() * 0.5f;
+  float_t y = camera.height() * 0.3f;
 
-  scale_width_ = new Gtk::HScale();
-  scale_width_->set_range(0.01,2.0);
-  scale_width_->set_increments(0.01,0.01);
-  scale_width_->signal_value_changed().connect(sigc::mem_fun(*this, &UXWindow::on_scale_width_changed));
-  scale_width_->set_value( FromStringS9<float_t>(*file_settings_["game/width"]) );
+  if (colour_feed_)
+    x -= depth_feed_.width() * scale * 0.5f;
 
-  scale_width_label_.set_text("Ball Spawn Width");
+  node_depth_.Add(camera);
+  node_depth_.set_matrix(glm::scale(glm::translate(glm::mat4(1.0f), glm::vec3(x, y, 0)), glm::vec3(scale, scale, 1.0f)));
+  if (depth_accumulator_ && depth_accumulator_.gpu()) {
+    depth_accumulator_.Bind();
+    node_depth_.Draw();
+    depth_accumulator_.Unbind();
+  } else {
+    depth_feed_.Bind();
+    node_depth_.Draw();
+    depth_feed_.Unbind();
+  }
+  node_depth_.Remove(camera);
 
-  // Combo Box
+  if (colour_feed_) {
+    x += depth_feed_.width() * scale;
+    node_colour_.Add(camera);
+    node_colour_.set_matrix(glm::scale(glm::translate(glm::mat4(1.0f), glm::vec3(x, y, 0)), glm::vec3(scale, scale, 1.0f)));
+    colour_feed_.Bind();
+    node_colour_.Draw();
+    colour_feed_.Unbind();
+    node_colour_.Remove(camera);
+  }
+}
 
-  combo_arms_.append("Both");
-  combo_arms_.append("Left Arm Track, No Mirror");
-  combo_arms_.append("Right Arm Track, No Mirror");
-  combo_arms_.append("Left Arm Track, Mirrored Right");
-  combo_arms_.append("Right Arm Track, Mirrored Left");
-  //combo_arms_.append("Left Arm, Copied Right");
-  //combo_arms_.append("Right Arm, Copied Left");
+/// Everything the operator has asked for since the last frame, in the order they asked
+void PhantomLimb::ApplyCommands(GLFWwindow* window) {
+  if (!console_ || !console_.connected())
+    return;
 
-  combo_arms_.set_active_text("Both");
-  combo_arms_.signal_changed().connect(sigc::mem_fun(*this, &UXWindow::on_combo_arms_changed));
+  Command command;
+  while (console_.Poll(command)) {
 
-  // This packs the button into the Window (a container).
-  grid_.attach(*button_fire_,0,0,1,1);
-  grid_.attach(*button_reset_,0,1,1,1);
-  grid_.attach(*button_auto_game_,0,2,1,1);
-  grid_.attach(*button_tracking_,0,3,1,1);
-  grid_.attach(*button_quit_,0,4,1,1);
+    // These change what the simulation does with the samples, so a replay needs them too
+    if (recorder_ && (command.type == COMMAND_RESET_PHYSICS || command.type == COMMAND_SET_HANDED))
+      recorder_.Record(command);
 
-  grid_.attach(*button_oculus_,1,0,2,1);
-  grid_.attach(combo_arms_,1,1,2,1);
-  grid_.attach(*button_emphasis_,1,2,2,1);
+    switch (command.type) {
+      case COMMAND_FIRE_BALL:
+        FireBall();
+      break;
 
-  grid_.attach(*scale_speed_,2,3,1,1);
-  grid_.attach(scale_speed_label_,1,3,1,1);
+      case COMMAND_RESET_PHYSICS:
+        ResetPhysics();
+      break;
 
-  grid_.attach(*scale_width_,2,4,1,1);
-  grid_.attach(scale_width_label_,1,4,1,1);
+      case COMMAND_TOGGLE_GAME:
+        PlayGame(!playing_game_);
+      break;
 
-  grid_.set_hexpand();
-  grid_.set_vexpand();
+      case COMMAND_RESTART_TRACKING:
+        RestartTracking();
+      break;
 
-  add(grid_);
-  show_all();
+      case COMMAND_RESET_VIEW:
+        ResetOculus();
+      break;
 
-}
+      case COMMAND_SET_HANDED:
+        SetHanded(command.arm);
+      break;
 
-UXWindow::~UXWindow() {
-  // Need to signal that we are done here
-  delete button_fire_;
-  delete button_reset_;
-  delete button_auto_game_;
-  delete button_tracking_;
-  delete button_oculus_;
-  delete button_quit_;
-  delete button_emphasis_;
-  delete scale_speed_;
-}
+      case COMMAND_SETTINGS:
+        game_ = std::make_shared<const GameSettings>(command.settings);
+        console_.PublishSettings(command.settings);
+      break;
 
-void UXWindow::on_button_fire_clicked() {
-  cout << "Firing Ball" << endl;
-  app_.FireBall();
+      case COMMAND_QUIT:
+        glfwSetWindowShouldClose(window, GL_TRUE);
+      break;
+    }
+  }
 }
 
-void UXWindow::on_button_reset_clicked() {
-  cout << "Reset Physics" << endl;
-  app_.ResetPhysics();
+/// One sample a frame for the operator console. If nothing is reading, the ring fills and
+/// the samples are dropped - this never waits on the console
+
+void PhantomLimb::PublishTelemetry(double_t dt, double_t cost, bool reprojected) {
+  if (!console_ || !console_.connected())
+    return;
+
+  TelemetrySample sample = telemetry_;
+  sample.time = NowSeconds();
+  sample.frame_time = pacer_ ? pacer_.last_interval() : dt;
+  sample.frame_cost = cost;
+  sample.input_to_swap = pacer_ ? pacer_.last_input_to_swap() : 0;
+  sample.missed = pacer_ ? pacer_.last_missed() : 0;
+  sample.reprojected = reprojected;
+  sample.half_rate = pacer_ && pacer_.half_rate();
+  console_.Publish(sample);
 }
 
-void UXWindow::on_button_tracking_clicked() {
-  cout << "Restarting Tracking" << endl;
-  app_.RestartTracking();
-}
+/// Fire a ball into the scene
+void PhantomLimb::FireBall() {
 
+  float_t rval0 = static_cast<float_t>(std::rand()) /  RAND_MAX;
+  float_t rval1 = static_cast<float_t>(std::rand()) /  RAND_MAX;
 
-void UXWindow::on_button_auto_game_clicked() {
-  cout << "Auto Game Clicked" << endl;
-  app_.PlayGame(!app_.playing_game());
-}
+  float_t game_width = game_->width;
+  float_t speed_min = game_->speed_min;
+  float_t speed_factor = game_->speed_factor;
 
-void UXWindow::on_button_oculus_clicked() {
-  cout << "Resetting Oculus View" << endl;
-  app_.ResetOculus();
-}
+  float_t height_min = game_->height_min;
+  float_t height_factor = game_->height_factor;
 
-void UXWindow::on_button_quit_clicked() {
-  cout << "Quitting PhantomLimb" << endl;
-  gtk_app_.Shutdown();
-}
+  float_t xpos = -game_width + (rval0 * 2.0f * game_width);
 
-bool UXWindow::on_window_closed(GdkEventAny* event) {
-  cout << "Quitting PhantomLimb" << endl;
-  gtk_app_.Shutdown();
-  return false;
-}
+  if (game_->emphasis){
+    switch (arm_state_) {
+      case BOTH_ARMS:
+      case LEFT_ARM_RIGHT_MIRROR:
+      case RIGHT_ARM_LEFT_MIRROR:
+      break;
+           
+      case LEFT_ARM_COPY:
+      case LEFT_ARM_RIGHT_FROZEN:
+        xpos = (-game_width * 0.1) + (rval0 * 1.1 * game_width);
+      break;
+
+     
+      case RIGHT_ARM_LEFT_FROZEN: 
+      case RIGHT_ARM_COPY:
+        xpos = -game_width + (rval0 * 1.1f * game_width);
+      break;
+    }
+
+  }
 
-void UXWindow::on_button_emphasis_toggled() {
-  cout << "Arm Emphasis Toggle" << endl;
-  app_.set_arm_emphasis(button_emphasis_->get_active());
-  file_settings_["game/emphasis"].SetValue(button_emphasis_->get_active());
+
+  BallEvent ball;
+  ball.radius = ball_radius_;
+  ball.position = glm::vec3( xpos , height_min + (rval1 * height_factor), -4.0f);
+  ball.velocity = glm::vec3(0.0f, (4.0f - speed_min + rval1 ) * 0.5f + rval0, speed_factor * rval1 + speed_min);
+
+  if (recorder_)
+    recorder_.Record(ball);
+
+  physics_.AddBall(ball.radius, ball.position, ball.velocity);
 }
 
-void UXWindow::on_scale_speed_changed() {
-  cout << "Speed Changed: " << scale_speed_->get_value() << endl;
-  file_settings_["game/speed/min"].SetValue(scale_speed_->get_value());
+
+/// Stop the sensor thread while OpenNI is still alive. Safe to call more than once
+void PhantomLimb::Shutdown() {
+  if (tasks_) {
+    if (sim_pending_)
+      FinishSimulation();
+    tasks_.Stop();
+  }
+  if (sensor_)
+    sensor_.Stop();
+  if (stereo_)
+    stereo_.Stop();
+  if (depth_colliders_)
+    depth_colliders_.Stop();
 }
 
-void UXWindow::on_scale_width_changed() {
-  cout << "Width Changed: " << scale_width_->get_value() << endl;
-  file_settings_["game/width"].SetValue(scale_width_->get_value());
+PhantomLimb::~PhantomLimb() {   
+  Shutdown();
 }
 
-void UXWindow::on_combo_arms_changed() {
-  Glib::ustring selected = combo_arms_.get_active_text();
-  if (selected.compare( Glib::ustring("Both")) == 0){
-    app_.SetHanded(BOTH_ARMS);
-  } else if (selected.compare( Glib::ustring("Left Arm Track, No Mirror")) == 0){
-    app_.SetHanded(LEFT_ARM_RIGHT_FROZEN);
-  } else if (selected.compare( Glib::ustring("Right Arm Track, No Mirror")) == 0) {
-    app_.SetHanded(RIGHT_ARM_LEFT_FROZEN);
-  }  else if (selected.compare( Glib::ustring("Left Arm Track, Mirrored Right")) == 0) {
-    app_.SetHanded(LEFT_ARM_RIGHT_MIRROR);
-  } else if (selected.compare( Glib::ustring("Right Arm Track, Mirrored Left")) == 0) {
-    app_.SetHanded(RIGHT_ARM_LEFT_MIRROR);
-  }/* else if (selected.compare( Glib::ustring("Left Arm, Copied Right")) == 0) {
-    app_.SetHanded(LEFT_ARM_COPY);
-  } else if (selected.compare( Glib::ustring("Right Arm, Copied Left")) == 0) {
-    app_.SetHanded(RIGHT_ARM_COPY);
-  }*/
+
+/*
+ * This is called by the wrapper function when an event is fired
+ */
+
+void PhantomLimb::ProcessEvent(MouseEvent e, GLFWwindow* window){}
+
+/*
+ * Called when the window is Resized. You should set cameras here
+ */
+
+void PhantomLimb::ProcessEvent(ResizeEvent e, GLFWwindow* window){
+  camera_ortho_.Resize(e.w,e.h);
 }
 
-#endif
+void PhantomLimb::ProcessEvent(KeyboardEvent e, GLFWwindow* window){}
+
 
 
+/*
+ * The UX window Class
+ */
+
+
+
+/*
+ * The headset window, whichever app is driving the loop
+ */
+
+static void CreateHeadsetWindow(GLFWApp &a, XMLSettings &settings) {
+
+  // Change HDMI-0 to whatever is listed in the output for the GLFW Monitor Screens
+
+
+  // Without a Rift the simulated headset renders into an ordinary window instead
+
+  if (FromStringS9<bool>(*settings["hmd/windowed"]))
+    a.CreateWindow("Oculus", FromStringS9<size_t>(*settings["hmd/resolution/x"]), FromStringS9<size_t>(*settings["hmd/resolution/y"]));
+  else
+    a.CreateWindowFullScreen("Oculus", 0, 0, settings["oculus_display"].Value().c_str());
+}
+
 /*
  * Main function - uses boost to parse program arguments
  */
@@ -816,26 +1552,39 @@ int main (int argc, const char * argv[]) {
     return -1;
   }
 
-  PhantomLimb b(settings);
+  // The operator console talks to us through shared memory, normally from its own process
+  // so GTK never runs alongside the frame loop
+
+  GameSettings game;
+  game.Read(settings);
+  ConsoleChannel console(settings["console/segment"].Value(), game);
+
+  PhantomLimb b(settings, console);
 
 #ifdef _SEBURO_OSX
   WithUXApp a(b,argc,argv,3,2);
-#else
-  WithUXApp a(b,argc,argv);
 #endif
 
 #ifdef _SEBURO_LINUX
-  // Change HDMI-0 to whatever is listed in the output for the GLFW Monitor Screens
-
 
-  a.CreateWindowFullScreen("Oculus", 0, 0, settings["oculus_display"].Value().c_str());
-  
-  //a.CreateWindow("Oculus", 1280, 800);
+  if (settings["console/mode"].Value() == "window") {
+    WithUXApp a(b,argc,argv);
+    CreateHeadsetWindow(a, settings);
+    UXWindow ux(console, [&a]() { a.Shutdown(); });
+    a.Run(ux);
+  } else {
+    // Run the separate PhantomConsole against the same segment. GLFW drives the loop on its
+    // own, so this process never starts GTK
+    GLFWApp a(b);
+    CreateHeadsetWindow(a, settings);
+    cout << "PhantomLimb: waiting for PhantomConsole on " << settings["console/segment"].Value() << endl;
+    a.Run();
+  }
 
-  UXWindow ux(a,b,settings);
-  a.Run(ux);
+  b.Shutdown();
+  b.StoreSettings();
 
-  // Call shutdown once the GTK Run loop has quit. This makes GLFW quit cleanly
+  // Call shutdown once the Run loop has quit. This makes GLFW quit cleanly
   //a.Shutdown();
 
   settings.SaveFile(s9::File("./data/settings.xml"));
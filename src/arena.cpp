@@ -0,0 +1,188 @@
+/**
+* @brief Arena allocator and the Bullet allocation hooks
+* @file arena.cpp
+* @author Benjamin Blundell <oni@section9.co.uk>
+* @date 19/10/2026
+*
+*/
+
+#include "arena.hpp"
+
+#include <LinearMath/btAlignedAllocator.h>
+
+#include <algorithm>
+#include <cstdlib>
+#include <mutex>
+
+
+using namespace std;
+using namespace s9;
+
+
+// Every pointer handed to Bullet has one of these immediately before it, so a free
+// can tell arena memory from heap memory, whichever thread frees it. Arena memory goes
+// back on its arena's free list
+
+namespace {
+
+  const uint32_t kHeapTag = 0x48454150;
+  const uint32_t kArenaTag = 0x4152454e;
+  const size_t kHeaderSize = 16;
+
+  struct AllocHeader {
+    void*     base;         // The malloc block for heap memory, the owning Arena for arena memory
+    uint32_t  tag;
+    uint8_t   size_class;   // Arena memory only
+    uint8_t   align_shift;
+    uint16_t  pad;
+  };
+
+  static_assert(sizeof(AllocHeader) <= kHeaderSize, "AllocHeader must fit in kHeaderSize");
+
+  thread_local Arena* tls_arena = nullptr;
+
+  // Only the heap path is counted here. Arenas keep their own tally
+  std::atomic<size_t> heap_allocations(0);
+  std::atomic<size_t> heap_bytes(0);
+
+  inline size_t AlignUp(size_t value, size_t alignment) {
+    return (value + alignment - 1) & ~(alignment - 1);
+  }
+
+  inline uint32_t Log2Ceil(size_t value) {
+    uint32_t shift = 0;
+    while ((size_t(1) << shift) < value)
+      shift++;
+    return shift;
+  }
+
+  void* BulletAlloc(size_t size, int alignment) {
+    size_t align = std::max<size_t>(static_cast<size_t>(alignment), kHeaderSize);
+    if (tls_arena != nullptr) {
+      // Reserve a full alignment step in front so the header never straddles the previous allocation
+      uint32_t size_class = 0;
+      byte_t* base = static_cast<byte_t*>(tls_arena->AllocatePooled(size + align, align, size_class));
+      byte_t* ptr = base + align;
+      AllocHeader* header = reinterpret_cast<AllocHeader*>(ptr - kHeaderSize);
+      header->base = tls_arena;
+      header->tag = kArenaTag;
+      header->size_class = static_cast<uint8_t>(size_class);
+      header->align_shift = static_cast<uint8_t>(Log2Ceil(align));
+      return ptr;
+    }
+
+    heap_allocations++;
+    heap_bytes += size;
+    byte_t* base = static_cast<byte_t*>(std::malloc(size + align + kHeaderSize));
+    if (base == nullptr)
+      return nullptr;
+
+    byte_t* ptr = reinterpret_cast<byte_t*>(AlignUp(reinterpret_cast<size_t>(base) + kHeaderSize, align));
+    AllocHeader* header = reinterpret_cast<AllocHeader*>(ptr - kHeaderSize);
+    header->base = base;
+    header->tag = kHeapTag;
+    return ptr;
+  }
+
+  void BulletFree(void* ptr) {
+    if (ptr == nullptr)
+      return;
+
+    AllocHeader* header = reinterpret_cast<AllocHeader*>(static_cast<byte_t*>(ptr) - kHeaderSize);
+    if (header->tag == kHeapTag) {
+      std::free(header->base);
+    } else if (header->base == tls_arena) {
+      // A worker thread freeing world memory mid step leaves it for the arena release,
+      // as the free lists belong to the thread with the arena in scope
+      byte_t* base = static_cast<byte_t*>(ptr) - (size_t(1) << header->align_shift);
+      static_cast<Arena*>(header->base)->FreePooled(base, header->size_class);
+    }
+  }
+
+}
+
+
+void* Arena::Allocate(size_t size, size_t alignment) {
+
+  if (head_ != nullptr) {
+    size_t offset = AlignUp(head_->offset, alignment);
+    if (offset + size <= head_->size) {
+      head_->offset = offset + size;
+      used_ += size;
+      allocations_++;
+      return reinterpret_cast<byte_t*>(head_) + offset;
+    }
+  }
+
+  // New block, big enough for this request even if it is larger than usual
+  size_t header = AlignUp(sizeof(Block), alignment);
+  size_t block_size = std::max(kBlockSize, header + size + alignment);
+
+  Block* block = static_cast<Block*>(std::malloc(block_size));
+  block->next = head_;
+  block->size = block_size;
+  block->offset = AlignUp(reinterpret_cast<size_t>(block) + header, alignment) - reinterpret_cast<size_t>(block) + size;
+  head_ = block;
+
+  reserved_ += block_size;
+  used_ += size;
+  allocations_++;
+  return reinterpret_cast<byte_t*>(block) + block->offset - size;
+}
+
+// Reuse needs the alignment to match as well. Bullet asks for 16 nearly everywhere, so a
+// mismatch just falls through to a fresh allocation
+
+void* Arena::AllocatePooled(size_t size, size_t alignment, uint32_t &size_class) {
+  size_class = Log2Ceil(std::max<size_t>(size, sizeof(FreeEntry)));
+
+  FreeEntry* entry = free_[size_class];
+  if (entry != nullptr && (reinterpret_cast<size_t>(entry) & (alignment - 1)) == 0) {
+    free_[size_class] = entry->next;
+    pooled_ -= size_t(1) << size_class;
+    allocations_++;
+    reused_++;
+    return entry;
+  }
+
+  return Allocate(size_t(1) << size_class, alignment);
+}
+
+void Arena::FreePooled(void* ptr, uint32_t size_class) {
+  FreeEntry* entry = static_cast<FreeEntry*>(ptr);
+  entry->next = free_[size_class];
+  free_[size_class] = entry;
+  pooled_ += size_t(1) << size_class;
+}
+
+void Arena::Release() {
+  while (head_ != nullptr) {
+    Block* next = head_->next;
+    std::free(head_);
+    head_ = next;
+  }
+  used_ = reserved_ = allocations_ = pooled_ = reused_ = 0;
+  std::fill(free_, free_ + kSizeClasses, nullptr);
+}
+
+
+ArenaScope::ArenaScope(Arena &arena) : previous_(tls_arena) {
+  tls_arena = &arena;
+}
+
+ArenaScope::~ArenaScope() {
+  tls_arena = previous_;
+}
+
+
+void s9::InstallBulletArenaHooks() {
+  static std::once_flag installed;
+  std::call_once(installed, []{ btAlignedAllocSetCustomAligned(BulletAlloc, BulletFree); });
+}
+
+BulletAllocStats s9::GetBulletAllocStats() {
+  BulletAllocStats stats;
+  stats.heap_allocations = heap_allocations.load();
+  stats.heap_bytes = heap_bytes.load();
+  return stats;
+}
@@ -0,0 +1,129 @@
+/**
+* @brief Instanced ball drawing
+* @file ball_batch.cpp
+* @author Benjamin Blundell <oni@section9.co.uk>
+* @date 19/10/2026
+*
+*/
+
+#include "ball_batch.hpp"
+
+#include <cstddef>
+
+
+using namespace std;
+using namespace s9;
+
+
+static const float_t kPi = 3.14159265358979f;
+
+BallBatch::BallBatch(float_t radius, size_t segments, const glm::vec4 &colour, GLuint program, size_t max_balls)
+  : obj_ (std::shared_ptr<SharedObject>(new SharedObject(radius, segments, colour, program, max_balls))) {
+
+}
+
+void BallBatch::Update(const std::vector<glm::mat4> &balls) {
+  CXSHARED
+
+  obj_->count = std::min(balls.size(), kMaxBallInstances * obj_->copies);
+  if (obj_->count == 0)
+    return;
+
+  for (size_t first = 0; first < obj_->count; first += kMaxBallInstances) {
+    size_t n = std::min(obj_->count - first, kMaxBallInstances);
+    std::copy(balls.begin() + first, balls.begin() + first + n, obj_->block.data(first / kMaxBallInstances).model);
+  }
+
+  // With one copy only the transforms in use go across
+  obj_->block.Upload(offsetof(BallBlock, model) + std::min(obj_->count, kMaxBallInstances) * sizeof(glm::mat4));
+  obj_->block.Bind();
+}
+
+void BallBatch::Draw() {
+  CXSHARED
+  if (obj_->count == 0)
+    return;
+
+  glUseProgram(obj_->program);
+  glBindVertexArray(obj_->vao);
+
+  for (size_t first = 0; first < obj_->count; first += kMaxBallInstances) {
+    if (first > 0)
+      obj_->block.Bind(first / kMaxBallInstances);
+    GLsizei n = static_cast<GLsizei>(std::min(obj_->count - first, kMaxBallInstances));
+    glDrawElementsInstanced(GL_TRIANGLES, obj_->index_count, GL_UNSIGNED_SHORT, nullptr, n);
+  }
+
+  // Leave the first copy bound, as Update found it
+  if (obj_->count > kMaxBallInstances)
+    obj_->block.Bind();
+
+  glBindVertexArray(0);
+  glUseProgram(0);
+}
+
+
+// A plain latitude / longitude sphere, position and normal interleaved
+
+BallBatch::SharedObject::SharedObject(float_t radius, size_t segments, const glm::vec4 &colour, GLuint program,
+  size_t max_balls) : program(program), copies((std::max<size_t>(max_balls, 1) + kMaxBallInstances - 1) / kMaxBallInstances),
+  count(0) {
+
+  size_t rings = std::max<size_t>(segments / 2, 2);
+  segments = std::max<size_t>(segments, 3);
+
+  std::vector<float_t> vertices;
+  std::vector<uint16_t> indices;
+
+  for (size_t r = 0; r <= rings; ++r) {
+    float_t phi = kPi * r / rings;
+    for (size_t s = 0; s <= segments; ++s) {
+      float_t theta = 2.0f * kPi * s / segments;
+      glm::vec3 n(sin(phi) * cos(theta), cos(phi), sin(phi) * sin(theta));
+      vertices.push_back(n.x * radius); vertices.push_back(n.y * radius); vertices.push_back(n.z * radius);
+      vertices.push_back(n.x); vertices.push_back(n.y); vertices.push_back(n.z);
+    }
+  }
+
+  for (size_t r = 0; r < rings; ++r) {
+    for (size_t s = 0; s < segments; ++s) {
+      uint16_t a = static_cast<uint16_t>(r * (segments + 1) + s);
+      uint16_t b = static_cast<uint16_t>(a + segments + 1);
+      indices.push_back(a); indices.push_back(a + 1); indices.push_back(b);
+      indices.push_back(a + 1); indices.push_back(b + 1); indices.push_back(b);
+    }
+  }
+
+  index_count = static_cast<GLsizei>(indices.size());
+
+  glGenVertexArrays(1, &vao);
+  glBindVertexArray(vao);
+
+  glGenBuffers(1, &vbo);
+  glBindBuffer(GL_ARRAY_BUFFER, vbo);
+  glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(float_t), &vertices[0], GL_STATIC_DRAW);
+  glEnableVertexAttribArray(0);
+  glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float_t), nullptr);
+  glEnableVertexAttribArray(1);
+  glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float_t), reinterpret_cast<void*>(3 * sizeof(float_t)));
+
+  glGenBuffers(1, &ibo);
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ibo);
+  glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(uint16_t), &indices[0], GL_STATIC_DRAW);
+
+  glBindVertexArray(0);
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+
+  ResolveUniformBlocks(program);
+
+  block = UniformBuffer<BallBlock>(UNIFORM_BINDING_BALLS, copies);
+  for (size_t i = 0; i < copies; ++i)
+    block.data(i).colour = colour;
+}
+
+BallBatch::SharedObject::~SharedObject() {
+  glDeleteBuffers(1, &vbo);
+  glDeleteBuffers(1, &ibo);
+  glDeleteVertexArrays(1, &vao);
+}
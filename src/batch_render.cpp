@@ -0,0 +1,169 @@
+/**
+* @brief Offscreen frame capture through a pixel buffer ring
+* @file batch_render.cpp
+* @author Benjamin Blundell <oni@section9.co.uk>
+* @date 19/10/2026
+*
+*/
+
+#include "batch_render.hpp"
+
+#include <sstream>
+
+
+using namespace std;
+using namespace s9;
+
+
+BatchRenderer::BatchRenderer(size_t width, size_t height, double_t fps, const std::string &output, const std::string &encoder)
+  : obj_ (std::shared_ptr<SharedObject>(new SharedObject(width, height, fps, output, encoder))) {
+
+}
+
+// Start the read into the next free buffer, then write out any older frames that are
+// already back. Frames always leave in the order they were captured
+
+void BatchRenderer::Capture() {
+  CXSHARED
+
+  if (obj_->captured == 0)
+    obj_->first_capture = NowSeconds();
+
+  if (obj_->in_flight == kSlots)
+    obj_->Retire(true);
+
+  size_t slot = (obj_->oldest + obj_->in_flight) % kSlots;
+
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, obj_->pbos[slot]);
+  glReadBuffer(GL_COLOR_ATTACHMENT0);
+  glPixelStorei(GL_PACK_ALIGNMENT, 1);
+  glReadPixels(0, 0, obj_->width, obj_->height, GL_RGB, GL_UNSIGNED_BYTE, nullptr);
+  glPixelStorei(GL_PACK_ALIGNMENT, 4);
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+  obj_->fences[slot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+  obj_->in_flight++;
+  obj_->captured++;
+
+  while (obj_->in_flight > 0) {
+    GLenum result = glClientWaitSync(obj_->fences[obj_->oldest], 0, 0);
+    if (result != GL_ALREADY_SIGNALED && result != GL_CONDITION_SATISFIED)
+      break;
+    obj_->Retire(false);
+  }
+}
+
+void BatchRenderer::Finish() {
+  CXSHARED
+  while (obj_->in_flight > 0)
+    obj_->Retire(true);
+  obj_->Close();
+
+  cout << "BatchRenderer: " << obj_->written << " frames at " << fps() << " fps"
+    << " readback stall " << obj_->stall * 1000.0 << "ms"
+    << " write " << obj_->write_time * 1000.0 << "ms" << endl;
+}
+
+
+BatchRenderer::SharedObject::SharedObject(size_t width, size_t height, double_t fps, const std::string &output,
+  const std::string &encoder) : width(width), height(height), oldest(0), in_flight(0), pipe(nullptr),
+  sequence(false), captured(0), written(0), first_capture(0), last_write(0), stall(0), write_time(0) {
+
+  frame_bytes = width * height * 3;
+
+  glGenBuffers(kSlots, pbos);
+  for (size_t i = 0; i < kSlots; ++i) {
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, pbos[i]);
+    glBufferData(GL_PIXEL_PACK_BUFFER, frame_bytes, nullptr, GL_STREAM_READ);
+    fences[i] = 0;
+  }
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+  if (output.size() > 4 && output.compare(output.size() - 4, 4, ".ppm") == 0) {
+    sequence = true;
+    pattern = output;
+    cout << "BatchRenderer: writing frames to " << output << endl;
+    return;
+  }
+
+  // GL hands rows back bottom up, so the encoder flips them for us
+  std::stringstream cmd;
+  cmd << encoder << " -y -loglevel error -f rawvideo -pix_fmt rgb24 -s " << width << "x" << height
+    << " -r " << fps << " -i - -vf vflip " << output;
+
+  pipe = popen(cmd.str().c_str(), "w");
+  if (pipe == nullptr)
+    cerr << "BatchRenderer: could not start " << cmd.str() << endl;
+  else
+    cout << "BatchRenderer: " << cmd.str() << endl;
+}
+
+BatchRenderer::SharedObject::~SharedObject() {
+  for (size_t i = 0; i < kSlots; ++i) {
+    if (fences[i] != 0)
+      glDeleteSync(fences[i]);
+  }
+  glDeleteBuffers(kSlots, pbos);
+  Close();
+}
+
+// Hand the oldest frame on. Waiting here means the GPU is behind by the whole ring
+
+void BatchRenderer::SharedObject::Retire(bool wait) {
+
+  GLsync &fence = fences[oldest];
+
+  if (wait) {
+    double_t start = NowSeconds();
+    while (true) {
+      GLenum result = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 100000000);
+      if (result == GL_ALREADY_SIGNALED || result == GL_CONDITION_SATISFIED || result == GL_WAIT_FAILED)
+        break;
+    }
+    stall += NowSeconds() - start;
+  }
+
+  glDeleteSync(fence);
+  fence = 0;
+
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, pbos[oldest]);
+  const byte_t *pixels = static_cast<const byte_t*>(glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, frame_bytes, GL_MAP_READ_BIT));
+  if (pixels != nullptr) {
+    Write(pixels);
+    glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+  }
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+  oldest = (oldest + 1) % kSlots;
+  in_flight--;
+}
+
+void BatchRenderer::SharedObject::Write(const byte_t *pixels) {
+
+  double_t start = NowSeconds();
+
+  if (sequence) {
+    char path[1024];
+    snprintf(path, sizeof(path), pattern.c_str(), static_cast<int>(written));
+    FILE *file = fopen(path, "wb");
+    if (file != nullptr) {
+      fprintf(file, "P6\n%zu %zu\n255\n", width, height);
+      for (size_t y = height; y > 0; --y)
+        fwrite(pixels + (y - 1) * width * 3, 1, width * 3, file);
+      fclose(file);
+    }
+  } else if (pipe != nullptr) {
+    fwrite(pixels, 1, frame_bytes, pipe);
+  }
+
+  written++;
+  last_write = NowSeconds();
+  write_time += last_write - start;
+}
+
+void BatchRenderer::SharedObject::Close() {
+  if (pipe != nullptr) {
+    pclose(pipe);
+    pipe = nullptr;
+  }
+}
@@ -0,0 +1,200 @@
+/**
+* @brief Sensor image streaming through a ring of pixel buffers
+* @file camera_feed.cpp
+* @author Benjamin Blundell <oni@section9.co.uk>
+* @date 19/10/2026
+*
+*/
+
+#include "camera_feed.hpp"
+
+#include <cstring>
+
+
+using namespace std;
+using namespace s9;
+
+
+CameraFeed::CameraFeed(size_t width, size_t height, FeedFormat format)
+  : obj_ (std::shared_ptr<SharedObject>(new SharedObject(width, height, format))) {
+
+}
+
+// Grab a free slot, copy the frame in and mark it ready. The only contention is with the
+// render thread handing slots back, so a failed claim just means we drop this frame
+
+bool CameraFeed::Submit(const void *data, size_t width, size_t height) {
+  CXSHARED
+
+  if (width != obj_->width || height != obj_->height) {
+    obj_->dropped++;
+    return false;
+  }
+
+  for (size_t i = 0; i < kSlots; ++i) {
+    Slot &slot = obj_->slots[i];
+    int expected = SLOT_FREE;
+    if (!slot.state.compare_exchange_strong(expected, SLOT_WRITING))
+      continue;
+
+    std::memcpy(slot.data, data, obj_->slot_bytes);
+    slot.sequence.store(++obj_->sequence);
+    slot.state.store(SLOT_READY);
+    obj_->submitted++;
+    return true;
+  }
+
+  obj_->dropped++;
+  return false;
+}
+
+// Recycle any slots the GPU has finished with, then upload the newest ready one.
+// Older ready slots are stale by now so they go straight back to the sensor
+
+bool CameraFeed::Upload() {
+  CXSHARED
+
+  double_t start = NowSeconds();
+  Slot *newest = nullptr;
+
+  for (size_t i = 0; i < kSlots; ++i) {
+    Slot &slot = obj_->slots[i];
+    int state = slot.state.load();
+
+    if (state == SLOT_UPLOADING) {
+      GLenum result = glClientWaitSync(slot.fence, 0, 0);
+      if (result == GL_ALREADY_SIGNALED || result == GL_CONDITION_SATISFIED) {
+        glDeleteSync(slot.fence);
+        slot.fence = 0;
+        slot.state.store(SLOT_FREE);
+      }
+    } else if (state == SLOT_READY) {
+      if (newest == nullptr || slot.sequence.load() > newest->sequence.load()) {
+        if (newest != nullptr)
+          newest->state.store(SLOT_FREE);
+        newest = &slot;
+      } else {
+        slot.state.store(SLOT_FREE);
+      }
+    }
+  }
+
+  if (newest == nullptr)
+    return false;
+
+  size_t offset = static_cast<size_t>(newest->data - obj_->mapped);
+
+  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, obj_->pbo);
+
+  if (!obj_->persistent) {
+    // Orphan first so the driver never stalls on the previous upload
+    glBufferData(GL_PIXEL_UNPACK_BUFFER, obj_->slot_bytes, nullptr, GL_STREAM_DRAW);
+    glBufferSubData(GL_PIXEL_UNPACK_BUFFER, 0, obj_->slot_bytes, newest->data);
+    offset = 0;
+  }
+
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+  glBindTexture(GL_TEXTURE_RECTANGLE, obj_->texture);
+
+  if (obj_->format == FEED_DEPTH16)
+    glTexSubImage2D(GL_TEXTURE_RECTANGLE, 0, 0, 0, obj_->width, obj_->height, GL_RED, GL_UNSIGNED_SHORT,
+      reinterpret_cast<const GLvoid*>(offset));
+  else
+    glTexSubImage2D(GL_TEXTURE_RECTANGLE, 0, 0, 0, obj_->width, obj_->height, GL_RGB, GL_UNSIGNED_BYTE,
+      reinterpret_cast<const GLvoid*>(offset));
+
+  glBindTexture(GL_TEXTURE_RECTANGLE, 0);
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+  if (obj_->persistent) {
+    newest->fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    newest->state.store(SLOT_UPLOADING);
+  } else {
+    // The driver has its own copy now
+    newest->state.store(SLOT_FREE);
+  }
+
+  obj_->uploaded++;
+  obj_->upload_cost = NowSeconds() - start;
+  return true;
+}
+
+void CameraFeed::Bind(GLuint unit) {
+  CXSHARED
+  obj_->bound_unit = unit;
+  glActiveTexture(GL_TEXTURE0 + unit);
+  glBindTexture(GL_TEXTURE_RECTANGLE, obj_->texture);
+}
+
+void CameraFeed::Unbind() {
+  CXSHARED
+  glActiveTexture(GL_TEXTURE0 + obj_->bound_unit);
+  glBindTexture(GL_TEXTURE_RECTANGLE, 0);
+  glActiveTexture(GL_TEXTURE0);
+}
+
+
+CameraFeed::SharedObject::SharedObject(size_t width, size_t height, FeedFormat format)
+  : width(width), height(height), format(format), texture(0), pbo(0), bound_unit(0), persistent(false),
+  mapped(nullptr), sequence(0), submitted(0), dropped(0), uploaded(0), upload_cost(0) {
+
+  slot_bytes = width * height * (format == FEED_DEPTH16 ? 2 : 3);
+
+  glGenTextures(1, &texture);
+  glBindTexture(GL_TEXTURE_RECTANGLE, texture);
+  glTexParameteri(GL_TEXTURE_RECTANGLE, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_RECTANGLE, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_RECTANGLE, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_RECTANGLE, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+  if (format == FEED_DEPTH16)
+    glTexImage2D(GL_TEXTURE_RECTANGLE, 0, GL_R16, width, height, 0, GL_RED, GL_UNSIGNED_SHORT, nullptr);
+  else
+    glTexImage2D(GL_TEXTURE_RECTANGLE, 0, GL_RGB8, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, nullptr);
+
+  glBindTexture(GL_TEXTURE_RECTANGLE, 0);
+
+  glGenBuffers(1, &pbo);
+  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pbo);
+
+  // One buffer, mapped once for its whole life, split into slots the sensor writes directly
+  if (GLEW_ARB_buffer_storage) {
+    GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+    glBufferStorage(GL_PIXEL_UNPACK_BUFFER, slot_bytes * kSlots, nullptr, flags);
+    mapped = static_cast<byte_t*>(glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, slot_bytes * kSlots, flags));
+    persistent = mapped != nullptr;
+  }
+
+  if (!persistent) {
+    cerr << "PhantomLimb: no persistent buffer mapping. Camera feed will upload through a staging copy." << endl;
+    glBufferData(GL_PIXEL_UNPACK_BUFFER, slot_bytes, nullptr, GL_STREAM_DRAW);
+    staging.resize(slot_bytes * kSlots);
+    mapped = &staging[0];
+  }
+
+  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+  for (size_t i = 0; i < kSlots; ++i) {
+    slots[i].state.store(SLOT_FREE);
+    slots[i].sequence.store(0);
+    slots[i].fence = 0;
+    slots[i].data = mapped + i * slot_bytes;
+  }
+}
+
+CameraFeed::SharedObject::~SharedObject() {
+  for (size_t i = 0; i < kSlots; ++i) {
+    if (slots[i].fence != 0)
+      glDeleteSync(slots[i].fence);
+  }
+
+  if (persistent) {
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pbo);
+    glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+  }
+
+  glDeleteBuffers(1, &pbo);
+  glDeleteTextures(1, &texture);
+}
@@ -0,0 +1,152 @@
+/**
+* @brief Shared memory channel to the operator console
+* @file console_channel.cpp
+* @author Benjamin Blundell <oni@section9.co.uk>
+* @date 19/10/2026
+*
+*/
+
+#include "console_channel.hpp"
+
+#include <cerrno>
+#include <csignal>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <new>
+
+
+using namespace std;
+using namespace s9;
+
+
+// Both processes map the same atomics, which only works if they never fall back to a lock
+static_assert(ATOMIC_LLONG_LOCK_FREE == 2 && ATOMIC_INT_LOCK_FREE == 2, "Console channel needs lock-free atomics");
+
+
+ConsoleChannel::ConsoleChannel(const std::string &name, const GameSettings &settings)
+  : obj_ (std::shared_ptr<SharedObject>(new SharedObject(name, true))) {
+
+  if (obj_->segment != nullptr) {
+    PublishSettings(settings);
+    obj_->segment->magic.store(kMagic, std::memory_order_release);
+  }
+}
+
+ConsoleChannel::ConsoleChannel(const std::string &name)
+  : obj_ (std::shared_ptr<SharedObject>(new SharedObject(name, false))) {
+
+}
+
+void ConsoleChannel::Publish(const TelemetrySample &sample) {
+  CXSHARED
+  Segment &s = *obj_->segment;
+  if (!s.telemetry.Push(sample))
+    s.dropped.fetch_add(1, std::memory_order_relaxed);
+  s.heartbeat.fetch_add(1, std::memory_order_release);
+}
+
+bool ConsoleChannel::AttachReader() {
+  CXSHARED
+  if (obj_->reader)
+    return true;
+
+  Segment &s = *obj_->segment;
+  int32_t self = static_cast<int32_t>(getpid());
+  int32_t current = s.reader.load();
+
+  while (true) {
+    // Taken by a live process - which may be this one, through another channel
+    if (current != 0 && (current == self || kill(current, 0) == 0 || errno != ESRCH))
+      return false;
+    if (s.reader.compare_exchange_weak(current, self))
+      break;
+  }
+
+  obj_->reader = true;
+  return true;
+}
+
+// A sequence lock. Only the render process ever writes, so there is no contention there,
+// and the console simply retries if it caught a write half done
+
+void ConsoleChannel::PublishSettings(const GameSettings &settings) {
+  CXSHARED
+  Segment &s = *obj_->segment;
+  uint32_t sequence = s.settings_sequence.load(std::memory_order_relaxed);
+  s.settings_sequence.store(sequence + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  s.settings = settings;
+  s.settings_sequence.store(sequence + 2, std::memory_order_release);
+}
+
+GameSettings ConsoleChannel::settings() {
+  CXSHARED
+  Segment &s = *obj_->segment;
+  GameSettings settings;
+  uint32_t before, after;
+  do {
+    before = s.settings_sequence.load(std::memory_order_acquire);
+    settings = s.settings;
+    std::atomic_thread_fence(std::memory_order_acquire);
+    after = s.settings_sequence.load(std::memory_order_relaxed);
+  } while (before != after || (before & 1) != 0);
+  return settings;
+}
+
+
+ConsoleChannel::SharedObject::SharedObject(const std::string &name, bool create) : name(name), fd(-1),
+  segment(nullptr), owner(create), reader(false) {
+
+  if (create) {
+    shm_unlink(name.c_str());
+    fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+    if (fd < 0 || ftruncate(fd, sizeof(Segment)) != 0) {
+      cerr << "PhantomLimb: could not create console segment " << name << endl;
+      return;
+    }
+  } else {
+    fd = shm_open(name.c_str(), O_RDWR, 0600);
+    struct stat info;
+    if (fd < 0 || fstat(fd, &info) != 0 || static_cast<size_t>(info.st_size) != sizeof(Segment))
+      return;
+  }
+
+  void *memory = mmap(nullptr, sizeof(Segment), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if (memory == MAP_FAILED) {
+    cerr << "PhantomLimb: could not map console segment " << name << endl;
+    return;
+  }
+
+  if (create) {
+    segment = new (memory) Segment();
+    segment->version = kVersion;
+    segment->heartbeat.store(0);
+    segment->dropped.store(0);
+    segment->reader.store(0);
+    segment->settings_sequence.store(0);
+    cout << "PhantomLimb: operator console segment " << name << " is " << sizeof(Segment) / 1024 << "KB" << endl;
+  } else {
+    Segment *mapped = static_cast<Segment*>(memory);
+    if (mapped->magic.load(std::memory_order_acquire) != kMagic || mapped->version != kVersion) {
+      munmap(memory, sizeof(Segment));
+      return;
+    }
+    segment = mapped;
+  }
+}
+
+ConsoleChannel::SharedObject::~SharedObject() {
+  if (segment != nullptr) {
+    int32_t self = static_cast<int32_t>(getpid());
+    if (reader)
+      segment->reader.compare_exchange_strong(self, 0);
+    munmap(segment, sizeof(Segment));
+  }
+  if (fd >= 0)
+    close(fd);
+  if (owner)
+    shm_unlink(name.c_str());
+}
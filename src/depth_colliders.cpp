@@ -0,0 +1,197 @@
+/**
+* @brief Depth stream voxeliser for the physics hand proxies
+* @file depth_colliders.cpp
+* @author Benjamin Blundell <oni@section9.co.uk>
+* @date 19/10/2026
+*
+*/
+
+#include "depth_colliders.hpp"
+
+#include <algorithm>
+
+
+using namespace std;
+using namespace s9;
+
+
+DepthColliders::DepthColliders(const DepthColliderSettings &settings)
+  : obj_ (std::shared_ptr<SharedObject>(new SharedObject(settings))) {
+
+}
+
+void DepthColliders::Start() {
+  CXSHARED
+  if (obj_->running.load())
+    return;
+
+  obj_->running.store(true);
+  obj_->thread = std::thread(&SharedObject::Run, obj_.get());
+}
+
+void DepthColliders::Stop() {
+  CXSHARED
+  {
+    std::lock_guard<std::mutex> lock(obj_->frame_mutex);
+    obj_->running.store(false);
+  }
+  obj_->frame_ready.notify_one();
+  if (obj_->thread.joinable())
+    obj_->thread.join();
+}
+
+void DepthColliders::Submit(DepthFrame &frame) {
+  CXSHARED
+  {
+    std::lock_guard<std::mutex> lock(obj_->frame_mutex);
+    std::swap(obj_->pending, frame);
+    obj_->has_pending = true;
+  }
+  obj_->frame_ready.notify_one();
+}
+
+bool DepthColliders::Latest(std::vector<glm::vec3> &centres) {
+  CXSHARED
+  // try_lock so a busy worker never holds up a frame
+  std::unique_lock<std::mutex> lock(obj_->result_mutex, std::try_to_lock);
+  if (!lock.owns_lock() || !obj_->has_published)
+    return false;
+
+  centres.assign(obj_->published.begin(), obj_->published.end());
+  obj_->has_published = false;
+  return true;
+}
+
+
+DepthColliders::SharedObject::SharedObject(const DepthColliderSettings &settings)
+  : settings(settings), has_pending(false), has_published(false),
+  running(false), frames(0), overruns(0), last_cost(0) {
+
+  glm::vec3 extent = settings.volume_max - settings.volume_min;
+  grid_x = std::max<size_t>(1, static_cast<size_t>(extent.x / settings.voxel_size));
+  grid_y = std::max<size_t>(1, static_cast<size_t>(extent.y / settings.voxel_size));
+  grid_z = std::max<size_t>(1, static_cast<size_t>(extent.z / settings.voxel_size));
+
+  size_t cells = grid_x * grid_y * grid_z;
+  counts.resize(cells, 0);
+  sums.resize(cells, glm::vec3(0.0f));
+  occupied.reserve(cells);
+
+  result.reserve(settings.max_spheres);
+  published.reserve(settings.max_spheres);
+}
+
+DepthColliders::SharedObject::~SharedObject() {
+  {
+    std::lock_guard<std::mutex> lock(frame_mutex);
+    running.store(false);
+  }
+  frame_ready.notify_one();
+  if (thread.joinable())
+    thread.join();
+}
+
+void DepthColliders::SharedObject::Run() {
+
+  while (running.load()) {
+    {
+      std::unique_lock<std::mutex> lock(frame_mutex);
+      frame_ready.wait(lock, [this]{ return has_pending || !running.load(); });
+      if (!running.load())
+        break;
+      std::swap(pending, working);
+      has_pending = false;
+    }
+
+    Process();
+  }
+}
+
+// Downsample, mask to the player band, project into world space and bin into voxels.
+// Stops early if it runs over budget, keeping whatever it had binned so far
+
+void DepthColliders::SharedObject::Process() {
+
+  double_t start = NowSeconds();
+  bool overrun = false;
+
+  if (working.width == 0 || working.height == 0)
+    return;
+
+  const float_t deg = 3.14159265f / 180.0f;
+  const float_t fx = static_cast<float_t>(working.width) / (2.0f * tan(settings.fov_h * 0.5f * deg));
+  const float_t fy = static_cast<float_t>(working.height) / (2.0f * tan(settings.fov_v * 0.5f * deg));
+  const float_t cx = working.width * 0.5f;
+  const float_t cy = working.height * 0.5f;
+  const float_t inv_voxel = 1.0f / settings.voxel_size;
+  const size_t step = std::max<size_t>(1, settings.downsample);
+
+  // Clear only the cells touched last time
+  for (uint32_t idx : occupied) {
+    counts[idx] = 0;
+    sums[idx] = glm::vec3(0.0f);
+  }
+  occupied.clear();
+
+  for (size_t y = 0; y < working.height; y += step) {
+
+    if (NowSeconds() - start > settings.budget) {
+      overrun = true;
+      break;
+    }
+
+    const uint16_t *row = &working.depth[y * working.width];
+
+    for (size_t x = 0; x < working.width; x += step) {
+      float_t z = row[x] * 0.001f;
+      if (z < settings.near_clip || z > settings.far_clip)
+        continue;
+
+      // The sensor faces the player so its x axis runs against world x
+      glm::vec3 p = settings.sensor_position + glm::vec3( -(x - cx) * z / fx, (cy - y) * z / fy, z);
+
+      glm::vec3 g = (p - settings.volume_min) * inv_voxel;
+      if (g.x < 0 || g.y < 0 || g.z < 0)
+        continue;
+
+      size_t gx = static_cast<size_t>(g.x);
+      size_t gy = static_cast<size_t>(g.y);
+      size_t gz = static_cast<size_t>(g.z);
+      if (gx >= grid_x || gy >= grid_y || gz >= grid_z)
+        continue;
+
+      uint32_t idx = static_cast<uint32_t>((gz * grid_y + gy) * grid_x + gx);
+      if (counts[idx] == 0)
+        occupied.push_back(idx);
+      if (counts[idx] < 0xffff) {
+        counts[idx]++;
+        sums[idx] += p;
+      }
+    }
+  }
+
+  // Keep the densest voxels, up to the size of the physics sphere pool
+
+  size_t keep = std::min(settings.max_spheres, occupied.size());
+  std::partial_sort(occupied.begin(), occupied.begin() + keep, occupied.end(),
+    [this](uint32_t a, uint32_t b) { return counts[a] > counts[b]; });
+
+  result.clear();
+  for (size_t i = 0; i < keep; ++i) {
+    uint32_t idx = occupied[i];
+    if (counts[idx] < settings.min_points)
+      break;
+    result.push_back(sums[idx] / static_cast<float_t>(counts[idx]));
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(result_mutex);
+    std::swap(result, published);
+    has_published = true;
+  }
+
+  frames++;
+  if (overrun)
+    overruns++;
+  last_cost.store(NowSeconds() - start);
+}
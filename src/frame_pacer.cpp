@@ -0,0 +1,232 @@
+/**
+* @brief Frame pacing against the predicted vsync
+* @file frame_pacer.cpp
+* @author Benjamin Blundell <oni@section9.co.uk>
+* @date 19/10/2026
+*
+*/
+
+#include "frame_pacer.hpp"
+
+
+using namespace std;
+using namespace s9;
+
+
+static const size_t kSettleFrames = 10;
+static const size_t kMissesToDrop = 3;     // Within a second
+
+void Histogram::Add(double_t value) {
+  if (bins_.empty())
+    return;
+  double_t t = (value - low_) / (high_ - low_) * bins_.size();
+  size_t bin = t < 0 ? 0 : std::min(static_cast<size_t>(t), bins_.size() - 1);
+  bins_[bin]++;
+  total_++;
+}
+
+void Histogram::Clear() {
+  std::fill(bins_.begin(), bins_.end(), 0);
+  total_ = 0;
+}
+
+double_t Histogram::Percentile(double_t p) const {
+  if (total_ == 0)
+    return 0;
+  size_t target = static_cast<size_t>(p * total_);
+  size_t seen = 0;
+  double_t width = (high_ - low_) / bins_.size();
+  for (size_t i = 0; i < bins_.size(); ++i) {
+    seen += bins_[i];
+    if (seen > target)
+      return low_ + width * (i + 1);
+  }
+  return high_;
+}
+
+// Only the bins from the first to the last with anything in them
+
+std::string Histogram::Render(const std::string &units, size_t width) const {
+  std::ostringstream out;
+  if (total_ == 0)
+    return out.str();
+
+  size_t first = 0, last = bins_.size() - 1, peak = 0;
+  while (bins_[first] == 0) first++;
+  while (bins_[last] == 0) last--;
+  for (size_t count : bins_)
+    peak = std::max(peak, count);
+
+  double_t bin_width = (high_ - low_) / bins_.size();
+  for (size_t i = first; i <= last; ++i) {
+    out.width(5);
+    out << low_ + bin_width * i << units << " ";
+    out << std::string(bins_[i] * width / peak, '#') << " " << bins_[i] << "\n";
+  }
+  return out.str();
+}
+
+
+FramePacer::FramePacer(const FramePacerSettings &settings)
+  : obj_ (std::shared_ptr<SharedObject>(new SharedObject())) {
+
+  obj_->settings = settings;
+  obj_->period = 1.0 / settings.refresh;
+  obj_->vsync = obj_->last_swap = obj_->start = obj_->input = 0;
+  obj_->cost = obj_->reproject_cost = 0;
+  obj_->slept = obj_->headroom = 0;
+  obj_->miss_window = 0;
+  obj_->recent_misses = 0;
+  obj_->frame = 0;
+  obj_->half_rate = false;
+  obj_->type = FRAME_RENDER;
+  obj_->last_interval = obj_->last_input_to_swap = 0;
+  obj_->last_missed = 0;
+
+  obj_->frame_times = Histogram(0.0, 50.0, 25);
+  obj_->missed = Histogram(0.0, 5.0, 5);
+  obj_->input_to_swap = Histogram(0.0, 50.0, 25);
+  obj_->frames = obj_->misses = obj_->reprojected = 0;
+
+  cout << "PhantomLimb: pacing frames to " << settings.refresh << "Hz" << endl;
+}
+
+FrameType FramePacer::Wait() {
+  CXSHARED
+  SharedObject &o = *obj_;
+
+  double_t now = NowSeconds();
+
+  if (o.last_swap > 0) {
+    double_t interval = now - o.last_swap;
+
+    // Lock onto the vsync phase. However many refreshes went by, the swap returned a little
+    // after one of them - nudge the estimate towards it rather than jump, to ride out jitter
+    double_t refreshes = std::max(1.0, std::floor((now - o.vsync) / o.period + 0.5));
+    double_t predicted = o.vsync + refreshes * o.period;
+    o.vsync = predicted + (now - predicted) * 0.1;
+
+    // And the period itself, off intervals that clearly spanned a single refresh
+    if (refreshes == 1.0 && std::abs(interval - o.period) < o.period * 0.25)
+      o.period += (interval - o.period) * 0.01;
+
+    bool missed = refreshes > 1.0;
+    if (missed) {
+      // Repeated misses mean the frame no longer fits, whatever the CPU says. A single one is
+      // often just the scheduler, and the first few frames miss while the cost estimate settles
+      if (now - o.miss_window > 1.0) {
+        o.miss_window = now;
+        o.recent_misses = 0;
+      }
+      o.recent_misses++;
+
+      if (o.settings.half_rate && !o.half_rate && o.frame > kSettleFrames && o.recent_misses >= kMissesToDrop) {
+        o.half_rate = true;
+        cout << "PhantomLimb: missing refreshes, dropping to half rate" << endl;
+      }
+      o.headroom = 0;
+    }
+
+    o.last_interval = interval;
+    o.last_missed = static_cast<size_t>(refreshes - 1.0);
+    o.last_input_to_swap = o.input > 0 ? now - o.input : 0;
+
+    o.frame_times.Add(interval * 1000.0);
+    o.missed.Add(refreshes - 1.0);
+    if (o.input > 0)
+      o.input_to_swap.Add((now - o.input) * 1000.0);
+    o.frames++;
+    if (missed)
+      o.misses++;
+    if (o.type == FRAME_REPROJECT)
+      o.reprojected++;
+  } else {
+    o.vsync = now;
+  }
+
+  o.last_swap = now;
+  o.input = 0;
+
+  // Full rate while the scene fits in a refresh with the margin to spare. Back up from half
+  // rate only after it has fitted comfortably for a while
+
+  double_t budget = o.period - o.settings.margin;
+  if (!o.half_rate) {
+    if (o.settings.half_rate && o.cost > budget) {
+      o.half_rate = true;
+      o.headroom = 0;
+      cout << "PhantomLimb: frame cost " << o.cost * 1000.0 << "ms over budget, dropping to half rate" << endl;
+    }
+  } else {
+    o.headroom = o.cost < budget * 0.75 ? o.headroom + o.period : 0;
+    if (o.headroom > o.settings.recover) {
+      o.half_rate = false;
+      cout << "PhantomLimb: back to full rate" << endl;
+    }
+  }
+
+  o.type = o.half_rate && o.frame % 2 == 1 ? FRAME_REPROJECT : FRAME_RENDER;
+  o.frame++;
+
+  // Start as late as will still make the next vsync. At half rate a scene frame gets the
+  // whole refresh, so it starts straight away
+
+  o.slept = 0;
+  if (!(o.half_rate && o.type == FRAME_RENDER)) {
+    double_t work = o.type == FRAME_RENDER ? o.cost : o.reproject_cost;
+    double_t start = o.vsync + o.period - work - o.settings.margin;
+    double_t wait = start - NowSeconds();
+
+    if (wait > 0) {
+      if (wait > o.settings.spin)
+        std::this_thread::sleep_for(std::chrono::duration<double_t>(wait - o.settings.spin));
+      while (NowSeconds() < start)
+        std::this_thread::yield();
+      o.slept = wait;
+    }
+  }
+
+  o.start = NowSeconds();
+  return o.type;
+}
+
+void FramePacer::InputSampled() {
+  CXSHARED
+  obj_->input = NowSeconds();
+}
+
+// Decaying peak - one slow frame raises the estimate straight away, and it takes a while of
+// faster frames to come back down
+
+void FramePacer::Submitted() {
+  CXSHARED
+  double_t cost = NowSeconds() - obj_->start;
+  double_t &estimate = obj_->type == FRAME_RENDER ? obj_->cost : obj_->reproject_cost;
+  estimate = cost > estimate ? cost : estimate + (cost - estimate) * 0.05;
+}
+
+std::string FramePacer::Report() {
+  CXSHARED
+
+  std::ostringstream out;
+  out.precision(3);
+  out << "Pacing " << 1.0 / obj_->period << "Hz " << (obj_->half_rate ? "half rate" : "full rate")
+    << ", frames " << obj_->frames << ", missed " << obj_->misses << ", reprojected " << obj_->reprojected << "\n"
+    << "Frame cost " << obj_->cost * 1000.0 << "ms\n\n";
+
+  out << "Frame time (p50 " << obj_->frame_times.Percentile(0.5) << "ms, p99 " << obj_->frame_times.Percentile(0.99) << "ms)\n"
+    << obj_->frame_times.Render("ms", 30) << "\n";
+  out << "Missed refreshes per frame\n" << obj_->missed.Render("", 30) << "\n";
+  out << "Input to swap (p50 " << obj_->input_to_swap.Percentile(0.5) << "ms, p99 " << obj_->input_to_swap.Percentile(0.99) << "ms)\n"
+    << obj_->input_to_swap.Render("ms", 30);
+
+  return out.str();
+}
+
+void FramePacer::Clear() {
+  CXSHARED
+  obj_->frame_times.Clear();
+  obj_->missed.Clear();
+  obj_->input_to_swap.Clear();
+  obj_->frames = obj_->misses = obj_->reprojected = 0;
+}
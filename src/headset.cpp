@@ -0,0 +1,112 @@
+/**
+* @brief Head mounted display, real or simulated
+* @file headset.cpp
+* @author Benjamin Blundell <oni@section9.co.uk>
+* @date 19/10/2026
+*
+*/
+
+#include "headset.hpp"
+#include "timing.hpp"
+
+
+using namespace std;
+using namespace s9;
+
+
+static const double_t kPi = 3.14159265358979323846;
+
+
+Headset::Headset(float_t near, float_t far, const SimulatedHMDSettings &settings)
+  : obj_ (std::shared_ptr<SharedObject>(new SharedObject(near, far, settings))) {
+
+}
+
+void Headset::Update(double_t dt) {
+  CXSHARED
+  if (!obj_->simulated)
+    obj_->oculus.Update(dt);
+}
+
+// The scripted track is a slow Lissajous curve - pitch and roll move at different rates to
+// yaw so the path never repeats exactly over a session. It runs off the wall clock like a
+// real tracker, so sampling it later in the frame gives a newer pose
+
+glm::quat Headset::orientation() {
+  CXSHARED
+
+  if (!obj_->simulated)
+    return obj_->oculus.orientation();
+
+  const SimulatedHMDSettings &s = obj_->settings;
+  double_t phase = s.period > 0 ? 2.0 * kPi * (NowSeconds() - obj_->start) / s.period : 0;
+
+  float_t yaw = s.yaw * static_cast<float_t>(sin(phase));
+  float_t pitch = s.pitch * static_cast<float_t>(sin(phase * 1.7));
+  float_t roll = s.roll * static_cast<float_t>(sin(phase * 0.6));
+
+  return glm::angleAxis(yaw, glm::vec3(0.0f, 1.0f, 0.0f))
+    * glm::angleAxis(pitch, glm::vec3(1.0f, 0.0f, 0.0f))
+    * glm::angleAxis(roll, glm::vec3(0.0f, 0.0f, 1.0f));
+}
+
+// Both eyes share a field of view. The lens shift only translates the projection, so the
+// diagonal still holds the scale
+
+glm::vec2 Headset::tan_half_fov() {
+  glm::mat4 projection = left_projection();
+  return glm::vec2(1.0f / projection[0][0], 1.0f / projection[1][1]);
+}
+
+void Headset::ResetView() {
+  CXSHARED
+  if (obj_->simulated) {
+    obj_->start = NowSeconds();
+  } else {
+    obj_->oculus.ResetView();
+  }
+}
+
+
+Headset::SharedObject::SharedObject(float_t near, float_t far, const SimulatedHMDSettings &settings)
+  : oculus(near, far), simulated(false), settings(settings), xcenter_offset(0), distortion_scale(1.0f), start(NowSeconds()) {
+
+  if (oculus.Connected() || !settings.enabled)
+    return;
+
+  simulated = true;
+  Simulate(near, far);
+
+  cout << "PhantomLimb: no Rift found. Simulating a " << settings.resolution.x << "x" << settings.resolution.y
+    << " headset, fbo " << fbo_size.x << "x" << fbo_size.y << endl;
+}
+
+// Derive everything the renderer needs from the panel and lens geometry, as the SDK does for
+// a real device. All of this is per eye, on half of the panel
+
+void Headset::SharedObject::Simulate(float_t near, float_t far) {
+
+  const SimulatedHMDSettings &s = settings;
+  float_t aspect = (s.resolution.x * 0.5f) / s.resolution.y;
+
+  // How far the lens centre sits from the middle of each half screen, in -1 to 1 units
+  float_t lens_shift = s.screen_size.x * 0.25f - s.lens_separation * 0.5f;
+  xcenter_offset = 4.0f * lens_shift / s.screen_size.x;
+
+  // Scale so the warped image still reaches the outer edge of the panel
+  float_t fit = -1.0f - xcenter_offset;
+  float_t r2 = fit * fit;
+  glm::vec4 k = s.distortion;
+  distortion_scale = k.x + k.y * r2 + k.z * r2 * r2 + k.w * r2 * r2 * r2;
+
+  float_t fov = 2.0f * atan(s.screen_size.y * distortion_scale / (2.0f * s.eye_to_screen)) * 180.0f / static_cast<float_t>(kPi);
+
+  glm::mat4 centre = glm::perspective(fov, aspect, near, far);
+  left_projection = glm::translate(glm::mat4(1.0f), glm::vec3(xcenter_offset, 0.0f, 0.0f)) * centre;
+  right_projection = glm::translate(glm::mat4(1.0f), glm::vec3(-xcenter_offset, 0.0f, 0.0f)) * centre;
+
+  left_inter = glm::translate(glm::mat4(1.0f), glm::vec3(s.ipd * 0.5f, 0.0f, 0.0f));
+  right_inter = glm::translate(glm::mat4(1.0f), glm::vec3(-s.ipd * 0.5f, 0.0f, 0.0f));
+
+  fbo_size = glm::vec2(ceil(s.resolution.x * distortion_scale), ceil(s.resolution.y * distortion_scale));
+}
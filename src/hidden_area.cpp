@@ -0,0 +1,240 @@
+/**
+* @brief Hidden area mask for the eye buffers
+* @file hidden_area.cpp
+* @author Benjamin Blundell <oni@section9.co.uk>
+* @date 19/10/2026
+*
+*/
+
+#include "hidden_area.hpp"
+
+
+using namespace std;
+using namespace s9;
+
+
+static const size_t kEdgeSteps = 24;
+
+// Where barrel.frag samples the left eye buffer, for a point on the left half of the screen.
+// Texture co-ordinates go in, eye clip space comes out. Takes the widest colour channel
+
+static glm::vec2 WarpSample(glm::vec2 tc, const glm::vec4 &k, const glm::vec4 &chromatic, float_t xcenter_offset,
+  float_t distortion_scale) {
+
+  glm::vec2 lens(0.25f + xcenter_offset * 0.25f, 0.5f);
+  glm::vec2 theta = (tc - lens) * glm::vec2(4.0f, 2.0f);
+  float_t r2 = theta.x * theta.x + theta.y * theta.y;
+  glm::vec2 rvector = theta * (k.x + k.y * r2 + k.z * r2 * r2 + k.w * r2 * r2 * r2);
+
+  float_t channel = std::max(1.0f, std::max(chromatic.x + chromatic.y * r2, chromatic.z + chromatic.w * r2));
+  glm::vec2 sample = lens + glm::vec2(0.25f, 0.5f) * rvector * (channel / distortion_scale);
+
+  return glm::vec2(sample.x * 4.0f - 1.0f, sample.y * 2.0f - 1.0f);
+}
+
+static bool InsidePolygon(const std::vector<glm::vec2> &polygon, glm::vec2 p) {
+  bool inside = false;
+  for (size_t i = 0, j = polygon.size() - 1; i < polygon.size(); j = i++) {
+    const glm::vec2 &a = polygon[i];
+    const glm::vec2 &b = polygon[j];
+    if ((a.y > p.y) != (b.y > p.y) && p.x < (b.x - a.x) * (p.y - a.y) / (b.y - a.y) + a.x)
+      inside = !inside;
+  }
+  return inside;
+}
+
+
+HiddenAreaMask::HiddenAreaMask(const glm::vec4 &distortion, const glm::vec4 &chromatic, float_t xcenter_offset,
+  float_t distortion_scale, float_t margin, size_t probe_interval, GLuint program)
+  : obj_ (std::shared_ptr<SharedObject>(new SharedObject(distortion, chromatic, xcenter_offset, distortion_scale,
+    margin, probe_interval, program))) {
+
+}
+
+bool HiddenAreaMask::Begin() {
+  CXSHARED
+
+  obj_->Collect();
+  obj_->frame++;
+
+  bool masked = obj_->probe_interval == 0 || obj_->frame % obj_->probe_interval != 0;
+
+  // Skip measuring rather than wait on a query still in flight. On a masked frame the
+  // samples are only counted once Write is done, or every mask fragment would pass
+  Query &query = obj_->queries[obj_->current];
+  obj_->active = !query.pending;
+  if (obj_->active) {
+    query.masked = masked;
+    glBeginQuery(GL_TIME_ELAPSED, query.time);
+    if (!masked)
+      obj_->CountSamples();
+  }
+
+  return masked;
+}
+
+void HiddenAreaMask::Write(size_t width, size_t height) {
+  CXSHARED
+
+  GLint eye_width = static_cast<GLint>(width / 2);
+
+  glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+  glDepthFunc(GL_ALWAYS);
+  glDisable(GL_CULL_FACE);
+
+  glUseProgram(obj_->program);
+  glBindVertexArray(obj_->vao);
+
+  for (GLint eye = 0; eye < 2; ++eye) {
+    glViewport(eye * eye_width, 0, eye_width, static_cast<GLsizei>(height));
+    glDrawArrays(GL_TRIANGLE_STRIP, eye * obj_->ring_vertices, obj_->ring_vertices);
+  }
+
+  glBindVertexArray(0);
+  glUseProgram(0);
+
+  glEnable(GL_CULL_FACE);
+  glDepthFunc(GL_LESS);
+  glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+
+  if (obj_->active)
+    obj_->CountSamples();
+}
+
+void HiddenAreaMask::End() {
+  CXSHARED
+  if (!obj_->active)
+    return;
+
+  // A masked frame that never wrote the mask has no sample count, so it is not kept
+  if (obj_->counting)
+    glEndQuery(GL_SAMPLES_PASSED);
+  glEndQuery(GL_TIME_ELAPSED);
+  obj_->queries[obj_->current].pending = obj_->counting;
+  obj_->current = (obj_->current + 1) % kQueries;
+  obj_->active = obj_->counting = false;
+}
+
+void HiddenAreaMask::Clear() {
+  CXSHARED
+  for (size_t i = 0; i < 2; ++i) {
+    obj_->totals[i].time = obj_->totals[i].samples = 0;
+    obj_->totals[i].frames = 0;
+  }
+}
+
+
+// Walk the edge of the left half screen, push each point through the warp and the result is
+// the outline of what the lens shows. Everything from there out to well past the buffer edge
+// is masked. The right eye is the mirror image
+
+HiddenAreaMask::SharedObject::SharedObject(const glm::vec4 &distortion, const glm::vec4 &chromatic, float_t xcenter_offset,
+  float_t distortion_scale, float_t margin, size_t probe_interval, GLuint program) : program(program), coverage(0),
+  probe_interval(probe_interval),
+  frame(0), current(0), active(false), counting(false) {
+
+  std::vector<glm::vec2> outline;
+  glm::vec2 corners[5] = { glm::vec2(0.0f, 0.0f), glm::vec2(0.5f, 0.0f), glm::vec2(0.5f, 1.0f),
+    glm::vec2(0.0f, 1.0f), glm::vec2(0.0f, 0.0f) };
+
+  glm::vec2 centre(xcenter_offset, 0.0f);
+
+  for (size_t edge = 0; edge < 4; ++edge) {
+    for (size_t step = 0; step < kEdgeSteps; ++step) {
+      float_t t = static_cast<float_t>(step) / kEdgeSteps;
+      glm::vec2 tc = corners[edge] + (corners[edge + 1] - corners[edge]) * t;
+      glm::vec2 p = WarpSample(tc, distortion, chromatic, xcenter_offset, distortion_scale);
+      outline.push_back(centre + (p - centre) * (1.0f + margin));
+    }
+  }
+
+  std::vector<glm::vec2> vertices;
+  for (size_t eye = 0; eye < 2; ++eye) {
+    float_t mirror = eye == 0 ? 1.0f : -1.0f;
+    for (size_t i = 0; i <= outline.size(); ++i) {
+      glm::vec2 p = outline[i % outline.size()];
+      glm::vec2 o = centre + (p - centre) * 8.0f;
+      vertices.push_back(glm::vec2(p.x * mirror, p.y));
+      vertices.push_back(glm::vec2(o.x * mirror, o.y));
+    }
+  }
+
+  ring_vertices = static_cast<GLsizei>(vertices.size() / 2);
+
+  // How much of the eye the mask covers, on a grid
+  size_t hidden = 0;
+  const size_t grid = 64;
+  for (size_t y = 0; y < grid; ++y) {
+    for (size_t x = 0; x < grid; ++x) {
+      glm::vec2 p((x + 0.5f) / grid * 2.0f - 1.0f, (y + 0.5f) / grid * 2.0f - 1.0f);
+      if (!InsidePolygon(outline, p))
+        hidden++;
+    }
+  }
+  coverage = static_cast<float_t>(hidden) / (grid * grid);
+
+  glGenVertexArrays(1, &vao);
+  glBindVertexArray(vao);
+  glGenBuffers(1, &vbo);
+  glBindBuffer(GL_ARRAY_BUFFER, vbo);
+  glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(glm::vec2), &vertices[0], GL_STATIC_DRAW);
+  glEnableVertexAttribArray(0);
+  glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, sizeof(glm::vec2), nullptr);
+  glBindVertexArray(0);
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+  for (size_t i = 0; i < kQueries; ++i) {
+    glGenQueries(1, &queries[i].time);
+    glGenQueries(1, &queries[i].samples);
+    queries[i].masked = queries[i].pending = false;
+  }
+
+  for (size_t i = 0; i < 2; ++i) {
+    totals[i].time = totals[i].samples = 0;
+    totals[i].frames = 0;
+  }
+
+  cout << "PhantomLimb: hidden area mask covers " << coverage * 100.0f << "% of each eye" << endl;
+}
+
+void HiddenAreaMask::SharedObject::CountSamples() {
+  if (counting)
+    return;
+  glBeginQuery(GL_SAMPLES_PASSED, queries[current].samples);
+  counting = true;
+}
+
+HiddenAreaMask::SharedObject::~SharedObject() {
+  for (size_t i = 0; i < kQueries; ++i) {
+    glDeleteQueries(1, &queries[i].time);
+    glDeleteQueries(1, &queries[i].samples);
+  }
+  glDeleteBuffers(1, &vbo);
+  glDeleteVertexArrays(1, &vao);
+}
+
+void HiddenAreaMask::SharedObject::Collect() {
+  for (size_t i = 0; i < kQueries; ++i) {
+    Query &query = queries[i];
+    if (!query.pending)
+      continue;
+
+    GLint available = 0;
+    glGetQueryObjectiv(query.samples, GL_QUERY_RESULT_AVAILABLE, &available);
+    if (!available)
+      continue;
+    glGetQueryObjectiv(query.time, GL_QUERY_RESULT_AVAILABLE, &available);
+    if (!available)
+      continue;
+
+    GLuint64 time = 0, samples = 0;
+    glGetQueryObjectui64v(query.time, GL_QUERY_RESULT, &time);
+    glGetQueryObjectui64v(query.samples, GL_QUERY_RESULT, &samples);
+    query.pending = false;
+
+    Totals &t = totals[query.masked ? 1 : 0];
+    t.time += time / 1.0e9;
+    t.samples += samples;
+    t.frames++;
+  }
+}
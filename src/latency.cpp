@@ -0,0 +1,83 @@
+/**
+* @brief Motion to photon latency measurement
+* @file latency.cpp
+* @author Benjamin Blundell <oni@section9.co.uk>
+* @date 19/10/2026
+*
+*/
+
+#include "latency.hpp"
+
+
+using namespace std;
+using namespace s9;
+
+
+LatencyProbe::LatencyProbe(bool create) {
+  if (create)
+    obj_ = std::shared_ptr<SharedObject>(new SharedObject());
+}
+
+// glGetInteger64v(GL_TIMESTAMP) reads the GPU clock as the CPU sees it now, without waiting
+// on queued work. The query after the warp reads the same clock once the warp has run
+
+void LatencyProbe::RenderSampled() {
+  CXSHARED
+  obj_->Collect();
+  glGetInteger64v(GL_TIMESTAMP, &obj_->render_time);
+}
+
+void LatencyProbe::WarpSampled() {
+  CXSHARED
+  glGetInteger64v(GL_TIMESTAMP, &obj_->warp_time);
+}
+
+void LatencyProbe::End() {
+  CXSHARED
+  Slot &slot = obj_->slots[obj_->current];
+
+  // Still waiting on this slot from kSlots frames ago. Skip this frame rather than stall
+  if (slot.pending)
+    return;
+
+  glQueryCounter(slot.query, GL_TIMESTAMP);
+  slot.render_time = obj_->render_time;
+  slot.warp_time = obj_->warp_time;
+  slot.pending = true;
+  obj_->current = (obj_->current + 1) % kSlots;
+}
+
+
+LatencyProbe::SharedObject::SharedObject() : current(0), render_time(0), warp_time(0), render_total(0), warp_total(0), frames(0) {
+  for (size_t i = 0; i < kSlots; ++i) {
+    glGenQueries(1, &slots[i].query);
+    slots[i].render_time = slots[i].warp_time = 0;
+    slots[i].pending = false;
+  }
+}
+
+LatencyProbe::SharedObject::~SharedObject() {
+  for (size_t i = 0; i < kSlots; ++i)
+    glDeleteQueries(1, &slots[i].query);
+}
+
+void LatencyProbe::SharedObject::Collect() {
+  for (size_t i = 0; i < kSlots; ++i) {
+    Slot &slot = slots[i];
+    if (!slot.pending)
+      continue;
+
+    GLint available = 0;
+    glGetQueryObjectiv(slot.query, GL_QUERY_RESULT_AVAILABLE, &available);
+    if (!available)
+      continue;
+
+    GLuint64 done = 0;
+    glGetQueryObjectui64v(slot.query, GL_QUERY_RESULT, &done);
+    slot.pending = false;
+
+    render_total += static_cast<double_t>(static_cast<GLint64>(done) - slot.render_time) / 1.0e9;
+    warp_total += static_cast<double_t>(static_cast<GLint64>(done) - slot.warp_time) / 1.0e9;
+    frames++;
+  }
+}
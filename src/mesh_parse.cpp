@@ -0,0 +1,909 @@
+/**
+* @brief Parallel OBJ and MD5 mesh parsing
+* @file mesh_parse.cpp
+* @author Benjamin Blundell <oni@section9.co.uk>
+* @date 19/10/2026
+*
+*/
+
+#include "mesh_parse.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <unordered_map>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+
+using namespace std;
+using namespace s9;
+
+
+static const uint32_t kNone = 0xffffffff;
+
+static const double_t kPowers[] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+  1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22 };
+
+
+MappedFile::MappedFile(const std::string &path)
+  : obj_ (std::shared_ptr<SharedObject>(new SharedObject(path))) {
+
+}
+
+MappedFile::SharedObject::SharedObject(const std::string &path) : data(nullptr), size(0) {
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0)
+    return;
+
+  struct stat info;
+  if (fstat(fd, &info) == 0 && info.st_size > 0) {
+    void *memory = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (memory != MAP_FAILED) {
+      madvise(memory, info.st_size, MADV_SEQUENTIAL);
+      data = static_cast<const char*>(memory);
+      size = info.st_size;
+    }
+  }
+  close(fd);
+}
+
+MappedFile::SharedObject::~SharedObject() {
+  if (data != nullptr)
+    munmap(const_cast<char*>(data), size);
+}
+
+
+static inline const char* SkipBlank(const char *p, const char *end) {
+  while (p < end && (*p == ' ' || *p == '\t' || *p == '\r'))
+    ++p;
+  return p;
+}
+
+static inline bool IsDigit(char c) {
+  return c >= '0' && c <= '9';
+}
+
+static inline bool StartsWith(const char *p, const char *end, const char *word) {
+  size_t length = strlen(word);
+  return static_cast<size_t>(end - p) >= length && memcmp(p, word, length) == 0 &&
+    (p + length == end || p[length] == ' ' || p[length] == '\t' || p[length] == '\r');
+}
+
+/// Up to 18 significant digits are kept, which is far more than a float needs
+
+const char* s9::ParseFloat(const char *start, const char *end, float_t &value) {
+  const char *p = SkipBlank(start, end);
+  bool negative = false;
+  if (p < end && (*p == '-' || *p == '+'))
+    negative = *p++ == '-';
+
+  uint64_t mantissa = 0;
+  int32_t exponent = 0;
+  bool digits = false;
+
+  for (; p < end && IsDigit(*p); ++p) {
+    if (mantissa < 100000000000000000ull)
+      mantissa = mantissa * 10 + (*p - '0');
+    else
+      exponent++;
+    digits = true;
+  }
+  if (p < end && *p == '.') {
+    for (++p; p < end && IsDigit(*p); ++p) {
+      if (mantissa < 100000000000000000ull) {
+        mantissa = mantissa * 10 + (*p - '0');
+        exponent--;
+      }
+      digits = true;
+    }
+  }
+  if (!digits)
+    return start;
+
+  if (p < end && (*p == 'e' || *p == 'E')) {
+    const char *q = p + 1;
+    bool negative_exponent = false;
+    if (q < end && (*q == '-' || *q == '+'))
+      negative_exponent = *q++ == '-';
+    if (q < end && IsDigit(*q)) {
+      int32_t e = 0;
+      for (; q < end && IsDigit(*q); ++q)
+        e = std::min(e * 10 + (*q - '0'), 1000);
+      exponent += negative_exponent ? -e : e;
+      p = q;
+    }
+  }
+
+  double_t result = static_cast<double_t>(mantissa);
+  if (exponent < 0)
+    result = exponent >= -22 ? result / kPowers[-exponent] : result * std::pow(10.0, exponent);
+  else if (exponent > 0)
+    result = exponent <= 22 ? result * kPowers[exponent] : result * std::pow(10.0, exponent);
+
+  value = static_cast<float_t>(negative ? -result : result);
+  return p;
+}
+
+const char* s9::ParseInt(const char *start, const char *end, int32_t &value) {
+  const char *p = SkipBlank(start, end);
+  bool negative = false;
+  if (p < end && (*p == '-' || *p == '+'))
+    negative = *p++ == '-';
+  if (p == end || !IsDigit(*p))
+    return start;
+
+  int64_t result = 0;
+  for (; p < end && IsDigit(*p); ++p)
+    result = std::min<int64_t>(result * 10 + (*p - '0'), 0x7fffffff);
+  value = static_cast<int32_t>(negative ? -result : result);
+  return p;
+}
+
+/// Skip to just past the next occurrence of c on the line
+static inline const char* SkipPast(const char *p, const char *end, char c) {
+  while (p < end && *p != c)
+    ++p;
+  return p < end ? p + 1 : p;
+}
+
+/// A quoted or bare word
+static const char* ParseName(const char *p, const char *end, std::string &name) {
+  p = SkipBlank(p, end);
+  if (p < end && *p == '"') {
+    const char *close = static_cast<const char*>(memchr(p + 1, '"', end - p - 1));
+    if (close == nullptr)
+      close = end;
+    name.assign(p + 1, close);
+    return close < end ? close + 1 : close;
+  }
+  const char *q = p;
+  while (q < end && *q != ' ' && *q != '\t' && *q != '\r')
+    ++q;
+  name.assign(p, q);
+  return q;
+}
+
+/// Cut the file into runs of whole lines of about the chunk size
+
+static std::vector< std::pair<const char*, const char*> > Split(const char *data, size_t size, size_t chunk_size) {
+  std::vector< std::pair<const char*, const char*> > chunks;
+  const char *end = data + size;
+  const char *begin = data;
+  while (begin < end) {
+    const char *stop = begin + std::min(chunk_size, static_cast<size_t>(end - begin));
+    if (stop < end) {
+      const char *newline = static_cast<const char*>(memchr(stop, '\n', end - stop));
+      stop = newline != nullptr ? newline + 1 : end;
+    }
+    chunks.push_back(std::make_pair(begin, stop));
+    begin = stop;
+  }
+  return chunks;
+}
+
+template<typename Fn>
+static void ForEachLine(const char *p, const char *end, Fn fn) {
+  while (p < end) {
+    const char *stop = static_cast<const char*>(memchr(p, '\n', end - p));
+    if (stop == nullptr)
+      stop = end;
+    const char *line = SkipBlank(p, stop);
+    if (line < stop && *line != '#')
+      fn(line, stop);
+    p = stop + 1;
+  }
+}
+
+
+// OBJ
+
+namespace {
+
+  struct Corner {
+    uint32_t v, t, n;
+    bool operator == (const Corner &c) const { return v == c.v && t == c.t && n == c.n; }
+  };
+
+  struct CornerHash {
+    size_t operator () (const Corner &c) const {
+      return (static_cast<size_t>(c.v) * 73856093u) ^ (static_cast<size_t>(c.t) * 19349663u) ^ (static_cast<size_t>(c.n) * 83492791u);
+    }
+  };
+
+  // An index as written, made zero based. A relative one counts from the start of its chunk and
+  // may reach back past it, so it stays signed until the merge knows what came before
+  struct ObjRef {
+    int64_t index;
+    bool    relative;
+  };
+
+  struct ObjChunk {
+    const char*               begin;
+    const char*               end;
+
+    std::vector<float_t>      positions, texcoords, normals;
+    std::vector<ObjRef>       corners;      // v, vt, vn
+    std::vector<uint32_t>     face_sizes;
+    std::vector< std::pair<std::string, size_t> > materials;   // Name and the face it starts on
+
+    size_t                    position_base, texcoord_base, normal_base;
+
+    std::vector<float_t>      vertices;
+    std::vector<uint32_t>     indices;
+    std::vector<size_t>       material_starts;
+  };
+
+  // Indices are one based, or negative to count back from the newest. Those are relative to
+  // what this chunk has seen, until the merge knows what came before it
+  inline ObjRef ObjIndex(int32_t i, size_t count) {
+    ObjRef ref = { -1, false };
+    if (i > 0)
+      ref.index = static_cast<int64_t>(i) - 1;
+    else if (i < 0)
+      ref = { static_cast<int64_t>(count) + i, true };
+    return ref;
+  }
+
+  void ParseObjLine(ObjChunk &chunk, const char *p, const char *end) {
+    float_t x = 0, y = 0, z = 0;
+
+    if (p[0] == 'v' && p + 1 < end && (p[1] == ' ' || p[1] == '\t')) {
+      p = ParseFloat(p + 2, end, x); p = ParseFloat(p, end, y); ParseFloat(p, end, z);
+      chunk.positions.push_back(x); chunk.positions.push_back(y); chunk.positions.push_back(z);
+
+    } else if (p[0] == 'v' && p + 2 < end && p[1] == 't') {
+      p = ParseFloat(p + 2, end, x); ParseFloat(p, end, y);
+      chunk.texcoords.push_back(x); chunk.texcoords.push_back(y);
+
+    } else if (p[0] == 'v' && p + 2 < end && p[1] == 'n') {
+      p = ParseFloat(p + 2, end, x); p = ParseFloat(p, end, y); ParseFloat(p, end, z);
+      chunk.normals.push_back(x); chunk.normals.push_back(y); chunk.normals.push_back(z);
+
+    } else if (p[0] == 'f' && p + 1 < end && (p[1] == ' ' || p[1] == '\t')) {
+      p += 2;
+      uint32_t count = 0;
+      for (;;) {
+        int32_t v = 0, t = 0, n = 0;
+        const char *q = ParseInt(p, end, v);
+        if (q == p)
+          break;
+        p = q;
+        if (p < end && *p == '/') {
+          ++p;
+          if (p < end && *p != '/')
+            p = ParseInt(p, end, t);
+          if (p < end && *p == '/')
+            p = ParseInt(p + 1, end, n);
+        }
+        chunk.corners.push_back(ObjIndex(v, chunk.positions.size() / 3));
+        chunk.corners.push_back(ObjIndex(t, chunk.texcoords.size() / 2));
+        chunk.corners.push_back(ObjIndex(n, chunk.normals.size() / 3));
+        count++;
+      }
+      if (count > 0)
+        chunk.face_sizes.push_back(count);
+
+    } else if (StartsWith(p, end, "usemtl")) {
+      std::string name;
+      ParseName(p + 6, end, name);
+      chunk.materials.push_back(std::make_pair(name, chunk.face_sizes.size()));
+    }
+  }
+
+  /// Anything that still lands outside the file is treated as missing
+  inline uint32_t Resolve(const ObjRef &ref, size_t base) {
+    int64_t i = ref.relative ? static_cast<int64_t>(base) + ref.index : ref.index;
+    return i < 0 || i >= static_cast<int64_t>(kNone) ? kNone : static_cast<uint32_t>(i);
+  }
+
+  /// Turn the chunk's faces into its own vertices and triangles, against the merged pools
+  void BuildObjChunk(ObjChunk &chunk, const ObjData &pools, const std::vector<float_t> &positions,
+    const std::vector<float_t> &texcoords, const std::vector<float_t> &normals) {
+
+    std::unordered_map<Corner, uint32_t, CornerHash> seen;
+    seen.reserve(chunk.corners.size() / 3);
+
+    std::vector<uint32_t> face;
+    size_t next_corner = 0, material = 0;
+
+    for (size_t f = 0; f < chunk.face_sizes.size(); ++f) {
+      while (material < chunk.materials.size() && chunk.materials[material].second == f) {
+        chunk.material_starts.push_back(chunk.indices.size());
+        material++;
+      }
+
+      face.clear();
+      for (uint32_t k = 0; k < chunk.face_sizes[f]; ++k, next_corner += 3) {
+        Corner c = { Resolve(chunk.corners[next_corner], chunk.position_base),
+          Resolve(chunk.corners[next_corner + 1], chunk.texcoord_base),
+          Resolve(chunk.corners[next_corner + 2], chunk.normal_base) };
+
+        auto found = seen.find(c);
+        if (found != seen.end()) {
+          face.push_back(found->second);
+          continue;
+        }
+
+        uint32_t index = static_cast<uint32_t>(chunk.vertices.size() / 8);
+        seen[c] = index;
+        face.push_back(index);
+
+        float_t vertex[8] = { 0, 0, 0, 0, 0, 0, 0, 0 };
+        if (c.v < pools.positions)
+          std::copy(&positions[c.v * 3], &positions[c.v * 3] + 3, vertex);
+        if (c.t < pools.texcoords)
+          std::copy(&texcoords[c.t * 2], &texcoords[c.t * 2] + 2, vertex + 3);
+        if (c.n < pools.normals)
+          std::copy(&normals[c.n * 3], &normals[c.n * 3] + 3, vertex + 5);
+        chunk.vertices.insert(chunk.vertices.end(), vertex, vertex + 8);
+      }
+
+      for (size_t k = 1; k + 1 < face.size(); ++k) {
+        chunk.indices.push_back(face[0]);
+        chunk.indices.push_back(face[k]);
+        chunk.indices.push_back(face[k + 1]);
+      }
+    }
+
+    while (material < chunk.materials.size()) {
+      chunk.material_starts.push_back(chunk.indices.size());
+      material++;
+    }
+  }
+
+  void AddMaterial(ObjData &data, const std::string &name, size_t start) {
+    if (!data.materials.empty() && data.materials.back() == name)
+      return;
+    if (!data.material_starts.empty() && data.material_starts.back() == start) {
+      data.materials.back() = name;
+      return;
+    }
+    data.materials.push_back(name);
+    data.material_starts.push_back(start);
+  }
+
+}
+
+
+MeshParser::MeshParser(TaskSystem &tasks, size_t chunk_size)
+  : obj_ (std::shared_ptr<SharedObject>(new SharedObject())) {
+  obj_->tasks = tasks;
+  obj_->chunk_size = std::max<size_t>(chunk_size, 4096);
+}
+
+/// Parse every chunk, gather the attribute pools with what each chunk's relative indices
+/// start from, then build each chunk's vertices and stitch them together
+
+bool MeshParser::ParseObj(const std::string &path, ObjData &data) {
+  CXSHARED
+
+  MappedFile file(path);
+  if (file.size() == 0)
+    return false;
+
+  std::vector< std::pair<const char*, const char*> > ranges = Split(file.data(), file.size(), obj_->chunk_size);
+  std::vector<ObjChunk> chunks(ranges.size());
+  std::vector<float_t> positions, texcoords, normals;
+
+  data = ObjData();
+
+  TaskGraph graph(true);
+  size_t gather = graph.Add("gather", [&]() {
+    size_t p = 0, t = 0, n = 0;
+    for (ObjChunk &chunk : chunks) {
+      chunk.position_base = p; chunk.texcoord_base = t; chunk.normal_base = n;
+      p += chunk.positions.size() / 3; t += chunk.texcoords.size() / 2; n += chunk.normals.size() / 3;
+    }
+    positions.reserve(p * 3); texcoords.reserve(t * 2); normals.reserve(n * 3);
+    for (ObjChunk &chunk : chunks) {
+      positions.insert(positions.end(), chunk.positions.begin(), chunk.positions.end());
+      texcoords.insert(texcoords.end(), chunk.texcoords.begin(), chunk.texcoords.end());
+      normals.insert(normals.end(), chunk.normals.begin(), chunk.normals.end());
+    }
+    data.positions = p; data.texcoords = t; data.normals = n;
+  });
+
+  size_t merge = graph.Add("merge", [&]() {
+    size_t vertices = 0, indices = 0;
+    for (ObjChunk &chunk : chunks) {
+      vertices += chunk.vertices.size();
+      indices += chunk.indices.size();
+    }
+    data.vertices.reserve(vertices);
+    data.indices.reserve(indices);
+
+    for (ObjChunk &chunk : chunks) {
+      uint32_t offset = static_cast<uint32_t>(data.vertices.size() / 8);
+      for (size_t m = 0; m < chunk.materials.size(); ++m)
+        AddMaterial(data, chunk.materials[m].first, data.indices.size() + chunk.material_starts[m]);
+      data.vertices.insert(data.vertices.end(), chunk.vertices.begin(), chunk.vertices.end());
+      for (uint32_t i : chunk.indices)
+        data.indices.push_back(i + offset);
+    }
+  });
+
+  for (size_t i = 0; i < chunks.size(); ++i) {
+    chunks[i].begin = ranges[i].first;
+    chunks[i].end = ranges[i].second;
+
+    size_t parse = graph.Add("parse", [&chunks, i]() {
+      ObjChunk &chunk = chunks[i];
+      ForEachLine(chunk.begin, chunk.end, [&chunk](const char *p, const char *end) { ParseObjLine(chunk, p, end); });
+    });
+    size_t build = graph.Add("build", [&, i]() { BuildObjChunk(chunks[i], data, positions, texcoords, normals); });
+
+    graph.Depend(gather, parse);
+    graph.Depend(build, gather);
+    graph.Depend(merge, build);
+  }
+
+  obj_->tasks.Run(graph);
+  obj_->tasks.Wait(graph);
+  return !data.indices.empty();
+}
+
+
+// MD5 mesh
+
+namespace {
+
+  typedef enum {
+    MD5_SHADER,
+    MD5_NUM_VERTS,
+    MD5_NUM_TRIS,
+    MD5_NUM_WEIGHTS,
+    MD5_VERT,
+    MD5_TRI,
+    MD5_WEIGHT
+  }MD5Item;
+
+  // One line's worth. Meshes are counted from the one open when the chunk began
+  struct MD5Entry {
+    MD5Item   type;
+    uint32_t  mesh;
+    int32_t   index;
+    int32_t   ints[3];
+    float_t   floats[5];
+  };
+
+  struct MD5Chunk {
+    const char*                       begin;
+    const char*                       end;
+    std::vector<MD5MeshData::Joint>   joints;
+    std::vector<MD5Entry>             entries;
+    std::vector< std::pair<uint32_t, std::string> > shaders;
+    uint32_t                          meshes;
+    size_t                            mesh_base;
+  };
+
+  void ParseMD5Line(MD5Chunk &chunk, const char *p, const char *end) {
+    MD5Entry e;
+    e.mesh = chunk.meshes;
+
+    if (*p == '"') {
+      MD5MeshData::Joint joint;
+      p = ParseName(p, end, joint.name);
+      p = ParseInt(p, end, joint.parent);
+      p = SkipPast(p, end, '(');
+      for (size_t i = 0; i < 3; ++i)
+        p = ParseFloat(p, end, joint.position[i]);
+      p = SkipPast(p, end, '(');
+      for (size_t i = 0; i < 3; ++i)
+        p = ParseFloat(p, end, joint.orientation[i]);
+      chunk.joints.push_back(joint);
+
+    } else if (StartsWith(p, end, "mesh") || (end - p > 4 && memcmp(p, "mesh{", 5) == 0)) {
+      chunk.meshes++;
+
+    } else if (StartsWith(p, end, "shader")) {
+      std::string name;
+      ParseName(p + 6, end, name);
+      chunk.shaders.push_back(std::make_pair(chunk.meshes, name));
+
+    } else if (StartsWith(p, end, "vert")) {
+      e.type = MD5_VERT;
+      p = ParseInt(p + 4, end, e.index);
+      p = SkipPast(p, end, '(');
+      p = ParseFloat(p, end, e.floats[0]);
+      p = ParseFloat(p, end, e.floats[1]);
+      p = SkipPast(p, end, ')');
+      p = ParseInt(p, end, e.ints[0]);
+      ParseInt(p, end, e.ints[1]);
+      chunk.entries.push_back(e);
+
+    } else if (StartsWith(p, end, "tri")) {
+      e.type = MD5_TRI;
+      p = ParseInt(p + 3, end, e.index);
+      for (size_t i = 0; i < 3; ++i)
+        p = ParseInt(p, end, e.ints[i]);
+      chunk.entries.push_back(e);
+
+    } else if (StartsWith(p, end, "weight")) {
+      e.type = MD5_WEIGHT;
+      p = ParseInt(p + 6, end, e.index);
+      p = ParseInt(p, end, e.ints[0]);
+      p = ParseFloat(p, end, e.floats[0]);
+      p = SkipPast(p, end, '(');
+      for (size_t i = 1; i < 4; ++i)
+        p = ParseFloat(p, end, e.floats[i]);
+      chunk.entries.push_back(e);
+
+    } else if (StartsWith(p, end, "numverts") || StartsWith(p, end, "numtris") || StartsWith(p, end, "numweights")) {
+      e.type = p[3] == 'v' ? MD5_NUM_VERTS : p[3] == 't' ? MD5_NUM_TRIS : MD5_NUM_WEIGHTS;
+      const char *q = p;
+      while (q < end && *q != ' ' && *q != '\t')
+        ++q;
+      ParseInt(q, end, e.index);
+      chunk.entries.push_back(e);
+    }
+  }
+
+  /// Entries carry their own index, so each chunk can write straight into the sized arrays
+  void PlaceMD5Chunk(const MD5Chunk &chunk, MD5MeshData &data) {
+    for (const MD5Entry &e : chunk.entries) {
+      size_t m = chunk.mesh_base + e.mesh;
+      if (e.mesh + chunk.mesh_base == 0 || m > data.meshes.size())
+        continue;
+      MD5MeshData::Mesh &mesh = data.meshes[m - 1];
+      size_t i = static_cast<size_t>(e.index);
+
+      switch (e.type) {
+        case MD5_VERT:
+          if (i < mesh.weight_start.size()) {
+            mesh.texcoords[i * 2] = e.floats[0];
+            mesh.texcoords[i * 2 + 1] = e.floats[1];
+            mesh.weight_start[i] = e.ints[0];
+            mesh.weight_count[i] = e.ints[1];
+          }
+        break;
+
+        case MD5_TRI:
+          if (i * 3 < mesh.indices.size()) {
+            for (size_t k = 0; k < 3; ++k)
+              mesh.indices[i * 3 + k] = e.ints[k];
+          }
+        break;
+
+        case MD5_WEIGHT:
+          if (i * 5 < mesh.weights.size()) {
+            mesh.weights[i * 5] = static_cast<float_t>(e.ints[0]);
+            for (size_t k = 0; k < 4; ++k)
+              mesh.weights[i * 5 + 1 + k] = e.floats[k];
+          }
+        break;
+
+        default:
+        break;
+      }
+    }
+  }
+
+}
+
+bool MeshParser::ParseMD5Mesh(const std::string &path, MD5MeshData &data) {
+  CXSHARED
+
+  MappedFile file(path);
+  if (file.size() == 0)
+    return false;
+
+  std::vector< std::pair<const char*, const char*> > ranges = Split(file.data(), file.size(), obj_->chunk_size);
+  std::vector<MD5Chunk> chunks(ranges.size());
+
+  data = MD5MeshData();
+
+  // Count the meshes, size them from their num lines, and take the joints in order
+  TaskGraph graph(true);
+  size_t size = graph.Add("size", [&]() {
+    size_t meshes = 0;
+    for (MD5Chunk &chunk : chunks) {
+      chunk.mesh_base = meshes;
+      meshes += chunk.meshes;
+      data.joints.insert(data.joints.end(), chunk.joints.begin(), chunk.joints.end());
+    }
+    data.meshes.resize(meshes);
+
+    for (MD5Chunk &chunk : chunks) {
+      for (auto &shader : chunk.shaders) {
+        if (chunk.mesh_base + shader.first > 0)
+          data.meshes[chunk.mesh_base + shader.first - 1].shader = shader.second;
+      }
+      for (const MD5Entry &e : chunk.entries) {
+        if (e.type > MD5_NUM_WEIGHTS || chunk.mesh_base + e.mesh == 0)
+          continue;
+        MD5MeshData::Mesh &mesh = data.meshes[chunk.mesh_base + e.mesh - 1];
+        size_t count = static_cast<size_t>(std::max(0, e.index));
+        if (e.type == MD5_NUM_VERTS) {
+          mesh.texcoords.assign(count * 2, 0);
+          mesh.weight_start.assign(count, 0);
+          mesh.weight_count.assign(count, 0);
+        } else if (e.type == MD5_NUM_TRIS) {
+          mesh.indices.assign(count * 3, 0);
+        } else {
+          mesh.weights.assign(count * 5, 0);
+        }
+      }
+    }
+  });
+
+  for (size_t i = 0; i < chunks.size(); ++i) {
+    chunks[i].begin = ranges[i].first;
+    chunks[i].end = ranges[i].second;
+    chunks[i].meshes = 0;
+
+    size_t parse = graph.Add("parse", [&chunks, i]() {
+      MD5Chunk &chunk = chunks[i];
+      ForEachLine(chunk.begin, chunk.end, [&chunk](const char *p, const char *end) { ParseMD5Line(chunk, p, end); });
+    });
+    size_t place = graph.Add("place", [&, i]() { PlaceMD5Chunk(chunks[i], data); });
+
+    graph.Depend(size, parse);
+    graph.Depend(place, size);
+  }
+
+  obj_->tasks.Run(graph);
+  obj_->tasks.Wait(graph);
+  return !data.joints.empty() && !data.meshes.empty();
+}
+
+
+// The reference - a line at a time through streams
+
+bool MeshParser::ParseObjStream(const std::string &path, ObjData &data) {
+  std::ifstream file(path.c_str());
+  if (!file)
+    return false;
+
+  data = ObjData();
+  std::vector<float_t> positions, texcoords, normals;
+  std::unordered_map<Corner, uint32_t, CornerHash> seen;
+  std::vector<uint32_t> face;
+
+  std::string line, word;
+  while (std::getline(file, line)) {
+    std::istringstream in(line);
+    if (!(in >> word) || word[0] == '#')
+      continue;
+
+    float_t x = 0, y = 0, z = 0;
+    if (word == "v") {
+      in >> x >> y >> z;
+      positions.push_back(x); positions.push_back(y); positions.push_back(z);
+    } else if (word == "vt") {
+      in >> x >> y;
+      texcoords.push_back(x); texcoords.push_back(y);
+    } else if (word == "vn") {
+      in >> x >> y >> z;
+      normals.push_back(x); normals.push_back(y); normals.push_back(z);
+    } else if (word == "usemtl") {
+      in >> word;
+      AddMaterial(data, word, data.indices.size());
+    } else if (word == "f") {
+      face.clear();
+      while (in >> word) {
+        int32_t parts[3] = { 0, 0, 0 };
+        std::istringstream corner(word);
+        std::string part;
+        for (size_t k = 0; k < 3 && std::getline(corner, part, '/'); ++k) {
+          if (!part.empty())
+            parts[k] = atoi(part.c_str());
+        }
+
+        Corner c = { Resolve(ObjIndex(parts[0], positions.size() / 3), 0),
+          Resolve(ObjIndex(parts[1], texcoords.size() / 2), 0), Resolve(ObjIndex(parts[2], normals.size() / 3), 0) };
+
+        auto found = seen.find(c);
+        if (found != seen.end()) {
+          face.push_back(found->second);
+          continue;
+        }
+        uint32_t index = static_cast<uint32_t>(data.vertices.size() / 8);
+        seen[c] = index;
+        face.push_back(index);
+
+        float_t vertex[8] = { 0, 0, 0, 0, 0, 0, 0, 0 };
+        if (c.v < positions.size() / 3)
+          std::copy(&positions[c.v * 3], &positions[c.v * 3] + 3, vertex);
+        if (c.t < texcoords.size() / 2)
+          std::copy(&texcoords[c.t * 2], &texcoords[c.t * 2] + 2, vertex + 3);
+        if (c.n < normals.size() / 3)
+          std::copy(&normals[c.n * 3], &normals[c.n * 3] + 3, vertex + 5);
+        data.vertices.insert(data.vertices.end(), vertex, vertex + 8);
+      }
+      for (size_t k = 1; k + 1 < face.size(); ++k) {
+        data.indices.push_back(face[0]);
+        data.indices.push_back(face[k]);
+        data.indices.push_back(face[k + 1]);
+      }
+    }
+  }
+
+  data.positions = positions.size() / 3;
+  data.texcoords = texcoords.size() / 2;
+  data.normals = normals.size() / 3;
+  return !data.indices.empty();
+}
+
+bool MeshParser::ParseMD5MeshStream(const std::string &path, MD5MeshData &data) {
+  std::ifstream file(path.c_str());
+  if (!file)
+    return false;
+
+  data = MD5MeshData();
+  MD5MeshData::Mesh *mesh = nullptr;
+  std::string line, word;
+  char skip;
+
+  while (std::getline(file, line)) {
+    std::istringstream in(line);
+    if (!(in >> word))
+      continue;
+
+    if (word[0] == '"' && mesh == nullptr) {
+      MD5MeshData::Joint joint;
+      size_t close = line.find('"', line.find('"') + 1);
+      joint.name = line.substr(line.find('"') + 1, close - line.find('"') - 1);
+      std::istringstream rest(line.substr(close + 1));
+      rest >> joint.parent >> skip >> joint.position[0] >> joint.position[1] >> joint.position[2] >> skip
+        >> skip >> joint.orientation[0] >> joint.orientation[1] >> joint.orientation[2];
+      data.joints.push_back(joint);
+    } else if (word == "mesh") {
+      data.meshes.push_back(MD5MeshData::Mesh());
+      mesh = &data.meshes.back();
+    } else if (mesh == nullptr) {
+      continue;
+    } else if (word == "shader") {
+      in >> mesh->shader;
+      mesh->shader.erase(std::remove(mesh->shader.begin(), mesh->shader.end(), '"'), mesh->shader.end());
+    } else if (word == "numverts") {
+      size_t count; in >> count;
+      mesh->texcoords.assign(count * 2, 0);
+      mesh->weight_start.assign(count, 0);
+      mesh->weight_count.assign(count, 0);
+    } else if (word == "numtris") {
+      size_t count; in >> count;
+      mesh->indices.assign(count * 3, 0);
+    } else if (word == "numweights") {
+      size_t count; in >> count;
+      mesh->weights.assign(count * 5, 0);
+    } else if (word == "vert") {
+      size_t i; in >> i;
+      if (i < mesh->weight_start.size())
+        in >> skip >> mesh->texcoords[i * 2] >> mesh->texcoords[i * 2 + 1] >> skip >> mesh->weight_start[i] >> mesh->weight_count[i];
+    } else if (word == "tri") {
+      size_t i; in >> i;
+      if (i * 3 < mesh->indices.size())
+        in >> mesh->indices[i * 3] >> mesh->indices[i * 3 + 1] >> mesh->indices[i * 3 + 2];
+    } else if (word == "weight") {
+      size_t i; in >> i;
+      if (i * 5 < mesh->weights.size()) {
+        float_t *w = &mesh->weights[i * 5];
+        int32_t joint;
+        in >> joint >> w[1] >> skip >> w[2] >> w[3] >> w[4];
+        w[0] = static_cast<float_t>(joint);
+      }
+    }
+  }
+
+  return !data.joints.empty() && !data.meshes.empty();
+}
+
+
+std::vector<std::string> MeshParser::FindMeshes(const std::string &directory) {
+  std::vector<std::string> found;
+  DIR *dir = opendir(directory.c_str());
+  if (dir == nullptr)
+    return found;
+
+  while (struct dirent *entry = readdir(dir)) {
+    std::string name = entry->d_name;
+    if (name == "." || name == "..")
+      continue;
+    std::string path = directory + "/" + name;
+
+    struct stat info;
+    if (stat(path.c_str(), &info) != 0)
+      continue;
+    if (S_ISDIR(info.st_mode)) {
+      std::vector<std::string> below = FindMeshes(path);
+      found.insert(found.end(), below.begin(), below.end());
+    } else if ((name.size() > 4 && name.compare(name.size() - 4, 4, ".obj") == 0) ||
+      (name.size() > 8 && name.compare(name.size() - 8, 8, ".md5mesh") == 0)) {
+      found.push_back(path);
+    }
+  }
+  closedir(dir);
+
+  std::sort(found.begin(), found.end());
+  return found;
+}
+
+/// Best of a few runs each, so the page cache and the pool are warm for both
+
+void MeshParser::Benchmark(const std::string &directory) {
+  CXSHARED
+
+  const size_t kRuns = 5;
+
+  for (const std::string &path : FindMeshes(directory)) {
+    MappedFile file(path);
+    double_t megabytes = file.size() / (1024.0 * 1024.0);
+    bool obj = path.compare(path.size() - 4, 4, ".obj") == 0;
+
+    double_t stream = 1.0e9, mapped = 1.0e9;
+    size_t stream_count = 0, mapped_count = 0, stream_vertices = 0, mapped_vertices = 0;
+
+    for (size_t run = 0; run < kRuns; ++run) {
+      double_t start = NowSeconds();
+      if (obj) {
+        ObjData data;
+        ParseObjStream(path, data);
+        stream_count = data.indices.size();
+        stream_vertices = data.vertices.size() / 8;
+      } else {
+        MD5MeshData data;
+        ParseMD5MeshStream(path, data);
+        stream_count = 0;
+        for (MD5MeshData::Mesh &mesh : data.meshes)
+          stream_count += mesh.indices.size() + mesh.weights.size();
+        stream_vertices = data.joints.size();
+      }
+      stream = std::min(stream, NowSeconds() - start);
+
+      start = NowSeconds();
+      if (obj) {
+        ObjData data;
+        ParseObj(path, data);
+        mapped_count = data.indices.size();
+        mapped_vertices = data.vertices.size() / 8;
+      } else {
+        MD5MeshData data;
+        ParseMD5Mesh(path, data);
+        mapped_count = 0;
+        for (MD5MeshData::Mesh &mesh : data.meshes)
+          mapped_count += mesh.indices.size() + mesh.weights.size();
+        mapped_vertices = data.joints.size();
+      }
+      mapped = std::min(mapped, NowSeconds() - start);
+    }
+
+    cout << "MeshParser: " << path << " " << megabytes * 1024.0 << "KB"
+      << " stream " << megabytes / stream << " MB/s"
+      << " mapped " << megabytes / mapped << " MB/s"
+      << " (" << obj_->tasks.threads() + 1 << " threads, " << Split(file.data(), file.size(), obj_->chunk_size).size() << " chunks)"
+      << (obj ? " vertices " : " joints ") << stream_vertices << "/" << mapped_vertices
+      << (stream_count == mapped_count ? "" : " MISMATCH") << endl;
+
+    if (obj) {
+      MeshParser small(obj_->tasks, 1024);
+      cout << "MeshParser: " << path << (small.CheckObj(path) ? " matches" : " DIFFERS from")
+        << " the reference in 1KB chunks" << endl;
+    }
+  }
+}
+
+bool MeshParser::CheckObj(const std::string &path) {
+  CXSHARED
+
+  ObjData stream, mapped;
+  if (!ParseObjStream(path, stream) || !ParseObj(path, mapped))
+    return false;
+
+  if (stream.indices.size() != mapped.indices.size() || stream.materials != mapped.materials ||
+    stream.material_starts != mapped.material_starts)
+    return false;
+
+  for (size_t i = 0; i < stream.indices.size(); ++i) {
+    const float_t *a = &stream.vertices[stream.indices[i] * 8];
+    const float_t *b = &mapped.vertices[mapped.indices[i] * 8];
+    if (!std::equal(a, a + 8, b))
+      return false;
+  }
+  return true;
+}
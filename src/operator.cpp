@@ -0,0 +1,31 @@
+/**
+* @brief Operator settings
+* @file operator.cpp
+* @author Benjamin Blundell <oni@section9.co.uk>
+* @date 19/10/2026
+*
+*/
+
+#include "operator.hpp"
+
+
+using namespace std;
+using namespace s9;
+
+
+void GameSettings::Read(XMLSettings &settings) {
+  fire_interval = FromStringS9<float_t>(*settings["game/time"]);
+  width = FromStringS9<float_t>(*settings["game/width"]);
+  speed_min = FromStringS9<float_t>(*settings["game/speed/min"]);
+  speed_factor = FromStringS9<float_t>(*settings["game/speed/factor"]);
+  height_min = FromStringS9<float_t>(*settings["game/height/min"]);
+  height_factor = FromStringS9<float_t>(*settings["game/height/factor"]);
+  emphasis = FromStringS9<bool>(*settings["game/emphasis"]);
+}
+
+/// Only what the operator console can change goes back
+void GameSettings::Write(XMLSettings &settings) const {
+  settings["game/width"].SetValue(width);
+  settings["game/speed/min"].SetValue(speed_min);
+  settings["game/emphasis"].SetValue(emphasis);
+}
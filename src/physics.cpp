@@ -9,36 +9,86 @@
 #include "physics.hpp"
 
 #include "btBulletDynamicsCommon.h"
+#include "timing.hpp"
+
+#include <fstream>
+
+#include <unistd.h>
 
 
 using namespace std;
 using namespace s9;
 
 
+// Where untracked hands and unused depth proxies wait - inside the ground box, well away from any ball
+static const btVector3 kParkedPosition(0, -25, 0);
+
+// User indices on bodies so contacts can be classified. Balls use their own index
+static const int kHandTag = -2;
+static const int kGroundTag = -3;
+
+// Balls that get past the player without being hit count as a miss
+static const btScalar kMissPlane = 1.0;
+
+// Longest time we will spread a hand movement over, in case the sensor stalls
+static const double_t kMaxHandSweep = 0.1;
+
 /// Phantom Physics main constructor
-PhantomPhysics::PhantomPhysics(float_t gravity, float_t hand_radius) 
-  : obj_ (std::shared_ptr<SharedObject>(new SharedObject(gravity, hand_radius))) {
+PhantomPhysics::PhantomPhysics(float_t gravity, float_t hand_radius, size_t num_users, size_t proxy_count, float_t proxy_radius,
+  const PhysicsProfile &profile, TaskSystem tasks)
+  : obj_ (std::shared_ptr<SharedObject>(new SharedObject(gravity, hand_radius, num_users, proxy_count, proxy_radius,
+    profile, tasks))) {
 
 }
 
+/// Never blocks. Repeated presses while a build is in flight are folded into one
 void PhantomPhysics::Reset() {
   CXSHARED
-  obj_->ExitPhysics();
-  obj_->InitPhysics();
+  if (obj_->spheres) {
+    obj_->spheres_reset.store(true);
+    return;
+  }
+
+  if (obj_->reset_in_flight.exchange(true))
+    return;
+
+  {
+    std::lock_guard<std::mutex> lock(obj_->builder_mutex);
+    obj_->build_requested = true;
+  }
+  obj_->builder_wake.notify_one();
 }
 
 void PhantomPhysics::AddBall(float_t radius, glm::vec3 pos, glm::vec3 velocity){
 
   CXSHARED
 
-  if ( obj_->balls.size() > 20)
+  std::lock_guard<std::mutex> lock(obj_->update_mutex);
+
+  if (obj_->spheres) {
+    if (obj_->spheres.size() > obj_->profile.max_balls)
+      Reset();
+    obj_->spheres.Add(radius, pos, velocity);
+    obj_->sphere_results.push_back(BALL_IN_FLIGHT);
+    obj_->ball_orients.push_back(glm::translate(glm::mat4(1.0f), pos ));
+    obj_->stats_fired++;
+    return;
+  }
+
+  World &world = *obj_->world;
+
+  if ( world.balls.size() > obj_->profile.max_balls)
     Reset();
 
-  //create a few dynamic rigidbodies
-  // Re-using the same collision is better for memory usage and performance
+  ArenaScope scope(world.arena);
 
-  btCollisionShape* colShape = new btSphereShape(btScalar(radius));
-  obj_->collision_shapes.push_back(colShape);
+  // Re-using the same collision shape is better for memory usage and performance
+  if (world.ball_shape == nullptr || world.ball_radius != radius) {
+    world.ball_shape = new btSphereShape(btScalar(radius));
+    world.ball_radius = radius;
+    world.collision_shapes.push_back(std::unique_ptr<btCollisionShape>(world.ball_shape));
+  }
+  btCollisionShape* colShape = world.ball_shape;
 
   /// Create Dynamic Objects
   btTransform startTransform;
@@ -46,29 +96,31 @@ void PhantomPhysics::AddBall(float_t radius, glm::vec3 pos, glm::vec3 velocity){
 
   btScalar  mass(1.f);
 
-  //rigidbody is dynamic if and only if mass is non zero, otherwise static
-  bool isDynamic = (mass != 0.f);
-
-  btVector3 localInertia(velocity.x, velocity.y, velocity.z);
-  if (isDynamic)
-    colShape->calculateLocalInertia(mass,localInertia);
+  btVector3 localInertia(0,0,0);
+  colShape->calculateLocalInertia(mass,localInertia);
 
   startTransform.setOrigin(btVector3( btScalar(pos.x), btScalar(pos.y), btScalar(pos.z)));
 
-    
-  //using motionstate is recommended, it provides interpolation capabilities, and only synchronizes 'active' objects
-  btDefaultMotionState* myMotionState = new btDefaultMotionState(startTransform);
-  btRigidBody::btRigidBodyConstructionInfo rbInfo(mass,myMotionState,colShape,localInertia);
-  btRigidBody* body = new btRigidBody(rbInfo);
+  btRigidBody* body = world.CreateBody(colShape, mass, startTransform, localInertia);
 
   body->setLinearVelocity( btVector3(velocity.x, velocity.y, velocity.z) );
+  body->setSleepingThresholds(obj_->profile.linear_sleep, obj_->profile.angular_sleep);
+  body->setUserIndex(static_cast<int>(world.balls.size()));
 
-  obj_->dynamics_world->addRigidBody(body);
+  // Swept sphere CCD kicks in once a ball moves more than half its radius in a substep
+  if (obj_->profile.ccd) {
+    body->setCcdMotionThreshold(btScalar(radius * 0.5f));
+    body->setCcdSweptSphereRadius(btScalar(radius * 0.9f));
+  }
+
+  world.dynamics_world->addRigidBody(body);
 
   // Keep a tally of the balls in flight and a useful orientation matrix
-  obj_->balls.push_back(body);
+  world.balls.push_back(body);
+  world.ball_results.push_back(BALL_IN_FLIGHT);
   obj_->ball_orients.push_back(glm::translate(glm::mat4(1.0f), pos ));
-  
+  obj_->stats_fired++;
+
 }
 
 
@@ -76,193 +128,656 @@ void PhantomPhysics::AddBall(float_t radius, glm::vec3 pos, glm::vec3 velocity){
 void PhantomPhysics::Update(double dt){
   CXSHARED
 
-  obj_->update_mutex.lock();
-  if (obj_->dynamics_world && obj_->running_) {
-    obj_->dynamics_world->stepSimulation(dt, 10);
-    
-    // Update handy ball matrices
-    for (size_t i = 0; i < obj_->balls.size(); ++i) {
-      btRigidBody* ball_body = obj_->balls[i];
-      btTransform trans;
-      ball_body->getMotionState()->getWorldTransform(trans);
-      trans.getOpenGLMatrix(  glm::value_ptr(obj_->ball_orients[i]) );
+  std::lock_guard<std::mutex> lock(obj_->update_mutex);
+
+  if (obj_->spheres) {
+    if (obj_->spheres_reset.exchange(false)) {
+      obj_->spheres.Clear();
+      obj_->sphere_results.clear();
+      obj_->ball_orients.clear();
+      obj_->stats_resets++;
     }
+
+    double_t start = NowSeconds();
+    obj_->spheres.Step(dt);
+    obj_->ScoreSpheres();
+    obj_->LogTiming(NowSeconds() - start, 0, 0);
+
+    obj_->spheres.Transforms(obj_->ball_orients);
+    return;
+  }
+
+  // A step boundary - the only place a world is ever replaced
+  obj_->SwapPendingWorld();
+
+  World &world = *obj_->world;
+
+  // Anything Bullet allocates while stepping lands in the world arena, or on the heap
+  // if it came from a worker thread. Both are counted
+  size_t arena_allocs = world.arena.allocations();
+  size_t arena_bytes = world.arena.used();
+  BulletAllocStats heap = GetBulletAllocStats();
+
+  double_t start = NowSeconds();
+  {
+    ArenaScope scope(world.arena);
+    world.dynamics_world->stepSimulation(dt, obj_->profile.max_substeps, obj_->profile.fixed_timestep);
+    world.ScoreBalls(*obj_);
+  }
+  double_t step_time = NowSeconds() - start;
+
+  BulletAllocStats heap_after = GetBulletAllocStats();
+  obj_->LogTiming(step_time,
+    (world.arena.allocations() - arena_allocs) + (heap_after.heap_allocations - heap.heap_allocations),
+    (world.arena.used() - arena_bytes) + (heap_after.heap_bytes - heap.heap_bytes));
+
+  // Update handy ball matrices
+  for (size_t i = 0; i < world.balls.size(); ++i) {
+    btRigidBody* ball_body = world.balls[i];
+    btTransform trans;
+    ball_body->getMotionState()->getWorldTransform(trans);
+    trans.getOpenGLMatrix(  glm::value_ptr(obj_->ball_orients[i]) );
   }
-  obj_->update_mutex.unlock();
 
   // Cheeky little reset in game
- 
+
 }
 
-void PhantomPhysics::MoveLeftHand(glm::vec3 pos) {
+void PhantomPhysics::MoveLeftHand(glm::vec3 pos, size_t user) {
   CXSHARED
-  //obj_->left_hand->translate( btVector3( pos.x, pos.y, pos.z ));
-  btTransform newTrans;
+  if (obj_->spheres)
+    obj_->spheres.MoveKinematic(user * 2, pos);
+  else
+    obj_->world->MoveHand(user * 2, pos);
+}
 
-  obj_->left_hand->getMotionState()->getWorldTransform(newTrans);
-  newTrans.setOrigin( btVector3( pos.x, pos.y, pos.z ));
-  obj_->left_hand->setActivationState(4);
-  obj_->left_hand->getMotionState()->setWorldTransform(newTrans);
+void PhantomPhysics::MoveRightHand(glm::vec3 pos, size_t user){
+  CXSHARED
+  if (obj_->spheres)
+    obj_->spheres.MoveKinematic(user * 2 + 1, pos);
+  else
+    obj_->world->MoveHand(user * 2 + 1, pos);
+}
 
+/// Take a users hands out of play when they are no longer tracked
+void PhantomPhysics::ParkHands(size_t user) {
+  CXSHARED
+  glm::vec3 parked(kParkedPosition.x(), kParkedPosition.y(), kParkedPosition.z());
+  if (obj_->spheres) {
+    obj_->spheres.MoveKinematic(user * 2, parked, true);
+    obj_->spheres.MoveKinematic(user * 2 + 1, parked, true);
+    return;
+  }
+  obj_->world->MoveHand(user * 2, parked, true);
+  obj_->world->MoveHand(user * 2 + 1, parked, true);
 }
 
-void PhantomPhysics::MoveRightHand(glm::vec3 pos){
+/// Move the pool of depth proxies onto the latest voxel centres. Shapes and bodies are never reallocated
+void PhantomPhysics::SetDepthProxies(const std::vector<glm::vec3> &centres) {
   CXSHARED
-  //obj_->right_hand->translate( btVector3( pos.x, pos.y, pos.z ));
-  btTransform newTrans;
-  
-  obj_->right_hand->getMotionState()->getWorldTransform(newTrans);
-  newTrans.setOrigin( btVector3( pos.x, pos.y, pos.z ));
-  obj_->right_hand->setActivationState(4);
-  obj_->right_hand->getMotionState()->setWorldTransform(newTrans);
+  std::lock_guard<std::mutex> lock(obj_->update_mutex);
 
- // ms.setWorldTransform(trans)
- // body.setMotionState(ms)
+  if (obj_->spheres) {
+    glm::vec3 parked(kParkedPosition.x(), kParkedPosition.y(), kParkedPosition.z());
+    for (size_t i = 0; i < obj_->proxy_count; ++i)
+      obj_->spheres.MoveKinematic(obj_->num_users * 2 + i, i < centres.size() ? centres[i] : parked, true);
+    return;
+  }
+
+  World &world = *obj_->world;
+
+  for (size_t i = 0; i < world.depth_proxies.size(); ++i) {
+    btRigidBody *proxy = world.depth_proxies[i];
+    btTransform trans;
+    trans.setIdentity();
 
+    if (i < centres.size())
+      trans.setOrigin( btVector3( centres[i].x, centres[i].y, centres[i].z ));
+    else
+      trans.setOrigin(kParkedPosition);
+
+    proxy->getMotionState()->setWorldTransform(trans);
+  }
 }
 
 
-PhantomPhysics::SharedObject::SharedObject(float_t gravity, float_t hand_radius) {
+PhantomPhysics::SharedObject::SharedObject(float_t gravity, float_t hand_radius, size_t num_users, size_t proxy_count, float_t proxy_radius,
+  const PhysicsProfile &profile, TaskSystem tasks) : profile(profile), spheres_reset(false),
+  builder_running(true), build_requested(false),
+  pending_world(nullptr), retired_world(nullptr), reset_in_flight(false),
+  timing_start(0), timing_total(0), timing_max(0), timing_steps(0),
+  alloc_total(0), alloc_max(0), alloc_bytes(0), arena_reserved(0),
+  stats_fired(0), stats_hits(0), stats_misses(0), stats_resets(0) {
+
   gravity_vector = btVector3(0,gravity,0);
   this->hand_radius = hand_radius;
-  InitPhysics();
+  this->num_users = num_users;
+  this->proxy_count = proxy_count;
+  this->proxy_radius = proxy_radius;
+
+  if (profile.backend == PHYSICS_SPHERES) {
+    SphereSolverSettings settings;
+    settings.gravity = glm::vec3(0, gravity, 0);
+    settings.fixed_timestep = profile.fixed_timestep;
+    settings.max_substeps = profile.max_substeps;
+    settings.iterations = profile.sphere_iterations;
+    settings.ground_size = profile.ground_size;
+    settings.hand_interpolation = profile.hand_interpolation;
+    spheres = SphereSolver(hand_radius, num_users * 2, proxy_radius, proxy_count, settings, tasks);
+
+    glm::vec3 parked(kParkedPosition.x(), kParkedPosition.y(), kParkedPosition.z());
+    for (size_t i = 0; i < num_users * 2 + proxy_count; ++i)
+      spheres.MoveKinematic(i, parked, true);
+    return;
+  }
+
+  // Must happen before Bullet allocates anything, so every free can be matched up
+  InstallBulletArenaHooks();
+
+  // Bullet only has a global for how long a body must be still before it sleeps
+  gDeactivationTime = btScalar(profile.deactivation_time);
+
+#ifdef BT_THREADSAFE
+  // The task scheduler is global to Bullet so only ever make one
+  if (profile.multithreaded && (btGetTaskScheduler() == nullptr || btGetTaskScheduler() == btGetSequentialTaskScheduler())) {
+    btITaskScheduler* scheduler = btCreateDefaultTaskScheduler();
+    if (scheduler != nullptr) {
+      if (profile.threads > 0)
+        scheduler->setNumThreads(static_cast<int>(profile.threads));
+      btSetTaskScheduler(scheduler);
+    }
+  }
+#else
+  if (profile.multithreaded)
+    cerr << "PhantomPhysics: Bullet was built without BT_THREADSAFE. Using the single threaded world." << endl;
+#endif
+
+  world = std::unique_ptr<World>(new World(*this));
+  builder = std::thread(&SharedObject::RunBuilder, this);
 }
 
 PhantomPhysics::SharedObject::~SharedObject() {
-  ///\todo will need some cleanup I suspect?
-  //ExitPhysics();
+  {
+    std::lock_guard<std::mutex> lock(builder_mutex);
+    builder_running = false;
+  }
+  builder_wake.notify_one();
+  if (builder.joinable())
+    builder.join();
+
+  delete pending_world.exchange(nullptr);
+  delete retired_world.exchange(nullptr);
+}
+
+// The builder thread makes replacement worlds and destroys old ones, so neither
+// cost ever lands on the thread that steps the simulation
+
+void PhantomPhysics::SharedObject::RunBuilder() {
+
+  while (true) {
+    bool build = false;
+    {
+      std::unique_lock<std::mutex> lock(builder_mutex);
+      builder_wake.wait_for(lock, std::chrono::milliseconds(100), [this]{
+        return build_requested || !builder_running || retired_world.load() != nullptr; });
+
+      if (!builder_running)
+        break;
+
+      build = build_requested;
+      build_requested = false;
+    }
+
+    delete retired_world.exchange(nullptr);
+
+    if (build) {
+      World *next = new World(*this);
+      delete pending_world.exchange(next);
+    }
+  }
+}
+
+// Called under update_mutex. If the builder has a world ready, it takes over from here
+
+void PhantomPhysics::SharedObject::SwapPendingWorld() {
+
+  World *next = pending_world.exchange(nullptr);
+  if (next == nullptr)
+    return;
+
+  World *old = world.release();
+  world.reset(next);
+  ball_orients.clear();
+  arena_reserved = 0;
+  stats_resets++;
+  reset_in_flight.store(false);
+
+  // The builder normally clears this slot within a frame. If not, pay for it here
+  World *expected = nullptr;
+  if (!retired_world.compare_exchange_strong(expected, old))
+    delete old;
+  builder_wake.notify_one();
+}
+
+// Accumulate step times and print them under the profile name, so two profiles can be
+// compared against the same session
+
+void PhantomPhysics::SharedObject::LogTiming(double_t step_time, size_t frame_allocs, size_t frame_bytes) {
+  if (profile.log_interval <= 0)
+    return;
+
+  double_t now = NowSeconds();
+  if (timing_steps == 0)
+    timing_start = now;
+
+  timing_total += step_time;
+  timing_max = std::max(timing_max, step_time);
+  timing_steps++;
+
+  alloc_total += frame_allocs;
+  alloc_max = std::max(alloc_max, frame_allocs);
+  alloc_bytes += frame_bytes;
+
+  if (now - timing_start > profile.log_interval) {
+    cout << "PhantomPhysics: profile " << profile.name
+      << " steps " << timing_steps
+      << " mean " << (timing_total / timing_steps) * 1000.0 << "ms"
+      << " max " << timing_max * 1000.0 << "ms"
+      << " balls " << (spheres ? spheres.size() : world->balls.size())
+      << " fired " << stats_fired
+      << " hit " << stats_hits
+      << " missed " << stats_misses
+      << " resets " << stats_resets << endl;
+
+    if (world) {
+      cout << "PhantomPhysics: allocations " << alloc_total
+        << " (" << alloc_bytes << " bytes)"
+        << " max per frame " << alloc_max
+        << " arena " << world->arena.used() / 1024 << "KB used of "
+        << world->arena.reserved() / 1024 << "KB, "
+        << world->arena.pooled() / 1024 << "KB free for reuse, "
+        << world->arena.reused() << " reused";
+      if (arena_reserved > 0)
+        cout << ", grew " << (world->arena.reserved() - arena_reserved) / 1024 << "KB since the last report";
+      cout << endl;
+      arena_reserved = world->arena.reserved();
+    }
+
+    timing_total = timing_max = 0;
+    timing_steps = 0;
+    alloc_total = alloc_max = alloc_bytes = 0;
+  }
 }
 
-void PhantomPhysics::SharedObject::InitPhysics() {
+
+PhantomPhysics::World::World(const SharedObject &config) : profile(config.profile), ball_shape(nullptr), ball_radius(0),
+  ground(nullptr), sim_time(0) {
+
+  ArenaScope scope(arena);
 
   ///collision configuration contains default setup for memory, collision setup
-  collision_configuration = new btDefaultCollisionConfiguration();
+  collision_configuration = std::unique_ptr<btDefaultCollisionConfiguration>(new btDefaultCollisionConfiguration());
   //m_collisionConfiguration->setConvexConvexMultipointIterations();
 
-  ///use the default collision dispatcher. For parallel processing you can use a diffent dispatcher (see Extras/BulletMultiThreaded)
-  dispatcher = new  btCollisionDispatcher(collision_configuration);
-  broadphase = new btDbvtBroadphase();
+  if (profile.broadphase == BROADPHASE_AXIS_SWEEP) {
+    broadphase = std::unique_ptr<btBroadphaseInterface>(new btAxisSweep3(
+      btVector3(profile.world_min.x, profile.world_min.y, profile.world_min.z),
+      btVector3(profile.world_max.x, profile.world_max.y, profile.world_max.z)));
+  } else {
+    broadphase = std::unique_ptr<btBroadphaseInterface>(new btDbvtBroadphase());
+  }
+
+#ifdef BT_THREADSAFE
+  if (profile.multithreaded) {
+    dispatcher = std::unique_ptr<btCollisionDispatcher>(new btCollisionDispatcherMt(collision_configuration.get()));
+    btConstraintSolverPoolMt *pool = new btConstraintSolverPoolMt(btGetTaskScheduler()->getNumThreads());
+    solver_pool = std::unique_ptr<btConstraintSolver>(pool);
+    solver = std::unique_ptr<btConstraintSolver>(new btSequentialImpulseConstraintSolverMt());
+    dynamics_world = std::unique_ptr<btDiscreteDynamicsWorld>(new btDiscreteDynamicsWorldMt(dispatcher.get(),
+      broadphase.get(), pool, solver.get(), collision_configuration.get()));
+  }
+#endif
 
-  ///the default constraint solver. For parallel processing you can use a different solver (see Extras/BulletMultiThreaded)
-  btSequentialImpulseConstraintSolver* sol = new btSequentialImpulseConstraintSolver;
-  solver = sol;
+  if (!dynamics_world) {
+    dispatcher = std::unique_ptr<btCollisionDispatcher>(new btCollisionDispatcher(collision_configuration.get()));
 
-  dynamics_world = new btDiscreteDynamicsWorld(dispatcher,broadphase,solver,collision_configuration);
-  dynamics_world->setGravity(gravity_vector);
+    ///the default constraint solver
+    solver = std::unique_ptr<btConstraintSolver>(new btSequentialImpulseConstraintSolver());
 
-  ///create a few basic rigid bodies
-  btBoxShape* groundShape = new btBoxShape(btVector3(btScalar(50.),btScalar(50.),btScalar(50.)));
+    dynamics_world = std::unique_ptr<btDiscreteDynamicsWorld>(new btDiscreteDynamicsWorld(dispatcher.get(),
+      broadphase.get(), solver.get(), collision_configuration.get()));
+  }
 
-  collision_shapes.push_back(groundShape);
+  dynamics_world->setGravity(config.gravity_vector);
+  dynamics_world->getSolverInfo().m_numIterations = profile.solver_iterations;
+  dynamics_world->setInternalTickCallback(&World::PreTick, this, true);
+
+  ///create a few basic rigid bodies
+  btScalar ground_size(profile.ground_size);
+  btBoxShape* groundShape = new btBoxShape(btVector3(ground_size, ground_size, ground_size));
+  collision_shapes.push_back(std::unique_ptr<btCollisionShape>(groundShape));
 
   btTransform groundTransform;
   groundTransform.setIdentity();
-  groundTransform.setOrigin(btVector3(0,-50,0));
+  groundTransform.setOrigin(btVector3(0,-ground_size,0));
 
-  //We can also use DemoApplication::localCreateRigidBody, but for clarity it is provided here:
+  ground = CreateBody(groundShape, 0, groundTransform, btVector3(0,0,0));
+  ground->setUserIndex(kGroundTag);
+  dynamics_world->addRigidBody(ground);
+
+  btTransform parkedTransform;
+  parkedTransform.setIdentity();
+  parkedTransform.setOrigin(kParkedPosition);
+
+  // Add both the hands for every user. They all share one shape and are laid out
+  // left, right, left, right... so each users pair sits together
   {
-    btScalar mass(0.);
+    btCollisionShape* colShape = new btSphereShape(btScalar(config.hand_radius));
+    collision_shapes.push_back(std::unique_ptr<btCollisionShape>(colShape));
+
+    for (size_t i = 0; i < config.num_users * 2; ++i) {
+      btRigidBody* hand = CreateBody(colShape, 0, parkedTransform, btVector3(0,0,0));
+      dynamics_world->addRigidBody(hand);
+
+      hand->setCollisionFlags( hand->getCollisionFlags() | btCollisionObject::CF_KINEMATIC_OBJECT);
+      hand->setActivationState(DISABLE_DEACTIVATION);
+      hand->activate(true);
+      hand->setUserIndex(kHandTag);
+      hands.push_back(hand);
+
+      HandTrack track;
+      track.from = track.to = kParkedPosition;
+      track.elapsed = track.duration = profile.fixed_timestep;
+      track.last_change = 0;
+      hand_tracks.push_back(track);
+    }
+  }
+
+  // Depth proxies all share the one shape
+  if (config.proxy_count > 0) {
+    btCollisionShape* colShape = new btSphereShape(btScalar(config.proxy_radius));
+    collision_shapes.push_back(std::unique_ptr<btCollisionShape>(colShape));
+
+    for (size_t i = 0; i < config.proxy_count; ++i) {
+      btRigidBody* proxy = CreateBody(colShape, 0, parkedTransform, btVector3(0,0,0));
+
+      proxy->setCollisionFlags( proxy->getCollisionFlags() | btCollisionObject::CF_KINEMATIC_OBJECT);
+      proxy->setActivationState(DISABLE_DEACTIVATION);
+      proxy->setUserIndex(kHandTag);
+      dynamics_world->addRigidBody(proxy);
+      depth_proxies.push_back(proxy);
+    }
+  }
 
-    //rigidbody is dynamic if and only if mass is non zero, otherwise static
-    bool isDynamic = (mass != 0.f);
+}
+
+/// Bodies must leave the world before it goes. Destructors still run so Bullet can unhook
+/// everything, but the memory only goes back to the system when the arena does
+PhantomPhysics::World::~World() {
+  ArenaScope scope(arena);
+
+  for (size_t i = bodies.size(); i > 0; --i)
+    dynamics_world->removeRigidBody(bodies[i - 1].get());
+
+  bodies.clear();
+  motion_states.clear();
+  collision_shapes.clear();
+  dynamics_world.reset();
+  solver_pool.reset();
+  solver.reset();
+  broadphase.reset();
+  dispatcher.reset();
+  collision_configuration.reset();
+}
+
+/// Make a body with its own motion state, both owned by this world
+btRigidBody* PhantomPhysics::World::CreateBody(btCollisionShape *shape, btScalar mass, const btTransform &start, const btVector3 &inertia) {
+  //using motionstate is recommended, it provides interpolation capabilities, and only synchronizes 'active' objects
+  btDefaultMotionState* motion_state = new btDefaultMotionState(start);
+  motion_states.push_back(std::unique_ptr<btMotionState>(motion_state));
 
-    btVector3 localInertia(0,0,0);
-    if (isDynamic)
-      groundShape->calculateLocalInertia(mass,localInertia);
+  btRigidBody::btRigidBodyConstructionInfo rbInfo(mass, motion_state, shape, inertia);
+  btRigidBody* body = new btRigidBody(rbInfo);
+  bodies.push_back(std::unique_ptr<btRigidBody>(body));
+  return body;
+}
 
-    //using motionstate is recommended, it provides interpolation capabilities, and only synchronizes 'active' objects
-    btDefaultMotionState* myMotionState = new btDefaultMotionState(groundTransform);
-    btRigidBody::btRigidBodyConstructionInfo rbInfo(mass,myMotionState,groundShape,localInertia);
-    ground = new btRigidBody(rbInfo);
+// With interpolation on, a new sensor position becomes a target that the hand sweeps
+// towards over the time the last sample took to arrive, one substep at a time
 
-    //add the body to the dynamics world
-    dynamics_world->addRigidBody(ground);
+void PhantomPhysics::World::MoveHand(size_t idx, glm::vec3 pos, bool snap) {
+  if (idx >= hands.size())
+    return;
+
+  btVector3 target(pos.x, pos.y, pos.z);
+  btRigidBody *hand = hands[idx];
+
+  if (!profile.hand_interpolation) {
+    btTransform newTrans;
+    hand->getMotionState()->getWorldTransform(newTrans);
+    newTrans.setOrigin(target);
+    hand->setActivationState(4);
+    hand->getMotionState()->setWorldTransform(newTrans);
+    return;
   }
 
-  // Add both the hands
-  {
-    btCollisionShape* colShape = new btSphereShape(btScalar(hand_radius));
-    collision_shapes.push_back(colShape);
-
-    /// Create Dynamic Objects
-    btTransform startTransform;
-    startTransform.setIdentity();
-
-    btScalar  mass(0.f);
-
-    //rigidbody is dynamic if and only if mass is non zero, otherwise static
-    bool isDynamic = (mass != 0.f);
-
-    startTransform.setOrigin(btVector3(0,0,0));
-    btVector3 localInertia(0,0,0);
-      
-    //using motionstate is recommended, it provides interpolation capabilities, and only synchronizes 'active' objects
-    btDefaultMotionState* myMotionStateLeft = new btDefaultMotionState(startTransform);
-    btRigidBody::btRigidBodyConstructionInfo rbInfoLeft(mass, myMotionStateLeft, colShape, localInertia);
-    
-    left_hand = new btRigidBody(rbInfoLeft);
-    dynamics_world->addRigidBody(left_hand);
-
-    left_hand->setCollisionFlags( left_hand->getCollisionFlags() | btCollisionObject::CF_KINEMATIC_OBJECT);
-    left_hand->setActivationState(DISABLE_DEACTIVATION);
-    left_hand->activate(true);
-
-    btDefaultMotionState* myMotionStateRight = new btDefaultMotionState(startTransform);
-    btRigidBody::btRigidBodyConstructionInfo rbInfoRight(mass, myMotionStateRight, colShape, localInertia);
-    
-    right_hand = new btRigidBody(rbInfoRight);
-    dynamics_world->addRigidBody(right_hand);
-
-    right_hand->setCollisionFlags( right_hand->getCollisionFlags() | btCollisionObject::CF_KINEMATIC_OBJECT);
-    right_hand->setActivationState(DISABLE_DEACTIVATION);
-    right_hand->activate(true); 
+  HandTrack &track = hand_tracks[idx];
+  if (target == track.to)
+    return;
+
+  // Hands coming into or out of play jump straight there rather than sweep through the scene
+  if (snap || track.to == kParkedPosition) {
+    track.from = track.to = target;
+    track.elapsed = track.duration = profile.fixed_timestep;
+    track.last_change = sim_time;
+    return;
   }
 
-  running_ = true;
+  track.from = hand->getWorldTransform().getOrigin();
+  track.to = target;
+  track.duration = std::min(std::max(sim_time - track.last_change, profile.fixed_timestep), kMaxHandSweep);
+  track.elapsed = 0;
+  track.last_change = sim_time;
+}
+
+// Called by Bullet before every substep. Moves the interpolated hands along and
+// gives them a real velocity so the solver sees a sweep rather than a teleport
+
+void PhantomPhysics::World::PreTick(btDynamicsWorld *dynamics_world, btScalar time_step) {
+  World *world = static_cast<World*>(dynamics_world->getWorldUserInfo());
+  world->sim_time += time_step;
+
+  if (!world->profile.hand_interpolation)
+    return;
+
+  for (size_t i = 0; i < world->hands.size(); ++i) {
+    HandTrack &track = world->hand_tracks[i];
+    btRigidBody *hand = world->hands[i];
 
+    track.elapsed += time_step;
+    btScalar alpha = std::min(btScalar(1.0), btScalar(track.elapsed / track.duration));
+
+    btTransform trans = hand->getWorldTransform();
+    btVector3 previous = trans.getOrigin();
+    trans.setOrigin( track.from.lerp(track.to, alpha) );
+
+    hand->setInterpolationWorldTransform(hand->getWorldTransform());
+    hand->setWorldTransform(trans);
+    hand->getMotionState()->setWorldTransform(trans);
+    hand->setLinearVelocity( (trans.getOrigin() - previous) / time_step );
+    hand->setInterpolationLinearVelocity(hand->getLinearVelocity());
+  }
 }
 
+// Work out which balls have been hit by a hand and which got past
 
-void PhantomPhysics::SharedObject::ExitPhysics() {
+void PhantomPhysics::World::ScoreBalls(SharedObject &owner) {
 
-  running_ = false;
-  update_mutex.lock();
-  ball_orients.clear();
-  
-  for (size_t i =0 ; i < balls.size(); ++i ){
-    dynamics_world->removeRigidBody(balls[i]);
-    delete balls[i]->getMotionState();
-    delete balls[i];
+  btDispatcher* dispatch = dynamics_world->getDispatcher();
+  int manifolds = dispatch->getNumManifolds();
+
+  for (int i = 0; i < manifolds; ++i) {
+    btPersistentManifold* manifold = dispatch->getManifoldByIndexInternal(i);
+    if (manifold->getNumContacts() == 0)
+      continue;
+
+    int a = manifold->getBody0()->getUserIndex();
+    int b = manifold->getBody1()->getUserIndex();
+
+    int ball = a >= 0 && b == kHandTag ? a : (b >= 0 && a == kHandTag ? b : -1);
+    if (ball >= 0 && static_cast<size_t>(ball) < ball_results.size() && ball_results[ball] == BALL_IN_FLIGHT) {
+      ball_results[ball] = BALL_HIT;
+      owner.stats_hits++;
+    }
   }
 
-  balls.clear();
-  
-  dynamics_world->removeRigidBody(left_hand);
-  delete left_hand->getMotionState();
-  delete left_hand;
-
-  dynamics_world->removeRigidBody(right_hand);
-  delete right_hand->getMotionState();
-  delete right_hand;
- 
-  dynamics_world->removeRigidBody(ground);
-  delete ground->getMotionState();
-  delete ground;
-
-   //delete collision shapes
-  for (size_t i=0; i < collision_shapes.size(); ++i) {
-    btCollisionShape* shape = collision_shapes[i];
-    delete shape;
+  for (size_t i = 0; i < balls.size(); ++i) {
+    if (ball_results[i] != BALL_IN_FLIGHT)
+      continue;
+    if (balls[i]->getWorldTransform().getOrigin().z() > kMissPlane) {
+      ball_results[i] = BALL_MISSED;
+      owner.stats_misses++;
+    }
   }
+}
 
-  collision_shapes.clear();
+// The same rules as ScoreBalls - touched by a hand or proxy is a hit, past the plane a miss
+
+void PhantomPhysics::SharedObject::ScoreSpheres() {
+  for (size_t i = 0; i < sphere_results.size(); ++i) {
+    if (sphere_results[i] != BALL_IN_FLIGHT)
+      continue;
+    if (spheres.touched(i)) {
+      sphere_results[i] = BALL_HIT;
+      stats_hits++;
+    } else if (spheres.position(i).z > kMissPlane) {
+      sphere_results[i] = BALL_MISSED;
+      stats_misses++;
+    }
+  }
+}
 
-  delete dynamics_world;
-  delete solver;
-  delete collision_configuration;
-  delete dispatcher;
-  delete broadphase;
+/// A block of balls dropped over the middle of the ground with a little sideways speed, and
+/// both hands sweeping through them, so each backend has contacts to resolve the whole time
+
+void PhantomPhysics::Benchmark(float_t gravity, float_t hand_radius, const PhysicsProfile &profile, TaskSystem tasks) {
+
+  const size_t kCounts[] = { 20, 1000, 10000 };
+  const PhysicsBackend kBackends[] = { PHYSICS_BULLET, PHYSICS_SPHERES };
+  const size_t kSettle = 30, kFrames = 120;
+  const double_t kFrameTime = 1.0 / 60.0;
+  const float_t kRadius = 0.05f;
+
+  for (PhysicsBackend backend : kBackends) {
+    for (size_t count : kCounts) {
+      PhysicsProfile p = profile;
+      p.backend = backend;
+      p.max_balls = count + 1;
+      p.log_interval = 0;
+
+      PhantomPhysics physics(gravity, hand_radius, 1, 0, 0.0f, p, tasks);
+
+      size_t side = static_cast<size_t>(std::ceil(std::sqrt(static_cast<double_t>(count) / 10.0)));
+      for (size_t i = 0; i < count; ++i) {
+        size_t x = i % side, z = (i / side) % side, y = i / (side * side);
+        glm::vec3 pos((x - side * 0.5f) * kRadius * 2.5f, 0.5f + y * kRadius * 2.5f, (z - side * 0.5f) * kRadius * 2.5f);
+        glm::vec3 velocity(std::sin(i * 0.7f) * 0.2f, 0.0f, std::cos(i * 1.3f) * 0.2f);
+        physics.AddBall(kRadius, pos, velocity);
+      }
+
+      double_t time = 0;
+      for (size_t frame = 0; frame < kSettle + kFrames; ++frame) {
+        float_t sweep = std::sin(frame * 0.05f) * side * kRadius;
+        physics.MoveLeftHand(glm::vec3(sweep, 0.2f, 0.0f));
+        physics.MoveRightHand(glm::vec3(0.0f, 0.2f, sweep));
+
+        double_t start = NowSeconds();
+        physics.Update(kFrameTime);
+        if (frame >= kSettle)
+          time += NowSeconds() - start;
+      }
+
+      cout << "PhantomPhysics: " << (backend == PHYSICS_BULLET ? "bullet " : "spheres ") << count << " balls "
+        << time / kFrames * 1000.0 << "ms per frame, "
+        << count * kFrames / time / 1.0e6 << "M ball frames per second" << endl;
+    }
+  }
+}
+
+static size_t ResidentBytes() {
+  std::ifstream statm("/proc/self/statm");
+  size_t pages = 0, resident = 0;
+  statm >> pages >> resident;
+  return resident * static_cast<size_t>(sysconf(_SC_PAGESIZE));
+}
 
-  update_mutex.unlock();
+/// Each round fires a full load of balls, steps a second of game time, then resets and steps
+/// until the builder's world has been swapped in
 
-}
\ No newline at end of file
+void PhantomPhysics::Soak(float_t gravity, float_t hand_radius, const PhysicsProfile &profile, size_t resets) {
+
+  const double_t kFrameTime = 1.0 / 60.0;
+  const size_t kFrames = 60;
+  const size_t kSteadyFrames = 60 * 60 * 10;
+  const size_t kReportEvery = std::max<size_t>(resets / 10, 1);
+
+  PhysicsProfile p = profile;
+  p.backend = PHYSICS_BULLET;
+  p.log_interval = 0;
+
+  PhantomPhysics physics(gravity, hand_radius, 1, 0, 0.0f, p);
+
+  size_t baseline = 0;
+  double_t start = NowSeconds();
+
+  // A long game in one world first, with the hands sweeping through the balls, to show the
+  // arena stops growing once Bullet's arrays have reached their working size
+  for (size_t i = 0; i < p.max_balls; ++i)
+    physics.AddBall(0.25f, glm::vec3(0.0f, 1.0f + i * 0.6f, 0.0f), glm::vec3(0.0f, 0.0f, 0.5f));
+
+  size_t settled = 0;
+  for (size_t frame = 0; frame < kSteadyFrames; ++frame) {
+    float_t sweep = std::sin(frame * 0.05f) * 2.0f;
+    physics.MoveLeftHand(glm::vec3(sweep, 0.5f, 0.0f));
+    physics.MoveRightHand(glm::vec3(0.0f, 0.5f, sweep));
+    physics.Update(kFrameTime);
+    if (frame + 1 == kSteadyFrames / 10)
+      settled = physics.obj_->world->arena.reserved();
+  }
+
+  Arena &arena = physics.obj_->world->arena;
+  cout << "PhantomPhysics: soak " << kSteadyFrames * kFrameTime / 60.0 << " minutes in one world, arena "
+    << arena.reserved() / 1024 << "KB reserved, " << (arena.reserved() - settled) / 1024
+    << "KB of that after the first tenth, " << arena.reused() << " allocations reused" << endl;
+
+  physics.Reset();
+
+  for (size_t round = 1; round <= resets; ++round) {
+    for (size_t i = 0; i < p.max_balls; ++i)
+      physics.AddBall(0.25f, glm::vec3(0.0f, 1.0f + i * 0.6f, 0.0f), glm::vec3(0.0f, 0.0f, 2.0f));
+    for (size_t frame = 0; frame < kFrames; ++frame)
+      physics.Update(kFrameTime);
+
+    size_t before = physics.obj_->stats_resets;
+    physics.Reset();
+    double_t waited = NowSeconds();
+    while (physics.obj_->stats_resets == before && NowSeconds() - waited < 5.0)
+      physics.Update(kFrameTime);
+
+    if (physics.obj_->stats_resets == before) {
+      cerr << "PhantomPhysics: soak reset " << round << " never completed" << endl;
+      return;
+    }
+
+    // The first worlds warm up the allocator, so growth is measured from the first report
+    if (round % kReportEvery == 0) {
+      size_t resident = ResidentBytes();
+      if (baseline == 0)
+        baseline = resident;
+      cout << "PhantomPhysics: soak " << round << " resets, resident " << resident / 1024 << "KB, "
+        << (static_cast<double_t>(resident) - baseline) / 1024.0 << "KB since reset " << kReportEvery << endl;
+    }
+  }
+
+  cout << "PhantomPhysics: soak of " << resets << " resets took " << NowSeconds() - start << "s" << endl;
+}
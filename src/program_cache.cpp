@@ -0,0 +1,314 @@
+/**
+* @brief Program binary cache and parallel program builds
+* @file program_cache.cpp
+* @author Benjamin Blundell <oni@section9.co.uk>
+* @date 19/10/2026
+*
+*/
+
+#include "program_cache.hpp"
+
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+
+#include <sys/stat.h>
+
+
+using namespace std;
+using namespace s9;
+
+
+static const uint32_t kBinaryMagic = 0x42504c50;   // PLPB
+static const GLenum kStages[] = { GL_VERTEX_SHADER, GL_FRAGMENT_SHADER, GL_GEOMETRY_SHADER };
+
+/// FNV-1a, folded over each string in turn
+static uint64_t Hash(uint64_t hash, const std::string &s) {
+  for (size_t i = 0; i < s.size(); ++i) {
+    hash ^= static_cast<uint8_t>(s[i]);
+    hash *= 0x100000001b3ull;
+  }
+  hash ^= 0xff;
+  hash *= 0x100000001b3ull;
+  return hash;
+}
+
+static std::string ReadText(const std::string &path) {
+  std::ifstream file(path.c_str());
+  if (!file)
+    return "";
+  std::stringstream text;
+  text << file.rdbuf();
+  return text.str();
+}
+
+static std::string GLString(GLenum name) {
+  const GLubyte *s = glGetString(name);
+  return s != nullptr ? reinterpret_cast<const char*>(s) : "";
+}
+
+
+ProgramCache::ProgramCache(const std::string &directory)
+  : obj_ (std::shared_ptr<SharedObject>(new SharedObject())) {
+
+  obj_->directory = directory;
+  obj_->driver = GLString(GL_VENDOR) + " / " + GLString(GL_RENDERER) + " / " + GLString(GL_VERSION);
+  obj_->build_start = obj_->issue_time = 0;
+
+  GLint formats = 0;
+  if (GLEW_ARB_get_program_binary)
+    glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+  obj_->binaries = !directory.empty() && formats > 0;
+  if (obj_->binaries)
+    mkdir(directory.c_str(), 0755);
+
+  // Let the driver use as many compiler threads as it likes
+  obj_->parallel = false;
+#ifdef GL_KHR_parallel_shader_compile
+  if (GLEW_KHR_parallel_shader_compile) {
+    glMaxShaderCompilerThreadsKHR(0xffffffff);
+    obj_->parallel = true;
+  }
+#endif
+#ifdef GL_ARB_parallel_shader_compile
+  if (!obj_->parallel && GLEW_ARB_parallel_shader_compile) {
+    glMaxShaderCompilerThreadsARB(0xffffffff);
+    obj_->parallel = true;
+  }
+#endif
+}
+
+ProgramCache::SharedObject::~SharedObject() {
+  for (Program &p : programs) {
+    for (size_t s = 0; s < 3; ++s) {
+      if (p.shaders[s] != 0)
+        glDeleteShader(p.shaders[s]);
+    }
+    if (p.program != 0)
+      glDeleteProgram(p.program);
+  }
+}
+
+size_t ProgramCache::Add(const std::string &name, const std::string &vertex, const std::string &fragment,
+  const std::string &geometry) {
+  CXSHARED
+
+  Program p;
+  p.name = name;
+  p.paths[0] = vertex;
+  p.paths[1] = fragment;
+  p.paths[2] = geometry;
+  p.key = 0;
+  p.program = 0;
+  p.shaders[0] = p.shaders[1] = p.shaders[2] = 0;
+  p.state = PROGRAM_QUEUED;
+  p.cached = false;
+  p.ready = 0;
+
+  obj_->programs.push_back(p);
+  return obj_->programs.size() - 1;
+}
+
+/// Binaries first, as loading one is cheap next to any compile. Then every compile and link
+/// goes in before anything asks how they went - that query is what would make us wait
+
+void ProgramCache::Build() {
+  CXSHARED
+
+  obj_->build_start = NowSeconds();
+
+  for (Program &p : obj_->programs) {
+    if (p.state != PROGRAM_QUEUED)
+      continue;
+
+    p.key = Hash(0xcbf29ce484222325ull, obj_->driver);
+    for (size_t s = 0; s < 3; ++s) {
+      if (!p.paths[s].empty())
+        p.sources[s] = ReadText(p.paths[s]);
+      p.key = Hash(p.key, p.sources[s]);
+    }
+
+    if (obj_->binaries && LoadBinary(p)) {
+      p.state = PROGRAM_READY;
+      p.cached = true;
+      p.ready = NowSeconds() - obj_->build_start;
+    }
+  }
+
+  for (Program &p : obj_->programs) {
+    if (p.state == PROGRAM_QUEUED)
+      Compile(p);
+  }
+
+  obj_->issue_time = NowSeconds() - obj_->build_start;
+}
+
+GLuint ProgramCache::program(size_t i) {
+  CXSHARED
+  Program &p = obj_->programs[i];
+  if (p.state == PROGRAM_QUEUED)
+    Build();
+  if (p.state == PROGRAM_BUILDING)
+    Finish(p);
+  return p.state == PROGRAM_READY ? p.program : 0;
+}
+
+void ProgramCache::Compile(Program &p) {
+  p.program = glCreateProgram();
+
+  for (size_t s = 0; s < 3; ++s) {
+    if (p.paths[s].empty())
+      continue;
+    const GLchar *source = p.sources[s].c_str();
+    p.shaders[s] = glCreateShader(kStages[s]);
+    glShaderSource(p.shaders[s], 1, &source, nullptr);
+    glCompileShader(p.shaders[s]);
+    glAttachShader(p.program, p.shaders[s]);
+  }
+
+  if (obj_->binaries)
+    glProgramParameteri(p.program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+
+  glLinkProgram(p.program);
+  p.state = PROGRAM_BUILDING;
+}
+
+void ProgramCache::Finish(Program &p) {
+  GLint linked = GL_FALSE;
+  glGetProgramiv(p.program, GL_LINK_STATUS, &linked);
+  p.ready = NowSeconds() - obj_->build_start;
+
+  if (linked != GL_TRUE) {
+    cerr << "PhantomLimb: program " << p.name << " failed to build" << endl;
+
+    GLchar log[4096];
+    for (size_t s = 0; s < 3; ++s) {
+      GLint compiled = GL_TRUE;
+      if (p.shaders[s] != 0)
+        glGetShaderiv(p.shaders[s], GL_COMPILE_STATUS, &compiled);
+      if (compiled != GL_TRUE) {
+        glGetShaderInfoLog(p.shaders[s], sizeof(log), nullptr, log);
+        cerr << p.paths[s] << ": " << log << endl;
+      }
+    }
+    glGetProgramInfoLog(p.program, sizeof(log), nullptr, log);
+    cerr << log << endl;
+  }
+
+  for (size_t s = 0; s < 3; ++s) {
+    if (p.shaders[s] != 0) {
+      glDetachShader(p.program, p.shaders[s]);
+      glDeleteShader(p.shaders[s]);
+      p.shaders[s] = 0;
+    }
+  }
+
+  if (linked != GL_TRUE) {
+    glDeleteProgram(p.program);
+    p.program = 0;
+    p.state = PROGRAM_FAILED;
+    return;
+  }
+
+  p.state = PROGRAM_READY;
+  if (obj_->binaries)
+    SaveBinary(p);
+}
+
+// The file repeats the key and the driver string so neither a stale file nor a hash collision
+// is ever handed to the driver
+
+static std::string BinaryPath(const std::string &directory, const std::string &name, uint64_t key) {
+  char hex[17];
+  snprintf(hex, sizeof(hex), "%016llx", static_cast<unsigned long long>(key));
+  return directory + "/" + name + "_" + hex + ".bin";
+}
+
+bool ProgramCache::LoadBinary(Program &p) {
+  std::ifstream file(BinaryPath(obj_->directory, p.name, p.key).c_str(), std::ios::binary);
+  if (!file)
+    return false;
+
+  uint32_t magic = 0, driver_length = 0, length = 0;
+  uint64_t key = 0;
+  GLenum format = 0;
+
+  file.read(reinterpret_cast<char*>(&magic), sizeof(magic));
+  file.read(reinterpret_cast<char*>(&key), sizeof(key));
+  file.read(reinterpret_cast<char*>(&driver_length), sizeof(driver_length));
+  if (!file || magic != kBinaryMagic || key != p.key || driver_length != obj_->driver.size())
+    return false;
+
+  std::string driver(driver_length, '\0');
+  file.read(&driver[0], driver_length);
+  file.read(reinterpret_cast<char*>(&format), sizeof(format));
+  file.read(reinterpret_cast<char*>(&length), sizeof(length));
+  if (!file || driver != obj_->driver || length == 0)
+    return false;
+
+  std::vector<char> binary(length);
+  file.read(&binary[0], length);
+  if (!file)
+    return false;
+
+  p.program = glCreateProgram();
+  glProgramBinary(p.program, format, &binary[0], static_cast<GLsizei>(length));
+
+  GLint linked = GL_FALSE;
+  glGetProgramiv(p.program, GL_LINK_STATUS, &linked);
+  if (linked == GL_TRUE)
+    return true;
+
+  // Refused, most likely after a driver update that kept its version string. Build it again
+  cout << "PhantomLimb: cached binary for " << p.name << " refused, compiling" << endl;
+  glDeleteProgram(p.program);
+  p.program = 0;
+  remove(BinaryPath(obj_->directory, p.name, p.key).c_str());
+  return false;
+}
+
+void ProgramCache::SaveBinary(Program &p) {
+  GLint length = 0;
+  glGetProgramiv(p.program, GL_PROGRAM_BINARY_LENGTH, &length);
+  if (length <= 0)
+    return;
+
+  std::vector<char> binary(length);
+  GLenum format = 0;
+  glGetProgramBinary(p.program, length, nullptr, &format, &binary[0]);
+
+  std::ofstream file(BinaryPath(obj_->directory, p.name, p.key).c_str(), std::ios::binary);
+  if (!file)
+    return;
+
+  uint32_t driver_length = static_cast<uint32_t>(obj_->driver.size());
+  uint32_t size = static_cast<uint32_t>(length);
+  file.write(reinterpret_cast<const char*>(&kBinaryMagic), sizeof(kBinaryMagic));
+  file.write(reinterpret_cast<const char*>(&p.key), sizeof(p.key));
+  file.write(reinterpret_cast<const char*>(&driver_length), sizeof(driver_length));
+  file.write(obj_->driver.data(), driver_length);
+  file.write(reinterpret_cast<const char*>(&format), sizeof(format));
+  file.write(reinterpret_cast<const char*>(&size), sizeof(size));
+  file.write(&binary[0], length);
+}
+
+void ProgramCache::Report() {
+  CXSHARED
+
+  size_t cached = 0;
+  double_t total = 0;
+  for (size_t i = 0; i < obj_->programs.size(); ++i) {
+    program(i);
+    Program &p = obj_->programs[i];
+    if (p.cached)
+      cached++;
+    total = std::max(total, p.ready);
+    cout << "PhantomLimb: program " << p.name << (p.state == PROGRAM_READY ? "" : " FAILED")
+      << (p.cached ? " from cache" : " compiled") << ", ready after " << p.ready * 1000.0 << "ms" << endl;
+  }
+
+  cout << "PhantomLimb: " << (cached == obj_->programs.size() ? "warm" : "cold") << " start, "
+    << obj_->programs.size() << " programs (" << cached << " cached) ready in " << total * 1000.0 << "ms, "
+    << obj_->issue_time * 1000.0 << "ms to issue, parallel compile " << (obj_->parallel ? "on" : "off")
+    << ", binary cache " << (obj_->binaries ? obj_->directory : "off") << endl;
+}
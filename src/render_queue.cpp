@@ -0,0 +1,113 @@
+/**
+* @brief State sorted render queue
+* @file render_queue.cpp
+* @author Benjamin Blundell <oni@section9.co.uk>
+* @date 19/10/2026
+*
+*/
+
+#include "render_queue.hpp"
+
+
+using namespace std;
+using namespace s9;
+
+
+RenderQueue::RenderQueue(PassFunc bind_pass)
+  : obj_ (std::shared_ptr<SharedObject>(new SharedObject(bind_pass))) {
+
+}
+
+uint32_t RenderQueue::Register(uint8_t program, uint16_t material, uint16_t mesh, DrawFunc draw) {
+  CXSHARED
+  Item item;
+  item.program = program;
+  item.material = material;
+  item.mesh = mesh;
+  item.draw = draw;
+  obj_->items.push_back(item);
+  return static_cast<uint32_t>(obj_->items.size() - 1);
+}
+
+void RenderQueue::Submit(uint32_t item, uint8_t pass, float_t depth) {
+  CXSHARED
+  const Item &i = obj_->items[item];
+  Packet packet;
+  packet.key = RenderKey(i.program, i.material, i.mesh, pass, depth);
+  packet.item = item;
+  obj_->packets.push_back(packet);
+}
+
+// The pass sits in the key, so it can be read back off the packet
+
+static inline uint8_t KeyPass(uint64_t key) { return static_cast<uint8_t>(key >> 62); }
+
+void RenderQueue::Flush() {
+  CXSHARED
+
+  std::vector<Packet> &packets = obj_->packets;
+
+  // What graph order would have cost, for the stats
+  obj_->unsorted_pass_binds = 0;
+  for (size_t i = 0; i < packets.size(); ++i) {
+    if (i == 0 || KeyPass(packets[i].key) != KeyPass(packets[i - 1].key))
+      obj_->unsorted_pass_binds++;
+  }
+
+  obj_->Sort();
+
+  obj_->draws = obj_->pass_binds = 0;
+  int pass = -1;
+
+  for (const Packet &packet : packets) {
+    // Only bind a pass when it changes
+    if (KeyPass(packet.key) != pass) {
+      pass = KeyPass(packet.key);
+      obj_->bind_pass(static_cast<uint8_t>(pass));
+      obj_->pass_binds++;
+    }
+
+    obj_->items[packet.item].draw();
+    obj_->draws++;
+  }
+
+  packets.clear();
+}
+
+// LSD radix sort, a byte at a time. A byte that is the same in every key - most of them, with
+// only a handful of programs and materials - costs a histogram and nothing more
+
+void RenderQueue::SharedObject::Sort() {
+
+  size_t count = packets.size();
+  if (count < 2)
+    return;
+
+  scratch.resize(count);
+  Packet *from = &packets[0];
+  Packet *to = &scratch[0];
+
+  for (size_t shift = 0; shift < 64; shift += 8) {
+    size_t histogram[256] = {0};
+    for (size_t i = 0; i < count; ++i)
+      histogram[(from[i].key >> shift) & 0xff]++;
+
+    if (histogram[(from[0].key >> shift) & 0xff] == count)
+      continue;
+
+    size_t offset = 0;
+    for (size_t b = 0; b < 256; ++b) {
+      size_t n = histogram[b];
+      histogram[b] = offset;
+      offset += n;
+    }
+
+    for (size_t i = 0; i < count; ++i)
+      to[histogram[(from[i].key >> shift) & 0xff]++] = from[i];
+
+    std::swap(from, to);
+  }
+
+  if (from != &packets[0])
+    std::copy(from, from + count, packets.begin());
+}
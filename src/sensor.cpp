@@ -0,0 +1,223 @@
+/**
+* @brief Sensor ingestion thread for OpenNI
+* @file sensor.cpp
+* @author Benjamin Blundell <oni@section9.co.uk>
+* @date 19/10/2026
+*
+*/
+
+#include "sensor.hpp"
+
+#include <algorithm>
+
+
+using namespace std;
+using namespace s9;
+using namespace s9::oni;
+
+
+// Names of the OpenNI bones, in TrackedJoint order
+static const char* kJointNames[JOINT_COUNT] = {
+  "Left Shoulder",
+  "Left Elbow",
+  "Right Shoulder",
+  "Right Elbow"
+};
+
+
+// Degrees the furthest turned joint moved between two samples of the same user
+
+static float_t JointMotion(const SkeletonSample &a, const SkeletonSample &b) {
+  if (!a.tracked || !b.tracked || a.user_id != b.user_id)
+    return 0;
+
+  float_t motion = 0;
+  for (size_t i = 0; i < JOINT_COUNT; ++i) {
+    const glm::quat &p = a.joints[i], &q = b.joints[i];
+    float_t d = std::min(std::fabs(p.w * q.w + p.x * q.x + p.y * q.y + p.z * q.z), 1.0f);
+    motion = std::max(motion, 2.0f * std::acos(d) * 57.2957795f);
+  }
+  return motion;
+}
+
+
+SensorIngest::SensorIngest(OpenNIBase &openni, OpenNISkeleton &tracker, double_t poll_rate, size_t max_users)
+  : obj_ (std::shared_ptr<SharedObject>(new SharedObject(openni, tracker, poll_rate, max_users))) {
+
+}
+
+void SensorIngest::Start() {
+  CXSHARED
+  if (obj_->running.load())
+    return;
+
+  obj_->running.store(true);
+  obj_->thread = std::thread(&SharedObject::Run, obj_.get());
+}
+
+/// Blocks until the sensor thread has left OpenNI. Must happen before OpenNI shuts down
+void SensorIngest::Stop() {
+  CXSHARED
+  obj_->running.store(false);
+  if (obj_->thread.joinable())
+    obj_->thread.join();
+}
+
+
+SensorIngest::SharedObject::SharedObject(OpenNIBase &openni, OpenNISkeleton &tracker, double_t poll_rate, size_t max_users)
+  : openni(openni), tracker(tracker), max_users(max_users), slot_users(max_users, 0), previous(max_users),
+  running(false), restart_requested(false), dropped(0), polled(0) {
+  for (SkeletonSample &sample : previous)
+    sample.tracked = false;
+  poll_interval = poll_rate > 0 ? 1.0 / poll_rate : 1.0 / 60.0;
+}
+
+SensorIngest::SharedObject::~SharedObject() {
+  running.store(false);
+  if (thread.joinable())
+    thread.join();
+}
+
+// The sensor thread itself. If the device never becomes ready we just idle at the poll
+// rate, so a missing Xtion no longer has any effect on the rest of the app
+
+void SensorIngest::SharedObject::Run() {
+
+  while (running.load()) {
+
+    double_t start = NowSeconds();
+
+    if (openni.ready()) {
+      if (restart_requested.exchange(false))
+        tracker.RestartTracking();
+
+      openni.Update();
+      tracker.Update();
+
+      double_t now = NowSeconds();
+      float_t motion = 0;
+      AssignSlots();
+
+      for (size_t slot = 0; slot < max_users; ++slot) {
+        SkeletonSample sample;
+        sample.timestamp = now;
+        sample.slot = static_cast<uint32_t>(slot);
+        sample.user_id = slot_users[slot];
+        sample.tracked = false;
+
+        if (sample.user_id != 0) {
+          OpenNISkeleton::User user = tracker.GetUserByID(static_cast<int>(sample.user_id));
+          sample.tracked = user.IsTracked();
+
+          if (sample.tracked) {
+            for (size_t i = 0; i < JOINT_COUNT; ++i) {
+              Bone * bone = user.skeleton().GetBone(kJointNames[i]);
+              sample.joints[i] = bone != nullptr ? bone->rotation() : glm::quat();
+            }
+          }
+        }
+
+        motion = std::max(motion, JointMotion(previous[slot], sample));
+        previous[slot] = sample;
+
+        if (!queue.PushOverwrite(sample))
+          dropped++;
+      }
+      polled++;
+
+      if (depth_accumulator)
+        depth_accumulator.Motion(motion);
+
+      CaptureImages();
+    }
+
+    double_t remaining = poll_interval - (NowSeconds() - start);
+    if (remaining > 0)
+      std::this_thread::sleep_for(std::chrono::duration<double_t>(remaining));
+  }
+
+}
+
+// NiTE numbers users from 1 and never reuses an ID, so someone who walks out and back in
+// comes back as a new user. A slot holds on to its user until NiTE drops them from its list,
+// then goes to whoever is found next
+
+void SensorIngest::SharedObject::AssignSlots() {
+
+  auto &users = tracker.users();
+
+  for (uint32_t &id : slot_users) {
+    bool present = false;
+    for (auto &user : users)
+      present = present || static_cast<uint32_t>(user.id()) == id;
+    if (!present)
+      id = 0;
+  }
+
+  for (auto &user : users) {
+    uint32_t id = static_cast<uint32_t>(user.id());
+    if (std::find(slot_users.begin(), slot_users.end(), id) != slot_users.end())
+      continue;
+
+    std::vector<uint32_t>::iterator free = std::find(slot_users.begin(), slot_users.end(), 0u);
+    if (free == slot_users.end())
+      break;
+    *free = id;
+  }
+}
+
+// Hand the current images to whoever wants them. The feeds copy straight into mapped
+// buffer memory, so the images are never copied more than once per consumer
+
+void SensorIngest::SharedObject::CaptureImages() {
+
+  if (depth_colliders || depth_feed) {
+    openni::VideoFrameRef frame = openni.depth_frame();
+
+    bool smooth = depth_accumulator && !depth_accumulator.gpu() && frame.isValid() &&
+      depth_accumulator.width() == static_cast<size_t>(frame.getWidth()) &&
+      depth_accumulator.height() == static_cast<size_t>(frame.getHeight());
+
+    if (smooth) {
+      // Smoothed depth goes to both, so it has to be copied out first
+      CaptureDepth(frame);
+      depth_accumulator.Accumulate(&depth_frame.depth[0], &depth_frame.depth[0]);
+
+      if (depth_feed)
+        depth_feed.Submit(&depth_frame.depth[0], depth_frame.width, depth_frame.height);
+      if (depth_colliders)
+        depth_colliders.Submit(depth_frame);
+
+    } else if (frame.isValid()) {
+      if (depth_feed)
+        depth_feed.Submit(frame.getData(), frame.getWidth(), frame.getHeight());
+
+      if (depth_colliders) {
+        CaptureDepth(frame);
+        depth_colliders.Submit(depth_frame);
+      }
+    }
+  }
+
+  if (colour_feed) {
+    openni::VideoFrameRef frame = openni.colour_frame();
+    if (frame.isValid())
+      colour_feed.Submit(frame.getData(), frame.getWidth(), frame.getHeight());
+  }
+}
+
+// Copy the depth image out of OpenNI. The buffer we copy into is whichever one
+// the collider stage handed back on the last Submit, so this only allocates at startup
+
+void SensorIngest::SharedObject::CaptureDepth(openni::VideoFrameRef &frame) {
+
+  depth_frame.width = static_cast<size_t>(frame.getWidth());
+  depth_frame.height = static_cast<size_t>(frame.getHeight());
+  depth_frame.timestamp = NowSeconds();
+
+  size_t count = depth_frame.width * depth_frame.height;
+  depth_frame.depth.resize(count);
+
+  const openni::DepthPixel *pixels = static_cast<const openni::DepthPixel*>(frame.getData());
+  std::copy(pixels, pixels + count, depth_frame.depth.begin());
+}
@@ -0,0 +1,168 @@
+/**
+* @brief Session recording and replay
+* @file session.cpp
+* @author Benjamin Blundell <oni@section9.co.uk>
+* @date 19/10/2026
+*
+*/
+
+#include "session.hpp"
+
+#include <algorithm>
+
+
+using namespace std;
+using namespace s9;
+
+
+static const char kMagic[4] = {'P', 'L', 'S', 'N'};
+static const uint32_t kVersion = 3;
+
+template<typename T>
+static void Write(std::ofstream &file, const T &value) {
+  file.write(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+template<typename T>
+static bool Read(std::ifstream &file, T &value) {
+  file.read(reinterpret_cast<char*>(&value), sizeof(T));
+  return static_cast<bool>(file);
+}
+
+static void WriteVec3(std::ofstream &file, const glm::vec3 &v) {
+  Write(file, v.x); Write(file, v.y); Write(file, v.z);
+}
+
+static bool ReadVec3(std::ifstream &file, glm::vec3 &v) {
+  return Read(file, v.x) && Read(file, v.y) && Read(file, v.z);
+}
+
+
+SessionRecorder::SessionRecorder(const std::string &path)
+  : obj_ (std::shared_ptr<SharedObject>(new SharedObject(path))) {
+
+}
+
+void SessionRecorder::Record(const SkeletonSample &sample) {
+  CXSHARED
+  obj_->WriteHeader(SESSION_SAMPLE, sample.timestamp - obj_->start);
+
+  Write(obj_->file, sample.slot);
+  Write(obj_->file, sample.user_id);
+  Write(obj_->file, static_cast<uint8_t>(sample.tracked ? 1 : 0));
+  for (size_t i = 0; i < JOINT_COUNT; ++i) {
+    Write(obj_->file, sample.joints[i].w);
+    Write(obj_->file, sample.joints[i].x);
+    Write(obj_->file, sample.joints[i].y);
+    Write(obj_->file, sample.joints[i].z);
+  }
+}
+
+void SessionRecorder::Record(const BallEvent &ball) {
+  CXSHARED
+  obj_->WriteHeader(SESSION_BALL, NowSeconds() - obj_->start);
+
+  Write(obj_->file, ball.radius);
+  WriteVec3(obj_->file, ball.position);
+  WriteVec3(obj_->file, ball.velocity);
+}
+
+void SessionRecorder::Record(const Command &command) {
+  CXSHARED
+  obj_->WriteHeader(SESSION_COMMAND, NowSeconds() - obj_->start);
+
+  Write(obj_->file, static_cast<uint32_t>(command.type));
+  Write(obj_->file, static_cast<uint32_t>(command.arm));
+}
+
+
+SessionRecorder::SharedObject::SharedObject(const std::string &path) : start(NowSeconds()), events(0) {
+  file.open(path.c_str(), std::ios::binary | std::ios::trunc);
+  if (!file.is_open()) {
+    cerr << "PhantomLimb: could not open " << path << " to record the session" << endl;
+    return;
+  }
+
+  file.write(kMagic, 4);
+  Write(file, kVersion);
+  cout << "PhantomLimb: recording session to " << path << endl;
+}
+
+void SessionRecorder::SharedObject::WriteHeader(SessionEventType type, double_t time) {
+  Write(file, static_cast<uint32_t>(type));
+  Write(file, time);
+  events++;
+}
+
+
+SessionPlayer::SessionPlayer(const std::string &path)
+  : obj_ (std::shared_ptr<SharedObject>(new SharedObject(path))) {
+
+}
+
+void SessionPlayer::Advance(double_t time, std::vector<SessionEvent> &events) {
+  CXSHARED
+  events.clear();
+  while (obj_->next < obj_->events.size() && obj_->events[obj_->next].time <= time)
+    events.push_back(obj_->events[obj_->next++]);
+}
+
+
+SessionPlayer::SharedObject::SharedObject(const std::string &path) : next(0) {
+
+  std::ifstream file(path.c_str(), std::ios::binary);
+  char magic[4];
+  uint32_t version = 0;
+
+  if (!file.is_open() || !file.read(magic, 4) || !std::equal(magic, magic + 4, kMagic) ||
+    !Read(file, version) || version < 1 || version > kVersion) {
+    cerr << "PhantomLimb: " << path << " is not a session recording" << endl;
+    return;
+  }
+
+  uint32_t type;
+  while (Read(file, type)) {
+    SessionEvent event;
+    event.type = static_cast<SessionEventType>(type);
+    if (!Read(file, event.time))
+      break;
+
+    bool ok = true;
+
+    if (event.type == SESSION_SAMPLE) {
+      uint8_t tracked = 0;
+      // Version 1 only had the user ID, which was the slot plus one
+      if (version > 1)
+        ok = Read(file, event.sample.slot);
+      ok = ok && Read(file, event.sample.user_id) && Read(file, tracked);
+      if (version == 1)
+        event.sample.slot = event.sample.user_id - 1;
+      event.sample.tracked = tracked != 0;
+      event.sample.timestamp = event.time;
+      for (size_t i = 0; ok && i < JOINT_COUNT; ++i) {
+        glm::quat &q = event.sample.joints[i];
+        ok = Read(file, q.w) && Read(file, q.x) && Read(file, q.y) && Read(file, q.z);
+      }
+    } else if (event.type == SESSION_BALL) {
+      ok = Read(file, event.ball.radius) && ReadVec3(file, event.ball.position) && ReadVec3(file, event.ball.velocity);
+    } else if (event.type == SESSION_COMMAND) {
+      uint32_t command = 0, arm = 0;
+      ok = Read(file, command) && Read(file, arm);
+      event.command.type = static_cast<CommandType>(command);
+      event.command.arm = static_cast<ArmState>(arm);
+    } else {
+      cerr << "PhantomLimb: unknown record in " << path << ". Stopping there" << endl;
+      break;
+    }
+
+    if (!ok)
+      break;
+    events.push_back(event);
+  }
+
+  // Samples come off the sensor thread, so they may be slightly out of order with the balls
+  std::stable_sort(events.begin(), events.end(),
+    [](const SessionEvent &a, const SessionEvent &b) { return a.time < b.time; });
+
+  cout << "PhantomLimb: loaded " << events.size() << " session events from " << path << endl;
+}
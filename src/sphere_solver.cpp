@@ -0,0 +1,388 @@
+/**
+* @brief Structure of arrays sphere solver
+* @file sphere_solver.cpp
+* @author Benjamin Blundell <oni@section9.co.uk>
+* @date 19/10/2026
+*
+*/
+
+#include "sphere_solver.hpp"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+
+using namespace std;
+using namespace s9;
+
+
+// Below this many balls a contact pass is cheaper than handing it out
+static const size_t kParallelMinimum = 512;
+
+// Longest time a kinematic move is spread over, in case the sensor stalls
+static const double_t kMaxSweep = 0.1;
+
+/// The low bits pick the bucket, so the cell coordinates are mixed down into them
+static inline uint32_t CellHash(int32_t x, int32_t y, int32_t z) {
+  uint32_t h = static_cast<uint32_t>(x) * 73856093u ^ static_cast<uint32_t>(y) * 19349663u ^ static_cast<uint32_t>(z) * 83492791u;
+  h ^= h >> 16;
+  h *= 0x85ebca6bu;
+  h ^= h >> 13;
+  return h;
+}
+
+
+SphereSolver::SphereSolver(float_t hand_radius, size_t hands, float_t proxy_radius, size_t proxies,
+  const SphereSolverSettings &settings, TaskSystem tasks)
+  : obj_ (std::shared_ptr<SharedObject>(new SharedObject())) {
+
+  obj_->settings = settings;
+  obj_->tasks = tasks;
+  obj_->count = 0;
+  obj_->max_radius = 0;
+  obj_->accumulator = obj_->sim_time = 0;
+  obj_->cell_size = 1.0f;
+  obj_->buckets = 0;
+  obj_->Resize(64);
+
+  for (size_t i = 0; i < hands + proxies; ++i) {
+    Kinematic k;
+    k.from = k.to = k.position = glm::vec3(0.0f, -1.0e6f, 0.0f);
+    k.velocity = glm::vec3(0.0f);
+    k.radius = i < hands ? hand_radius : proxy_radius;
+    k.snapped = true;
+    k.elapsed = k.duration = settings.fixed_timestep;
+    k.last_change = 0;
+    obj_->kinematics.push_back(k);
+  }
+
+  // Every contact range must finish before any correction goes in, as the passes read the
+  // positions and velocities of other balls
+
+  obj_->ranges = tasks ? (tasks.threads() + 1) * 2 : 1;
+  if (tasks) {
+    obj_->graph = TaskGraph(true);
+    SharedObject *o = obj_.get();
+    size_t join = obj_->graph.Add("join", []() {});
+
+    for (size_t r = 0; r < obj_->ranges; ++r) {
+      size_t contacts = obj_->graph.Add("contacts", [o, r]() {
+        o->Contacts(o->count * r / o->ranges, o->count * (r + 1) / o->ranges);
+      });
+      size_t apply = obj_->graph.Add("apply", [o, r]() {
+        o->Apply(o->count * r / o->ranges, o->count * (r + 1) / o->ranges);
+      });
+      obj_->graph.Depend(join, contacts);
+      obj_->graph.Depend(apply, join);
+    }
+  }
+}
+
+size_t SphereSolver::Add(float_t radius, const glm::vec3 &position, const glm::vec3 &velocity) {
+  CXSHARED
+
+  size_t i = obj_->count;
+  if (i == obj_->px.size())
+    obj_->Resize(obj_->px.size() * 2);
+
+  obj_->px[i] = position.x; obj_->py[i] = position.y; obj_->pz[i] = position.z;
+  obj_->vx[i] = velocity.x; obj_->vy[i] = velocity.y; obj_->vz[i] = velocity.z;
+  obj_->radius[i] = radius;
+  obj_->touched[i] = 0;
+  obj_->max_radius = std::max(obj_->max_radius, radius);
+  obj_->count++;
+  return i;
+}
+
+void SphereSolver::Clear() {
+  CXSHARED
+  obj_->count = 0;
+  obj_->max_radius = 0;
+}
+
+void SphereSolver::MoveKinematic(size_t idx, const glm::vec3 &position, bool snap) {
+  CXSHARED
+  if (idx >= obj_->kinematics.size())
+    return;
+
+  Kinematic &k = obj_->kinematics[idx];
+  if (position == k.to)
+    return;
+
+  double_t h = obj_->settings.fixed_timestep;
+
+  if (snap || k.snapped) {
+    k.from = k.to = k.position = position;
+    k.velocity = glm::vec3(0.0f);
+    k.elapsed = k.duration = h;
+    k.snapped = snap;
+    k.last_change = obj_->sim_time;
+    return;
+  }
+
+  // Without interpolation the move still takes one substep, so a hit carries the hand's speed
+  k.from = k.position;
+  k.to = position;
+  k.duration = obj_->settings.hand_interpolation ? std::min(std::max(obj_->sim_time - k.last_change, h), kMaxSweep) : h;
+  k.elapsed = 0;
+  k.last_change = obj_->sim_time;
+}
+
+void SphereSolver::Step(double_t dt) {
+  CXSHARED
+
+  double_t h = obj_->settings.fixed_timestep;
+  obj_->accumulator += dt;
+
+  int steps = 0;
+  while (obj_->accumulator >= h && steps < obj_->settings.max_substeps) {
+    obj_->Substep(static_cast<float_t>(h));
+    obj_->accumulator -= h;
+    steps++;
+  }
+
+  // Too far behind to catch up. Drop the time rather than spiral
+  if (obj_->accumulator >= h)
+    obj_->accumulator = std::fmod(obj_->accumulator, h);
+}
+
+void SphereSolver::Transforms(std::vector<glm::mat4> &out) {
+  CXSHARED
+  out.resize(obj_->count);
+  for (size_t i = 0; i < obj_->count; ++i) {
+    out[i] = glm::mat4(1.0f);
+    out[i][3] = glm::vec4(obj_->px[i], obj_->py[i], obj_->pz[i], 1.0f);
+  }
+}
+
+
+void SphereSolver::SharedObject::Resize(size_t capacity) {
+  std::vector<float_t>* arrays[] = { &px, &py, &pz, &vx, &vy, &vz, &radius, &dpx, &dpy, &dpz, &dvx, &dvy, &dvz };
+  for (std::vector<float_t> *a : arrays)
+    a->resize(capacity, 0.0f);
+  touched.resize(capacity, 0);
+}
+
+void SphereSolver::SharedObject::Substep(float_t h) {
+  sim_time += h;
+  MoveKinematics(h);
+  Integrate(h);
+
+  if (count == 0)
+    return;
+
+  BuildGrid();
+
+  for (size_t i = 0; i < settings.iterations; ++i) {
+    if (tasks && count >= kParallelMinimum) {
+      tasks.Run(graph);
+      tasks.Wait(graph);
+    } else {
+      Contacts(0, count);
+      Apply(0, count);
+    }
+  }
+}
+
+void SphereSolver::SharedObject::MoveKinematics(float_t h) {
+  for (Kinematic &k : kinematics) {
+    if (k.elapsed >= k.duration) {
+      k.velocity = glm::vec3(0.0f);
+      continue;
+    }
+    k.elapsed += h;
+    float_t alpha = static_cast<float_t>(std::min(1.0, k.elapsed / k.duration));
+    glm::vec3 next = k.from + (k.to - k.from) * alpha;
+    k.velocity = (next - k.position) / h;
+    k.position = next;
+  }
+}
+
+/// Gravity, symplectic Euler and the top of the ground box. A ball resting on the ground
+/// loses its downward speed, bounces by the restitution and slides to a stop
+
+void SphereSolver::SharedObject::Integrate(float_t h) {
+  glm::vec3 g = settings.gravity * h;
+  float_t extent = settings.ground_size;
+  float_t bounce = -settings.restitution;
+  float_t slide = std::max(0.0f, 1.0f - settings.friction * h);
+
+  size_t i = 0;
+
+#ifdef __SSE2__
+  const __m128 h4 = _mm_set1_ps(h);
+  const __m128 gx = _mm_set1_ps(g.x), gy = _mm_set1_ps(g.y), gz = _mm_set1_ps(g.z);
+  const __m128 extent4 = _mm_set1_ps(extent);
+  const __m128 bounce4 = _mm_set1_ps(bounce);
+  const __m128 slide4 = _mm_set1_ps(slide);
+  const __m128 zero = _mm_setzero_ps();
+  const __m128 magnitude = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+
+  for (; i + 4 <= count; i += 4) {
+    __m128 x = _mm_loadu_ps(&px[i]), y = _mm_loadu_ps(&py[i]), z = _mm_loadu_ps(&pz[i]);
+    __m128 u = _mm_add_ps(_mm_loadu_ps(&vx[i]), gx);
+    __m128 v = _mm_add_ps(_mm_loadu_ps(&vy[i]), gy);
+    __m128 w = _mm_add_ps(_mm_loadu_ps(&vz[i]), gz);
+    __m128 r = _mm_loadu_ps(&radius[i]);
+
+    x = _mm_add_ps(x, _mm_mul_ps(u, h4));
+    y = _mm_add_ps(y, _mm_mul_ps(v, h4));
+    z = _mm_add_ps(z, _mm_mul_ps(w, h4));
+
+    __m128 over = _mm_and_ps(_mm_cmplt_ps(_mm_and_ps(x, magnitude), extent4), _mm_cmplt_ps(_mm_and_ps(z, magnitude), extent4));
+    __m128 ground = _mm_and_ps(over, _mm_cmplt_ps(y, r));
+    __m128 falling = _mm_and_ps(ground, _mm_cmplt_ps(v, zero));
+
+    y = _mm_or_ps(_mm_and_ps(ground, r), _mm_andnot_ps(ground, y));
+    v = _mm_or_ps(_mm_and_ps(falling, _mm_mul_ps(v, bounce4)), _mm_andnot_ps(falling, v));
+    u = _mm_or_ps(_mm_and_ps(ground, _mm_mul_ps(u, slide4)), _mm_andnot_ps(ground, u));
+    w = _mm_or_ps(_mm_and_ps(ground, _mm_mul_ps(w, slide4)), _mm_andnot_ps(ground, w));
+
+    _mm_storeu_ps(&px[i], x); _mm_storeu_ps(&py[i], y); _mm_storeu_ps(&pz[i], z);
+    _mm_storeu_ps(&vx[i], u); _mm_storeu_ps(&vy[i], v); _mm_storeu_ps(&vz[i], w);
+  }
+#endif
+
+  for (; i < count; ++i) {
+    vx[i] += g.x; vy[i] += g.y; vz[i] += g.z;
+    px[i] += vx[i] * h; py[i] += vy[i] * h; pz[i] += vz[i] * h;
+
+    if (std::fabs(px[i]) < extent && std::fabs(pz[i]) < extent && py[i] < radius[i]) {
+      py[i] = radius[i];
+      if (vy[i] < 0)
+        vy[i] *= bounce;
+      vx[i] *= slide;
+      vz[i] *= slide;
+    }
+  }
+}
+
+/// Counting sort of balls and kinematics into hashed cells big enough that any two spheres
+/// touching sit in neighbouring cells. Kinematics outside the balls' bounds are left out
+
+void SphereSolver::SharedObject::BuildGrid() {
+  float_t largest = max_radius;
+  for (Kinematic &k : kinematics)
+    largest = std::max(largest, k.radius);
+  cell_size = std::max(max_radius + largest, 1.0e-3f);
+  float_t inverse = 1.0f / cell_size;
+
+  glm::vec3 low(px[0], py[0], pz[0]), high = low;
+  for (size_t i = 1; i < count; ++i) {
+    low = glm::min(low, glm::vec3(px[i], py[i], pz[i]));
+    high = glm::max(high, glm::vec3(px[i], py[i], pz[i]));
+  }
+  low -= glm::vec3(cell_size);
+  high += glm::vec3(cell_size);
+
+  size_t total = count + kinematics.size();
+  buckets = 64;
+  while (buckets < total * 2)
+    buckets *= 2;
+
+  bucket_start.assign(buckets + 1, 0);
+  cells.resize(total * 3);
+  entry_bucket.resize(total);
+
+  for (size_t e = 0; e < total; ++e) {
+    glm::vec3 p = e < count ? glm::vec3(px[e], py[e], pz[e]) : kinematics[e - count].position;
+    if (e >= count && (glm::any(glm::lessThan(p, low)) || glm::any(glm::greaterThan(p, high)))) {
+      entry_bucket[e] = static_cast<uint32_t>(buckets);
+      continue;
+    }
+
+    int32_t x = static_cast<int32_t>(std::floor(p.x * inverse));
+    int32_t y = static_cast<int32_t>(std::floor(p.y * inverse));
+    int32_t z = static_cast<int32_t>(std::floor(p.z * inverse));
+    cells[e * 3] = x; cells[e * 3 + 1] = y; cells[e * 3 + 2] = z;
+
+    uint32_t bucket = CellHash(x, y, z) & (buckets - 1);
+    entry_bucket[e] = bucket;
+    bucket_start[bucket + 1]++;
+  }
+
+  for (size_t b = 0; b < buckets; ++b)
+    bucket_start[b + 1] += bucket_start[b];
+
+  entries.resize(bucket_start[buckets]);
+  std::vector<uint32_t> next(bucket_start.begin(), bucket_start.end() - 1);
+  for (size_t e = 0; e < total; ++e) {
+    if (entry_bucket[e] < buckets)
+      entries[next[entry_bucket[e]]++] = static_cast<uint32_t>(e);
+  }
+}
+
+/// Reads everything, writes only the corrections for balls in range. Two balls share a
+/// contact evenly, as they all weigh the same. Kinematics push back the whole way
+
+void SphereSolver::SharedObject::Contacts(size_t begin, size_t end) {
+  float_t response = 1.0f + settings.restitution;
+
+  for (size_t i = begin; i < end; ++i) {
+    glm::vec3 p(px[i], py[i], pz[i]);
+    glm::vec3 v(vx[i], vy[i], vz[i]);
+    glm::vec3 dp(0.0f), dv(0.0f);
+    int32_t cx = cells[i * 3], cy = cells[i * 3 + 1], cz = cells[i * 3 + 2];
+
+    for (int32_t z = cz - 1; z <= cz + 1; ++z) {
+      for (int32_t y = cy - 1; y <= cy + 1; ++y) {
+        for (int32_t x = cx - 1; x <= cx + 1; ++x) {
+          uint32_t bucket = CellHash(x, y, z) & (buckets - 1);
+
+          for (uint32_t n = bucket_start[bucket]; n < bucket_start[bucket + 1]; ++n) {
+            uint32_t e = entries[n];
+            if (e == i || cells[e * 3] != x || cells[e * 3 + 1] != y || cells[e * 3 + 2] != z)
+              continue;
+
+            bool ball = e < count;
+            glm::vec3 q = ball ? glm::vec3(px[e], py[e], pz[e]) : kinematics[e - count].position;
+            float_t reach = radius[i] + (ball ? radius[e] : kinematics[e - count].radius);
+
+            glm::vec3 d = p - q;
+            float_t distance2 = glm::dot(d, d);
+            if (distance2 >= reach * reach)
+              continue;
+
+            float_t distance = std::sqrt(distance2);
+            glm::vec3 normal = distance > 1.0e-6f ? d / distance : glm::vec3(0.0f, 1.0f, 0.0f);
+            float_t share = ball ? 0.5f : 1.0f;
+
+            dp += normal * ((reach - distance) * share);
+
+            glm::vec3 other = ball ? glm::vec3(vx[e], vy[e], vz[e]) : kinematics[e - count].velocity;
+            float_t closing = glm::dot(v - other, normal);
+            if (closing < 0)
+              dv -= normal * (closing * response * share);
+
+            if (!ball)
+              touched[i] = 1;
+          }
+        }
+      }
+    }
+
+    dpx[i] = dp.x; dpy[i] = dp.y; dpz[i] = dp.z;
+    dvx[i] = dv.x; dvy[i] = dv.y; dvz[i] = dv.z;
+  }
+}
+
+void SphereSolver::SharedObject::Apply(size_t begin, size_t end) {
+  size_t i = begin;
+
+#ifdef __SSE2__
+  for (; i + 4 <= end; i += 4) {
+    _mm_storeu_ps(&px[i], _mm_add_ps(_mm_loadu_ps(&px[i]), _mm_loadu_ps(&dpx[i])));
+    _mm_storeu_ps(&py[i], _mm_add_ps(_mm_loadu_ps(&py[i]), _mm_loadu_ps(&dpy[i])));
+    _mm_storeu_ps(&pz[i], _mm_add_ps(_mm_loadu_ps(&pz[i]), _mm_loadu_ps(&dpz[i])));
+    _mm_storeu_ps(&vx[i], _mm_add_ps(_mm_loadu_ps(&vx[i]), _mm_loadu_ps(&dvx[i])));
+    _mm_storeu_ps(&vy[i], _mm_add_ps(_mm_loadu_ps(&vy[i]), _mm_loadu_ps(&dvy[i])));
+    _mm_storeu_ps(&vz[i], _mm_add_ps(_mm_loadu_ps(&vz[i]), _mm_loadu_ps(&dvz[i])));
+  }
+#endif
+
+  for (; i < end; ++i) {
+    px[i] += dpx[i]; py[i] += dpy[i]; pz[i] += dpz[i];
+    vx[i] += dvx[i]; vy[i] += dvy[i]; vz[i] += dvz[i];
+  }
+}
@@ -0,0 +1,579 @@
+/**
+* @brief CPU stereo block matching with a coarse to fine pyramid
+* @file stereo.cpp
+* @author Benjamin Blundell <oni@section9.co.uk>
+* @date 19/10/2026
+*
+*/
+
+#include "stereo.hpp"
+
+#include <algorithm>
+#include <climits>
+#include <fstream>
+#include <limits>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+
+using namespace std;
+using namespace s9;
+
+
+// Blocks are this wide, from x - 3 to x + 4, so one row fits a single 64 bit SAD
+static const size_t kBlockWidth = 8;
+static const size_t kBlockLeft = 3;
+
+// How far either side of the coarse guess each finer level searches
+static const size_t kRefineRange = 2;
+
+// Levels smaller than this are not worth matching
+static const size_t kMinLevelSize = 16;
+
+
+// Sum of absolute differences over an 8 wide block, one row per SAD instruction
+
+static inline uint32_t CostSAD(const uint8_t *l, const uint8_t *r, size_t stride, size_t rows) {
+#ifdef __SSE2__
+  __m128i acc = _mm_setzero_si128();
+  for (size_t i = 0; i < rows; ++i) {
+    __m128i a = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(l + i * stride));
+    __m128i b = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(r + i * stride));
+    acc = _mm_add_epi32(acc, _mm_sad_epu8(a, b));
+  }
+  return static_cast<uint32_t>(_mm_cvtsi128_si32(acc));
+#else
+  uint32_t acc = 0;
+  for (size_t i = 0; i < rows; ++i) {
+    for (size_t j = 0; j < kBlockWidth; ++j)
+      acc += static_cast<uint32_t>(std::abs(static_cast<int>(l[i * stride + j]) - static_cast<int>(r[i * stride + j])));
+  }
+  return acc;
+#endif
+}
+
+// Hamming distance between census codes over the same block. SSE2 has no popcount, so
+// each row of eight codes is counted a byte at a time and summed with a SAD against zero
+
+static inline uint32_t CostCensus(const uint32_t *l, const uint32_t *r, size_t stride, size_t rows) {
+#ifdef __SSE2__
+  const __m128i m1 = _mm_set1_epi8(0x55);
+  const __m128i m2 = _mm_set1_epi8(0x33);
+  const __m128i m4 = _mm_set1_epi8(0x0f);
+  const __m128i zero = _mm_setzero_si128();
+  __m128i acc = zero;
+
+  for (size_t i = 0; i < rows; ++i) {
+    const __m128i *lp = reinterpret_cast<const __m128i*>(l + i * stride);
+    const __m128i *rp = reinterpret_cast<const __m128i*>(r + i * stride);
+    __m128i a = _mm_xor_si128(_mm_loadu_si128(lp), _mm_loadu_si128(rp));
+    __m128i b = _mm_xor_si128(_mm_loadu_si128(lp + 1), _mm_loadu_si128(rp + 1));
+
+    a = _mm_sub_epi8(a, _mm_and_si128(_mm_srli_epi16(a, 1), m1));
+    b = _mm_sub_epi8(b, _mm_and_si128(_mm_srli_epi16(b, 1), m1));
+    a = _mm_add_epi8(_mm_and_si128(a, m2), _mm_and_si128(_mm_srli_epi16(a, 2), m2));
+    b = _mm_add_epi8(_mm_and_si128(b, m2), _mm_and_si128(_mm_srli_epi16(b, 2), m2));
+    a = _mm_and_si128(_mm_add_epi8(a, _mm_srli_epi16(a, 4)), m4);
+    b = _mm_and_si128(_mm_add_epi8(b, _mm_srli_epi16(b, 4)), m4);
+
+    acc = _mm_add_epi32(acc, _mm_sad_epu8(_mm_add_epi8(a, b), zero));
+  }
+  return static_cast<uint32_t>(_mm_cvtsi128_si32(acc) + _mm_cvtsi128_si32(_mm_unpackhi_epi64(acc, acc)));
+#else
+  uint32_t acc = 0;
+  for (size_t i = 0; i < rows; ++i) {
+    for (size_t j = 0; j < kBlockWidth; ++j)
+      acc += static_cast<uint32_t>(__builtin_popcount(l[i * stride + j] ^ r[i * stride + j]));
+  }
+  return acc;
+#endif
+}
+
+// 5x5 census - one bit per neighbour, set if it is darker than the centre
+
+static void CensusRows(const std::vector<uint8_t> &image, std::vector<uint32_t> &codes, size_t width, size_t height,
+  size_t y0, size_t y1) {
+
+  for (size_t y = y0; y < y1; ++y) {
+    uint32_t *out = &codes[y * width];
+    if (y < 2 || y + 2 >= height) {
+      std::fill(out, out + width, 0);
+      continue;
+    }
+
+    for (size_t x = 0; x < width; ++x) {
+      if (x < 2 || x + 2 >= width) {
+        out[x] = 0;
+        continue;
+      }
+
+      uint8_t centre = image[y * width + x];
+      uint32_t code = 0;
+      for (size_t j = y - 2; j <= y + 2; ++j) {
+        const uint8_t *row = &image[j * width];
+        for (size_t i = x - 2; i <= x + 2; ++i) {
+          if (i == x && j == y)
+            continue;
+          code = (code << 1) | (row[i] < centre ? 1 : 0);
+        }
+      }
+      out[x] = code;
+    }
+  }
+}
+
+
+StereoMatcher::StereoMatcher(const StereoSettings &settings)
+  : obj_ (std::shared_ptr<SharedObject>(new SharedObject(settings))) {
+
+}
+
+void StereoMatcher::Match(const StereoPair &pair) {
+  CXSHARED
+  obj_->Match(pair);
+}
+
+void StereoMatcher::ToDepth(DepthFrame &frame) {
+  CXSHARED
+  obj_->ToDepth(frame);
+}
+
+/// Throughput at a few disparity ranges, so settings can be picked for the host we are on
+
+void StereoMatcher::Benchmark(const StereoPair &pair) {
+  CXSHARED
+
+  const size_t kRanges[] = {16, 32, 64, 128};
+  const size_t kRuns = 5;
+  size_t original = obj_->settings.max_disparity;
+
+  for (size_t range : kRanges) {
+    obj_->settings.max_disparity = range;
+    obj_->Match(pair);
+
+    double_t start = NowSeconds();
+    for (size_t i = 0; i < kRuns; ++i)
+      obj_->Match(pair);
+    double_t cost = (NowSeconds() - start) / kRuns;
+
+    cout << "StereoMatcher: " << pair.width << "x" << pair.height
+      << " disparities " << range
+      << " levels " << obj_->levels.size()
+      << (obj_->settings.cost == STEREO_CENSUS ? " census " : " sad ")
+      << (pair.width * pair.height) / cost / 1.0e6 << " MP/s"
+      << " (" << cost * 1000.0 << "ms)" << endl;
+  }
+
+  obj_->settings.max_disparity = original;
+}
+
+void StereoMatcher::Start() {
+  CXSHARED
+  if (obj_->running.load())
+    return;
+
+  obj_->running.store(true);
+  obj_->thread = std::thread(&SharedObject::Run, obj_.get());
+}
+
+void StereoMatcher::Stop() {
+  CXSHARED
+  {
+    std::lock_guard<std::mutex> lock(obj_->pair_mutex);
+    obj_->running.store(false);
+  }
+  obj_->pair_ready.notify_one();
+  if (obj_->thread.joinable())
+    obj_->thread.join();
+}
+
+void StereoMatcher::Submit(StereoPair &pair) {
+  CXSHARED
+  {
+    std::lock_guard<std::mutex> lock(obj_->pair_mutex);
+    std::swap(obj_->pending, pair);
+    obj_->has_pending = true;
+  }
+  obj_->pair_ready.notify_one();
+}
+
+// Binary PGM only - P5 with 8 bit samples
+
+static bool LoadPGM(const std::string &path, std::vector<uint8_t> &pixels, size_t &width, size_t &height) {
+  std::ifstream file(path.c_str(), std::ios::binary);
+  if (!file.is_open())
+    return false;
+
+  std::string magic;
+  file >> magic;
+  if (magic != "P5")
+    return false;
+
+  size_t values[3];
+  for (size_t i = 0; i < 3; ++i) {
+    file >> std::ws;
+    while (file.peek() == '#')
+      file.ignore(std::numeric_limits<std::streamsize>::max(), '\n') >> std::ws;
+    file >> values[i];
+  }
+  file.get();
+
+  if (!file || values[2] > 255)
+    return false;
+
+  width = values[0];
+  height = values[1];
+  pixels.resize(width * height);
+  file.read(reinterpret_cast<char*>(&pixels[0]), pixels.size());
+  return static_cast<bool>(file);
+}
+
+bool StereoMatcher::LoadPair(const std::string &left, const std::string &right, StereoPair &pair) {
+  size_t lw = 0, lh = 0, rw = 0, rh = 0;
+  if (!LoadPGM(left, pair.left, lw, lh) || !LoadPGM(right, pair.right, rw, rh)) {
+    cerr << "StereoMatcher: could not load " << left << " and " << right << endl;
+    return false;
+  }
+
+  if (lw != rw || lh != rh) {
+    cerr << "StereoMatcher: " << left << " and " << right << " are different sizes" << endl;
+    return false;
+  }
+
+  pair.width = lw;
+  pair.height = lh;
+  return true;
+}
+
+
+StereoMatcher::SharedObject::SharedObject(const StereoSettings &settings)
+  : settings(settings), pool(settings.threads), has_pending(false), running(false),
+  frames(0), last_cost(0), mpps(0) {
+
+}
+
+StereoMatcher::SharedObject::~SharedObject() {
+  {
+    std::lock_guard<std::mutex> lock(pair_mutex);
+    running.store(false);
+  }
+  pair_ready.notify_one();
+  if (thread.joinable())
+    thread.join();
+}
+
+// Buffers are only reallocated when the image size changes
+
+void StereoMatcher::SharedObject::Resize(size_t width, size_t height) {
+  if (!levels.empty() && levels[0].width == width && levels[0].height == height)
+    return;
+
+  levels.clear();
+  size_t w = width, h = height;
+  for (size_t i = 0; i < std::max<size_t>(1, settings.levels); ++i) {
+    if (i > 0 && (w < kMinLevelSize || h < kMinLevelSize))
+      break;
+
+    Level level;
+    level.width = w;
+    level.height = h;
+    level.left.resize(w * h);
+    level.right.resize(w * h);
+    level.disparity.resize(w * h);
+    if (settings.cost == STEREO_CENSUS) {
+      level.census_left.resize(w * h);
+      level.census_right.resize(w * h);
+    }
+    levels.push_back(level);
+
+    w /= 2;
+    h /= 2;
+  }
+
+  disparity.assign(width * height, 0.0f);
+}
+
+// Each level is a 2x2 box filter of the one below
+
+void StereoMatcher::SharedObject::BuildPyramid(const StereoPair &pair) {
+
+  levels[0].left = pair.left;
+  levels[0].right = pair.right;
+
+  for (size_t l = 1; l < levels.size(); ++l) {
+    const Level &src = levels[l - 1];
+    Level &dst = levels[l];
+
+    pool.Run(dst.height, [&](size_t y0, size_t y1) {
+      for (size_t y = y0; y < y1; ++y) {
+        const uint8_t *la = &src.left[(y * 2) * src.width];
+        const uint8_t *lb = la + src.width;
+        const uint8_t *ra = &src.right[(y * 2) * src.width];
+        const uint8_t *rb = ra + src.width;
+        for (size_t x = 0; x < dst.width; ++x) {
+          size_t i = x * 2;
+          dst.left[y * dst.width + x] = static_cast<uint8_t>((la[i] + la[i + 1] + lb[i] + lb[i + 1] + 2) >> 2);
+          dst.right[y * dst.width + x] = static_cast<uint8_t>((ra[i] + ra[i + 1] + rb[i] + rb[i + 1] + 2) >> 2);
+        }
+      }
+    });
+  }
+
+  if (settings.cost == STEREO_CENSUS) {
+    for (Level &level : levels) {
+      pool.Run(level.height, [&](size_t y0, size_t y1) {
+        CensusRows(level.left, level.census_left, level.width, level.height, y0, y1);
+        CensusRows(level.right, level.census_right, level.width, level.height, y0, y1);
+      });
+    }
+  }
+}
+
+// Match one band of rows on one level. The coarsest level searches every disparity, the
+// rest only search around twice the disparity found at the same spot one level up.
+// Zero is used for no match throughout, as a disparity of zero is out of range anyway
+
+void StereoMatcher::SharedObject::MatchRows(size_t l, size_t y0, size_t y1) {
+
+  Level &level = levels[l];
+  const size_t w = level.width;
+  const size_t h = level.height;
+  const size_t r = settings.block_radius;
+  const size_t rows = r * 2 + 1;
+  const bool top = l + 1 == levels.size();
+  const bool census = settings.cost == STEREO_CENSUS;
+  const size_t dmax = std::min<size_t>(255, settings.max_disparity >> l);
+
+  uint32_t costs[256];
+
+  for (size_t y = y0; y < y1; ++y) {
+    uint8_t *out = &level.disparity[y * w];
+    float_t *out_full = l == 0 ? &disparity[y * w] : nullptr;
+
+    if (y < r || y + r >= h) {
+      std::fill(out, out + w, 0);
+      if (out_full != nullptr)
+        std::fill(out_full, out_full + w, 0.0f);
+      continue;
+    }
+
+    size_t block_row = (y - r) * w;
+
+    for (size_t x = 0; x < w; ++x) {
+      out[x] = 0;
+      if (out_full != nullptr)
+        out_full[x] = 0.0f;
+
+      if (x < kBlockLeft || x + kBlockWidth - kBlockLeft > w)
+        continue;
+
+      size_t lo = 0;
+      size_t hi = std::min(dmax, x - kBlockLeft);
+
+      if (!top) {
+        const Level &coarse = levels[l + 1];
+        size_t cx = std::min(x / 2, coarse.width - 1);
+        size_t cy = std::min(y / 2, coarse.height - 1);
+        size_t guess = coarse.disparity[cy * coarse.width + cx] * 2;
+        if (guess == 0)
+          continue;
+        lo = guess > kRefineRange ? guess - kRefineRange : 1;
+        hi = std::min(hi, guess + kRefineRange);
+      }
+
+      if (lo > hi)
+        continue;
+
+      size_t base = block_row + x - kBlockLeft;
+      uint32_t best = UINT_MAX;
+      size_t best_d = lo;
+
+      for (size_t d = lo; d <= hi; ++d) {
+        uint32_t cost = census ?
+          CostCensus(&level.census_left[base], &level.census_right[base - d], w, rows) :
+          CostSAD(&level.left[base], &level.right[base - d], w, rows);
+        costs[d - lo] = cost;
+        if (cost < best) {
+          best = cost;
+          best_d = d;
+        }
+      }
+
+      // Ambiguous if anything not next to the winner comes close
+      uint32_t second = UINT_MAX;
+      for (size_t d = lo; d <= hi; ++d) {
+        if (d + 1 < best_d || d > best_d + 1)
+          second = std::min(second, costs[d - lo]);
+      }
+      if (second != UINT_MAX && best > second * settings.uniqueness)
+        continue;
+
+      if (best_d == 0)
+        continue;
+
+      out[x] = static_cast<uint8_t>(best_d);
+
+      // Sub pixel at full resolution from a parabola through the neighbouring costs
+      if (out_full != nullptr) {
+        float_t sub = static_cast<float_t>(best_d);
+        if (best_d > lo && best_d < hi) {
+          float_t c0 = static_cast<float_t>(costs[best_d - 1 - lo]);
+          float_t c1 = static_cast<float_t>(costs[best_d - lo]);
+          float_t c2 = static_cast<float_t>(costs[best_d + 1 - lo]);
+          float_t denom = c0 - 2.0f * c1 + c2;
+          if (denom > 0)
+            sub += 0.5f * (c0 - c2) / denom;
+        }
+        out_full[x] = sub;
+      }
+    }
+  }
+}
+
+void StereoMatcher::SharedObject::Match(const StereoPair &pair) {
+
+  if (pair.width == 0 || pair.height == 0)
+    return;
+
+  double_t start = NowSeconds();
+
+  Resize(pair.width, pair.height);
+  BuildPyramid(pair);
+
+  for (size_t l = levels.size(); l > 0; --l) {
+    pool.Run(levels[l - 1].height, [this, l](size_t y0, size_t y1) { MatchRows(l - 1, y0, y1); });
+  }
+
+  double_t cost = NowSeconds() - start;
+  last_cost.store(cost);
+  mpps.store(cost > 0 ? (pair.width * pair.height) / cost / 1.0e6 : 0);
+  frames++;
+}
+
+void StereoMatcher::SharedObject::ToDepth(DepthFrame &frame) {
+
+  if (levels.empty())
+    return;
+
+  frame.width = levels[0].width;
+  frame.height = levels[0].height;
+  frame.timestamp = NowSeconds();
+  frame.depth.resize(frame.width * frame.height);
+
+  const float_t fb = settings.focal_length * settings.baseline * 1000.0f;
+
+  for (size_t i = 0; i < disparity.size(); ++i) {
+    float_t d = disparity[i];
+    frame.depth[i] = d > 0 ? static_cast<uint16_t>(std::min(fb / d, 65535.0f)) : 0;
+  }
+}
+
+// The depth source worker. Each new pair becomes one depth frame for the colliders and overlay
+
+void StereoMatcher::SharedObject::Run() {
+
+  while (running.load()) {
+    {
+      std::unique_lock<std::mutex> lock(pair_mutex);
+      pair_ready.wait(lock, [this]{ return has_pending || !running.load(); });
+      if (!running.load())
+        break;
+      std::swap(pending, working);
+      has_pending = false;
+    }
+
+    Match(working);
+
+    if (!depth_colliders && !depth_feed)
+      continue;
+
+    ToDepth(depth_frame);
+
+    if (depth_feed)
+      depth_feed.Submit(&depth_frame.depth[0], depth_frame.width, depth_frame.height);
+    if (depth_colliders)
+      depth_colliders.Submit(depth_frame);
+  }
+}
+
+
+StereoMatcher::RowPool::RowPool(size_t threads) : job_(nullptr), rows_(0), chunk_(1), next_(0),
+  active_(0), generation_(0), running_(true) {
+
+  size_t count = threads > 0 ? threads : std::max<size_t>(1, std::thread::hardware_concurrency());
+
+  // The calling thread always takes a share, so it counts as one of them
+  for (size_t i = 1; i < count; ++i)
+    workers_.push_back(std::thread(&RowPool::Work, this));
+}
+
+StereoMatcher::RowPool::~RowPool() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    running_ = false;
+  }
+  wake_.notify_all();
+  for (std::thread &worker : workers_)
+    worker.join();
+}
+
+// Chunks are small enough that a slow core does not hold everyone up at the end
+
+void StereoMatcher::RowPool::Run(size_t rows, const std::function<void(size_t, size_t)> &fn) {
+
+  if (workers_.empty()) {
+    fn(0, rows);
+    return;
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    job_ = &fn;
+    rows_ = rows;
+    chunk_ = std::max<size_t>(1, rows / ((workers_.size() + 1) * 4));
+    next_.store(0);
+    active_ = workers_.size();
+    generation_++;
+  }
+  wake_.notify_all();
+
+  Drain();
+
+  std::unique_lock<std::mutex> lock(mutex_);
+  done_.wait(lock, [this]{ return active_ == 0; });
+  job_ = nullptr;
+}
+
+void StereoMatcher::RowPool::Work() {
+
+  size_t seen = 0;
+
+  while (true) {
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      wake_.wait(lock, [this, seen]{ return !running_ || generation_ != seen; });
+      if (!running_)
+        return;
+      seen = generation_;
+    }
+
+    Drain();
+
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (--active_ == 0)
+        done_.notify_one();
+    }
+  }
+}
+
+void StereoMatcher::RowPool::Drain() {
+  while (true) {
+    size_t y0 = next_.fetch_add(chunk_);
+    if (y0 >= rows_)
+      break;
+    (*job_)(y0, std::min(rows_, y0 + chunk_));
+  }
+}
@@ -0,0 +1,186 @@
+/**
+* @brief Work stealing task system
+* @file task_system.cpp
+* @author Benjamin Blundell <oni@section9.co.uk>
+* @date 19/10/2026
+*
+*/
+
+#include "task_system.hpp"
+
+
+using namespace std;
+using namespace s9;
+
+
+// Which queue the current thread owns. Threads outside the system push round robin
+static thread_local int tQueue = -1;
+
+
+TaskGraph::TaskGraph(bool create) {
+  if (create) {
+    obj_ = std::shared_ptr<SharedObject>(new SharedObject());
+    obj_->remaining.store(0);
+  }
+}
+
+size_t TaskGraph::Add(const std::string &name, std::function<void()> fn) {
+  CXSHARED
+  std::unique_ptr<Task> task(new Task());
+  task->name = name;
+  task->fn = fn;
+  task->dependencies = 0;
+  task->pending.store(0);
+  task->time = 0;
+  task->graph = obj_.get();
+  obj_->tasks.push_back(std::move(task));
+  return obj_->tasks.size() - 1;
+}
+
+void TaskGraph::Depend(size_t task, size_t after) {
+  CXSHARED
+  obj_->tasks[after]->dependents.push_back(obj_->tasks[task].get());
+  obj_->tasks[task]->dependencies++;
+}
+
+
+TaskSystem::TaskSystem(size_t threads)
+  : obj_ (std::shared_ptr<SharedObject>(new SharedObject(threads))) {
+
+}
+
+void TaskSystem::Run(TaskGraph &graph) {
+  CXSHARED
+
+  TaskGraph::SharedObject &g = *graph.obj_;
+  g.remaining.store(g.tasks.size());
+
+  for (auto &task : g.tasks)
+    task->pending.store(task->dependencies);
+
+  for (auto &task : g.tasks) {
+    if (task->dependencies == 0)
+      obj_->Push(task.get());
+  }
+}
+
+void TaskSystem::Wait(TaskGraph &graph) {
+  CXSHARED
+
+  size_t start = obj_->next_queue.load();
+  while (!graph.done()) {
+    Task *task = nullptr;
+    for (size_t i = 0; i < obj_->queues.size() && task == nullptr; ++i)
+      task = obj_->Take((start + i) % obj_->queues.size());
+
+    if (task != nullptr)
+      obj_->Execute(task);
+    else
+      std::this_thread::yield();
+  }
+}
+
+void TaskSystem::Stop() {
+  CXSHARED
+  obj_->Stop();
+}
+
+
+TaskSystem::SharedObject::SharedObject(size_t threads) : ready(0), next_queue(0), running(true), busy_ns(0) {
+
+  if (threads == 0) {
+    size_t cores = std::thread::hardware_concurrency();
+    threads = cores > 1 ? cores - 1 : 1;
+  }
+
+  for (size_t i = 0; i < threads; ++i)
+    queues.push_back(std::unique_ptr<Queue>(new Queue()));
+
+  for (size_t i = 0; i < threads; ++i)
+    workers.push_back(std::thread(&SharedObject::Work, this, i));
+}
+
+TaskSystem::SharedObject::~SharedObject() {
+  Stop();
+}
+
+void TaskSystem::SharedObject::Stop() {
+  {
+    std::lock_guard<std::mutex> lock(sleep_mutex);
+    running.store(false);
+  }
+  wake.notify_all();
+
+  for (std::thread &worker : workers) {
+    if (worker.joinable())
+      worker.join();
+  }
+}
+
+void TaskSystem::SharedObject::Push(Task *task) {
+  size_t index = tQueue >= 0 ? static_cast<size_t>(tQueue) : next_queue.fetch_add(1) % queues.size();
+  {
+    std::lock_guard<std::mutex> lock(queues[index]->mutex);
+    queues[index]->tasks.push_back(task);
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(sleep_mutex);
+    ready.fetch_add(1);
+  }
+  wake.notify_one();
+}
+
+// The owner works from the back, where its newest and cache warm tasks are. Everyone else
+// steals from the front
+
+TaskSystem::Task* TaskSystem::SharedObject::Take(size_t index) {
+  Queue &queue = *queues[index];
+  std::lock_guard<std::mutex> lock(queue.mutex);
+  if (queue.tasks.empty())
+    return nullptr;
+
+  Task *task;
+  if (tQueue == static_cast<int>(index)) {
+    task = queue.tasks.back();
+    queue.tasks.pop_back();
+  } else {
+    task = queue.tasks.front();
+    queue.tasks.pop_front();
+  }
+  ready.fetch_sub(1);
+  return task;
+}
+
+void TaskSystem::SharedObject::Execute(Task *task) {
+  double_t start = NowSeconds();
+  task->fn();
+  task->time = NowSeconds() - start;
+  busy_ns.fetch_add(static_cast<uint64_t>(task->time * 1.0e9));
+
+  for (Task *dependent : task->dependents) {
+    if (dependent->pending.fetch_sub(1) == 1)
+      Push(dependent);
+  }
+
+  // Last, so a waiter that sees the graph done also sees every task's results
+  task->graph->remaining.fetch_sub(1);
+}
+
+void TaskSystem::SharedObject::Work(size_t index) {
+  tQueue = static_cast<int>(index);
+
+  while (running.load()) {
+    Task *task = Take(index);
+    for (size_t i = 1; i < queues.size() && task == nullptr; ++i)
+      task = Take((index + i) % queues.size());
+
+    if (task != nullptr) {
+      Execute(task);
+      continue;
+    }
+
+    std::unique_lock<std::mutex> lock(sleep_mutex);
+    wake.wait(lock, [this] { return ready.load() > 0 || !running.load(); });
+  }
+}
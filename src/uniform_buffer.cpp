@@ -0,0 +1,46 @@
+/**
+* @brief Uniform buffer block bindings
+* @file uniform_buffer.cpp
+* @author Benjamin Blundell <oni@section9.co.uk>
+* @date 19/10/2026
+*
+*/
+
+#include "uniform_buffer.hpp"
+
+
+using namespace std;
+using namespace s9;
+
+
+static const struct {
+  const char*     name;
+  UniformBinding  binding;
+} kBlocks[] = {
+  {"PhantomEyes", UNIFORM_BINDING_EYES},
+  {"PhantomPass", UNIFORM_BINDING_PASS},
+  {"PhantomWarp", UNIFORM_BINDING_WARP},
+  {"PhantomBalls", UNIFORM_BINDING_BALLS}
+};
+
+// GLSL 3.30 cannot give a block its binding in the source, so it is set here once per
+// program. The program is whichever one the shader leaves current once bound
+
+void s9::ResolveUniformBlocks(gl::Shader &shader) {
+
+  shader.Bind();
+
+  GLint program = 0;
+  glGetIntegerv(GL_CURRENT_PROGRAM, &program);
+  ResolveUniformBlocks(static_cast<GLuint>(program));
+
+  shader.Unbind();
+}
+
+void s9::ResolveUniformBlocks(GLuint program) {
+  for (size_t i = 0; i < sizeof(kBlocks) / sizeof(kBlocks[0]); ++i) {
+    GLuint index = glGetUniformBlockIndex(program, kBlocks[i].name);
+    if (index != GL_INVALID_INDEX)
+      glUniformBlockBinding(program, index, kBlocks[i].binding);
+  }
+}
@@ -0,0 +1,295 @@
+/**
+* @brief Operator console window
+* @file ux_window.cpp
+* @author Benjamin Blundell <oni@section9.co.uk>
+* @date 19/10/2026
+*
+*/
+
+#include "ux_window.hpp"
+
+#ifdef _SEBURO_LINUX
+
+
+using namespace std;
+using namespace s9;
+
+
+UXWindow::UXWindow(ConsoleChannel channel, std::function<void()> quit) : channel_(channel), quit_(quit),
+  last_heartbeat_(0), last_beat_time_(0) {
+
+  // Our own copy of the live settings, as the render process last published them. Every
+  // change goes back as a fresh snapshot
+  game_settings_ = channel_.settings();
+  latest_ = TelemetrySample();
+
+  if (!channel_.AttachReader())
+    cerr << "PhantomLimb: another console is reading telemetry. This window only sends commands" << endl;
+
+  frame_times_ = Histogram(0.0, 50.0, 25);
+  missed_ = Histogram(0.0, 5.0, 5);
+  input_to_swap_ = Histogram(0.0, 50.0, 25);
+
+  //Glib::RefPtr< Screen > screen =  Gdk::Screen::get_default();
+  //Glib::RefPtr<Display> display = screen->get_display();
+
+  maximize();
+  fullscreen();
+
+  // Sets the border width of the window.
+  set_border_width(10);
+
+  // When the button receives the "clicked" signal, it will call the
+  // on_button_clicked() method defined below.
+  button_fire_ = new Gtk::Button("Fire Ball");
+  button_fire_->signal_clicked().connect(sigc::mem_fun(*this, &UXWindow::on_button_fire_clicked));
+  button_fire_->set_hexpand(true);
+  button_fire_->set_vexpand(true);
+
+
+  button_reset_ = new Gtk::Button("Reset Game");
+  button_reset_->signal_clicked().connect(sigc::mem_fun(*this, &UXWindow::on_button_reset_clicked));
+  button_reset_->set_hexpand(true);
+  button_reset_->set_vexpand(true);
+
+  button_auto_game_ = new Gtk::Button("Auto Game Start / Stop");
+  button_auto_game_->signal_clicked().connect(sigc::mem_fun(*this, &UXWindow::on_button_auto_game_clicked));
+  button_auto_game_->set_hexpand(true);
+  button_auto_game_->set_vexpand(true);
+
+  button_oculus_ = new Gtk::Button("Reset Oculus View");
+  button_oculus_->signal_clicked().connect(sigc::mem_fun(*this, &UXWindow::on_button_oculus_clicked));
+  button_oculus_->set_hexpand(true);
+  button_oculus_->set_vexpand(true);
+
+  button_tracking_ = new Gtk::Button("Restart Tracking");
+  button_tracking_->signal_clicked().connect(sigc::mem_fun(*this, &UXWindow::on_button_tracking_clicked));
+  button_tracking_->set_hexpand(true);
+  button_tracking_->set_vexpand(true);
+
+
+  button_quit_ = new Gtk::Button("Quit");
+  button_quit_->signal_clicked().connect(sigc::mem_fun(*this, &UXWindow::on_button_quit_clicked));
+  button_quit_->set_hexpand(true);
+  button_quit_->set_vexpand(true);
+
+  signal_delete_event().connect(sigc::mem_fun(*this, &UXWindow::on_window_closed));
+
+  button_emphasis_ = new Gtk::CheckButton("Arm-Game Emphasis");
+  button_emphasis_->signal_toggled().connect(sigc::mem_fun(*this, &UXWindow::on_button_emphasis_toggled));
+  button_emphasis_->set_hexpand(true);
+  button_emphasis_->set_vexpand(true);
+  button_emphasis_->set_active( game_settings_.emphasis );
+
+
+  scale_speed_ = new Gtk::HScale();
+  scale_speed_->set_range(0.1,4.0);
+  scale_speed_->signal_value_changed().connect(sigc::mem_fun(*this, &UXWindow::on_scale_speed_changed));
+  scale_speed_->set_value( game_settings_.speed_min );
+
+  scale_speed_label_.set_text("Ball Speed");
+
+
+  scale_width_ = new Gtk::HScale();
+  scale_width_->set_range(0.01,2.0);
+  scale_width_->set_increments(0.01,0.01);
+  scale_width_->signal_value_changed().connect(sigc::mem_fun(*this, &UXWindow::on_scale_width_changed));
+  scale_width_->set_value( game_settings_.width );
+
+  scale_width_label_.set_text("Ball Spawn Width");
+
+  // Combo Box
+
+  combo_arms_.append("Both");
+  combo_arms_.append("Left Arm Track, No Mirror");
+  combo_arms_.append("Right Arm Track, No Mirror");
+  combo_arms_.append("Left Arm Track, Mirrored Right");
+  combo_arms_.append("Right Arm Track, Mirrored Left");
+  //combo_arms_.append("Left Arm, Copied Right");
+  //combo_arms_.append("Right Arm, Copied Left");
+
+  combo_arms_.set_active_text("Both");
+  combo_arms_.signal_changed().connect(sigc::mem_fun(*this, &UXWindow::on_combo_arms_changed));
+
+  // This packs the button into the Window (a container).
+  grid_.attach(*button_fire_,0,0,1,1);
+  grid_.attach(*button_reset_,0,1,1,1);
+  grid_.attach(*button_auto_game_,0,2,1,1);
+  grid_.attach(*button_tracking_,0,3,1,1);
+  grid_.attach(*button_quit_,0,4,1,1);
+
+  grid_.attach(*button_oculus_,1,0,2,1);
+  grid_.attach(combo_arms_,1,1,2,1);
+  grid_.attach(*button_emphasis_,1,2,2,1);
+
+  grid_.attach(*scale_speed_,2,3,1,1);
+  grid_.attach(scale_speed_label_,1,3,1,1);
+
+  grid_.attach(*scale_width_,2,4,1,1);
+  grid_.attach(scale_width_label_,1,4,1,1);
+
+  // Telemetry from the render process, taken off the ring four times a second
+  telemetry_label_.set_halign(Gtk::ALIGN_START);
+  grid_.attach(telemetry_label_,0,5,3,1);
+  Glib::signal_timeout().connect(sigc::mem_fun(*this, &UXWindow::on_telemetry_timeout), 250);
+
+  grid_.set_hexpand();
+  grid_.set_vexpand();
+
+  add(grid_);
+  show_all();
+
+}
+
+UXWindow::~UXWindow() {
+  // Need to signal that we are done here
+  delete button_fire_;
+  delete button_reset_;
+  delete button_auto_game_;
+  delete button_tracking_;
+  delete button_oculus_;
+  delete button_quit_;
+  delete button_emphasis_;
+  delete scale_speed_;
+}
+
+void UXWindow::on_button_fire_clicked() {
+  cout << "Firing Ball" << endl;
+  Post(COMMAND_FIRE_BALL);
+}
+
+void UXWindow::on_button_reset_clicked() {
+  cout << "Reset Physics" << endl;
+  Post(COMMAND_RESET_PHYSICS);
+}
+
+void UXWindow::on_button_tracking_clicked() {
+  cout << "Restarting Tracking" << endl;
+  Post(COMMAND_RESTART_TRACKING);
+}
+
+
+void UXWindow::on_button_auto_game_clicked() {
+  cout << "Auto Game Clicked" << endl;
+  Post(COMMAND_TOGGLE_GAME);
+}
+
+void UXWindow::on_button_oculus_clicked() {
+  cout << "Resetting Oculus View" << endl;
+  Post(COMMAND_RESET_VIEW);
+}
+
+void UXWindow::on_button_quit_clicked() {
+  cout << "Quitting PhantomLimb" << endl;
+  Post(COMMAND_QUIT);
+  quit_();
+}
+
+/// Closing the console leaves the headset session running
+bool UXWindow::on_window_closed(GdkEventAny* event) {
+  quit_();
+  return false;
+}
+
+void UXWindow::on_button_emphasis_toggled() {
+  cout << "Arm Emphasis Toggle" << endl;
+  game_settings_.emphasis = button_emphasis_->get_active();
+  PublishSettings();
+}
+
+void UXWindow::on_scale_speed_changed() {
+  cout << "Speed Changed: " << scale_speed_->get_value() << endl;
+  game_settings_.speed_min = scale_speed_->get_value();
+  PublishSettings();
+}
+
+void UXWindow::on_scale_width_changed() {
+  cout << "Width Changed: " << scale_width_->get_value() << endl;
+  game_settings_.width = scale_width_->get_value();
+  PublishSettings();
+}
+
+bool UXWindow::on_telemetry_timeout() {
+
+  TelemetrySample sample;
+  bool any = false;
+  while (channel_.Receive(sample)) {
+    frame_times_.Add(sample.frame_time * 1000.0);
+    missed_.Add(sample.missed);
+    input_to_swap_.Add(sample.input_to_swap * 1000.0);
+    latest_ = sample;
+    any = true;
+  }
+
+  // Roughly the last ten seconds at headset rates
+  if (frame_times_.total() > 600) {
+    frame_times_.Clear();
+    missed_.Clear();
+    input_to_swap_.Clear();
+  }
+
+  double_t now = NowSeconds();
+  uint64_t heartbeat = channel_.heartbeat();
+  if (heartbeat != last_heartbeat_) {
+    last_heartbeat_ = heartbeat;
+    last_beat_time_ = now;
+  }
+
+  if (!any && now - last_beat_time_ < 1.0)
+    return true;
+
+  std::ostringstream out;
+  out.precision(3);
+  out << (now - last_beat_time_ < 1.0 ? "Render process running" : "Render process not responding")
+    << (latest_.half_rate ? ", half rate" : ", full rate")
+    << ", game " << (latest_.playing ? "on" : "off")
+    << ", balls " << latest_.balls << ", tracking";
+  for (size_t i = 0; i < 32; ++i) {
+    if (latest_.tracked & (1u << i))
+      out << " " << i + 1;
+  }
+  out << ", telemetry dropped " << channel_.dropped() << "\n\n";
+
+  out << "Frame time (p50 " << frame_times_.Percentile(0.5) << "ms, p99 " << frame_times_.Percentile(0.99) << "ms)\n"
+    << frame_times_.Render("ms", 30) << "\n";
+  out << "Missed refreshes per frame\n" << missed_.Render("", 30) << "\n";
+  out << "Input to swap (p50 " << input_to_swap_.Percentile(0.5) << "ms, p99 " << input_to_swap_.Percentile(0.99) << "ms)\n"
+    << input_to_swap_.Render("ms", 30);
+
+  telemetry_label_.set_markup("<tt>" + Glib::Markup::escape_text(out.str()) + "</tt>");
+  return true;
+}
+
+void UXWindow::Post(CommandType type, ArmState arm) {
+  Command command;
+  command.type = type;
+  command.arm = arm;
+  command.settings = game_settings_;
+  if (!channel_.Post(command))
+    cerr << "PhantomLimb: command queue full, dropping operator command" << endl;
+}
+
+void UXWindow::PublishSettings() {
+  Post(COMMAND_SETTINGS);
+}
+
+void UXWindow::on_combo_arms_changed() {
+  Glib::ustring selected = combo_arms_.get_active_text();
+  if (selected.compare( Glib::ustring("Both")) == 0){
+    Post(COMMAND_SET_HANDED, BOTH_ARMS);
+  } else if (selected.compare( Glib::ustring("Left Arm Track, No Mirror")) == 0){
+    Post(COMMAND_SET_HANDED, LEFT_ARM_RIGHT_FROZEN);
+  } else if (selected.compare( Glib::ustring("Right Arm Track, No Mirror")) == 0) {
+    Post(COMMAND_SET_HANDED, RIGHT_ARM_LEFT_FROZEN);
+  }  else if (selected.compare( Glib::ustring("Left Arm Track, Mirrored Right")) == 0) {
+    Post(COMMAND_SET_HANDED, LEFT_ARM_RIGHT_MIRROR);
+  } else if (selected.compare( Glib::ustring("Right Arm Track, Mirrored Left")) == 0) {
+    Post(COMMAND_SET_HANDED, RIGHT_ARM_LEFT_MIRROR);
+  }/* else if (selected.compare( Glib::ustring("Left Arm, Copied Right")) == 0) {
+    Post(COMMAND_SET_HANDED, LEFT_ARM_COPY);
+  } else if (selected.compare( Glib::ustring("Right Arm, Copied Left")) == 0) {
+    Post(COMMAND_SET_HANDED, RIGHT_ARM_COPY);
+  }*/
+}
+
+#endif